@@ -0,0 +1,693 @@
+#include "Alloc.hpp"
+#include "Budget.hpp"
+#include "Corpus.hpp"
+#include "Dispatch.hpp"
+#include "Evaluator.hpp"
+#include "Lexer.hpp"
+#include "MPoly.hpp"
+#include "Math.hpp"
+#include "Parser.hpp"
+#include "Pipeline.hpp"
+#include "Scheduler.hpp"
+#include "Utils.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#	define DCS213_P1_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#	include <intrin.h>
+#	define DCS213_P1_TSC
+#endif
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+DCS213_P1_ALLOC_COUNTING();
+
+namespace dcs213::p1::bench {
+	inline static constexpr auto usage = R"(usage: dcs213.project1.bench [options]
+
+Runs micro-benchmarks of the lexer, parser, polynomial arithmetic, evaluator and built-in
+functions, plus end-to-end runs, and prints the results as JSON to stdout. Progress goes to
+stderr. Builds with DCS213_P1_COUNT_ALLOCS also report the allocations of one iteration, per
+stage.
+
+options:
+      --filter <text>      only run benchmarks whose name contains text
+      --min-time <ms>      time spent measuring each benchmark (default: 200)
+      --repetitions <n>    measured batches per benchmark, the median is reported (default: 5)
+      --out <file>         write the JSON to a file instead of stdout
+      --list               list the benchmarks and exit
+  -h, --help               show this message
+)";
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		std::string				  filter;
+		std::chrono::milliseconds min_time	  = std::chrono::milliseconds { 200 };
+		std::size_t				  repetitions = 5;
+		std::string				  out;
+		bool					  list = false;
+	};
+
+	/**
+	 * @brief Reference cycles (the time stamp counter), where there is one.
+	 *
+	 */
+	inline static auto cycles() -> std::uint64_t {
+#ifdef DCS213_P1_TSC
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * @brief Results are folded into this, so that the work producing them is not optimized away.
+	 *
+	 */
+	inline static volatile std::size_t sink = 0;
+
+	/**
+	 * @brief One benchmark: a single iteration of `run`, on an input of the given parameters.
+	 *
+	 */
+	using Params = std::vector<std::pair<std::string_view, double>>;
+
+	struct Case {
+		std::string			  name;
+		std::string			  stage;  // lex, parse, termlist, mpoly, eval, e2e or math
+		Params				  params;
+		std::size_t			  bytes = 0;  // input bytes per iteration
+		std::size_t			  items = 0;  // tokens, nodes, terms or points per iteration
+		std::string_view	  unit;		  // of `items`
+		std::function<void()> run;
+	};
+
+	struct Result {
+		const Case*			  bench;
+		std::size_t			  iterations;  // per batch
+		std::size_t			  repetitions;
+		double				  ns_median;   // per iteration
+		double				  ns_min;
+		std::optional<double> cycles_median;
+		alloc::Snapshot		  allocs;  // of one iteration, if `alloc::enabled`
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("name", bench->name)
+				.field("stage", bench->stage)
+				.key("params")
+				.begin_object();
+			for (const auto& [key, value] : bench->params) writer.field(key, value);
+			writer.end_object()
+				.field("iterations", iterations)
+				.field("repetitions", repetitions)
+				.field("ns_per_iter", ns_median)
+				.field("ns_per_iter_min", ns_min)
+				.field("cycles_per_iter", cycles_median);
+
+			if (bench->bytes > 0) {
+				writer.field("bytes", bench->bytes).field("ns_per_byte", ns_median / bench->bytes);
+				if (cycles_median)
+					writer.field("cycles_per_byte", *cycles_median / bench->bytes);
+			}
+			if (bench->items > 0)
+				writer.field("items", bench->items)
+					.field("unit", bench->unit)
+					.field(std::format("ns_per_{}", bench->unit), ns_median / bench->items);
+
+			if (alloc::enabled) {
+				writer.key("allocs")
+					.begin_object()
+					.field("count", allocs.total.count)
+					.field("bytes", allocs.total.bytes)
+					.field("peak", allocs.total.peak)
+					.key("tags")
+					.begin_object();
+				for (std::size_t t = 0; t < alloc::tag_count; ++t)
+					if (const auto& tag = allocs.tags[t]; tag.count > 0)
+						writer.key(alloc::to_string(static_cast<alloc::Tag>(t)))
+							.begin_object()
+							.field("count", tag.count)
+							.field("bytes", tag.bytes)
+							.end_object();
+				writer.end_object().end_object();
+			}
+
+			writer.end_object();
+		}
+	};
+
+	/**
+	 * @brief Time a benchmark.
+	 *
+	 * The batch size is doubled until a batch takes its share of `min_time`, which also warms
+	 * up caches and the allocator. Then `repetitions` batches are timed, and the allocations of
+	 * one more iteration are counted.
+	 *
+	 * @param bench
+	 * @param options
+	 * @return Result
+	 */
+	inline static auto measure(const Case& bench, const Options& options) -> Result {
+		const auto target = options.min_time / std::max<std::size_t>(options.repetitions, 1);
+
+		const auto batch = [&](std::size_t n) {
+			const auto c0 = cycles();
+			const auto t0 = Clock::now();
+			for (std::size_t i = 0; i < n; ++i) bench.run();
+			const auto t1 = Clock::now();
+			const auto c1 = cycles();
+			return std::pair { t1 - t0, c1 - c0 };
+		};
+
+		std::size_t n = 1;
+		while (batch(n).first < target && n < (std::size_t { 1 } << 40)) n *= 2;
+
+		std::vector<double> ns, cs;
+		for (std::size_t r = 0; r < options.repetitions; ++r) {
+			const auto [elapsed, c] = batch(n);
+			ns.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / n);
+			cs.push_back(static_cast<double>(c) / n);
+		}
+		std::ranges::sort(ns);
+		std::ranges::sort(cs);
+
+		// The peak is relative to what was live before, i.e. the working set of an iteration.
+		auto& registry = alloc::Registry::global();
+		registry.reset_peak();
+		const auto before = registry.snapshot();
+		bench.run();
+		auto allocs = registry.snapshot() - before;
+		for (std::size_t t = 0; t < alloc::tag_count; ++t)
+			allocs.tags[t].peak -= before.tags[t].live;
+		allocs.total.peak -= before.total.live;
+
+		return {
+			.bench		   = &bench,
+			.iterations	   = n,
+			.repetitions   = ns.size(),
+			.ns_median	   = ns[ns.size() / 2],
+			.ns_min		   = ns.front(),
+			.cycles_median = cycles() != 0 ? std::optional { cs[cs.size() / 2] } : std::nullopt,
+			.allocs		   = allocs,
+		};
+	}
+
+	/**
+	 * @brief Input shapes, all deterministic. `corpus::presets` add random ones.
+	 *
+	 */
+	namespace inputs {
+		/**
+		 * @brief A long flat sum, of `size` operands. `density` of them are plain numbers, the
+		 * others `c*x^k`.
+		 *
+		 */
+		inline static auto flat_sum(std::size_t size, double density) -> std::string {
+			std::mt19937_64						   rng { size };
+			std::uniform_real_distribution<double> coin { 0., 1. };
+			std::uniform_int_distribution<int>	   num { 1, 999 };
+			std::uniform_int_distribution<int>	   expo { 0, 9 };
+
+			std::string script;
+			for (std::size_t i = 0; i < size; ++i) {
+				if (i > 0)
+					script += coin(rng) < .5 ? '+' : '-';
+				if (coin(rng) < density)
+					std::format_to(std::back_inserter(script), "{}.{}", num(rng), num(rng));
+				else
+					std::format_to(std::back_inserter(script), "{}*x^{}", num(rng), expo(rng));
+			}
+			return script;	// nrvo
+		}
+
+		/**
+		 * @brief `depth` nested parentheses, `...x+3-(x+2-(x+1-(x)))`.
+		 *
+		 * Only sums, so that every level stays on the `TermList` path and the result stays
+		 * small: a product of a group inside a sum would go to the multivariate fallback.
+		 */
+		inline static auto nested(std::size_t depth) -> std::string {
+			std::string script = "x";
+			for (std::size_t i = 1; i <= depth; ++i) script = std::format("x+{}-({})", i, script);
+			return script;	// nrvo
+		}
+
+		/**
+		 * @brief A product of `degree` linear factors, which expands to a polynomial of that
+		 * degree. Its coefficients are finite up to degree 169.
+		 *
+		 */
+		inline static auto product(std::size_t degree) -> std::string {
+			std::string script;
+			for (std::size_t i = 1; i <= degree; ++i)
+				std::format_to(std::back_inserter(script), "{}(x+{})", i > 1 ? "*" : "", i);
+			return script;	// nrvo
+		}
+
+		/**
+		 * @brief A polynomial of the given degree, with every exponent present.
+		 *
+		 */
+		inline static auto polynomial(std::size_t degree, double offset) -> evaluate::TermList {
+			evaluate::TermList terms;
+			for (std::size_t e = 0; e <= degree; ++e)
+				terms.push_back({
+					.coef = offset + static_cast<double>(e),
+					.expo = static_cast<double>(e),
+				});
+			return terms;  // nrvo
+		}
+
+		/**
+		 * @brief The same as `polynomial`, as a multivariate polynomial in `vars` variables.
+		 *
+		 * With one variable it has the same terms; with more, the exponents of the first two
+		 * walk a square grid, so products go through the sparse path.
+		 */
+		inline static auto mpoly(std::size_t degree, double offset, std::size_t vars)
+			-> evaluate::MPoly {
+			static constexpr std::array<char, 2> names { 'x', 'y' };
+
+			const auto ring = *evaluate::Ring::of(std::span { names }.first(vars));
+			const auto side = static_cast<std::size_t>(std::ceil(std::sqrt(degree + 1.)));
+
+			std::vector<evaluate::MPoly::Term> terms;
+			for (std::size_t e = 0; e <= degree; ++e)
+				terms.push_back({
+					.coef = offset + static_cast<double>(e),
+					.key  = vars == 1 ? ring.key(0, e)
+									  : ring.key(0, e % side) + ring.key(1, e / side),
+				});
+			return { ring, std::move(terms) };
+		}
+
+		/**
+		 * @brief `n` points spread over `[-range, range]`, in a shuffled order.
+		 *
+		 */
+		inline static auto points(std::size_t n, double range) -> std::vector<double> {
+			std::mt19937_64						   rng { n };
+			std::uniform_real_distribution<double> dist { -range, range };
+
+			std::vector<double> xs(n);
+			for (auto& x : xs) x = dist(rng);
+			return xs;	// nrvo
+		}
+	}  // namespace inputs
+
+	inline static auto count_nodes(const parse::Expr& expr) -> std::size_t {
+		return 1 + std::visit(
+			[](const auto& node) -> std::size_t {
+				using T = std::decay_t<decltype(node)>;
+				if constexpr (std::same_as<T, parse::BinOpExpr>)
+					return count_nodes(*node.lhs) + count_nodes(*node.rhs);
+				else if constexpr (std::same_as<T, parse::UnaryOpExpr>)
+					return count_nodes(*node.operand);
+				else if constexpr (std::same_as<T, parse::CallExpr>)
+					return count_nodes(*node.arg);
+				else if constexpr (
+					std::same_as<T, parse::SumExpr> || std::same_as<T, parse::ProductExpr>
+				) {
+					std::size_t n = 0;
+					for (const auto& operand : node.operands) n += count_nodes(*operand.expr);
+					return n;
+				} else
+					return 0;
+			},
+			static_cast<const parse::Expr::variant&>(expr)
+		);
+	}
+
+	/**
+	 * @brief Every benchmark, owning its inputs.
+	 *
+	 */
+	class Suite {
+	public:
+		Suite() {
+			struct Input {
+				std::string shape;
+				Params		params;
+				std::string script;
+			};
+
+			std::vector<Input> scripts;
+			for (const std::size_t size : { 10, 100, 1'000, 10'000 })
+				for (const double density : { .2, .8 })
+					scripts.push_back({
+						.shape	= "flat_sum",
+						.params = { { "size", size }, { "density", density } },
+						.script = inputs::flat_sum(size, density),
+					});
+			for (const std::size_t depth : { 10, 100, 500 })
+				scripts.push_back({
+					.shape	= "nested",
+					.params = { { "depth", depth } },
+					.script = inputs::nested(depth),
+				});
+			for (const std::size_t degree : { 4, 16, 64, 128 })
+				scripts.push_back({
+					.shape	= "product",
+					.params = { { "degree", degree } },
+					.script = inputs::product(degree),
+				});
+			for (const auto preset : corpus::presets)
+				for (const std::size_t size : { 16, 256, 2'048 })
+					scripts.push_back({
+						.shape	= std::format("corpus.{}", preset),
+						.params = { { "size", size } },
+						.script = corpus::Generator { *corpus::preset(preset, size) }.next(),
+					});
+
+			for (auto& input : scripts) {
+				const auto suffix = _suffix(input.params);
+
+				// Timing a failure would measure how fast an error comes back.
+				if (const auto outcome = pipeline::run(input.script); !outcome.success) {
+					const auto message =
+						std::format("skipping {}{}: {}\n", input.shape, suffix, outcome.text);
+					std::fputs(message.c_str(), stderr);
+					continue;
+				}
+
+				const auto& script = _keep(std::move(input.script));
+				const auto& tokens = _keep(*lex::lex(script));
+				const auto& ast	   = _keep(*parse::parse(tokens));
+
+				_add({
+					.name	= std::format("lex/{}{}", input.shape, suffix),
+					.stage	= "lex",
+					.params = input.params,
+					.bytes	= script.size(),
+					.items	= tokens.size(),
+					.unit	= "token",
+					.run	= [&script] { sink = sink + lex::lex(script)->size(); },
+				});
+				_add({
+					.name	= std::format("parse/{}{}", input.shape, suffix),
+					.stage	= "parse",
+					.params = input.params,
+					.items	= tokens.size(),
+					.unit	= "token",
+					.run	= [&tokens] { sink = sink + parse::parse(tokens).has_value(); },
+				});
+				_add({
+					.name	= std::format("eval/{}{}", input.shape, suffix),
+					.stage	= "eval",
+					.params = input.params,
+					.items	= count_nodes(ast),
+					.unit	= "node",
+					.run	= [&ast] { sink = sink + evaluate::eval(ast).has_value(); },
+				});
+				_add({
+					.name	= std::format("e2e/{}{}", input.shape, suffix),
+					.stage	= "e2e",
+					.params = input.params,
+					.bytes	= script.size(),
+					.unit	= {},
+					.run	= [&script] { sink = sink + pipeline::run(script).text.size(); },
+				});
+			}
+
+			for (const std::size_t degree : { 16, 256, 4096 }) {
+				const auto& lhs	   = _keep(inputs::polynomial(degree, 1.));
+				const auto& rhs	   = _keep(inputs::polynomial(degree, 2.));
+				const auto	params = Params { { "degree", degree } };
+				const auto	suffix = _suffix(params);
+
+				_add({
+					.name	= std::format("termlist/add{}", suffix),
+					.stage	= "termlist",
+					.params = params,
+					.items	= lhs.size() + rhs.size(),
+					.unit	= "term",
+					.run	= [&lhs, &rhs] { sink = sink + (lhs + rhs).size(); },
+				});
+				_add({
+					.name	= std::format("termlist/mul{}", suffix),
+					.stage	= "termlist",
+					.params = params,
+					.items	= lhs.size() * rhs.size(),
+					.unit	= "term",
+					.run	= [&lhs, &rhs] { sink = sink + (lhs * rhs).size(); },
+				});
+				_add({
+					.name	= std::format("termlist/eval{}", suffix),
+					.stage	= "termlist",
+					.params = params,
+					.items	= lhs.size(),
+					.unit	= "term",
+					.run	= [&lhs] { sink = sink + (lhs.eval(.5) != 0.); },
+				});
+			}
+
+			for (const std::size_t vars : { 1, 2 })
+				for (const std::size_t degree : { 16, 256, 4096 }) {
+					const auto& lhs	   = _keep(inputs::mpoly(degree, 1., vars));
+					const auto& rhs	   = _keep(inputs::mpoly(degree, 2., vars));
+					const auto	params = Params { { "degree", degree }, { "vars", vars } };
+					const auto	suffix = _suffix(params);
+
+					_add({
+						.name	= std::format("mpoly/add{}", suffix),
+						.stage	= "mpoly",
+						.params = params,
+						.items	= lhs.size() + rhs.size(),
+						.unit	= "term",
+						.run	= [&lhs, &rhs] { sink = sink + (lhs + rhs).size(); },
+					});
+					_add({
+						.name	= std::format("mpoly/mul{}", suffix),
+						.stage	= "mpoly",
+						.params = params,
+						.items	= lhs.size() * rhs.size(),
+						.unit	= "term",
+						.run	= [&lhs, &rhs] {
+							   sink = sink + evaluate::MPoly::product(lhs, rhs)->size();
+						},
+					});
+					_add({
+						.name	= std::format("mpoly/eval{}", suffix),
+						.stage	= "mpoly",
+						.params = params,
+						.items	= lhs.size(),
+						.unit	= "term",
+						.run	= [&lhs] { sink = sink + lhs.substitute(0, .5).size(); },
+					});
+				}
+
+			const auto& points = _keep(inputs::points(4'096, 100.));
+			for (std::size_t f = 0; f < math::function_count; ++f) {
+				const auto fn = static_cast<math::Function>(f);
+				_add({
+					.name	= std::format("math/{}", math::to_string(fn)),
+					.stage	= "math",
+					.params = {},
+					.items	= points.size(),
+					.unit	= "point",
+					.run	= [&points, fn, ys = std::vector<double>(points.size())]() mutable {
+						math::eval(fn, points, ys);
+						sink = sink + (ys.back() != 0.);
+					},
+				});
+			}
+		}
+
+	public:
+		[[nodiscard]] auto cases() const -> const std::vector<Case>& { return _cases; }
+
+	private:
+		/**
+		 * @brief Keep an input alive, at a stable address, for as long as the suite.
+		 *
+		 */
+		template<typename T>
+		auto _keep(T value) -> const T& {
+			auto holder = std::make_shared<T>(std::move(value));
+			_inputs.push_back(holder);
+			return *holder;
+		}
+
+		auto _add(Case bench) -> void { _cases.push_back(std::move(bench)); }
+
+		inline static auto _suffix(const Params& params) -> std::string {
+			std::string suffix;
+			for (const auto& [key, value] : params)
+				std::format_to(std::back_inserter(suffix), "/{}={}", key, value);
+			return suffix;	// nrvo
+		}
+
+	private:
+		std::vector<std::shared_ptr<const void>> _inputs;
+		std::vector<Case>						 _cases;
+	};
+
+	template<typename T>
+	inline static auto parse_number(std::string_view str) -> std::optional<T> {
+		T	 value;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		if (ec != std::errc {} || end != str.data() + str.size())
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief Parse the command line.
+	 *
+	 * @return the options, or the exit code if the program should stop right away
+	 */
+	inline static auto parse_options(int argc, char** argv) -> std::variant<Options, int> {
+		Options options;
+
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg	= argv[i];
+			const auto			   next = [&]() -> std::optional<std::string_view> {
+				  if (i + 1 >= argc)
+					  return std::nullopt;
+				  return argv[++i];
+			};
+			const auto next_number = [&]<typename T>() -> std::optional<T> {
+				if (const auto value = next())
+					return parse_number<T>(*value);
+				return std::nullopt;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				std::fputs(usage, stdout);
+				return 0;
+			} else if (arg == "--list")
+				options.list = true;
+			else if (arg == "--filter") {
+				if (const auto text = next())
+					options.filter = *text;
+				else {
+					std::fputs("error: --filter expects a text\n", stderr);
+					return 2;
+				}
+			} else if (arg == "--out") {
+				if (const auto path = next())
+					options.out = *path;
+				else {
+					std::fputs("error: --out expects a path\n", stderr);
+					return 2;
+				}
+			} else if (arg == "--min-time") {
+				if (const auto ms = next_number.operator()<std::int64_t>(); ms && *ms > 0)
+					options.min_time = std::chrono::milliseconds { *ms };
+				else {
+					std::fputs("error: --min-time expects a positive number of ms\n", stderr);
+					return 2;
+				}
+			} else if (arg == "--repetitions") {
+				if (const auto n = next_number.operator()<std::size_t>(); n && *n > 0)
+					options.repetitions = *n;
+				else {
+					std::fputs("error: --repetitions expects a positive number\n", stderr);
+					return 2;
+				}
+			} else {
+				std::fputs(std::format("error: unknown option `{}`\n\n{}", arg, usage).c_str(), stderr);
+				return 2;
+			}
+		}
+
+		return options;
+	}
+
+	inline static auto run(const Options& options) -> int {
+		const Suite suite;
+
+		std::vector<const Case*> selected;
+		for (const auto& bench : suite.cases())
+			if (bench.name.find(options.filter) != std::string::npos)
+				selected.push_back(&bench);
+
+		if (options.list) {
+			for (const auto bench : selected) std::puts(bench->name.c_str());
+			return 0;
+		}
+
+		std::vector<Result> results;
+		for (const auto bench : selected) {
+			results.push_back(measure(*bench, options));
+			const auto& res = results.back();
+
+			auto line = std::format("{:<48} {:>14.1f} ns", bench->name, res.ns_median);
+			if (res.cycles_median && bench->bytes)
+				line += std::format("  {:>8.2f} cycles/B", *res.cycles_median / bench->bytes);
+			else if (bench->items)
+				line += std::format("  {:>8.2f} ns/{}", res.ns_median / bench->items, bench->unit);
+			if (alloc::enabled)
+				line += std::format(
+					"  {:>8} allocs {:>10} B",
+					res.allocs.total.count,
+					res.allocs.total.bytes
+				);
+			line += '\n';
+			std::fputs(line.c_str(), stderr);
+		}
+
+		json::Writer writer;
+		writer.begin_object()
+			.key("context")
+			.begin_object()
+			.field("threads", sched::ThreadPool::default_concurrency())
+			.field("tsc", cycles() != 0)
+#ifdef NDEBUG
+			.field("build", "release")
+#else
+			.field("build", "debug")
+#endif
+			.field("min_time_ms", options.min_time.count())
+			.field("count_allocs", alloc::enabled)
+			.field("cpu", dispatch::to_string(dispatch::detect()))
+			.key("kernels")
+			.begin_object();
+		for (std::size_t k = 0; k < dispatch::kernel_count; ++k) {
+			const auto kernel = static_cast<dispatch::Kernel>(k);
+			writer.field(
+				dispatch::to_string(kernel),
+				dispatch::to_string(dispatch::kernels().level(kernel))
+			);
+		}
+		writer.end_object().end_object().field("benchmarks", results).end_object();
+
+		auto* out = options.out.empty() ? stdout : std::fopen(options.out.c_str(), "wb");
+		if (!out) {
+			std::fputs(std::format("error: cannot write `{}`\n", options.out).c_str(), stderr);
+			return 1;
+		}
+		std::fputs(writer.str().c_str(), out);
+		std::fputc('\n', out);
+		if (out != stdout)
+			std::fclose(out);
+		return 0;
+	}
+}  // namespace dcs213::p1::bench
+
+int main(int argc, char** argv) {
+	using namespace dcs213::p1;
+
+	const auto options = bench::parse_options(argc, argv);
+	if (const auto code = std::get_if<int>(&options))
+		return *code;
+
+	return bench::run(std::get<bench::Options>(options));
+}
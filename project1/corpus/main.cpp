@@ -0,0 +1,305 @@
+#include "Corpus.hpp"
+#include "Pipeline.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+namespace dcs213::p1::corpus {
+	inline static constexpr auto usage = R"(usage: dcs213.project1.corpus [options]
+
+Writes random expressions, one per line, e.g. as input for dcs213.project1.headless. The same
+options and seed always give the same corpus.
+
+options:
+  -p, --preset <name>    mixed, flat, deep, product or numeric (default: mixed)
+  -n, --count <n>        expressions to write (default: 1000)
+  -b, --bytes <n>[k|m|g] write expressions until the corpus has at least this size instead
+      --seed <n>         seed of the generator (default: 0)
+      --size <n>         operands per expression (default: 64)
+      --depth <n>        maximum nesting of parentheses
+      --width <n>        maximum operands joined at one level
+      --numbers <p>      share of operands that are numbers or constants rather than x
+      --spaces <p>       chance of spaces around a joining operator
+      --mix <op=w,...>   weights of operators, by the fields of `corpus::Mix`, e.g. ln=0,when=2
+      --check            evaluate every expression, at most a second each, and report on
+                         stderr how many succeed
+  -o, --out <file>       write to a file instead of stdout
+  -h, --help             show this message
+)";
+
+	struct Options {
+		Config		  config = *preset("mixed", 64);
+		std::size_t	  count	 = 1000;
+		std::uint64_t bytes	 = 0;  // instead of `count` if not zero
+		bool		  check	 = false;
+		std::string	  out;
+	};
+
+	template<typename T>
+	inline static auto parse_number(std::string_view str) -> std::optional<T> {
+		T	 value;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		if (ec != std::errc {} || end != str.data() + str.size())
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief A size in bytes, with an optional binary `k`, `m` or `g` suffix.
+	 *
+	 */
+	inline static auto parse_bytes(std::string_view str) -> std::optional<std::uint64_t> {
+		std::uint64_t scale = 1;
+		if (!str.empty())
+			switch (str.back()) {
+				case 'k': case 'K': scale = 1ull << 10; break;
+				case 'm': case 'M': scale = 1ull << 20; break;
+				case 'g': case 'G': scale = 1ull << 30; break;
+				default: break;
+			}
+		if (scale != 1)
+			str.remove_suffix(1);
+
+		if (const auto n = parse_number<std::uint64_t>(str); n && *n <= UINT64_MAX / scale)
+			return *n * scale;
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief Apply `op=weight,...` to `mix`.
+	 *
+	 * @return whether every entry names a field and has a non-negative weight
+	 */
+	inline static auto parse_mix(std::string_view str, Mix& mix) -> bool {
+		const std::pair<std::string_view, double Mix::*> fields[] {
+			{ "plus", &Mix::plus },
+			{ "minus", &Mix::minus },
+			{ "multiply", &Mix::multiply },
+			{ "devide", &Mix::devide },
+			{ "plain", &Mix::plain },
+			{ "negate", &Mix::negate },
+			{ "exponent", &Mix::exponent },
+			{ "ln", &Mix::ln },
+			{ "derivative", &Mix::derivative },
+			{ "when", &Mix::when },
+		};
+
+		while (!str.empty()) {
+			const auto comma = str.find(',');
+			const auto entry = str.substr(0, comma);
+			str				 = comma == std::string_view::npos ? "" : str.substr(comma + 1);
+
+			const auto eq = entry.find('=');
+			if (eq == std::string_view::npos)
+				return false;
+
+			const auto weight = parse_number<double>(entry.substr(eq + 1));
+			if (!weight || *weight < 0.)
+				return false;
+
+			bool known = false;
+			for (const auto& [name, field] : fields)
+				if (name == entry.substr(0, eq)) {
+					mix.*field = *weight;
+					known	   = true;
+				}
+			if (!known)
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Parse the command line.
+	 *
+	 * The preset is applied first, whatever its position, so that the other options refine it.
+	 *
+	 * @return the options, or the exit code if the program should stop right away
+	 */
+	inline static auto parse_options(int argc, char** argv) -> std::variant<Options, int> {
+		Options options;
+
+		for (int i = 1; i + 1 < argc; ++i) {
+			const std::string_view arg = argv[i];
+			if (arg != "-p" && arg != "--preset")
+				continue;
+
+			if (const auto config = preset(argv[i + 1], options.config.size))
+				options.config = *config;
+			else {
+				const auto message = std::format("error: unknown preset `{}`\n", argv[i + 1]);
+				std::fputs(message.c_str(), stderr);
+				return 2;
+			}
+		}
+
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg	= argv[i];
+			const auto			   next = [&]() -> std::optional<std::string_view> {
+				  if (i + 1 >= argc)
+					  return std::nullopt;
+				  return argv[++i];
+			};
+			const auto next_number = [&]<typename T>() -> std::optional<T> {
+				if (const auto value = next())
+					return parse_number<T>(*value);
+				return std::nullopt;
+			};
+			const auto fail = [](std::string_view message) {
+				std::fputs(std::format("error: {}\n", message).c_str(), stderr);
+				return 2;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				std::fputs(usage, stdout);
+				return 0;
+			} else if (arg == "-p" || arg == "--preset")
+				++i;  // applied above
+			else if (arg == "-n" || arg == "--count") {
+				if (const auto n = next_number.operator()<std::size_t>())
+					options.count = *n;
+				else
+					return fail("--count expects a number");
+			} else if (arg == "-b" || arg == "--bytes") {
+				const auto size = next();
+				if (const auto n = size ? parse_bytes(*size) : std::nullopt; n && *n > 0)
+					options.bytes = *n;
+				else
+					return fail("--bytes expects a positive size, e.g. 512m");
+			} else if (arg == "--seed") {
+				if (const auto n = next_number.operator()<std::uint64_t>())
+					options.config.seed = *n;
+				else
+					return fail("--seed expects a number");
+			} else if (arg == "--size") {
+				if (const auto n = next_number.operator()<std::size_t>(); n && *n > 0) {
+					// Presets that scale with the size keep doing so.
+					if (options.config.depth == options.config.size)
+						options.config.depth = *n;
+					options.config.size = *n;
+				} else
+					return fail("--size expects a positive number");
+			} else if (arg == "--depth") {
+				if (const auto n = next_number.operator()<std::size_t>())
+					options.config.depth = *n;
+				else
+					return fail("--depth expects a number");
+			} else if (arg == "--width") {
+				if (const auto n = next_number.operator()<std::size_t>(); n && *n >= 2)
+					options.config.width = *n;
+				else
+					return fail("--width expects a number of at least 2");
+			} else if (arg == "--numbers") {
+				if (const auto p = next_number.operator()<double>(); p && *p >= 0. && *p <= 1.)
+					options.config.numbers = *p;
+				else
+					return fail("--numbers expects a number in [0, 1]");
+			} else if (arg == "--spaces") {
+				if (const auto p = next_number.operator()<double>(); p && *p >= 0. && *p <= 1.)
+					options.config.spaces = *p;
+				else
+					return fail("--spaces expects a number in [0, 1]");
+			} else if (arg == "--mix") {
+				if (const auto mix = next(); !mix || !parse_mix(*mix, options.config.mix))
+					return fail("--mix expects op=weight,... with the fields of corpus::Mix");
+			} else if (arg == "--check")
+				options.check = true;
+			else if (arg == "-o" || arg == "--out") {
+				if (const auto path = next())
+					options.out = *path;
+				else
+					return fail("--out expects a path");
+			} else {
+				std::fputs(std::format("error: unknown option `{}`\n\n{}", arg, usage).c_str(), stderr);
+				return 2;
+			}
+		}
+
+		return options;
+	}
+
+	/**
+	 * @brief Whether `script` evaluates, within a second.
+	 *
+	 */
+	inline static auto evaluates(std::string_view script) -> bool {
+		const auto ts = lex::lex(script);
+		if (!ts)
+			return false;
+		Budget budget { { .timeout = std::chrono::seconds { 1 } } };
+		return pipeline::run(*ts, budget).success;
+	}
+
+	inline static auto run(const Options& options) -> int {
+		constexpr std::size_t flush_at = 1 << 20;
+
+		auto* out = options.out.empty() ? stdout : std::fopen(options.out.c_str(), "wb");
+		if (!out) {
+			std::fputs(std::format("error: cannot write `{}`\n", options.out).c_str(), stderr);
+			return 1;
+		}
+
+		Generator	  generator { options.config };
+		std::string	  buffer;
+		std::uint64_t written	= 0;
+		std::size_t	  evaluated = 0;
+		bool		  failed	= false;
+
+		const auto flush = [&] {
+			failed = failed || std::fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size();
+			buffer.clear();
+		};
+
+		buffer.reserve(flush_at + (flush_at >> 2));
+		std::size_t n = 0;
+		for (; options.bytes ? written < options.bytes : n < options.count; ++n) {
+			const auto before = buffer.size();
+			generator.next(buffer);
+			if (options.check)
+				evaluated += evaluates(std::string_view { buffer }.substr(before));
+			buffer += '\n';
+			written += buffer.size() - before;
+
+			if (buffer.size() >= flush_at) {
+				flush();
+				if (failed)
+					break;
+			}
+		}
+		flush();
+
+		failed = std::fflush(out) != 0 || failed;
+		if (out != stdout)
+			failed = std::fclose(out) != 0 || failed;
+		if (failed) {
+			std::fputs("error: failed to write the corpus\n", stderr);
+			return 1;
+		}
+
+		if (options.check) {
+			const auto share   = n == 0 ? 100. : 100. * static_cast<double>(evaluated) / n;
+			const auto message =
+				std::format("{} of {} expressions evaluate ({:.1f}%)\n", evaluated, n, share);
+			std::fputs(message.c_str(), stderr);
+		}
+		return 0;
+	}
+}  // namespace dcs213::p1::corpus
+
+int main(int argc, char** argv) {
+	using namespace dcs213::p1;
+
+	const auto options = corpus::parse_options(argc, argv);
+	if (const auto code = std::get_if<int>(&options))
+		return *code;
+
+	return corpus::run(std::get<corpus::Options>(options));
+}
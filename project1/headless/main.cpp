@@ -0,0 +1,477 @@
+#include "Alloc.hpp"
+#include "Budget.hpp"
+#include "History.hpp"
+#include "Lexer.hpp"
+#include "Pipeline.hpp"
+#include "Scheduler.hpp"
+#include "Trace.hpp"
+
+#if defined DCS213_P1_PLAT_WINDOWS
+#	include <fstream>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+DCS213_P1_ALLOC_COUNTING();
+
+namespace dcs213::p1::headless {
+	inline static constexpr auto usage = R"(usage: dcs213.project1.headless [options] [files...]
+
+Evaluates one expression per line of the files (or of stdin), and prints one result per line.
+With --replay, the files are history logs instead, and every logged expression is evaluated.
+
+options:
+  -j, --jobs <n>      evaluate on n threads, 1 evaluates inline (default: all cores)
+  -u, --unordered     print results as soon as they are ready, prefixed with their line number
+  -s, --stats         report throughput statistics to stderr, and allocations per stage in
+                      builds with DCS213_P1_COUNT_ALLOCS
+  -r, --replay        read expressions from history logs
+      --steps <n>     step limit per expression
+      --timeout <ms>  time limit per expression
+      --trace <file>  write a Chrome trace of the stages, in builds with DCS213_P1_TRACE
+  -h, --help          show this message
+)";
+
+	/**
+	 * @brief Lines evaluated per task.
+	 *
+	 */
+	inline static constexpr std::size_t chunk_lines = 256;
+
+	struct Options {
+		std::size_t				 jobs	 = sched::ThreadPool::default_concurrency() + 1;
+		bool					 ordered = true;
+		bool					 stats	 = false;
+		bool					 replay	 = false;
+		Budget::Limits			 limits	 = {};
+		std::string				 trace;	 // Chrome trace to write, if any
+		std::vector<std::string> files;
+	};
+
+	/**
+	 * @brief The whole content of an input, mapped into memory where possible.
+	 *
+	 */
+	class Input {
+	public:
+		Input(const Input&)			   = delete;
+		Input& operator=(const Input&) = delete;
+
+		Input(Input&& other) noexcept :
+			_text(std::exchange(other._text, {})),
+			_buffer(std::move(other._buffer)),
+			_mapped(std::exchange(other._mapped, false)) {
+			if (!_mapped)
+				_text = _buffer;
+		}
+
+		~Input() {
+#if !defined DCS213_P1_PLAT_WINDOWS
+			if (_mapped)
+				::munmap(const_cast<char*>(_text.data()), _text.size());
+#endif
+		}
+
+	public:
+		inline static auto from_stdin() -> Input {
+			Input		input;
+			char		buf[1 << 16];
+			std::size_t n;
+			while ((n = std::fread(buf, 1, sizeof(buf), stdin)) > 0) input._buffer.append(buf, n);
+			input._text = input._buffer;
+			return input;
+		}
+
+		inline static auto from_file(const std::string& path) -> std::optional<Input> {
+			Input input;
+#if defined DCS213_P1_PLAT_WINDOWS
+			std::ifstream file { path, std::ios::binary };
+			if (!file)
+				return std::nullopt;
+			input._buffer.assign(std::istreambuf_iterator<char> { file }, {});
+			input._text = input._buffer;
+#else
+			const auto fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return std::nullopt;
+
+			struct stat st;
+			if (::fstat(fd, &st) != 0) {
+				::close(fd);
+				return std::nullopt;
+			}
+
+			if (st.st_size > 0) {
+				const auto size = static_cast<std::size_t>(st.st_size);
+				void*	   addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (addr == MAP_FAILED) {
+					::close(fd);
+					return std::nullopt;
+				}
+				::madvise(addr, size, MADV_SEQUENTIAL);
+				input._text	  = { static_cast<const char*>(addr), size };
+				input._mapped = true;
+			}
+			::close(fd);
+#endif
+			return input;
+		}
+
+		[[nodiscard]] auto text() const -> std::string_view { return _text; }
+
+	private:
+		Input() = default;
+
+	private:
+		std::string_view _text;
+		std::string		 _buffer;  // owns `_text` unless it is mapped
+		bool			 _mapped = false;
+	};
+
+	/**
+	 * @brief Split into lines, without their `\n` or `\r\n`.
+	 *
+	 * @param text
+	 * @return std::vector<std::string_view>
+	 */
+	inline static auto split_lines(std::string_view text) -> std::vector<std::string_view> {
+		std::vector<std::string_view> lines;
+
+		while (!text.empty()) {
+			const auto eol	= text.find('\n');
+			auto	   line = text.substr(0, eol);
+			if (line.ends_with('\r'))
+				line.remove_suffix(1);
+			lines.push_back(line);
+			text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+		}
+
+		return lines;  // nrvo
+	}
+
+	struct Counters {
+		std::atomic<std::size_t> lines	  = 0;
+		std::atomic<std::size_t> failures = 0;
+		std::atomic<std::size_t> bytes	  = 0;
+	};
+
+	/**
+	 * @brief Evaluate a chunk of lines, appending one result line per input line to `out`.
+	 *
+	 * @param lines
+	 * @param first line number of `lines[0]`, printed in unordered mode
+	 * @param options
+	 * @param counters
+	 * @param out
+	 */
+	inline static auto eval_chunk(
+		std::span<const std::string_view> lines,
+		std::size_t						  first,
+		const Options&					  options,
+		Counters&						  counters,
+		std::string&					  out
+	) -> void {
+		std::size_t failures = 0;
+		std::size_t bytes	 = 0;
+
+		for (std::size_t i = 0; i < lines.size(); ++i) {
+			const auto line	 = lines[i];
+			bytes			+= line.size() + 1;
+
+			if (!options.ordered)
+				std::format_to(std::back_inserter(out), "{}\t", first + i + 1);
+
+			if (line.find_first_not_of(" \t") == std::string_view::npos) {
+				out += '\n';
+				continue;
+			}
+
+			Budget	   budget { options.limits };
+			const auto ts  = lex::lex(line);
+			const auto res = ts ? pipeline::run(*ts, budget)
+								: pipeline::Outcome::fail(ts.error().to_string());
+
+			if (!res.success) {
+				++failures;
+				out += "error: ";
+			}
+			out += res.text;
+			out += '\n';
+		}
+
+		counters.lines	  += lines.size();
+		counters.failures += failures;
+		counters.bytes	  += bytes;
+	}
+
+	/**
+	 * @brief Evaluate all lines of an input and write the results to stdout.
+	 *
+	 * In ordered mode, chunks are evaluated in windows of a few per thread, and each window is
+	 * written out in input order once it is complete. In unordered mode, every chunk is written
+	 * as soon as it is evaluated.
+	 *
+	 * @param lines
+	 * @param options
+	 * @param pool `nullptr` to evaluate inline
+	 * @param counters
+	 */
+	inline static auto eval_all(
+		std::span<const std::string_view> lines,
+		const Options&					  options,
+		sched::ThreadPool*				  pool,
+		Counters&						  counters
+	) -> void {
+		const auto chunks = (lines.size() + chunk_lines - 1) / chunk_lines;
+		const auto chunk  = [&](std::size_t c) {
+			 return lines.subspan(c * chunk_lines, std::min(chunk_lines, lines.size() - c * chunk_lines));
+		};
+
+		if (!pool) {
+			std::string out;
+			for (std::size_t c = 0; c < chunks; ++c) {
+				eval_chunk(chunk(c), c * chunk_lines, options, counters, out);
+				std::fwrite(out.data(), 1, out.size(), stdout);
+				out.clear();
+			}
+			return;
+		}
+
+		if (!options.ordered) {
+			std::mutex mutex;
+			pool->parallel_for(0, chunks, 1, [&](std::size_t c) {
+				std::string out;
+				eval_chunk(chunk(c), c * chunk_lines, options, counters, out);
+				std::lock_guard lock { mutex };
+				std::fwrite(out.data(), 1, out.size(), stdout);
+			});
+			return;
+		}
+
+		const auto				 window = pool->concurrency() * 4;
+		std::vector<std::string> outs(window);
+		for (std::size_t base = 0; base < chunks; base += window) {
+			const auto count = std::min(window, chunks - base);
+			pool->parallel_for(0, count, 1, [&](std::size_t c) {
+				eval_chunk(chunk(base + c), (base + c) * chunk_lines, options, counters, outs[c]);
+			});
+			for (std::size_t c = 0; c < count; ++c) {
+				std::fwrite(outs[c].data(), 1, outs[c].size(), stdout);
+				outs[c].clear();
+			}
+		}
+	}
+
+	template<typename T>
+	inline static auto parse_number(std::string_view str) -> std::optional<T> {
+		T	 value;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		if (ec != std::errc {} || end != str.data() + str.size())
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief Parse the command line.
+	 *
+	 * @return the options, or the exit code if the program should stop right away
+	 */
+	inline static auto parse_options(int argc, char** argv) -> std::variant<Options, int> {
+		Options options;
+
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg = argv[i];
+			const auto			   next_number = [&]<typename T>() -> std::optional<T> {
+				  if (i + 1 >= argc)
+					  return std::nullopt;
+				  return parse_number<T>(argv[++i]);
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				std::fputs(usage, stdout);
+				return 0;
+			} else if (arg == "-u" || arg == "--unordered")
+				options.ordered = false;
+			else if (arg == "-s" || arg == "--stats")
+				options.stats = true;
+			else if (arg == "-r" || arg == "--replay")
+				options.replay = true;
+			else if (arg == "-j" || arg == "--jobs") {
+				if (const auto jobs = next_number.operator()<std::size_t>(); jobs && *jobs > 0)
+					options.jobs = *jobs;
+				else {
+					std::fputs("error: --jobs expects a positive number\n", stderr);
+					return 2;
+				}
+			} else if (arg == "--steps") {
+				if (const auto steps = next_number.operator()<std::size_t>())
+					options.limits.steps = *steps;
+				else {
+					std::fputs("error: --steps expects a number\n", stderr);
+					return 2;
+				}
+			} else if (arg == "--timeout") {
+				if (const auto ms = next_number.operator()<std::int64_t>())
+					options.limits.timeout = std::chrono::milliseconds { *ms };
+				else {
+					std::fputs("error: --timeout expects a number of milliseconds\n", stderr);
+					return 2;
+				}
+			} else if (arg == "--trace") {
+				if (i + 1 >= argc) {
+					std::fputs("error: --trace expects a path\n", stderr);
+					return 2;
+				}
+				options.trace = argv[++i];
+				if (!trace::enabled)
+					std::fputs("warning: built without DCS213_P1_TRACE, the trace is empty\n", stderr);
+			} else if (arg.starts_with('-') && arg != "-") {
+				std::fputs(std::format("error: unknown option `{}`\n\n{}", arg, usage).c_str(), stderr);
+				return 2;
+			} else
+				options.files.emplace_back(arg);
+		}
+
+		return options;
+	}
+
+	inline static auto run(const Options& options) -> int {
+		using Clock = std::chrono::steady_clock;
+
+		// Evaluations fork onto the global pool too, so it is the one that gets the threads.
+		sched::ThreadPool::configure_global(options.jobs - 1);
+		sched::ThreadPool* const pool = options.jobs > 1 ? &sched::ThreadPool::global() : nullptr;
+
+		Counters   counters;
+		int		   status = 0;
+		const auto start  = Clock::now();
+
+		const auto process = [&](const Input& input) {
+			const auto lines = split_lines(input.text());
+			eval_all(lines, options, pool, counters);
+		};
+
+		const auto replay = [&](const std::string& path) {
+			const auto reader = history::Reader::open(path);
+			if (!reader)
+				return false;
+
+			std::vector<std::string_view> scripts;
+			scripts.reserve(reader->log().size());
+			for (const auto entry : reader->log()) scripts.push_back(entry.script);
+			eval_all(scripts, options, pool, counters);
+			return true;
+		};
+
+		if (options.replay) {
+			if (options.files.empty()) {
+				std::fputs("error: --replay expects history logs\n", stderr);
+				status = 2;
+			}
+			for (const auto& path : options.files)
+				if (!replay(path)) {
+					std::fputs(std::format("error: `{}` is not a history log\n", path).c_str(), stderr);
+					status = 1;
+				}
+		} else if (options.files.empty())
+			process(Input::from_stdin());
+		else
+			for (const auto& path : options.files)
+				if (path == "-")
+					process(Input::from_stdin());
+				else if (const auto input = Input::from_file(path))
+					process(*input);
+				else {
+					std::fputs(std::format("error: cannot read `{}`\n", path).c_str(), stderr);
+					status = 1;
+				}
+
+		std::fflush(stdout);
+
+		if (options.stats) {
+			const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			const auto lines   = counters.lines.load();
+			const auto bytes   = counters.bytes.load();
+			std::fputs(
+				std::format(
+					"lines: {}, failures: {}, bytes: {}, threads: {}\n"
+					"time: {:.3f} s, {:.0f} lines/s, {:.2f} MiB/s, {:.0f} ns/line\n",
+					lines,
+					counters.failures.load(),
+					bytes,
+					options.jobs,
+					seconds,
+					lines / seconds,
+					bytes / seconds / (1 << 20),
+					lines ? seconds * 1e9 / lines : 0.
+				)
+					.c_str(),
+				stderr
+			);
+
+			if (alloc::enabled) {
+				const auto allocs = alloc::Registry::global().snapshot();
+
+				auto text = std::format(
+					"allocs: {}, bytes: {}, peak: {} B\n",
+					allocs.total.count,
+					allocs.total.bytes,
+					allocs.total.peak
+				);
+				for (std::size_t t = 0; t < alloc::tag_count; ++t)
+					text += std::format(
+						"  {:<10} {:>12} allocs {:>14} B {:>8.2f} allocs/line\n",
+						alloc::to_string(static_cast<alloc::Tag>(t)),
+						allocs.tags[t].count,
+						allocs.tags[t].bytes,
+						lines ? static_cast<double>(allocs.tags[t].count) / lines : 0.
+					);
+				std::fputs(text.c_str(), stderr);
+			}
+			if (trace::enabled) {
+				json::Writer writer;
+				writer.value(trace::Tracer::global());
+				std::fputs(std::format("stages: {}\n", writer.str()).c_str(), stderr);
+			}
+		}
+
+		if (!options.trace.empty() && !trace::Tracer::global().dump(options.trace)) {
+			std::fputs(std::format("error: cannot write `{}`\n", options.trace).c_str(), stderr);
+			status = 1;
+		}
+
+		return status;
+	}
+}  // namespace dcs213::p1::headless
+
+int main(int argc, char** argv) {
+	using namespace dcs213::p1;
+
+	const auto options = headless::parse_options(argc, argv);
+	if (const auto code = std::get_if<int>(&options))
+		return *code;
+
+	std::setvbuf(stdout, nullptr, _IOFBF, 1 << 16);
+	return headless::run(std::get<headless::Options>(options));
+}
@@ -0,0 +1,352 @@
+#include "Budget.hpp"
+#include "History.hpp"
+#include "Lexer.hpp"
+#include "Pipeline.hpp"
+#include "Scheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+namespace dcs213::p1::replay {
+	inline static constexpr auto usage = R"(usage: dcs213.project1.replay [options] <logs...>
+
+Replays the evaluations of history logs against the engine, open-loop: every request is issued
+at its recorded time, scaled by --speed, whether or not the earlier ones are done. Reports
+throughput, latency percentiles, and outcomes that differ from the recorded ones.
+
+Logs are recorded by dcs213.project1 (--history, on by default) and dcs213.project1.server
+(--history). Several logs are replayed one after the other.
+
+options:
+  -s, --speed <x|max>  replay speed, e.g. 1, 10, or max to issue requests back to back, where
+                       latency is the service time (default: 1)
+  -t, --threads <n>    evaluating threads (default: all cores)
+      --max-gap <ms>   shorten longer pauses between requests to this (default: 1000)
+      --steps <n>      step limit per expression
+      --timeout <ms>   time limit per expression
+      --no-check       do not compare outcomes with the recorded ones
+  -h, --help           show this message
+)";
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		std::optional<double>	 speed	 = 1.;	// none for as fast as possible
+		std::size_t				 threads = sched::ThreadPool::default_concurrency() + 1;
+		std::chrono::nanoseconds max_gap = std::chrono::seconds { 1 };
+		Budget::Limits			 limits	 = {};
+		bool					 check	 = true;
+		std::vector<std::string> logs;
+	};
+
+	/**
+	 * @brief A recorded request, viewing into its log.
+	 *
+	 */
+	struct Request {
+		std::chrono::nanoseconds at;  // since the first request, gaps shortened
+		history::Entry			 entry;
+	};
+
+	struct Result {
+		std::vector<Clock::duration> latencies;	 // from the scheduled time to the outcome
+		std::vector<Clock::duration> services;	 // from the actual start to the outcome
+		std::size_t					 failures	= 0;
+		std::size_t					 mismatches = 0;
+	};
+
+	/**
+	 * @brief The requests of the logs in order, each log after the previous one.
+	 *
+	 * A request arrived at its logged time minus its duration, since entries are logged once
+	 * evaluated. Pauses longer than `max_gap`, e.g. between two sessions, are shortened to it.
+	 *
+	 * @param logs
+	 * @param max_gap
+	 * @return std::vector<Request>
+	 */
+	inline static auto schedule(
+		const std::vector<history::Reader>& logs,
+		std::chrono::nanoseconds			max_gap
+	) -> std::vector<Request> {
+		std::vector<Request>	 requests;
+		std::chrono::nanoseconds at {};
+
+		for (const auto& reader : logs) {
+			std::vector<history::Entry> entries;
+			entries.reserve(reader.log().size());
+			for (const auto entry : reader.log()) entries.push_back(entry);
+
+			const auto arrival = [](const history::Entry& e) { return e.time - e.duration; };
+			std::ranges::stable_sort(entries, {}, arrival);
+
+			for (std::size_t i = 0; i < entries.size(); ++i) {
+				// A log starts `max_gap` after the end of the previous one.
+				const auto gap = i > 0 ? arrival(entries[i]) - arrival(entries[i - 1]) : max_gap;
+				if (!requests.empty())
+					at += std::clamp(gap, std::chrono::nanoseconds {}, max_gap);
+				requests.push_back({ .at = at, .entry = entries[i] });
+			}
+		}
+
+		return requests;  // nrvo
+	}
+
+	/**
+	 * @brief Whether a replayed outcome agrees with the recorded one. Outcomes that depend on
+	 * the moment they ran, i.e. cancellations and deadlines, agree with anything.
+	 *
+	 */
+	inline static auto agrees(const history::Entry& entry, const pipeline::Outcome& outcome)
+		-> bool {
+		if ((entry.flags & (history::Cancelled | history::Transient)) != 0 || outcome.cancelled
+			|| outcome.transient)
+			return true;
+		return ((entry.flags & history::Success) != 0) == outcome.success
+			&& entry.result == outcome.text;
+	}
+
+	/**
+	 * @brief Run one replaying thread: take the next request, wait for its time, evaluate it.
+	 *
+	 * Threads take requests in order from a shared counter, so when all of them are busy, the
+	 * next request waits, and the wait counts towards its latency.
+	 *
+	 */
+	inline static auto drive(
+		const Options&				options,
+		const std::vector<Request>& requests,
+		std::atomic<std::size_t>&	next,
+		Clock::time_point			start
+	) -> Result {
+		Result result;
+
+		for (;;) {
+			const auto i = next.fetch_add(1, std::memory_order_relaxed);
+			if (i >= requests.size())
+				break;
+
+			const auto& request = requests[i];
+			const auto	due		= options.speed
+									  ? start + std::chrono::duration_cast<Clock::duration>(
+											request.at / *options.speed
+										)
+									  : Clock::now();
+			std::this_thread::sleep_until(due);
+
+			const auto begun   = Clock::now();
+			Budget	   budget { options.limits };
+			const auto ts	   = lex::lex(request.entry.script);
+			const auto outcome = ts ? pipeline::run(*ts, budget)
+									: pipeline::Outcome::fail(ts.error().to_string());
+			const auto done	   = Clock::now();
+
+			result.latencies.push_back(done - due);
+			result.services.push_back(done - begun);
+			result.failures += !outcome.success;
+
+			if (options.check && !agrees(request.entry, outcome) && ++result.mismatches <= 4)
+				std::fputs(
+					std::format(
+						"mismatch: `{}` gave `{}`, recorded `{}`\n",
+						request.entry.script,
+						outcome.text,
+						request.entry.result
+					)
+						.c_str(),
+					stderr
+				);
+		}
+
+		return result;
+	}
+
+	template<typename T>
+	inline static auto parse_number(std::string_view str) -> std::optional<T> {
+		T	 value;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		if (ec != std::errc {} || end != str.data() + str.size())
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief Parse the command line.
+	 *
+	 * @return the options, or the exit code if the program should stop right away
+	 */
+	inline static auto parse_options(int argc, char** argv) -> std::variant<Options, int> {
+		Options options;
+
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg	= argv[i];
+			const auto			   next = [&]() -> std::optional<std::string_view> {
+				  if (i + 1 >= argc)
+					  return std::nullopt;
+				  return argv[++i];
+			};
+			const auto count = [&](std::size_t& out) {
+				if (const auto value = next())
+					if (const auto n = parse_number<std::size_t>(*value); n && *n > 0) {
+						out = *n;
+						return true;
+					}
+				std::fputs(std::format("error: {} expects a positive number\n", arg).c_str(), stderr);
+				return false;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				std::fputs(usage, stdout);
+				return 0;
+			} else if (arg == "-s" || arg == "--speed") {
+				const auto value = next();
+				if (value == "max")
+					options.speed = std::nullopt;
+				else if (const auto x = value ? parse_number<double>(*value) : std::nullopt;
+						 x && *x > 0.)
+					options.speed = *x;
+				else {
+					std::fputs("error: --speed expects a positive number or max\n", stderr);
+					return 2;
+				}
+			} else if (arg == "-t" || arg == "--threads") {
+				if (!count(options.threads))
+					return 2;
+			} else if (arg == "--max-gap") {
+				std::size_t ms;
+				if (!count(ms))
+					return 2;
+				options.max_gap = std::chrono::milliseconds { ms };
+			} else if (arg == "--steps") {
+				if (!count(options.limits.steps))
+					return 2;
+			} else if (arg == "--timeout") {
+				std::size_t ms;
+				if (!count(ms))
+					return 2;
+				options.limits.timeout = std::chrono::milliseconds { ms };
+			} else if (arg == "--no-check")
+				options.check = false;
+			else if (arg.starts_with('-')) {
+				std::fputs(std::format("error: unknown option `{}`\n\n{}", arg, usage).c_str(), stderr);
+				return 2;
+			} else
+				options.logs.emplace_back(arg);
+		}
+
+		if (options.logs.empty()) {
+			std::fputs(std::format("error: no history logs given\n\n{}", usage).c_str(), stderr);
+			return 2;
+		}
+
+		return options;
+	}
+
+	inline static auto run(const Options& options) -> int {
+		std::vector<history::Reader> logs;
+		for (const auto& path : options.logs)
+			if (auto reader = history::Reader::open(path))
+				logs.push_back(*std::move(reader));
+			else {
+				std::fputs(std::format("error: `{}` is not a history log\n", path).c_str(), stderr);
+				return 1;
+			}
+
+		const auto requests = schedule(logs, options.max_gap);
+		if (requests.empty()) {
+			std::fputs("no requests to replay\n", stderr);
+			return 1;
+		}
+
+		std::vector<Result>		 results(options.threads);
+		std::vector<std::thread> threads;
+		std::atomic<std::size_t> next = 0;
+		threads.reserve(options.threads);
+
+		const auto start = Clock::now();
+		for (std::size_t i = 0; i < options.threads; ++i)
+			threads.emplace_back([&, i] { results[i] = drive(options, requests, next, start); });
+		for (auto& t : threads) t.join();
+		const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::vector<Clock::duration> latencies;
+		std::vector<Clock::duration> services;
+		std::size_t					 failures	= 0;
+		std::size_t					 mismatches = 0;
+		for (const auto& res : results) {
+			latencies.insert(latencies.end(), res.latencies.begin(), res.latencies.end());
+			services.insert(services.end(), res.services.begin(), res.services.end());
+			failures   += res.failures;
+			mismatches += res.mismatches;
+		}
+
+		std::ranges::sort(latencies);
+		std::ranges::sort(services);
+		const auto percentiles = [](const std::vector<Clock::duration>& sorted) {
+			const auto at = [&](double p) {
+				const auto last = static_cast<double>(sorted.size() - 1);
+				const auto idx	= static_cast<std::size_t>(p * last);
+				return std::chrono::duration<double, std::micro>(sorted[idx]).count();
+			};
+			return std::format(
+				"p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, p99.9 {:.1f}, max {:.1f}",
+				at(.5),
+				at(.9),
+				at(.99),
+				at(.999),
+				at(1.)
+			);
+		};
+
+		// The rate the log asks for, against the one achieved.
+		const auto span	   = std::chrono::duration<double>(requests.back().at).count();
+		const auto count   = static_cast<double>(requests.size());
+		const auto offered = options.speed && span > 0.
+							   ? std::format("{:.0f} req/s", count * *options.speed / span)
+							   : std::string { "unbounded" };
+
+		std::fputs(
+			std::format(
+				"requests: {}, failures: {}, mismatches: {}, threads: {}, speed: {}\n"
+				"time: {:.3f} s, offered: {}, achieved: {:.0f} req/s\n"
+				"latency (us): {}\n"
+				"service (us): {}\n",
+				requests.size(),
+				failures,
+				options.check ? std::format("{}", mismatches) : std::string { "unchecked" },
+				options.threads,
+				options.speed ? std::format("{}x", *options.speed) : std::string { "max" },
+				seconds,
+				offered,
+				count / seconds,
+				percentiles(latencies),
+				percentiles(services)
+			)
+				.c_str(),
+			stdout
+		);
+
+		return mismatches > 0;
+	}
+}  // namespace dcs213::p1::replay
+
+int main(int argc, char** argv) {
+	using namespace dcs213::p1;
+
+	const auto options = replay::parse_options(argc, argv);
+	if (const auto code = std::get_if<int>(&options))
+		return *code;
+
+	return replay::run(std::get<replay::Options>(options));
+}
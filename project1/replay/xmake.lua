@@ -0,0 +1,19 @@
+target("dcs213.project1.replay")
+    set_kind("binary")
+    set_languages("cxx20")
+
+    add_packages("simdjson")
+    add_packages("tl_expected")
+    add_packages("magic_enum")
+
+    add_files("main.cpp")
+    add_includedirs("$(scriptdir)/../src")
+
+    if is_plat("windows") then
+        add_defines("DCS213_P1_PLAT_WINDOWS")
+    elseif is_plat("macos") then
+        add_defines("DCS213_P1_PLAT_MACOS")
+    elseif is_plat("linux") then
+        add_defines("DCS213_P1_PLAT_LINUX")
+        add_syslinks("pthread")
+    end
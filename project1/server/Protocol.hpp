@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace dcs213::p1::server::protocol {
+	/**
+	 * @brief Wire format shared by the server and its clients.
+	 *
+	 * Every message is a frame: a little-endian `u32` payload length, then the payload.
+	 *
+	 * - request payload:  `u32 id`, then the script
+	 * - response payload: `u32 id`, `u8 status`, then the result or the error message
+	 *
+	 * Requests may be pipelined. Responses carry the id of their request and may arrive in any
+	 * order.
+	 */
+	inline static constexpr std::size_t header_size	   = 4;
+	inline static constexpr std::size_t max_payload	   = 1 << 20;
+	inline static constexpr auto		default_socket = "/tmp/dcs213.project1.sock";
+
+	enum class Status : std::uint8_t {
+		Ok	  = 0,
+		Error = 1,
+	};
+
+	inline static auto put_u32(std::string& out, std::uint32_t v) -> void {
+		const char bytes[] {
+			static_cast<char>(v & 0xff),
+			static_cast<char>((v >> 8) & 0xff),
+			static_cast<char>((v >> 16) & 0xff),
+			static_cast<char>((v >> 24) & 0xff),
+		};
+		out.append(bytes, sizeof(bytes));
+	}
+
+	inline static auto get_u32(const char* p) -> std::uint32_t {
+		const auto b = reinterpret_cast<const unsigned char*>(p);
+		return static_cast<std::uint32_t>(b[0]) | static_cast<std::uint32_t>(b[1]) << 8
+			 | static_cast<std::uint32_t>(b[2]) << 16 | static_cast<std::uint32_t>(b[3]) << 24;
+	}
+
+	inline static auto write_request(std::string& out, std::uint32_t id, std::string_view script)
+		-> void {
+		put_u32(out, static_cast<std::uint32_t>(4 + script.size()));
+		put_u32(out, id);
+		out += script;
+	}
+
+	inline static auto write_response(
+		std::string&	 out,
+		std::uint32_t	 id,
+		Status			 status,
+		std::string_view text
+	) -> void {
+		put_u32(out, static_cast<std::uint32_t>(5 + text.size()));
+		put_u32(out, id);
+		out += static_cast<char>(status);
+		out += text;
+	}
+
+	struct Request {
+		std::uint32_t	 id;
+		std::string_view script;
+	};
+
+	struct Response {
+		std::uint32_t	 id;
+		Status			 status;
+		std::string_view text;
+	};
+
+	/**
+	 * @brief Incremental frame splitter over a receive buffer.
+	 *
+	 */
+	class FrameReader {
+	public:
+		/**
+		 * @brief Append received bytes.
+		 *
+		 */
+		auto feed(const char* data, std::size_t size) -> void { _buffer.append(data, size); }
+
+		/**
+		 * @brief The next complete payload, valid until the next call of `next` or `feed`.
+		 *
+		 * @return the payload, or `std::nullopt` if incomplete
+		 */
+		auto next() -> std::optional<std::string_view> {
+			const auto avail = _buffer.size() - _consumed;
+
+			if (avail >= header_size) {
+				const auto size = get_u32(_buffer.data() + _consumed);
+				if (avail - header_size >= size) {
+					const auto payload = std::string_view { _buffer }.substr(_consumed + header_size, size);
+					_consumed += header_size + size;
+					return payload;
+				}
+			}
+
+			_compact();
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief Whether the pending frame announces a payload larger than `max_payload`.
+		 *
+		 */
+		[[nodiscard]] auto oversized() const -> bool {
+			return _buffer.size() - _consumed >= header_size
+				&& get_u32(_buffer.data() + _consumed) > max_payload;
+		}
+
+		[[nodiscard]] auto buffered() const -> std::size_t { return _buffer.size() - _consumed; }
+
+	private:
+		auto _compact() -> void {
+			if (_consumed > 0) {
+				_buffer.erase(0, _consumed);
+				_consumed = 0;
+			}
+		}
+
+	private:
+		std::string _buffer;
+		std::size_t _consumed = 0;
+	};
+
+	inline static auto parse_request(std::string_view payload) -> std::optional<Request> {
+		if (payload.size() < 4)
+			return std::nullopt;
+		return Request { .id = get_u32(payload.data()), .script = payload.substr(4) };
+	}
+
+	inline static auto parse_response(std::string_view payload) -> std::optional<Response> {
+		if (payload.size() < 5)
+			return std::nullopt;
+		return Response {
+			.id		= get_u32(payload.data()),
+			.status = static_cast<Status>(payload[4]),
+			.text	= payload.substr(5),
+		};
+	}
+}  // namespace dcs213::p1::server::protocol
@@ -0,0 +1,300 @@
+#include "Protocol.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace dcs213::p1::server::loadgen {
+	inline static constexpr auto usage = R"(usage: dcs213.project1.loadgen [options]
+
+Drives a running dcs213.project1.server and reports throughput and latency percentiles.
+
+options:
+      --socket <path>     server socket (default: /tmp/dcs213.project1.sock)
+  -c, --connections <n>   concurrent connections, one thread each (default: 8)
+  -d, --depth <n>         requests pipelined per connection (default: 16)
+  -n, --requests <n>      requests per connection (default: 10000)
+  -f, --file <path>       expressions to send round robin, one per line (default: built-in mix)
+  -h, --help              show this message
+)";
+
+	inline static constexpr std::string_view builtin[] {
+		"1+2*3",
+		"(x+1)*(x-1)",
+		"(x+1)*(x+2)*(x+3)*(x+4)",
+		"2^10-24",
+		"x^3+3*x^2+3*x+1",
+		"(1+",
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		std::string				 socket		 = protocol::default_socket;
+		std::size_t				 connections = 8;
+		std::size_t				 depth		 = 16;
+		std::size_t				 requests	 = 10'000;
+		std::vector<std::string> scripts;
+	};
+
+	struct Result {
+		std::vector<Clock::duration> latencies;
+		std::size_t					 errors = 0;
+		std::optional<std::string>	 failure;
+	};
+
+	inline static auto connect(const std::string& path) -> int {
+		sockaddr_un addr {};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path))
+			return -1;
+		std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+		const auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	inline static auto write_all(int fd, std::string_view data) -> bool {
+		while (!data.empty()) {
+			const auto n = ::write(fd, data.data(), data.size());
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			data.remove_prefix(static_cast<std::size_t>(n));
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Run one closed-loop connection: keep `depth` requests outstanding until
+	 * `requests` have been answered.
+	 *
+	 */
+	inline static auto drive(const Options& options, std::size_t seed) -> Result {
+		Result result;
+		result.latencies.reserve(options.requests);
+
+		const auto fd = connect(options.socket);
+		if (fd < 0) {
+			result.failure = std::format("connect: {}", std::strerror(errno));
+			return result;
+		}
+
+		std::unordered_map<std::uint32_t, Clock::time_point> outstanding;
+		protocol::FrameReader								 reader;
+		std::string											 out;
+		std::uint32_t										 next_id = 0;
+		char												 buf[1 << 16];
+
+		const auto send = [&](std::size_t count) {
+			out.clear();
+			const auto now = Clock::now();
+			for (std::size_t i = 0; i < count; ++i) {
+				const auto id	  = next_id++;
+				const auto& script = options.scripts[(seed + id) % options.scripts.size()];
+				protocol::write_request(out, id, script);
+				outstanding.emplace(id, now);
+			}
+			return write_all(fd, out);
+		};
+
+		if (!send(std::min(options.depth, options.requests)))
+			result.failure = "write failed";
+
+		while (!result.failure && result.latencies.size() < options.requests) {
+			const auto n = ::read(fd, buf, sizeof(buf));
+			if (n <= 0) {
+				if (n < 0 && errno == EINTR)
+					continue;
+				result.failure = n == 0 ? "server closed the connection" : std::strerror(errno);
+				break;
+			}
+			reader.feed(buf, static_cast<std::size_t>(n));
+
+			std::size_t answered = 0;
+			const auto	now		 = Clock::now();
+			while (const auto payload = reader.next()) {
+				const auto response = protocol::parse_response(*payload);
+				const auto it		= response ? outstanding.find(response->id) : outstanding.end();
+				if (it == outstanding.end()) {
+					result.failure = "malformed response";
+					break;
+				}
+				result.latencies.push_back(now - it->second);
+				result.errors += response->status != protocol::Status::Ok;
+				outstanding.erase(it);
+				++answered;
+			}
+
+			const auto remaining = options.requests - std::min<std::size_t>(next_id, options.requests);
+			if (!result.failure && answered > 0 && remaining > 0
+				&& !send(std::min(answered, remaining)))
+				result.failure = "write failed";
+		}
+
+		::close(fd);
+		return result;
+	}
+
+	template<typename T>
+	inline static auto parse_number(std::string_view str) -> std::optional<T> {
+		T	 value;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		if (ec != std::errc {} || end != str.data() + str.size())
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief Parse the command line.
+	 *
+	 * @return the options, or the exit code if the program should stop right away
+	 */
+	inline static auto parse_options(int argc, char** argv) -> std::variant<Options, int> {
+		Options options;
+
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg	= argv[i];
+			const auto			   next = [&]() -> std::optional<std::string_view> {
+				  if (i + 1 >= argc)
+					  return std::nullopt;
+				  return argv[++i];
+			};
+			const auto count = [&](std::size_t& out) {
+				if (const auto value = next())
+					if (const auto n = parse_number<std::size_t>(*value); n && *n > 0) {
+						out = *n;
+						return true;
+					}
+				std::fputs(std::format("error: {} expects a positive number\n", arg).c_str(), stderr);
+				return false;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				std::fputs(usage, stdout);
+				return 0;
+			} else if (arg == "--socket") {
+				if (const auto path = next())
+					options.socket = *path;
+				else {
+					std::fputs("error: --socket expects a path\n", stderr);
+					return 2;
+				}
+			} else if (arg == "-c" || arg == "--connections") {
+				if (!count(options.connections))
+					return 2;
+			} else if (arg == "-d" || arg == "--depth") {
+				if (!count(options.depth))
+					return 2;
+			} else if (arg == "-n" || arg == "--requests") {
+				if (!count(options.requests))
+					return 2;
+			} else if (arg == "-f" || arg == "--file") {
+				const auto	  path = next();
+				std::ifstream file { std::string(path.value_or("")) };
+				if (!path || !file) {
+					std::fputs("error: --file expects a readable file\n", stderr);
+					return 2;
+				}
+				for (std::string line; std::getline(file, line);)
+					if (!line.empty())
+						options.scripts.push_back(std::move(line));
+			} else {
+				std::fputs(std::format("error: unknown option `{}`\n\n{}", arg, usage).c_str(), stderr);
+				return 2;
+			}
+		}
+
+		if (options.scripts.empty())
+			options.scripts.assign(std::begin(builtin), std::end(builtin));
+
+		return options;
+	}
+
+	inline static auto run(const Options& options) -> int {
+		std::vector<Result>		 results(options.connections);
+		std::vector<std::thread> threads;
+		threads.reserve(options.connections);
+
+		const auto start = Clock::now();
+		for (std::size_t i = 0; i < options.connections; ++i)
+			threads.emplace_back([&, i] { results[i] = drive(options, i); });
+		for (auto& t : threads) t.join();
+		const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::vector<Clock::duration> latencies;
+		std::size_t					 errors = 0;
+		for (const auto& res : results) {
+			if (res.failure)
+				std::fputs(std::format("connection failed: {}\n", *res.failure).c_str(), stderr);
+			latencies.insert(latencies.end(), res.latencies.begin(), res.latencies.end());
+			errors += res.errors;
+		}
+
+		if (latencies.empty()) {
+			std::fputs("no responses\n", stderr);
+			return 1;
+		}
+
+		std::ranges::sort(latencies);
+		const auto percentile = [&](double p) {
+			const auto idx = static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1));
+			return std::chrono::duration<double, std::micro>(latencies[idx]).count();
+		};
+
+		std::fputs(
+			std::format(
+				"connections: {}, depth: {}, responses: {}, errors: {}\n"
+				"time: {:.3f} s, {:.0f} req/s\n"
+				"latency (us): p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, p99.9 {:.1f}, max {:.1f}\n",
+				options.connections,
+				options.depth,
+				latencies.size(),
+				errors,
+				seconds,
+				static_cast<double>(latencies.size()) / seconds,
+				percentile(.5),
+				percentile(.9),
+				percentile(.99),
+				percentile(.999),
+				percentile(1.)
+			)
+				.c_str(),
+			stdout
+		);
+
+		return std::ranges::any_of(results, [](const Result& res) { return res.failure.has_value(); });
+	}
+}  // namespace dcs213::p1::server::loadgen
+
+int main(int argc, char** argv) {
+	using namespace dcs213::p1::server;
+
+	const auto options = loadgen::parse_options(argc, argv);
+	if (const auto code = std::get_if<int>(&options))
+		return *code;
+
+	return loadgen::run(std::get<loadgen::Options>(options));
+}
@@ -0,0 +1,564 @@
+#include "Protocol.hpp"
+
+#include "Budget.hpp"
+#include "Cache.hpp"
+#include "History.hpp"
+#include "Lexer.hpp"
+#include "Pipeline.hpp"
+#include "Scheduler.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace dcs213::p1::server {
+	inline static constexpr auto usage = R"(usage: dcs213.project1.server [options]
+
+Serves evaluations over a Unix domain socket, see `Protocol.hpp` for the wire format.
+
+options:
+      --socket <path>     socket to listen on (default: /tmp/dcs213.project1.sock)
+  -j, --jobs <n>          evaluation threads (default: all cores)
+      --inflight <n>      requests evaluated at once per connection before reading pauses
+                          (default: 64)
+      --high-water <n>    unsent response bytes per connection before reading pauses
+                          (default: 1048576)
+      --steps <n>         step limit per expression
+      --timeout <ms>      time limit per expression (default: 10000)
+      --history <file>    log every evaluation, e.g. to replay the traffic with
+                          dcs213.project1.replay
+  -h, --help              show this message
+)";
+
+	struct Options {
+		std::string	   socket		= protocol::default_socket;
+		std::size_t	   jobs			= sched::ThreadPool::default_concurrency() + 1;
+		std::size_t	   max_inflight = 64;
+		std::size_t	   high_water	= 1 << 20;
+		Budget::Limits limits		= {
+				  .steps   = 50'000'000,
+				  .depth   = 1'000,
+				  .terms   = 1 << 20,
+				  .bytes   = 256 << 20,
+				  .timeout = std::chrono::seconds { 10 },
+		  };
+		cache::Config cache = {};
+		std::string	  history;	// log of evaluations, none if empty
+	};
+
+	/**
+	 * @brief A client connection.
+	 *
+	 * Everything but `mutex`-guarded members is touched by the event loop thread only. Workers
+	 * append responses to `outbox` and hand the connection back to the loop to flush it.
+	 */
+	struct Connection {
+		int					  fd;
+		protocol::FrameReader reader;
+		std::uint32_t		  events = 0;	  // currently registered with epoll
+		bool				  eof	 = false;  // the peer stopped sending
+
+		std::mutex			  mutex;
+		std::string			  outbox;  // responses not yet written
+		std::size_t			  sent	   = 0;	 // prefix of `outbox` already written
+		std::size_t			  inflight = 0;	 // requests being evaluated
+		bool				  closed   = false;
+	};
+
+	/**
+	 * @brief An epoll event loop serving a pool of evaluation workers.
+	 *
+	 * The loop accepts connections, splits frames and writes responses; evaluations run on the
+	 * pool, through a result cache shared by all connections. Each connection reads only while
+	 * it has less than `max_inflight` requests in evaluation and less than `high_water` bytes
+	 * of unsent responses, so a slow or greedy client cannot make the server buffer without
+	 * bound.
+	 */
+	class Server {
+	public:
+		explicit Server(Options options) :
+			_options(std::move(options)), _cache(_options.cache) {
+			// Evaluations fork onto the global pool, so workers run them from inside it.
+			sched::ThreadPool::configure_global(_options.jobs);
+		}
+
+		Server(const Server&)			 = delete;
+		Server& operator=(const Server&) = delete;
+
+		~Server() {
+			{
+				std::unique_lock lock { _tasks_mutex };
+				_tasks_cv.wait(lock, [this] { return _tasks == 0; });
+			}
+
+			for (const auto& [fd, _] : _connections) ::close(fd);
+			for (const auto fd : { _listen_fd, _epoll_fd, _event_fd, _signal_fd })
+				if (fd >= 0)
+					::close(fd);
+			if (_listen_fd >= 0)
+				::unlink(_options.socket.c_str());
+		}
+
+	public:
+		/**
+		 * @brief Bind the socket and set up the event loop.
+		 *
+		 * @return the error message on failure
+		 */
+		auto listen() -> std::optional<std::string> {
+			sockaddr_un addr {};
+			addr.sun_family = AF_UNIX;
+			if (_options.socket.size() >= sizeof(addr.sun_path))
+				return std::format("socket path too long: {}", _options.socket);
+			std::memcpy(addr.sun_path, _options.socket.c_str(), _options.socket.size() + 1);
+
+			if (!_options.history.empty() && !(_history = history::Writer::open(_options.history)))
+				return std::format("cannot open history log or it is in use: {}", _options.history);
+
+			sigset_t signals;
+			sigemptyset(&signals);
+			sigaddset(&signals, SIGINT);
+			sigaddset(&signals, SIGTERM);
+			pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+			::signal(SIGPIPE, SIG_IGN);
+
+			_listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (_listen_fd < 0)
+				return _error("socket");
+
+			::unlink(_options.socket.c_str());
+			if (::bind(_listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+				return _error("bind");
+			if (::listen(_listen_fd, SOMAXCONN) != 0)
+				return _error("listen");
+
+			_epoll_fd  = ::epoll_create1(EPOLL_CLOEXEC);
+			_event_fd  = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			_signal_fd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+			if (_epoll_fd < 0 || _event_fd < 0 || _signal_fd < 0)
+				return _error("epoll setup");
+
+			for (const auto fd : { _listen_fd, _event_fd, _signal_fd }) {
+				epoll_event ev { .events = EPOLLIN, .data = { .fd = fd } };
+				::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+			}
+
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief Serve until SIGINT or SIGTERM.
+		 *
+		 */
+		auto run() -> void {
+			std::vector<epoll_event> events(256);
+
+			while (true) {
+				const auto n = ::epoll_wait(_epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+				if (n < 0) {
+					if (errno == EINTR)
+						continue;
+					std::fputs(_error("epoll_wait").c_str(), stderr);
+					return;
+				}
+
+				for (int i = 0; i < n; ++i) {
+					const auto fd = events[i].data.fd;
+
+					if (fd == _signal_fd)
+						return;
+					else if (fd == _listen_fd)
+						_accept();
+					else if (fd == _event_fd)
+						_drain_ready();
+					else if (const auto it = _connections.find(fd); it != _connections.end()) {
+						const auto conn = it->second;
+						if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN))
+							_close(conn);
+						else {
+							if (events[i].events & EPOLLIN)
+								_read(conn);
+							if (!_alive(conn))
+								continue;
+							if (events[i].events & EPOLLOUT)
+								_flush(conn);
+							_update(conn);
+						}
+					}
+				}
+			}
+		}
+
+	private:
+		inline static auto _error(std::string_view what) -> std::string {
+			return std::format("{}: {}\n", what, std::strerror(errno));
+		}
+
+		auto _accept() -> void {
+			while (true) {
+				const auto fd = ::accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd < 0)
+					return;
+
+				auto conn = std::make_shared<Connection>();
+				conn->fd	 = fd;
+				conn->events = EPOLLIN;
+				epoll_event ev { .events = EPOLLIN, .data = { .fd = fd } };
+				::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+				_connections.emplace(fd, std::move(conn));
+			}
+		}
+
+		/**
+		 * @brief Whether the connection may take more requests.
+		 *
+		 */
+		auto _accepting(Connection& conn) -> bool {
+			std::lock_guard lock { conn.mutex };
+			return conn.inflight < _options.max_inflight
+				&& conn.outbox.size() - conn.sent < _options.high_water;
+		}
+
+		auto _read(const std::shared_ptr<Connection>& conn) -> void {
+			constexpr int reads = 4;  // per wakeup, so one busy peer cannot starve the others
+			char		  buf[1 << 16];
+
+			for (int round = 0; round < reads && !conn->eof && _accepting(*conn); ++round) {
+				const auto n = ::read(conn->fd, buf, sizeof(buf));
+				if (n > 0) {
+					conn->reader.feed(buf, static_cast<std::size_t>(n));
+					if (!_dispatch(conn))
+						return;
+				} else if (n == 0)
+					conn->eof = true;
+				else if (errno == EINTR)
+					--round;
+				else
+					break;	// EAGAIN, or an error that the next poll reports as EPOLLERR
+			}
+		}
+
+		/**
+		 * @brief Hand complete frames to the pool, as far as backpressure allows.
+		 *
+		 * @return false if the connection was closed for a protocol violation
+		 */
+		auto _dispatch(const std::shared_ptr<Connection>& conn) -> bool {
+			while (_accepting(*conn)) {
+				if (conn->reader.oversized()) {
+					_close(conn);
+					return false;
+				}
+
+				const auto payload = conn->reader.next();
+				if (!payload)
+					break;
+
+				const auto request = protocol::parse_request(*payload);
+				if (!request) {
+					_close(conn);
+					return false;
+				}
+
+				{
+					std::lock_guard lock { conn->mutex };
+					++conn->inflight;
+				}
+				_task_started();
+				auto& pool = sched::ThreadPool::global();
+				pool.spawn([this, conn, id = request->id, script = std::string(request->script)] {
+					const auto outcome = _evaluate(script);
+					{
+						std::lock_guard lock { conn->mutex };
+						--conn->inflight;
+						if (!conn->closed)
+							protocol::write_response(
+								conn->outbox,
+								id,
+								outcome.success ? protocol::Status::Ok : protocol::Status::Error,
+								outcome.text
+							);
+					}
+					_notify(conn);
+					_task_finished();
+				});
+			}
+			return true;
+		}
+
+		/**
+		 * @brief Evaluate a script through the cache, and log it to the history if there is one.
+		 *
+		 */
+		auto _evaluate(std::string_view script) -> pipeline::Outcome {
+			const auto start   = std::chrono::steady_clock::now();
+			auto	   outcome = _evaluate_cached(script);
+			if (_history)
+				_history->append(script, outcome, std::chrono::steady_clock::now() - start);
+			return outcome;
+		}
+
+		auto _evaluate_cached(std::string_view script) -> pipeline::Outcome {
+			const auto ts = lex::lex(script);
+
+			if (!ts)
+				return pipeline::Outcome::fail(ts.error().to_string());
+
+			return _cache.get_or_compute(*ts, [&] {
+				Budget budget { _options.limits };
+				return pipeline::run(*ts, budget);
+			});
+		}
+
+		/**
+		 * @brief Queue a connection for the loop to flush, from a worker.
+		 *
+		 */
+		auto _notify(std::shared_ptr<Connection> conn) -> void {
+			{
+				std::lock_guard lock { _ready_mutex };
+				_ready.push_back(std::move(conn));
+			}
+			const std::uint64_t one = 1;
+			[[maybe_unused]] const auto _ = ::write(_event_fd, &one, sizeof(one));
+		}
+
+		auto _drain_ready() -> void {
+			std::uint64_t count;
+			[[maybe_unused]] const auto _ = ::read(_event_fd, &count, sizeof(count));
+
+			std::vector<std::shared_ptr<Connection>> ready;
+			{
+				std::lock_guard lock { _ready_mutex };
+				ready.swap(_ready);
+			}
+
+			for (const auto& conn : ready) {
+				if (!_alive(conn))
+					continue;
+				_flush(conn);
+				if (_dispatch(conn))  // frames held back by backpressure
+					_update(conn);
+			}
+		}
+
+		auto _flush(const std::shared_ptr<Connection>& conn) -> void {
+			std::lock_guard lock { conn->mutex };
+
+			while (conn->sent < conn->outbox.size()) {
+				const auto n = ::write(
+					conn->fd,
+					conn->outbox.data() + conn->sent,
+					conn->outbox.size() - conn->sent
+				);
+				if (n > 0)
+					conn->sent += static_cast<std::size_t>(n);
+				else if (n < 0 && errno == EINTR)
+					continue;
+				else
+					break;
+			}
+
+			if (conn->sent == conn->outbox.size()) {
+				conn->outbox.clear();
+				conn->sent = 0;
+			} else if (conn->sent > conn->outbox.size() / 2) {
+				conn->outbox.erase(0, conn->sent);
+				conn->sent = 0;
+			}
+		}
+
+		/**
+		 * @brief Re-register the connection for what it is waiting for, or close it when done.
+		 *
+		 */
+		auto _update(const std::shared_ptr<Connection>& conn) -> void {
+			bool pending;
+			bool idle;
+			{
+				std::lock_guard lock { conn->mutex };
+				pending = conn->sent < conn->outbox.size();
+				idle	= conn->inflight == 0;
+			}
+
+			// Complete frames are dispatched as soon as a connection is idle, what is left
+			// after the peer stopped sending can only be a truncated frame.
+			if (conn->eof && !pending && idle) {
+				_close(conn);
+				return;
+			}
+
+			std::uint32_t events = 0;
+			if (!conn->eof && _accepting(*conn))
+				events |= EPOLLIN;
+			if (pending)
+				events |= EPOLLOUT;
+
+			if (events != conn->events) {
+				epoll_event ev { .events = events, .data = { .fd = conn->fd } };
+				::epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+				conn->events = events;
+			}
+		}
+
+		[[nodiscard]] auto _alive(const std::shared_ptr<Connection>& conn) const -> bool {
+			const auto it = _connections.find(conn->fd);
+			return it != _connections.end() && it->second == conn;
+		}
+
+		auto _close(const std::shared_ptr<Connection>& conn) -> void {
+			{
+				std::lock_guard lock { conn->mutex };
+				conn->closed = true;
+			}
+			::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+			::close(conn->fd);
+			_connections.erase(conn->fd);
+		}
+
+		auto _task_started() -> void {
+			std::lock_guard lock { _tasks_mutex };
+			++_tasks;
+		}
+
+		auto _task_finished() -> void {
+			std::lock_guard lock { _tasks_mutex };
+			if (--_tasks == 0)
+				_tasks_cv.notify_all();
+		}
+
+	private:
+		Options												 _options;
+		cache::ResultCache									 _cache;
+		std::unique_ptr<history::Writer>					 _history;	// may be null
+
+		int													 _listen_fd = -1;
+		int													 _epoll_fd	= -1;
+		int													 _event_fd	= -1;
+		int													 _signal_fd = -1;
+		std::unordered_map<int, std::shared_ptr<Connection>> _connections;
+
+		std::mutex											 _ready_mutex;
+		std::vector<std::shared_ptr<Connection>>			 _ready;  // to be flushed by the loop
+
+		std::mutex											 _tasks_mutex;
+		std::condition_variable								 _tasks_cv;
+		std::size_t											 _tasks = 0;  // evaluations in flight
+	};
+
+	template<typename T>
+	inline static auto parse_number(std::string_view str) -> std::optional<T> {
+		T	 value;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+		if (ec != std::errc {} || end != str.data() + str.size())
+			return std::nullopt;
+		return value;
+	}
+
+	/**
+	 * @brief Parse the command line.
+	 *
+	 * @return the options, or the exit code if the program should stop right away
+	 */
+	inline static auto parse_options(int argc, char** argv) -> std::variant<Options, int> {
+		Options options;
+
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg	= argv[i];
+			const auto			   next = [&]() -> std::optional<std::string_view> {
+				  if (i + 1 >= argc)
+					  return std::nullopt;
+				  return argv[++i];
+			};
+			const auto count = [&](std::size_t& out) {
+				if (const auto value = next())
+					if (const auto n = parse_number<std::size_t>(*value); n && *n > 0) {
+						out = *n;
+						return true;
+					}
+				std::fputs(std::format("error: {} expects a positive number\n", arg).c_str(), stderr);
+				return false;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				std::fputs(usage, stdout);
+				return 0;
+			} else if (arg == "--socket") {
+				if (const auto path = next())
+					options.socket = *path;
+				else {
+					std::fputs("error: --socket expects a path\n", stderr);
+					return 2;
+				}
+			} else if (arg == "-j" || arg == "--jobs") {
+				if (!count(options.jobs))
+					return 2;
+			} else if (arg == "--inflight") {
+				if (!count(options.max_inflight))
+					return 2;
+			} else if (arg == "--high-water") {
+				if (!count(options.high_water))
+					return 2;
+			} else if (arg == "--steps") {
+				if (!count(options.limits.steps))
+					return 2;
+			} else if (arg == "--timeout") {
+				std::size_t ms;
+				if (!count(ms))
+					return 2;
+				options.limits.timeout = std::chrono::milliseconds { ms };
+			} else if (arg == "--history") {
+				if (const auto path = next())
+					options.history = *path;
+				else {
+					std::fputs("error: --history expects a path\n", stderr);
+					return 2;
+				}
+			} else {
+				std::fputs(std::format("error: unknown option `{}`\n\n{}", arg, usage).c_str(), stderr);
+				return 2;
+			}
+		}
+
+		return options;
+	}
+}  // namespace dcs213::p1::server
+
+int main(int argc, char** argv) {
+	using namespace dcs213::p1;
+
+	const auto options = server::parse_options(argc, argv);
+	if (const auto code = std::get_if<int>(&options))
+		return *code;
+
+	server::Server srv { std::get<server::Options>(options) };
+	if (const auto err = srv.listen()) {
+		std::fputs(err->c_str(), stderr);
+		return 1;
+	}
+
+	std::fputs(std::format("listening on {}\n", std::get<server::Options>(options).socket).c_str(), stderr);
+	srv.run();
+	return 0;
+}
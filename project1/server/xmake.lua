@@ -0,0 +1,27 @@
+-- epoll, eventfd and signalfd are Linux only.
+if is_plat("linux") then
+    target("dcs213.project1.server")
+        set_kind("binary")
+        set_languages("cxx20")
+
+        add_packages("simdjson")
+        add_packages("tl_expected")
+        add_packages("magic_enum")
+
+        add_headerfiles("Protocol.hpp")
+        add_options("p1_trace")
+        add_files("main.cpp")
+        add_includedirs("$(scriptdir)", "$(scriptdir)/../src")
+        add_defines("DCS213_P1_PLAT_LINUX")
+        add_syslinks("pthread")
+
+    target("dcs213.project1.loadgen")
+        set_kind("binary")
+        set_languages("cxx20")
+
+        add_headerfiles("Protocol.hpp")
+        add_files("loadgen.cpp")
+        add_includedirs("$(scriptdir)")
+        add_defines("DCS213_P1_PLAT_LINUX")
+        add_syslinks("pthread")
+end
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <utility>
+
+/**
+ * @brief Attribute the allocations of the enclosing scope to a stage, as
+ * `DCS213_P1_ALLOC_TAG(Lex)`, by the enumerator of `alloc::Tag`. The innermost tag wins.
+ *
+ * Compiled out unless `DCS213_P1_COUNT_ALLOCS` is defined (`xmake f --p1_alloc_stats=y`).
+ */
+#ifdef DCS213_P1_COUNT_ALLOCS
+#	define DCS213_P1_ALLOC_CONCAT_IMPL(a, b) a##b
+#	define DCS213_P1_ALLOC_CONCAT(a, b)	  DCS213_P1_ALLOC_CONCAT_IMPL(a, b)
+#	define DCS213_P1_ALLOC_TAG(tag)                                                               \
+		const ::dcs213::p1::alloc::Tagged DCS213_P1_ALLOC_CONCAT(_alloc_tag_, __LINE__) {          \
+			::dcs213::p1::alloc::Tag::tag                                                          \
+		}
+#else
+#	define DCS213_P1_ALLOC_TAG(tag) static_cast<void>(0)
+#endif
+
+namespace dcs213::p1::alloc {
+	inline static constexpr bool enabled =
+#ifdef DCS213_P1_COUNT_ALLOCS
+		true;
+#else
+		false;
+#endif
+
+	enum class Tag : std::uint8_t {
+		Other,
+		Lex,
+		Parse,
+		Evaluate,
+		Serialize,
+	};
+
+	inline static constexpr std::size_t tag_count = 5;
+
+	inline static constexpr auto to_string(Tag tag) -> std::string_view {
+		switch (tag) {
+			case Tag::Other: return "other";
+			case Tag::Lex: return "lex";
+			case Tag::Parse: return "parse";
+			case Tag::Evaluate: return "evaluate";
+			case Tag::Serialize: return "serialize";
+		}
+		return "?";
+	}
+
+	/**
+	 * @brief The tag of the calling thread.
+	 *
+	 * @return Tag&
+	 */
+	inline auto current() -> Tag& {
+		thread_local Tag tag = Tag::Other;
+		return tag;
+	}
+
+	/**
+	 * @brief Sets the tag of the calling thread for its lifetime. Use through
+	 * `DCS213_P1_ALLOC_TAG`, or directly to carry a tag over to another thread.
+	 *
+	 */
+	class Tagged {
+	public:
+		explicit Tagged(Tag tag) : _previous(std::exchange(current(), tag)) {}
+
+		Tagged(const Tagged&)			 = delete;
+		Tagged& operator=(const Tagged&) = delete;
+
+		~Tagged() { current() = _previous; }
+
+	private:
+		Tag _previous;
+	};
+
+	/**
+	 * @brief Allocation counters of one tag, or of all of them.
+	 *
+	 */
+	struct Counters {
+		std::uint64_t count = 0;  // allocations
+		std::uint64_t bytes = 0;  // allocated in total
+		std::uint64_t live	= 0;  // allocated and not freed yet
+		std::uint64_t peak	= 0;  // highest `live` since the last `reset_peak`
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("count", count)
+				.field("bytes", bytes)
+				.field("live", live)
+				.field("peak", peak)
+				.end_object();
+		}
+	};
+
+	/**
+	 * @brief Counters of every tag at one moment.
+	 *
+	 * The difference of two snapshots is what happened in between, except for `live` and
+	 * `peak`, which are those of the later one.
+	 */
+	struct Snapshot {
+		std::array<Counters, tag_count> tags;
+		Counters						total;
+
+		[[nodiscard]] auto operator[](Tag tag) const -> const Counters& {
+			return tags[static_cast<std::size_t>(tag)];
+		}
+
+		[[nodiscard]] auto operator-(const Snapshot& before) const -> Snapshot {
+			auto diff = *this;
+			for (std::size_t t = 0; t <= tag_count; ++t) {
+				auto&		lhs = t < tag_count ? diff.tags[t] : diff.total;
+				const auto& rhs = t < tag_count ? before.tags[t] : before.total;
+				lhs.count	   -= rhs.count;
+				lhs.bytes	   -= rhs.bytes;
+			}
+			return diff;
+		}
+
+		/**
+		 * @brief `{ "enabled": ..., "total": counters, "tags": { "lex": counters, ... } }`.
+		 *
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object().field("enabled", enabled).field("total", total).key("tags");
+			writer.begin_object();
+			for (std::size_t t = 0; t < tag_count; ++t)
+				writer.field(to_string(static_cast<Tag>(t)), tags[t]);
+			writer.end_object().end_object();
+		}
+	};
+
+	/**
+	 * @brief The process-wide counters, fed by the replaced `operator new` and `operator
+	 * delete` of `DCS213_P1_ALLOC_COUNTING`.
+	 *
+	 * An allocation stays attributed to the tag it was made under, even if it is freed under
+	 * another one.
+	 */
+	class Registry {
+	public:
+		inline static auto global() -> Registry& {
+			static Registry registry;  // constant initialized, usable before `main`
+			return registry;
+		}
+
+	public:
+		auto on_alloc(Tag tag, std::size_t size) -> void {
+			_on_alloc(_tags[static_cast<std::size_t>(tag)], size);
+			_on_alloc(_total, size);
+		}
+
+		auto on_free(Tag tag, std::size_t size) -> void {
+			_tags[static_cast<std::size_t>(tag)].live.fetch_sub(size, std::memory_order_relaxed);
+			_total.live.fetch_sub(size, std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] auto snapshot() const -> Snapshot {
+			Snapshot snapshot;
+			for (std::size_t t = 0; t < tag_count; ++t) snapshot.tags[t] = _load(_tags[t]);
+			snapshot.total = _load(_total);
+			return snapshot;
+		}
+
+		/**
+		 * @brief Restart the peaks from the bytes live now.
+		 *
+		 */
+		auto reset_peak() -> void {
+			for (std::size_t t = 0; t <= tag_count; ++t) {
+				auto& atomics = t < tag_count ? _tags[t] : _total;
+				atomics.peak.store(atomics.live.load(std::memory_order_relaxed));
+			}
+		}
+
+	private:
+		struct Atomics {
+			std::atomic<std::uint64_t> count = 0;
+			std::atomic<std::uint64_t> bytes = 0;
+			std::atomic<std::uint64_t> live	 = 0;
+			std::atomic<std::uint64_t> peak	 = 0;
+		};
+
+		inline static auto _on_alloc(Atomics& atomics, std::size_t size) -> void {
+			atomics.count.fetch_add(1, std::memory_order_relaxed);
+			atomics.bytes.fetch_add(size, std::memory_order_relaxed);
+			const auto live = atomics.live.fetch_add(size, std::memory_order_relaxed) + size;
+
+			auto peak = atomics.peak.load(std::memory_order_relaxed);
+			while (live > peak && !atomics.peak.compare_exchange_weak(peak, live)) {}
+		}
+
+		inline static auto _load(const Atomics& atomics) -> Counters {
+			return {
+				.count = atomics.count.load(std::memory_order_relaxed),
+				.bytes = atomics.bytes.load(std::memory_order_relaxed),
+				.live  = atomics.live.load(std::memory_order_relaxed),
+				.peak  = atomics.peak.load(std::memory_order_relaxed),
+			};
+		}
+
+	private:
+		std::array<Atomics, tag_count> _tags;
+		Atomics						   _total;
+	};
+
+	namespace details {
+		/**
+		 * @brief Every counted block starts with this, to find its size and tag on free. Its
+		 * size keeps the block aligned for any fundamental type.
+		 *
+		 */
+		struct alignas(std::max_align_t) Header {
+			std::size_t size;
+			Tag			tag;
+		};
+
+		inline auto allocate(std::size_t size) -> void* {
+			const auto tag	 = current();
+			auto*	   block = static_cast<Header*>(std::malloc(sizeof(Header) + size));
+			if (!block)
+				return nullptr;
+
+			*block = { .size = size, .tag = tag };
+			Registry::global().on_alloc(tag, size);
+			return block + 1;
+		}
+
+		inline auto deallocate(void* ptr) noexcept -> void {
+			if (!ptr)
+				return;
+
+			auto* block = static_cast<Header*>(ptr) - 1;
+			Registry::global().on_free(block->tag, block->size);
+			std::free(block);
+		}
+
+		inline auto allocate_or_throw(std::size_t size) -> void* {
+			if (auto* ptr = allocate(size))
+				return ptr;
+			throw std::bad_alloc {};
+		}
+	}  // namespace details
+}  // namespace dcs213::p1::alloc
+
+/**
+ * @brief Replace the global `operator new` and `operator delete` with counting ones. Expand in
+ * exactly one translation unit of a program, at global scope; does nothing unless
+ * `DCS213_P1_COUNT_ALLOCS` is defined.
+ *
+ * Over-aligned allocations keep the default operators and are not counted.
+ */
+#ifdef DCS213_P1_COUNT_ALLOCS
+#	define DCS213_P1_ALLOC_COUNTING()                                                             \
+		auto operator new(std::size_t size)->void* {                                               \
+			return ::dcs213::p1::alloc::details::allocate_or_throw(size);                          \
+		}                                                                                          \
+		auto operator new[](std::size_t size)->void* {                                             \
+			return ::dcs213::p1::alloc::details::allocate_or_throw(size);                          \
+		}                                                                                          \
+		auto operator new(std::size_t size, const std::nothrow_t&) noexcept->void* {               \
+			return ::dcs213::p1::alloc::details::allocate(size);                                   \
+		}                                                                                          \
+		auto operator new[](std::size_t size, const std::nothrow_t&) noexcept->void* {             \
+			return ::dcs213::p1::alloc::details::allocate(size);                                   \
+		}                                                                                          \
+		auto operator delete(void* ptr) noexcept->void {                                           \
+			::dcs213::p1::alloc::details::deallocate(ptr);                                         \
+		}                                                                                          \
+		auto operator delete[](void* ptr) noexcept->void {                                         \
+			::dcs213::p1::alloc::details::deallocate(ptr);                                         \
+		}                                                                                          \
+		auto operator delete(void* ptr, std::size_t) noexcept->void {                              \
+			::dcs213::p1::alloc::details::deallocate(ptr);                                         \
+		}                                                                                          \
+		auto operator delete[](void* ptr, std::size_t) noexcept->void {                            \
+			::dcs213::p1::alloc::details::deallocate(ptr);                                         \
+		}                                                                                          \
+		auto operator delete(void* ptr, const std::nothrow_t&) noexcept->void {                    \
+			::dcs213::p1::alloc::details::deallocate(ptr);                                         \
+		}                                                                                          \
+		auto operator delete[](void* ptr, const std::nothrow_t&) noexcept->void {                  \
+			::dcs213::p1::alloc::details::deallocate(ptr);                                         \
+		}                                                                                          \
+		static_assert(true)
+#else
+#	define DCS213_P1_ALLOC_COUNTING() static_assert(true)
+#endif
@@ -0,0 +1,313 @@
+#pragma once
+
+#include "Budget.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Pipeline.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace dcs213::p1::analyze {
+	using Pass = Budget::Observer::Pass;
+
+	inline static constexpr std::size_t pass_count = 5;
+
+	inline static constexpr auto to_string(Pass pass) -> std::string_view {
+		switch (pass) {
+			case Pass::Constant: return "constant";
+			case Pass::Term: return "term";
+			case Pass::TermList: return "termlist";
+			case Pass::Point: return "point";
+			case Pass::MPoly: return "mpoly";
+		}
+		return "?";
+	}
+
+	/**
+	 * @brief What the passes of one kind did on one node.
+	 *
+	 */
+	struct PassStats {
+		std::uint64_t visits	= 0;
+		std::uint64_t successes = 0;
+		std::uint64_t ns		= 0;  // inclusive
+		std::size_t	  terms		= 0;  // of the largest result
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("visits", visits)
+				.field("successes", successes)
+				.field("ns", ns)
+				.field("terms", terms)
+				.end_object();
+		}
+	};
+
+	/**
+	 * @brief Records the passes over every node, as the observer of a budget.
+	 *
+	 * The time of a node is that of its outermost passes: passes a node makes over itself,
+	 * e.g. `eval_termlist` trying `eval_term` first, are not counted twice. When evaluation
+	 * forks, children run concurrently and their times may add up to more than their parent's.
+	 */
+	class Profiler final : public Budget::Observer {
+	public:
+		struct NodeStats {
+			std::array<PassStats, pass_count> passes;
+			std::uint64_t					  ns = 0;  // inclusive, all passes
+		};
+
+	public:
+		auto enter(const void* node, Pass /* pass */) -> void override {
+			_stack.push_back({ node, Clock::now() });
+		}
+
+		auto leave(const void* node, Pass pass, std::optional<std::size_t> terms) -> void override {
+			const auto frame = _stack.back();
+			_stack.pop_back();
+			const auto ns = static_cast<std::uint64_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start)
+					.count()
+			);
+			const auto nested = !_stack.empty() && _stack.back().node == node;
+
+			std::lock_guard lock { _mutex };
+			auto&			stats = _nodes[node];
+			auto&			ps	  = stats.passes[static_cast<std::size_t>(pass)];
+			++ps.visits;
+			ps.ns += ns;
+			if (terms) {
+				++ps.successes;
+				ps.terms = std::max(ps.terms, *terms);
+			}
+			if (!nested)
+				stats.ns += ns;
+		}
+
+		/**
+		 * @brief What was recorded for a node, if it was visited at all.
+		 *
+		 * @param node
+		 * @return const NodeStats*
+		 */
+		[[nodiscard]] auto find(const void* node) const -> const NodeStats* {
+			std::lock_guard lock { _mutex };
+			const auto		it = _nodes.find(node);
+			return it != _nodes.end() ? &it->second : nullptr;
+		}
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Frame {
+			const void*		  node;
+			Clock::time_point start;
+		};
+
+		inline static thread_local std::vector<Frame> _stack;
+
+		mutable std::mutex						   _mutex;
+		std::unordered_map<const void*, NodeStats> _nodes;
+	};
+
+	/**
+	 * @brief A node of the analyzed tree.
+	 *
+	 * `kind` is the cheapest pass that succeeded on the node (`constant`, `term` or `termlist`),
+	 * `failed` if none did, or `unvisited` if evaluation never got there.
+	 */
+	struct Node {
+		inline static constexpr std::size_t max_text = 120;
+
+		std::string						  text;	 // `Expr::to_string()`, shortened
+		std::string_view				  kind;
+		std::uint64_t					  visits  = 0;
+		std::uint64_t					  ns	  = 0;
+		std::uint64_t					  self_ns = 0;	// without the children
+		std::size_t						  terms	  = 0;	// of the result of the pass `kind`
+		std::array<PassStats, pass_count> passes;
+		std::vector<Node>				  children;
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("expr", text)
+				.field("kind", kind)
+				.field("visits", visits)
+				.field("ns", ns)
+				.field("self_ns", self_ns)
+				.field("terms", terms)
+				.key("passes")
+				.begin_object();
+			for (std::size_t p = 0; p < pass_count; ++p)
+				if (passes[p].visits > 0)
+					writer.field(to_string(static_cast<Pass>(p)), passes[p]);
+			writer.end_object().field("children", children).end_object();
+		}
+
+		/**
+		 * @brief Append the subtree as indented lines, one per node.
+		 *
+		 * @param out
+		 * @param depth
+		 */
+		auto render(std::string& out, std::size_t depth = 0) const -> void {
+			std::format_to(
+				std::back_inserter(out),
+				"{:{}}{}  [{}] {} terms, {} visits, {:.3f} us (self {:.3f} us)\n",
+				"",
+				depth * 2,
+				text,
+				kind,
+				terms,
+				visits,
+				static_cast<double>(ns) / 1e3,
+				static_cast<double>(self_ns) / 1e3
+			);
+			for (const auto& child : children) child.render(out, depth + 1);
+		}
+	};
+
+	/**
+	 * @brief The outcome of an evaluation, with the cost of every node of the tree.
+	 *
+	 */
+	struct Report {
+		pipeline::Outcome	outcome;
+		std::optional<Node> tree;  // none if parsing failed
+		std::size_t			steps = 0;
+		std::uint64_t		ns	  = 0;
+
+		/**
+		 * @brief The tree as indented lines, empty if there is none.
+		 *
+		 * @return std::string
+		 */
+		[[nodiscard]] auto text() const -> std::string {
+			std::string out;
+			if (tree)
+				tree->render(out);
+			return out;	 // nrvo
+		}
+
+		/**
+		 * @brief The fields of `outcome`, plus `"steps"`, `"ns"`, `"tree"` and its `"text"`.
+		 *
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object().field("success", outcome.success);
+			if (outcome.success)
+				writer.field("result", outcome.text);
+			else
+				writer.field("cancelled", outcome.cancelled).field("error", outcome.text);
+			writer.field("steps", steps)
+				.field("ns", ns)
+				.field("tree", tree)
+				.field("text", text())
+				.end_object();
+		}
+	};
+
+	namespace details {
+		inline static auto children(const parse::Expr& expr) -> std::vector<const parse::Expr*> {
+			std::vector<const parse::Expr*> children;
+			if (const auto binop = expr.get_if<parse::BinOpExpr>())
+				children = { binop->lhs.get(), binop->rhs.get() };
+			else if (const auto uop = expr.get_if<parse::UnaryOpExpr>())
+				children = { uop->operand.get() };
+			else if (const auto call = expr.get_if<parse::CallExpr>())
+				children = { call->arg.get() };
+			else if (const auto sum = expr.get_if<parse::SumExpr>())
+				for (const auto& operand : sum->operands) children.push_back(operand.expr.get());
+			else if (const auto prod = expr.get_if<parse::ProductExpr>())
+				for (const auto& operand : prod->operands) children.push_back(operand.expr.get());
+			return children;  // nrvo
+		}
+
+		inline static auto annotate(const parse::Expr& expr, const Profiler& profiler) -> Node {
+			Node node;
+			node.text = expr.to_string();
+			if (node.text.size() > Node::max_text) {
+				node.text.resize(Node::max_text - 3);
+				node.text += "...";
+			}
+
+			std::uint64_t children_ns = 0;
+			for (const auto child : children(expr)) {
+				node.children.push_back(annotate(*child, profiler));
+				children_ns += node.children.back().ns;
+			}
+
+			const auto stats = profiler.find(&expr);
+			if (!stats) {
+				node.kind = "unvisited";
+				return node;
+			}
+
+			node.passes	 = stats->passes;
+			node.ns		 = stats->ns;
+			node.self_ns = node.ns > children_ns ? node.ns - children_ns : 0;
+			node.kind	 = "failed";
+			for (std::size_t p = 0; p < pass_count; ++p) {
+				node.visits += node.passes[p].visits;
+				if (node.passes[p].successes > 0 && node.kind == "failed") {
+					node.kind  = to_string(static_cast<Pass>(p));
+					node.terms = node.passes[p].terms;
+				}
+			}
+			return node;
+		}
+	}  // namespace details
+
+	/**
+	 * @brief Parse and evaluate an already tokenized script like `pipeline::run`, recording the
+	 * cost of every node.
+	 *
+	 * Profiling slows evaluation down, so the times are best compared with each other.
+	 *
+	 * @param ts
+	 * @param budget its observer is replaced for the evaluation
+	 * @return Report
+	 */
+	inline static auto analyze(const lex::TokenStream& ts, Budget& budget) -> Report {
+		const auto ast = parse::parse(ts, budget);
+
+		if (!ast) {
+			const auto err = std::get_if<BudgetExhausted>(&ast.error());
+			return {
+				.outcome = err ? pipeline::Outcome::exhausted(*err)
+							   : pipeline::Outcome::fail(ast.error().to_string()),
+				.tree	 = {},
+				.steps	 = budget.steps(),
+			};
+		}
+
+		Profiler   profiler;
+		const auto start = std::chrono::steady_clock::now();
+		budget.observe(&profiler);
+		auto outcome = pipeline::run(*ast, budget);
+		budget.observe(nullptr);
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		return {
+			.outcome = std::move(outcome),
+			.tree	 = details::annotate(*ast, profiler),
+			.steps	 = budget.steps(),
+			.ns		 = static_cast<std::uint64_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()
+			),
+		};
+	}
+}  // namespace dcs213::p1::analyze
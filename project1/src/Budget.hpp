@@ -0,0 +1,214 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <optional>
+#include <stop_token>
+#include <string>
+
+namespace dcs213::p1 {
+	/**
+	 * @brief Per-request resource limits, threaded through parsing and evaluation.
+	 *
+	 * The counters are atomic because evaluation may fork onto the thread pool. Once a limit is
+	 * hit the budget stays exhausted: every later charge fails, so the recursive passes unwind
+	 * quickly and the caller can report `reason()`.
+	 */
+	class Budget {
+	public:
+		inline static constexpr auto unlimited = std::numeric_limits<std::size_t>::max();
+
+		struct Limits {
+			std::size_t steps = unlimited;	// node visits plus term operations
+			std::size_t depth = unlimited;	// nesting depth of the parsed expression
+			std::size_t terms = unlimited;	// terms in any single intermediate polynomial
+			std::size_t bytes = unlimited;	// bytes of intermediate polynomials, summed up
+			std::optional<std::chrono::steady_clock::duration> timeout = std::nullopt;
+		};
+
+		enum class Exceeded {
+			None,
+			Steps,
+			Depth,
+			Terms,
+			Bytes,
+			Deadline,
+			Cancelled,
+		};
+
+		/**
+		 * @brief Watches the evaluation passes run under a budget, node by node, e.g. to profile
+		 * them.
+		 *
+		 * `enter` and `leave` bracket every pass over a node, on whichever thread the evaluation
+		 * forked onto. `terms` is the size of the result, `std::nullopt` if the pass failed.
+		 */
+		class Observer {
+		public:
+			enum class Pass : std::uint8_t {
+				Constant,  // `eval_con`
+				Term,	   // `eval_term`
+				TermList,  // `eval_termlist`, `eval_termlist_calc`
+				Point,	   // `eval_point`
+				MPoly,	   // `eval_mpoly`
+			};
+
+			virtual ~Observer() = default;
+
+			virtual auto enter(const void* node, Pass pass) -> void = 0;
+
+			virtual auto leave(const void* node, Pass pass, std::optional<std::size_t> terms)
+				-> void = 0;
+		};
+
+	public:
+		Budget() : Budget(Limits {}) {}
+
+		explicit Budget(Limits limits, std::stop_token stop = {}) :
+			_limits(limits), _stop(std::move(stop)) {
+			if (limits.timeout)
+				_deadline = std::chrono::steady_clock::now() + *limits.timeout;
+		}
+
+	public:
+		[[nodiscard]] auto limits() const -> const Limits& { return _limits; }
+
+		/**
+		 * @brief Charge `n` steps of work.
+		 *
+		 * The deadline and the stop token are polled every `poll_interval` steps.
+		 *
+		 * @param n
+		 * @return whether the budget still holds
+		 */
+		auto step(std::size_t n = 1) -> bool {
+			if (exhausted())
+				return false;
+
+			const auto before = _steps.fetch_add(n, std::memory_order_relaxed);
+			if (n > _limits.steps || before > _limits.steps - n)
+				return _exceed(Exceeded::Steps);
+
+			if (before / poll_interval != (before + n) / poll_interval)
+				return poll();
+			return true;
+		}
+
+		/**
+		 * @brief Charge an intermediate polynomial.
+		 *
+		 * @param terms its number of terms
+		 * @param bytes its size in memory
+		 * @return whether the budget still holds
+		 */
+		auto alloc(std::size_t terms, std::size_t bytes) -> bool {
+			if (exhausted())
+				return false;
+			if (terms > _limits.terms)
+				return _exceed(Exceeded::Terms);
+
+			const auto before = _bytes.fetch_add(bytes, std::memory_order_relaxed);
+			if (bytes > _limits.bytes || before > _limits.bytes - bytes)
+				return _exceed(Exceeded::Bytes);
+			return true;
+		}
+
+		/**
+		 * @brief Check nesting depth.
+		 *
+		 * @param depth
+		 * @return whether the budget still holds
+		 */
+		auto depth(std::size_t depth) -> bool {
+			if (exhausted())
+				return false;
+			if (depth > _limits.depth)
+				return _exceed(Exceeded::Depth);
+			return true;
+		}
+
+		/**
+		 * @brief Check the deadline and the stop token right now.
+		 *
+		 * @return whether the budget still holds
+		 */
+		auto poll() -> bool {
+			if (exhausted())
+				return false;
+			if (_stop.stop_requested())
+				return _exceed(Exceeded::Cancelled);
+			if (_deadline && std::chrono::steady_clock::now() > *_deadline)
+				return _exceed(Exceeded::Deadline);
+			return true;
+		}
+
+		[[nodiscard]] auto exhausted() const -> bool {
+			return _reason.load(std::memory_order_relaxed) != Exceeded::None;
+		}
+
+		[[nodiscard]] auto reason() const -> Exceeded {
+			return _reason.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] auto steps() const -> std::size_t {
+			return _steps.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] auto bytes() const -> std::size_t {
+			return _bytes.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Attach an observer to the evaluation, which must outlive it.
+		 *
+		 * @param observer `nullptr` to detach
+		 */
+		auto observe(Observer* observer) -> void { _observer = observer; }
+
+		[[nodiscard]] auto observer() const -> Observer* { return _observer; }
+
+	private:
+		inline static constexpr std::size_t poll_interval = 1024;
+
+		auto _exceed(Exceeded reason) -> bool {
+			auto none = Exceeded::None;
+			_reason.compare_exchange_strong(none, reason, std::memory_order_relaxed);
+			return false;
+		}
+
+	private:
+		Limits												 _limits;
+		std::stop_token										 _stop;
+		std::optional<std::chrono::steady_clock::time_point> _deadline;
+
+		std::atomic<std::size_t>							 _steps	   = 0;
+		std::atomic<std::size_t>							 _bytes	   = 0;
+		std::atomic<Exceeded>								 _reason   = Exceeded::None;
+		Observer*											 _observer = nullptr;
+	};
+
+	/**
+	 * @brief An error that a request ran out of its budget.
+	 *
+	 */
+	struct BudgetExhausted {
+		Budget::Exceeded   reason;
+
+		[[nodiscard]] auto to_string() const -> std::string {
+			switch (reason) {
+				case Budget::Exceeded::Steps: return "Too much work, step limit exceeded!";
+				case Budget::Exceeded::Depth: return "Expression nested too deeply!";
+				case Budget::Exceeded::Terms: return "Polynomial grew too large, term limit exceeded!";
+				case Budget::Exceeded::Bytes: return "Out of memory budget!";
+				case Budget::Exceeded::Deadline: return "Timed out!";
+				case Budget::Exceeded::Cancelled: return "Cancelled!";
+				case Budget::Exceeded::None: break;
+			}
+			return std::format("Budget exhausted ({})!", static_cast<int>(reason));
+		}
+	};
+}  // namespace dcs213::p1
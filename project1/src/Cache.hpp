@@ -0,0 +1,308 @@
+#pragma once
+
+#include "Lexer.hpp"
+#include "Pipeline.hpp"
+#include "Scheduler.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace dcs213::p1::cache {
+	/**
+	 * @brief Hash a token stream, ignoring whitespace.
+	 *
+	 * Only the token kinds and payloads take part, the `conj` flags (which record surrounding
+	 * spaces) do not, consistent with `Token::operator==`.
+	 *
+	 * @param ts
+	 * @return std::size_t
+	 */
+	inline static auto hash(const lex::TokenStream& ts) -> std::size_t {
+		std::uint64_t h	  = 0xcbf29ce484222325ull;
+		const auto	  mix = [&](std::uint64_t v) {
+			   h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		};
+
+		for (const auto& tok : ts) {
+			mix(tok.token.index());
+			std::visit(
+				overload {
+					[&](const lex::Number& num) {
+						mix(std::bit_cast<std::uint64_t>(num.value == 0. ? 0. : num.value));
+					},
+					[&](const lex::Operator& op) { mix(static_cast<std::uint64_t>(op)); },
+					[&](const lex::Constant& con) { mix(static_cast<std::uint64_t>(con)); },
+					[&](const lex::Variable& var) { mix(static_cast<std::uint64_t>(var.name)); },
+					[&](const lex::Function& fn) { mix(static_cast<std::uint64_t>(fn)); },
+				},
+				tok.token
+			);
+		}
+
+		return static_cast<std::size_t>(h);
+	}
+
+	struct Config {
+		std::size_t shards		 = 16;
+		std::size_t memory_limit = 16 << 20;  // bytes, split evenly over the shards
+	};
+
+	struct Stats {
+		std::uint64_t hits		= 0;
+		std::uint64_t misses	= 0;
+		std::uint64_t coalesced = 0;  // misses that waited for an in-flight computation
+		std::uint64_t evictions = 0;
+		std::size_t	  entries	= 0;
+		std::size_t	  bytes		= 0;
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("hits", hits)
+				.field("misses", misses)
+				.field("coalesced", coalesced)
+				.field("evictions", evictions)
+				.field("entries", entries)
+				.field("bytes", bytes)
+				.end_object();
+		}
+	};
+
+	/**
+	 * @brief A bounded, sharded LRU cache of pipeline outcomes keyed by token streams.
+	 *
+	 * Each shard has its own lock, LRU list and byte budget. Concurrent lookups of a key that is
+	 * still being computed wait for that computation instead of starting their own, except on
+	 * pool threads helping out in a `join`, which must not block (see `helping`). Cancelled
+	 * and transient outcomes are never cached, and whoever waited for a cancelled one retries on
+	 * its own.
+	 */
+	class ResultCache {
+	public:
+		explicit ResultCache(Config config = {}) :
+			_shards(std::max<std::size_t>(config.shards, 1)),
+			_shard_limit(config.memory_limit / std::max<std::size_t>(config.shards, 1)) {}
+
+	public:
+		/**
+		 * @brief Look up `ts`, or compute, cache and return its outcome.
+		 *
+		 * @param ts normalized key
+		 * @param compute called at most once per missing key among concurrent callers
+		 * @return pipeline::Outcome
+		 */
+		template<std::invocable F>
+		auto get_or_compute(const lex::TokenStream& ts, F&& compute) -> pipeline::Outcome {
+			while (true)
+				if (auto outcome = _get_or_compute(ts, compute))
+					return *std::move(outcome);
+		}
+
+		/**
+		 * @brief Look up `ts` without computing it on a miss.
+		 *
+		 * @param ts normalized key
+		 * @return the cached outcome, if any
+		 */
+		auto find(const lex::TokenStream& ts) -> std::optional<pipeline::Outcome> {
+			const auto h	 = hash(ts);
+			auto&	   shard = _shards[h % _shards.size()];
+			const auto key	 = KeyRef { .ts = &ts, .hash = h };
+
+			std::lock_guard lock { shard.mutex };
+			const auto		it = shard.index.find(key);
+			if (it == shard.index.end())
+				return std::nullopt;
+			shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+			++shard.stats.hits;
+			return it->second->value;
+		}
+
+		[[nodiscard]] auto stats() const -> Stats {
+			Stats total;
+			for (const auto& shard : _shards) {
+				std::lock_guard lock { shard.mutex };
+				total.hits		+= shard.stats.hits;
+				total.misses	+= shard.stats.misses;
+				total.coalesced += shard.stats.coalesced;
+				total.evictions += shard.stats.evictions;
+				total.entries	+= shard.lru.size();
+				total.bytes		+= shard.bytes;
+			}
+			return total;
+		}
+
+		auto clear() -> void {
+			for (auto& shard : _shards) {
+				std::lock_guard lock { shard.mutex };
+				shard.index.clear();
+				shard.lru.clear();
+				shard.bytes = 0;
+			}
+		}
+
+	private:
+		struct KeyRef {
+			const lex::TokenStream* ts;
+			std::size_t				hash;
+
+			inline friend auto operator==(const KeyRef& lhs, const KeyRef& rhs) -> bool {
+				return lhs.hash == rhs.hash && *lhs.ts == *rhs.ts;
+			}
+		};
+
+		struct KeyHash {
+			auto operator()(const KeyRef& key) const -> std::size_t { return key.hash; }
+		};
+
+		struct Entry {
+			lex::TokenStream  key;
+			std::size_t		  hash;
+			pipeline::Outcome value;
+			std::size_t		  bytes;
+		};
+
+		using Lru = std::list<Entry>;
+
+		struct Shard {
+			mutable std::mutex													 mutex;
+			Lru																	 lru;  // most recent first
+			std::unordered_map<KeyRef, Lru::iterator, KeyHash>					 index;
+			std::unordered_map<KeyRef, std::shared_future<pipeline::Outcome>, KeyHash> inflight;
+			std::size_t															 bytes = 0;
+			Stats																 stats;
+		};
+
+		/**
+		 * @brief One lookup attempt.
+		 *
+		 * @return the outcome, or `std::nullopt` if the computation waited for was cancelled
+		 */
+		template<std::invocable F>
+		auto _get_or_compute(const lex::TokenStream& ts, F& compute)
+			-> std::optional<pipeline::Outcome> {
+			const auto h	 = hash(ts);
+			auto&	   shard = _shards[h % _shards.size()];
+			const auto key	 = KeyRef { .ts = &ts, .hash = h };
+
+			std::promise<pipeline::Outcome> promise;
+			{
+				std::unique_lock lock { shard.mutex };
+
+				if (const auto it = shard.index.find(key); it != shard.index.end()) {
+					shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+					++shard.stats.hits;
+					return it->second->value;
+				}
+
+				if (const auto it = shard.inflight.find(key); it != shard.inflight.end()) {
+					// A helping pool thread may be computing the key lower on its own stack.
+					if (sched::ThreadPool::helping()) {
+						++shard.stats.misses;
+						lock.unlock();
+						return _compute_alone(shard, ts, h, compute);
+					}
+
+					auto future = it->second;
+					++shard.stats.coalesced;
+					lock.unlock();
+					if (auto outcome = future.get(); !outcome.cancelled)
+						return outcome;
+					return std::nullopt;
+				}
+
+				++shard.stats.misses;
+				shard.inflight.emplace(key, promise.get_future().share());
+			}
+
+			try {
+				auto outcome = std::invoke(compute);
+				{
+					std::lock_guard lock { shard.mutex };
+					shard.inflight.erase(key);
+					if (!outcome.cancelled && !outcome.transient)
+						_insert(shard, ts, h, outcome);
+				}
+				promise.set_value(outcome);
+				return outcome;
+			} catch (...) {
+				{
+					std::lock_guard lock { shard.mutex };
+					shard.inflight.erase(key);
+				}
+				promise.set_exception(std::current_exception());
+				throw;
+			}
+		}
+
+		/**
+		 * @brief Rough footprint of an entry, including list and hash nodes.
+		 *
+		 */
+		inline static auto _footprint(const lex::TokenStream& ts, const pipeline::Outcome& value)
+			-> std::size_t {
+			return sizeof(Entry) + ts.size() * sizeof(lex::Token) + value.text.size()
+				 + 4 * sizeof(void*) /* list node */ + 4 * sizeof(void*) /* hash node */;
+		}
+
+		/**
+		 * @brief Compute without coalescing, for a key that is in flight elsewhere.
+		 *
+		 */
+		template<std::invocable F>
+		auto _compute_alone(Shard& shard, const lex::TokenStream& ts, std::size_t h, F& compute)
+			-> pipeline::Outcome {
+			auto outcome = std::invoke(compute);
+
+			std::lock_guard lock { shard.mutex };
+			if (!outcome.cancelled && !outcome.transient
+				&& !shard.index.contains(KeyRef { .ts = &ts, .hash = h }))
+				_insert(shard, ts, h, outcome);
+			return outcome;
+		}
+
+		auto _insert(
+			Shard&					 shard,
+			const lex::TokenStream&	 ts,
+			std::size_t				 h,
+			const pipeline::Outcome& value
+		) -> void {
+			const auto bytes = _footprint(ts, value);
+			if (bytes > _shard_limit)
+				return;
+
+			while (shard.bytes + bytes > _shard_limit && !shard.lru.empty()) {
+				auto& victim = shard.lru.back();
+				shard.index.erase(KeyRef { .ts = &victim.key, .hash = victim.hash });
+				shard.bytes -= victim.bytes;
+				shard.lru.pop_back();
+				++shard.stats.evictions;
+			}
+
+			shard.lru.push_front(Entry {
+				.key   = lex::TokenStream(ts.begin(), ts.end()),
+				.hash  = h,
+				.value = value,
+				.bytes = bytes,
+			});
+			shard.index.emplace(KeyRef { .ts = &shard.lru.front().key, .hash = h }, shard.lru.begin());
+			shard.bytes += bytes;
+		}
+
+	private:
+		std::vector<Shard> _shards;
+		std::size_t		   _shard_limit;
+	};
+}  // namespace dcs213::p1::cache
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dcs213::p1::corpus {
+	/**
+	 * @brief Relative weights of the operators.
+	 *
+	 * `plus` to `devide` pick the operator joining two operands. The others pick what is applied
+	 * to a single operand, against `plain` for nothing: `-a`, `a^k`, `ln(a)`, `(a)'` and, for
+	 * parenthesized operands only, `(a$c)`.
+	 */
+	struct Mix {
+		double plus		  = 4.;
+		double minus	  = 2.;
+		double multiply	  = 3.;
+		double devide	  = 1.;
+		double plain	  = 8.;
+		double negate	  = 1.;
+		double exponent	  = 2.;
+		double ln		  = .5;
+		double derivative = .5;
+		double when		  = .25;
+	};
+
+	/**
+	 * @brief The shape of generated expressions.
+	 *
+	 */
+	struct Config {
+		std::uint64_t seed		   = 0;
+		std::size_t	  size		   = 64;   // operands (numbers, constants and `x`) per expression
+		std::size_t	  depth		   = 8;	   // maximum nesting of parentheses
+		std::size_t	  width		   = 8;	   // maximum operands joined at one level
+		double		  spine		   = 0.;   // chance that one operand of a level takes all but one
+		double		  numbers	   = .5;   // share of operands that are not `x`
+		double		  constants	   = .1;   // share of those that are `e` or `pi`
+		double		  decimals	   = .5;   // share of numbers with a fractional part
+		std::size_t	  digits	   = 3;	   // maximum digits before and after the point
+		std::size_t	  max_exponent = 4;	   // exponents are integers in `[0, max_exponent]`
+		double		  spaces	   = 0.;   // chance of spaces around a joining operator
+		Mix			  mix;
+	};
+
+	/**
+	 * @brief Named configurations.
+	 *
+	 * - `mixed`: a bit of everything
+	 * - `flat`: one long sum of monomials, the shape of typed-in polynomials
+	 * - `deep`: operands nested `depth` parentheses deep
+	 * - `product`: products of small sums, which expand to large polynomials
+	 * - `numeric`: long decimal numbers and constants, hardly any `x`, i.e. mostly lexing
+	 */
+	inline static constexpr std::array<std::string_view, 5> presets {
+		"mixed", "flat", "deep", "product", "numeric",
+	};
+
+	/**
+	 * @brief The configuration of a preset, with the given size and seed.
+	 *
+	 * @param name one of `presets`
+	 * @param size
+	 * @param seed
+	 * @return std::optional<Config> nothing if there is no such preset
+	 */
+	inline static auto preset(std::string_view name, std::size_t size, std::uint64_t seed = 0)
+		-> std::optional<Config> {
+		Config config { .seed = seed, .size = size, .mix = {} };
+
+		if (name == "mixed")
+			return config;
+		else if (name == "flat") {
+			config.depth = 0;
+			config.mix	 = {
+					.multiply	= 0.,
+					.devide		= 0.,
+					.negate		= 0.,
+					.ln			= 0.,
+					.derivative = 0.,
+					.when		= 0.,
+			};
+			return config;
+		} else if (name == "deep") {
+			config.depth = size;
+			config.width = 2;
+			config.spine = 1.;
+			return config;
+		} else if (name == "product") {
+			config.depth   = 2;
+			config.width   = 4;
+			config.numbers = .5;
+			config.mix	   = {
+					.plus		= 2.,
+					.minus		= 1.,
+					.multiply	= 6.,
+					.devide		= 0.,
+					.negate		= 0.,
+					.exponent	= 0.,
+					.ln			= 0.,
+					.derivative = 0.,
+					.when		= 0.,
+			};
+			return config;
+		} else if (name == "numeric") {
+			config.numbers	 = .95;
+			config.constants = .05;
+			config.decimals	 = 1.;
+			config.digits	 = 12;
+			config.depth	 = 2;
+			config.width	 = 16;
+			return config;
+		}
+
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief A seeded stream of random, grammatical expressions over `lex::Operator`.
+	 *
+	 * The same configuration gives the same expressions on every platform: only the raw output
+	 * of `std::mt19937_64` is used, none of the implementation-defined distributions.
+	 *
+	 * Expressions also evaluate: the evaluator expands everything into polynomials, so `x` is
+	 * kept out of divisors and out of `ln`, the two places it cannot be expanded from.
+	 */
+	class Generator {
+	public:
+		explicit Generator(Config config) : _config(std::move(config)), _rng(_config.seed) {}
+
+	public:
+		/**
+		 * @brief The next expression.
+		 *
+		 * @return std::string
+		 */
+		[[nodiscard]] auto next() -> std::string {
+			std::string script;
+			next(script);
+			return script;	// nrvo
+		}
+
+		/**
+		 * @brief Append the next expression to `out`, to reuse its storage.
+		 *
+		 * @param out
+		 */
+		auto next(std::string& out) -> void {
+			_expr(out, std::max<std::size_t>(_config.size, 1), _config.depth, false);
+		}
+
+		[[nodiscard]] auto config() const -> const Config& { return _config; }
+
+	private:
+		/**
+		 * @brief `leaves` operands, joined at this level and grouped in parentheses below it.
+		 *
+		 * @param constant whether to leave `x` out
+		 */
+		auto _expr(std::string& out, std::size_t leaves, std::size_t depth, bool constant)
+			-> void {
+			// Without depth left, or with a single operand, every operand is a leaf.
+			const auto	width = std::max<std::size_t>(_config.width, 2);
+			std::size_t count;
+			if (depth == 0 || leaves <= 2)
+				count = leaves;
+			else
+				count = std::min(leaves, 2 + _below(width - 1));
+
+			// Share the leaves out, one each and the rest at random, or all to one operand.
+			std::vector<std::size_t> shares(count, 1);
+			if (count < leaves) {
+				if (_chance(_config.spine))
+					shares[_below(count)] += leaves - count;
+				else
+					for (auto rest = leaves - count; rest > 0; --rest) ++shares[_below(count)];
+			}
+
+			for (std::size_t i = 0; i < count; ++i) {
+				// A divisor is the operand right after `/`, nothing binds tighter than a group.
+				const auto divisor = i > 0 && _join(out) == '/';
+				if (shares[i] == 1)
+					_leaf(out, constant || divisor);
+				else
+					_group(out, shares[i], depth - 1, constant || divisor);
+			}
+		}
+
+		/**
+		 * @brief Append a joining operator.
+		 *
+		 * @return the operator
+		 */
+		auto _join(std::string& out) -> char {
+			const auto& mix = _config.mix;
+			const auto	op	= "+-*/"[_pick({ mix.plus, mix.minus, mix.multiply, mix.devide })];
+			if (_chance(_config.spaces)) {
+				out += ' ';
+				out += op;
+				out += ' ';
+			} else
+				out += op;
+			return op;
+		}
+
+		/**
+		 * @brief A parenthesized expression, maybe with an operator applied to it.
+		 *
+		 */
+		auto _group(std::string& out, std::size_t leaves, std::size_t depth, bool constant)
+			-> void {
+			const auto& mix = _config.mix;
+			switch (_pick({ mix.plain, mix.negate, mix.exponent, mix.ln, mix.derivative, mix.when })
+			) {
+				case 1: out += '-'; [[fallthrough]];
+				case 0:
+					out += '(';
+					_expr(out, leaves, depth, constant);
+					out += ')';
+					break;
+				case 2:
+					out += '(';
+					_expr(out, leaves, depth, constant);
+					out += ")^";
+					_integer(out, _below(_config.max_exponent + 1));
+					break;
+				case 3:
+					out += "ln(";
+					_expr(out, leaves, depth, true);
+					out += ')';
+					break;
+				case 4:
+					out += '(';
+					_expr(out, leaves, depth, constant);
+					out += ")'";
+					break;
+				case 5:
+					out += '(';
+					_expr(out, leaves, depth, constant);
+					out += '$';
+					_number(out);
+					out += ')';
+					break;
+			}
+		}
+
+		/**
+		 * @brief A number, constant or `x`, maybe with an operator applied to it.
+		 *
+		 */
+		auto _leaf(std::string& out, bool constant) -> void {
+			const auto& mix	  = _config.mix;
+			const auto	plain = mix.plain + mix.when;  // `$` only applies to groups
+			switch (_pick({ plain, mix.negate, mix.exponent, mix.ln, mix.derivative })) {
+				case 0: _atom(out, constant); break;
+				case 1:
+					out += '-';
+					_atom(out, constant);
+					break;
+				case 2:
+					_atom(out, constant);
+					out += '^';
+					_integer(out, _below(_config.max_exponent + 1));
+					break;
+				case 3:
+					out += "ln(";
+					_atom(out, true);
+					out += ')';
+					break;
+				case 4:
+					_atom(out, constant);
+					out += '\'';
+					break;
+			}
+		}
+
+		auto _atom(std::string& out, bool constant) -> void {
+			if (!_chance(_config.numbers) && !constant)
+				out += 'x';
+			else if (_chance(_config.constants))
+				out += _chance(.5) ? "e" : "pi";
+			else
+				_number(out);
+		}
+
+		auto _number(std::string& out) -> void {
+			const auto digits = std::max<std::size_t>(_config.digits, 1);
+
+			_digits(out, 1 + _below(digits), true);
+			if (_chance(_config.decimals)) {
+				out += '.';
+				_digits(out, 1 + _below(digits), false);
+			}
+		}
+
+		auto _digits(std::string& out, std::size_t n, bool leading) -> void {
+			for (std::size_t i = 0; i < n; ++i) {
+				const auto digit = leading && i == 0 && n > 1 ? 1 + _below(9) : _below(10);
+				out += static_cast<char>('0' + digit);
+			}
+		}
+
+		auto _integer(std::string& out, std::uint64_t value) -> void {
+			out += std::to_string(value);
+		}
+
+		/**
+		 * @brief Uniform in `[0, n)`, `n > 0`. The modulo bias is negligible for small `n`.
+		 *
+		 */
+		auto _below(std::uint64_t n) -> std::uint64_t { return _rng() % n; }
+
+		auto _chance(double p) -> bool {
+			return static_cast<double>(_rng() >> 11) * 0x1.0p-53 < p;
+		}
+
+		/**
+		 * @brief An index drawn in proportion to `weights`, the first one if they are all zero.
+		 *
+		 */
+		template<std::size_t N>
+		auto _pick(const double (&weights)[N]) -> std::size_t {
+			double total = 0.;
+			for (const auto w : weights) total += w;
+			if (!(total > 0.))
+				return 0;
+
+			auto point = static_cast<double>(_rng() >> 11) * 0x1.0p-53 * total;
+			for (std::size_t i = 0; i + 1 < N; ++i)
+				if ((point -= weights[i]) < 0.)
+					return i;
+			return N - 1;
+		}
+
+	private:
+		Config			_config;
+		std::mt19937_64 _rng;
+	};
+}  // namespace dcs213::p1::corpus
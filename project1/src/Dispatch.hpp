@@ -0,0 +1,506 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define DCS213_P1_X86
+#	include <immintrin.h>
+#	if defined _MSC_VER
+#		include <intrin.h>
+#	endif
+#endif
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string_view>
+
+/**
+ * @brief Compile one function for an instruction set beyond the baseline of the build, e.g.
+ * `DCS213_P1_TARGET("avx2")`. MSVC needs no flag to emit any of them.
+ *
+ * Kernels with floating point arithmetic also get `DCS213_P1_NO_CONTRACT`, so that GCC does
+ * not fuse multiplies and adds where the target has FMA: every implementation of a kernel
+ * rounds the same way, and gives bit for bit the same results.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#	define DCS213_P1_TARGET(isa) __attribute__((target(isa)))
+#else
+#	define DCS213_P1_TARGET(isa)
+#endif
+#if defined(__GNUC__) && !defined(__clang__)
+#	define DCS213_P1_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#	define DCS213_P1_NO_CONTRACT
+#endif
+
+/**
+ * @brief Hot kernels with one implementation per instruction set, chosen once at run time.
+ *
+ * Every implementation is compiled into every build; `kernels()` detects what the CPU
+ * supports on first use and fills a table of function pointers with the best implementation
+ * of each kernel. `DCS213_P1_KERNELS` caps the choice for testing, either for all kernels, as
+ * `DCS213_P1_KERNELS=sse4.2`, or per kernel, as `DCS213_P1_KERNELS=escape=scalar,horner=avx2`.
+ * A cap above what the CPU supports has no effect.
+ */
+namespace dcs213::p1::dispatch {
+	enum class Level : std::uint8_t {
+		Scalar,
+		SSE2,
+		SSE42,
+		AVX2,
+		AVX512,	 // F and BW
+	};
+
+	inline static constexpr auto to_string(Level level) -> std::string_view {
+		switch (level) {
+			case Level::Scalar: return "scalar";
+			case Level::SSE2: return "sse2";
+			case Level::SSE42: return "sse4.2";
+			case Level::AVX2: return "avx2";
+			case Level::AVX512: return "avx512";
+		}
+		return "?";
+	}
+
+	enum class Kernel : std::uint8_t {
+		Horner,
+		Digits,
+		Escape,
+		Math,
+	};
+
+	inline static constexpr std::size_t kernel_count = 4;
+
+	inline static constexpr auto to_string(Kernel kernel) -> std::string_view {
+		switch (kernel) {
+			case Kernel::Horner: return "horner";
+			case Kernel::Digits: return "digits";
+			case Kernel::Escape: return "escape";
+			case Kernel::Math: return "math";
+		}
+		return "?";
+	}
+
+	/**
+	 * @brief `ys[i]` = the polynomial of coefficients `coefs[0..n_coefs)`, by exponent, at
+	 * `xs[i]`, by Horner's rule, for `i < n`. `n_coefs > 0`.
+	 *
+	 */
+	using HornerFn = void (*)(
+		const double* coefs,
+		std::size_t	  n_coefs,
+		const double* xs,
+		double*		  ys,
+		std::size_t	  n
+	);
+
+	/**
+	 * @brief The first position of `[first, last)` that stops a scan, `last` if none does.
+	 *
+	 */
+	using ScanFn = const char* (*)(const char* first, const char* last);
+
+	struct Kernels {
+		HornerFn horner;  // batch evaluation of dense polynomials
+		ScanFn	 digits;  // stops at the first byte that is not a decimal digit
+		ScanFn	 escape;  // stops at the first byte a JSON string has to escape
+
+		// Of the chosen implementations, by `Kernel`. The batch functions of `math::batch` have
+		// a table per level, and look theirs up by the level of `Kernel::Math`.
+		std::array<Level, kernel_count> levels;
+
+		[[nodiscard]] auto level(Kernel kernel) const -> Level {
+			return levels[static_cast<std::size_t>(kernel)];
+		}
+	};
+
+	namespace details {
+		inline static constexpr auto is_digit(char c) -> bool {
+			return '0' <= c && c <= '9';
+		}
+
+		inline static constexpr auto needs_escape(char c) -> bool {
+			return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+		}
+
+		// Horner
+
+		DCS213_P1_NO_CONTRACT inline auto horner_scalar(
+			const double* coefs,
+			std::size_t	  n_coefs,
+			const double* xs,
+			double*		  ys,
+			std::size_t	  n
+		) -> void {
+			constexpr std::size_t block = 256;	// points kept in L1 at once
+
+			// The loop over points is innermost, so that the compiler vectorizes it for the
+			// baseline of the build.
+			for (std::size_t begin = 0; begin < n; begin += block) {
+				const auto	  m = std::min(block, n - begin);
+				const double* x = xs + begin;
+				double*		  y = ys + begin;
+
+				std::fill_n(y, m, coefs[n_coefs - 1]);
+				for (auto k = n_coefs - 1; k-- > 0;) {
+					const auto c = coefs[k];
+					for (std::size_t i = 0; i < m; ++i) y[i] = y[i] * x[i] + c;
+				}
+			}
+		}
+
+#ifdef DCS213_P1_X86
+		/**
+		 * @brief Horner's rule on `Lanes` vectors of points at once, which keeps that many
+		 * independent multiply-add chains in flight. Leftover points go through the scalar loop,
+		 * which rounds the same way.
+		 *
+		 */
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto horner_avx2(
+			const double* coefs,
+			std::size_t	  n_coefs,
+			const double* xs,
+			double*		  ys,
+			std::size_t	  n
+		) -> void {
+			constexpr std::size_t lanes = 4, vectors = 4, step = lanes * vectors;
+
+			std::size_t i = 0;
+			for (; i + step <= n; i += step) {
+				__m256d x[vectors], y[vectors];
+				for (std::size_t v = 0; v < vectors; ++v) {
+					x[v] = _mm256_loadu_pd(xs + i + v * lanes);
+					y[v] = _mm256_set1_pd(coefs[n_coefs - 1]);
+				}
+				for (auto k = n_coefs - 1; k-- > 0;) {
+					const auto c = _mm256_set1_pd(coefs[k]);
+					for (std::size_t v = 0; v < vectors; ++v)
+						y[v] = _mm256_add_pd(_mm256_mul_pd(y[v], x[v]), c);
+				}
+				for (std::size_t v = 0; v < vectors; ++v)
+					_mm256_storeu_pd(ys + i + v * lanes, y[v]);
+			}
+
+			if (i < n)
+				horner_scalar(coefs, n_coefs, xs + i, ys + i, n - i);
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT inline auto horner_avx512(
+			const double* coefs,
+			std::size_t	  n_coefs,
+			const double* xs,
+			double*		  ys,
+			std::size_t	  n
+		) -> void {
+			constexpr std::size_t lanes = 8, vectors = 4, step = lanes * vectors;
+
+			std::size_t i = 0;
+			for (; i + step <= n; i += step) {
+				__m512d x[vectors], y[vectors];
+				for (std::size_t v = 0; v < vectors; ++v) {
+					x[v] = _mm512_loadu_pd(xs + i + v * lanes);
+					y[v] = _mm512_set1_pd(coefs[n_coefs - 1]);
+				}
+				for (auto k = n_coefs - 1; k-- > 0;) {
+					const auto c = _mm512_set1_pd(coefs[k]);
+					for (std::size_t v = 0; v < vectors; ++v)
+						y[v] = _mm512_add_pd(_mm512_mul_pd(y[v], x[v]), c);
+				}
+				for (std::size_t v = 0; v < vectors; ++v)
+					_mm512_storeu_pd(ys + i + v * lanes, y[v]);
+			}
+
+			if (i < n)
+				horner_scalar(coefs, n_coefs, xs + i, ys + i, n - i);
+		}
+#endif
+
+		// Digits
+
+		inline auto digits_scalar(const char* first, const char* last) -> const char* {
+			while (first != last && is_digit(*first)) ++first;
+			return first;
+		}
+
+#ifdef DCS213_P1_X86
+		DCS213_P1_TARGET("sse4.2")
+		inline auto digits_sse42(const char* first, const char* last) -> const char* {
+			constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY
+							   | _SIDD_LEAST_SIGNIFICANT;
+			const auto range = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+			while (last - first >= 16) {
+				const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+				const auto index = _mm_cmpestri(range, 2, chunk, 16, mode);	 // 16 if all digits
+				first			+= index;
+				if (index < 16)
+					return first;
+			}
+			return digits_scalar(first, last);
+		}
+
+		DCS213_P1_TARGET("avx2")
+		inline auto digits_avx2(const char* first, const char* last) -> const char* {
+			const auto zero = _mm256_set1_epi8('0');
+			const auto nine = _mm256_set1_epi8(9);
+
+			while (last - first >= 32) {
+				const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+				const auto value = _mm256_sub_epi8(chunk, zero);
+				const auto digit = _mm256_cmpeq_epi8(_mm256_min_epu8(value, nine), value);
+				const auto mask	 = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(digit));
+				if (mask != 0)
+					return first + std::countr_zero(mask);
+				first += 32;
+			}
+			return digits_scalar(first, last);
+		}
+#endif
+
+		// Escape
+
+		inline auto escape_scalar(const char* first, const char* last) -> const char* {
+			while (first != last && !needs_escape(*first)) ++first;
+			return first;
+		}
+
+#ifdef DCS213_P1_X86
+		DCS213_P1_TARGET("sse2")
+		inline auto escape_sse2(const char* first, const char* last) -> const char* {
+			const auto quote	 = _mm_set1_epi8('"');
+			const auto backslash = _mm_set1_epi8('\\');
+			const auto control	 = _mm_set1_epi8(0x1f);
+
+			while (last - first >= 16) {
+				const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+				// `chunk <= 0x1f` is unsigned through `min`.
+				const auto hits	 = _mm_or_si128(
+					 _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+					 _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk)
+				 );
+				if (const auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits)); mask != 0)
+					return first + std::countr_zero(mask);
+				first += 16;
+			}
+			return escape_scalar(first, last);
+		}
+
+		DCS213_P1_TARGET("avx2")
+		inline auto escape_avx2(const char* first, const char* last) -> const char* {
+			const auto quote	 = _mm256_set1_epi8('"');
+			const auto backslash = _mm256_set1_epi8('\\');
+			const auto control	 = _mm256_set1_epi8(0x1f);
+
+			while (last - first >= 32) {
+				const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+				const auto hits	 = _mm256_or_si256(
+					 _mm256_or_si256(
+						 _mm256_cmpeq_epi8(chunk, quote),
+						 _mm256_cmpeq_epi8(chunk, backslash)
+					 ),
+					 _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk)
+				 );
+				if (const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(hits)))
+					return first + std::countr_zero(mask);
+				first += 32;
+			}
+			return escape_sse2(first, last);
+		}
+
+		DCS213_P1_TARGET("avx512f,avx512bw")
+		inline auto escape_avx512(const char* first, const char* last) -> const char* {
+			const auto quote	 = _mm512_set1_epi8('"');
+			const auto backslash = _mm512_set1_epi8('\\');
+			const auto control	 = _mm512_set1_epi8(0x1f);
+
+			while (last - first >= 64) {
+				const auto chunk = _mm512_loadu_si512(first);
+				const auto hits	 = _mm512_cmpeq_epi8_mask(chunk, quote)
+								| _mm512_cmpeq_epi8_mask(chunk, backslash)
+								| _mm512_cmple_epu8_mask(chunk, control);
+				if (hits != 0)
+					return first + std::countr_zero(static_cast<std::uint64_t>(hits));
+				first += 64;
+			}
+			return escape_avx2(first, last);
+		}
+#endif
+
+		/**
+		 * @brief The implementations of a kernel, by ascending level.
+		 *
+		 */
+		template<typename F>
+		struct Candidate {
+			Level level;
+			F	  fn;
+		};
+
+		inline static constexpr Candidate<HornerFn> horners[] {
+			{ Level::Scalar, &horner_scalar },
+#ifdef DCS213_P1_X86
+			{ Level::AVX2, &horner_avx2 },
+			{ Level::AVX512, &horner_avx512 },
+#endif
+		};
+
+		inline static constexpr Candidate<ScanFn> digits[] {
+			{ Level::Scalar, &digits_scalar },
+#ifdef DCS213_P1_X86
+			{ Level::SSE42, &digits_sse42 },
+			{ Level::AVX2, &digits_avx2 },
+#endif
+		};
+
+		// Implemented by `math::batch`, only the level is chosen here.
+		inline static constexpr Candidate<std::nullptr_t> maths[] {
+			{ Level::Scalar, nullptr },
+#ifdef DCS213_P1_X86
+			{ Level::AVX2, nullptr },
+			{ Level::AVX512, nullptr },
+#endif
+		};
+
+		inline static constexpr Candidate<ScanFn> escapes[] {
+			{ Level::Scalar, &escape_scalar },
+#ifdef DCS213_P1_X86
+			{ Level::SSE2, &escape_sse2 },
+			{ Level::AVX2, &escape_avx2 },
+			{ Level::AVX512, &escape_avx512 },
+#endif
+		};
+
+		/**
+		 * @brief The best implementation up to `cap`. The scalar one always qualifies.
+		 *
+		 */
+		template<typename F, std::size_t N>
+		inline auto pick(const Candidate<F> (&candidates)[N], Level cap) -> Candidate<F> {
+			auto best = candidates[0];
+			for (const auto& candidate : candidates)
+				if (candidate.level <= cap)
+					best = candidate;
+			return best;
+		}
+
+		inline auto parse_level(std::string_view name) -> std::optional<Level> {
+			for (const auto level :
+				 { Level::Scalar, Level::SSE2, Level::SSE42, Level::AVX2, Level::AVX512 })
+				if (name == to_string(level))
+					return level;
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief Apply `DCS213_P1_KERNELS`-style caps to `caps`; malformed entries are ignored.
+		 *
+		 */
+		inline auto parse_caps(std::string_view spec, std::array<Level, kernel_count>& caps)
+			-> void {
+			while (!spec.empty()) {
+				const auto comma = spec.find(',');
+				const auto entry = spec.substr(0, comma);
+				spec			 = comma == std::string_view::npos ? "" : spec.substr(comma + 1);
+
+				const auto eq = entry.find('=');
+				if (eq == std::string_view::npos) {
+					if (const auto level = parse_level(entry))
+						caps.fill(*level);
+					continue;
+				}
+
+				const auto level = parse_level(entry.substr(eq + 1));
+				for (std::size_t k = 0; level && k < kernel_count; ++k)
+					if (entry.substr(0, eq) == to_string(static_cast<Kernel>(k)))
+						caps[k] = *level;
+			}
+		}
+	}  // namespace details
+
+	/**
+	 * @brief The highest level the CPU and the OS support.
+	 *
+	 * @return Level
+	 */
+	inline auto detect() -> Level {
+#if defined DCS213_P1_X86 && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+			return Level::AVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return Level::AVX2;
+		if (__builtin_cpu_supports("sse4.2"))
+			return Level::SSE42;
+		if (__builtin_cpu_supports("sse2"))
+			return Level::SSE2;
+		return Level::Scalar;
+#elif defined DCS213_P1_X86 && defined _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		const auto max_leaf = info[0];
+
+		__cpuid(info, 1);
+		const bool sse2	   = (info[3] & (1 << 26)) != 0;
+		const bool sse42   = (info[2] & (1 << 20)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+
+		bool avx2 = false, avx512 = false;
+		if (osxsave && max_leaf >= 7) {
+			const auto xcr0 = _xgetbv(0);
+			__cpuidex(info, 7, 0);
+			avx2   = (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+			avx512 = (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0
+				  && (info[1] & (1 << 30)) != 0;
+		}
+
+		return avx512 ? Level::AVX512
+			 : avx2	  ? Level::AVX2
+			 : sse42  ? Level::SSE42
+			 : sse2	  ? Level::SSE2
+					  : Level::Scalar;
+#else
+		return Level::Scalar;
+#endif
+	}
+
+	/**
+	 * @brief Choose the implementation of every kernel for a CPU, within the caps of `spec`.
+	 *
+	 * @param cpu
+	 * @param spec as `DCS213_P1_KERNELS`
+	 * @return Kernels
+	 */
+	inline auto select(Level cpu, std::string_view spec = {}) -> Kernels {
+		std::array<Level, kernel_count> caps;
+		caps.fill(cpu);
+		details::parse_caps(spec, caps);
+		for (auto& cap : caps) cap = std::min(cap, cpu);
+
+		const auto horner = details::pick(details::horners, caps[0]);
+		const auto digits = details::pick(details::digits, caps[1]);
+		const auto escape = details::pick(details::escapes, caps[2]);
+		const auto math	  = details::pick(details::maths, caps[3]);
+		return {
+			.horner = horner.fn,
+			.digits = digits.fn,
+			.escape = escape.fn,
+			.levels = { horner.level, digits.level, escape.level, math.level },
+		};
+	}
+
+	/**
+	 * @brief The kernels of this process, chosen on the first call.
+	 *
+	 * @return const Kernels&
+	 */
+	inline auto kernels() -> const Kernels& {
+		static const Kernels kernels = [] {
+			const auto spec = std::getenv("DCS213_P1_KERNELS");
+			return select(detect(), spec ? spec : "");
+		}();
+		return kernels;
+	}
+}  // namespace dcs213::p1::dispatch
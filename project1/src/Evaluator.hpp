@@ -1,10 +1,23 @@
 #pragma once
 
+#include "Alloc.hpp"
+#include "Budget.hpp"
 #include "Lexer.hpp"
+#include "MPoly.hpp"
+#include "Math.hpp"
 #include "Parser.hpp"
+#include "Scheduler.hpp"
+#include "Trace.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <functional>
 #include <optional>
+#include <span>
+#include <tuple>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace dcs213::p1::evaluate {
@@ -122,29 +135,102 @@ namespace dcs213::p1::evaluate {
 			return res;	 // nrvo
 		}
 
+		/**
+		 * @brief Multiply two polynomials.
+		 *
+		 * Dense integral operands are accumulated into a flat coefficient array, anything else
+		 * (high degree gaps, fractional or negative exponents) goes through Johnson's heap-based
+		 * sparse multiplication. Both produce already sorted terms, so no re-sort is needed.
+		 */
 		inline friend auto operator*(const TermList& lhs, const TermList& rhs) -> TermList {
-			TermList						   res;
+			if (lhs.empty() || rhs.empty())
+				return {};
 
-			std::unordered_map<double, double> terms;
+			TermList	lhs_sorted;
+			TermList	rhs_sorted;
+			const auto& l = lhs._is_sorted() ? lhs : (lhs_sorted = TermList { lhs }._sorted());
+			const auto& r = rhs._is_sorted() ? rhs : (rhs_sorted = TermList { rhs }._sorted());
 
-			for (const auto& [c1, e1] : lhs)
-				for (const auto& [c2, e2] : rhs) {
-					const auto e = e1 + e2;
-					if (terms.find(e) != terms.end())
-						terms[e] += c1 * c2;
-					else
-						terms[e] = c1 * c2;
-				}
+			if (_is_dense_product(l, r))
+				return _mul_dense(l, r);
+			else
+				return _mul_heap(l, r);
+		}
 
-			res.reserve(terms.size());
+		/**
+		 * @brief Add up many polynomials at once.
+		 *
+		 * A k-way merge over the (sorted) lists, so the sum of `k` lists with `n` terms in total
+		 * costs O(n log k) instead of the O(n k) of folding `+`.
+		 *
+		 * @param lists
+		 * @return TermList
+		 */
+		[[nodiscard]] inline static auto merge(std::vector<TermList> lists) -> TermList {
+			struct Cursor {
+				double		expo;
+				std::size_t list;
+				std::size_t index;
+			};
+
+			// Equal exponents are summed in list order, like folding `+` would.
+			const auto later = [](const Cursor& a, const Cursor& b) {
+				return std::tie(a.expo, a.list, a.index) > std::tie(b.expo, b.list, b.index);
+			};
+
+			std::vector<Cursor> heap;
+			std::size_t			total = 0;
+			heap.reserve(lists.size());
+			for (std::size_t i = 0; i < lists.size(); ++i) {
+				if (lists[i].empty())
+					continue;
+				if (!lists[i]._is_sorted())
+					lists[i]._sort_self();
+				heap.push_back({ lists[i][0].expo, i, 0 });
+				total += lists[i].size();
+			}
+			std::ranges::make_heap(heap, later);
 
-			for (const auto& [e, c] : terms) res.emplace_back(c, e);
+			TermList res;
+			res.reserve(total);
 
-			res._sort_self();
+			while (!heap.empty()) {
+				std::ranges::pop_heap(heap, later);
+				auto&		cur	 = heap.back();
+				const auto& term = lists[cur.list][cur.index];
+
+				if (!res.empty() && res.back().expo == cur.expo)
+					res.back().coef += term.coef;
+				else
+					res.emplace_back(term.coef, cur.expo);
+
+				if (++cur.index < lists[cur.list].size()) {
+					cur.expo = lists[cur.list][cur.index].expo;
+					std::ranges::push_heap(heap, later);
+				} else
+					heap.pop_back();
+			}
 
 			return res;	 // nrvo
 		}
 
+		/**
+		 * @brief An upper bound on the number of terms of `lhs * rhs`, to charge up front.
+		 *
+		 * With integral exponents, the product has at most one term per exponent in its span.
+		 */
+		[[nodiscard]] inline static auto product_bound(const TermList& lhs, const TermList& rhs)
+			-> std::size_t {
+			const auto products = lhs.size() * rhs.size();
+			if (products == 0 || !_integral(lhs) || !_integral(rhs))
+				return products;
+
+			const auto [lmin, lmax] = std::ranges::minmax(lhs, {}, &Term::expo);
+			const auto [rmin, rmax] = std::ranges::minmax(rhs, {}, &Term::expo);
+			const auto span			= (lmax.expo - lmin.expo) + (rmax.expo - rmin.expo) + 1.;
+			return span < static_cast<double>(products) ? static_cast<std::size_t>(span) : products;
+		}
+
 		[[nodiscard]] auto derivative() const -> std::optional<TermList> {
 			TermList terms;
 			terms.reserve(size());
@@ -179,6 +265,134 @@ namespace dcs213::p1::evaluate {
 		}
 
 	private:
+		inline static constexpr std::size_t dense_span_factor = 4;
+		inline static constexpr std::size_t dense_span_limit  = 1 << 20;
+
+		[[nodiscard]] auto _is_sorted() const -> bool {
+			return std::ranges::is_sorted(*this, {}, &Term::expo);
+		}
+
+		[[nodiscard]] auto _sorted() && -> TermList {
+			_sort_self();
+			return std::move(*this);
+		}
+
+		[[nodiscard]] inline static auto _integral(const TermList& terms) -> bool {
+			return std::ranges::all_of(terms, [](const Term& t) {
+				return std::isfinite(t.expo) && t.expo == std::trunc(t.expo);
+			});
+		}
+
+		/**
+		 * @brief Whether the product of two sorted lists is worth a flat coefficient array.
+		 *
+		 * Only integral exponents can be indexed, and the output span has to be comparable to
+		 * the number of input terms, otherwise most of the array would stay untouched.
+		 */
+		[[nodiscard]] inline static auto _is_dense_product(const TermList& lhs, const TermList& rhs)
+			-> bool {
+			if (!_integral(lhs) || !_integral(rhs))
+				return false;
+
+			const auto span = (lhs.back().expo - lhs.front().expo)
+							+ (rhs.back().expo - rhs.front().expo) + 1.;
+
+			return span <= static_cast<double>(dense_span_limit)
+				&& span <= static_cast<double>(dense_span_factor * (lhs.size() + rhs.size()));
+		}
+
+		/**
+		 * @brief Schoolbook multiplication into a flat coefficient array.
+		 *
+		 * Exponents that are hit by some product are kept even if their coefficients cancel, the
+		 * same as the sparse path does.
+		 */
+		[[nodiscard]] inline static auto _mul_dense(const TermList& lhs, const TermList& rhs)
+			-> TermList {
+			const auto base = lhs.front().expo + rhs.front().expo;
+			const auto span = static_cast<std::size_t>(
+				(lhs.back().expo - lhs.front().expo) + (rhs.back().expo - rhs.front().expo) + 1.
+			);
+
+			std::vector<double> coefs(span, 0.);
+			std::vector<bool>	hit(span, false);
+
+			for (const auto& [c1, e1] : lhs)
+				for (const auto& [c2, e2] : rhs) {
+					const auto idx	= static_cast<std::size_t>(e1 + e2 - base);
+					coefs[idx]	   += c1 * c2;
+					hit[idx]		= true;
+				}
+
+			TermList res;
+			res.reserve(std::min(span, lhs.size() * rhs.size()));
+
+			for (std::size_t i = 0; i < span; ++i)
+				if (hit[i])
+					res.emplace_back(coefs[i], base + static_cast<double>(i));
+
+			return res;	 // nrvo
+		}
+
+		/**
+		 * @brief Johnson's heap-based sparse multiplication.
+		 *
+		 * Keeps one cursor into `rhs` per term of the shorter operand, and a min-heap over the
+		 * exponents those cursors currently point at. Products therefore pop out in exponent
+		 * order and equal exponents are adjacent, so they merge on the fly with only
+		 * O(min(n, m)) extra memory.
+		 *
+		 * Equal exponents are summed in the order of the schoolbook product, by `lhs` index,
+		 * which is descending along the shorter operand when it is `rhs` (`swapped`).
+		 */
+		[[nodiscard]] inline static auto _mul_heap(
+			const TermList& lhs,
+			const TermList& rhs,
+			bool			swapped = false
+		) -> TermList {
+			if (lhs.size() > rhs.size())
+				return _mul_heap(rhs, lhs, true);
+
+			struct Cursor {
+				double		expo;
+				std::size_t i;	// index into `lhs`
+				std::size_t j;	// index into `rhs`
+			};
+
+			const auto later = [swapped](const Cursor& a, const Cursor& b) {
+				if (a.expo != b.expo)
+					return a.expo > b.expo;
+				return swapped ? a.i < b.i : a.i > b.i;
+			};
+
+			std::vector<Cursor> heap;
+			heap.reserve(lhs.size());
+			for (std::size_t i = 0; i < lhs.size(); ++i)
+				heap.push_back({ lhs[i].expo + rhs[0].expo, i, 0 });
+			std::ranges::make_heap(heap, later);
+
+			TermList res;
+
+			while (!heap.empty()) {
+				std::ranges::pop_heap(heap, later);
+				auto& cur  = heap.back();
+				auto  coef = lhs[cur.i].coef * rhs[cur.j].coef;
+
+				if (!res.empty() && res.back().expo == cur.expo)
+					res.back().coef += coef;
+				else
+					res.emplace_back(coef, cur.expo);
+
+				if (++cur.j < rhs.size()) {
+					cur.expo = lhs[cur.i].expo + rhs[cur.j].expo;
+					std::ranges::push_heap(heap, later);
+				} else
+					heap.pop_back();
+			}
+
+			return res;	 // nrvo
+		}
+
 		auto _sort_self() -> void { _sort_self(0, size()); }
 
 		auto _sort_self(std::size_t l, std::size_t r) -> void {
@@ -237,51 +451,125 @@ namespace dcs213::p1::evaluate {
 		}
 	};
 
-	inline static auto eval_con(const parse::Expr& expr) -> std::optional<double>;
+	inline static auto eval_con(const parse::Expr& expr, Budget& budget) -> std::optional<double>;
+	inline static auto eval_term(const parse::Expr& expr, Budget& budget) -> std::optional<Term>;
+	inline static auto eval_termlist(const parse::Expr& expr, Budget& budget)
+		-> std::optional<TermList>;
+	inline static auto eval_termlist_calc(const parse::Expr& expr, Budget& budget)
+		-> std::optional<TermList>;
+	inline static auto eval_point(const parse::Expr& expr, double x, Budget& budget)
+		-> std::optional<double>;
+	inline static auto eval_mpoly(const parse::Expr& expr, const Ring& ring, Budget& budget)
+		-> std::optional<MPoly>;
+
+	/**
+	 * @brief Run an evaluation pass over `expr`, through the observer of the budget if any.
+	 *
+	 * @param expr
+	 * @param budget
+	 * @param pass
+	 * @param f the pass, returning an optional `double`, `Term`, `TermList` or `MPoly`
+	 * @return the result of `f`
+	 */
+	template<std::invocable F>
+	inline static auto observe(
+		const parse::Expr&	   expr,
+		Budget&				   budget,
+		Budget::Observer::Pass pass,
+		F&&					   f
+	) -> std::invoke_result_t<F> {
+		const auto observer = budget.observer();
+		if (!observer) [[likely]]
+			return std::invoke(std::forward<F>(f));
+
+		observer->enter(&expr, pass);
+		auto res = std::invoke(std::forward<F>(f));
+
+		std::optional<std::size_t> terms;
+		using T = typename decltype(res)::value_type;
+		if constexpr (std::same_as<T, TermList> || std::same_as<T, MPoly>) {
+			if (res)
+				terms = res->size();
+		} else if (res)
+			terms = 1;
+		observer->leave(&expr, pass, terms);
+		return res;
+	}
+
 	inline static auto eval_var(const parse::Expr& expr) -> parse::Expr;
 
-	inline static auto eval_nocoef_term(const parse::Expr& expr) -> std::optional<double> {
+	/**
+	 * @brief Whether `expr` is the variable `x`, the one univariate polynomials are in.
+	 *
+	 * @param expr
+	 * @return bool
+	 */
+	inline static auto is_x(const parse::Expr& expr) -> bool {
+		const auto var = expr.get_if<parse::Variable>();
+		return var && var->name == 'x';
+	}
+
+	inline static auto eval_nocoef_term(const parse::Expr& expr, Budget& budget)
+		-> std::optional<double> {
 		// std::cout << std::format("parsing nocoef term: {}\n", expr.to_string());
 		if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
 			if (binop->op == lex::Operator::Exponent) {
-				if (binop->lhs->is<parse::Variable>()) {
-					if (auto expo = eval_con(*binop->rhs))
+				if (is_x(*binop->lhs)) {
+					if (auto expo = eval_con(*binop->rhs, budget))
 						return *expo;
 				}
-				if (binop->rhs->is<parse::Variable>()) {
-					if (auto expo = eval_con(*binop->rhs))
+				if (is_x(*binop->rhs)) {
+					if (auto expo = eval_con(*binop->rhs, budget))
 						return *expo;
 				}
 			}
 		}
-		if (const auto var = expr.get_if<parse::Variable>())
+		if (is_x(expr))
 			return 1.;
 
 		return std::nullopt;
 	}
 
-	inline static auto eval_term(const parse::Expr& expr) -> std::optional<Term> {
+	inline static auto eval_term_impl(const parse::Expr& expr, Budget& budget)
+		-> std::optional<Term> {
 		// std::cout << std::format("parsing term: {}\n", expr.to_string());
+		if (const auto prod = expr.get_if<parse::ProductExpr>()) {	// c1 * x ^ e / c2 * ...
+			Term term { .coef = 1., .expo = 0. };
+			bool has_var = false;
+
+			for (const auto& [op, operand] : prod->operands)
+				if (const auto coef = eval_con(*operand, budget))
+					term.coef = op == lex::Operator::Devide ? term.coef / *coef : term.coef * *coef;
+				else if (const auto expo = eval_nocoef_term(*operand, budget);
+						 expo && !has_var && op == lex::Operator::Multiply) {
+					term.expo = *expo;
+					has_var	  = true;
+				} else
+					return std::nullopt;
+
+			return term;
+		}
+
 		if (const auto binop = expr.get_if<parse::BinOpExpr>())
 			if (binop->op == lex::Operator::Multiply) {	 // c * x ^ e
-				if (const auto expo = eval_nocoef_term(*binop->lhs))
-					if (auto coef = eval_con(*binop->rhs))
+				if (const auto expo = eval_nocoef_term(*binop->lhs, budget))
+					if (auto coef = eval_con(*binop->rhs, budget))
 						return Term {
 							.coef = *coef,
 							.expo = *expo,
 						};
 
-				if (const auto expo = eval_nocoef_term(*binop->rhs))
-					if (auto coef = eval_con(*binop->lhs))
+				if (const auto expo = eval_nocoef_term(*binop->rhs, budget))
+					if (auto coef = eval_con(*binop->lhs, budget))
 						return Term {
 							.coef = *coef,
 							.expo = *expo,
 						};
 			}
 
-		if (auto expo = eval_nocoef_term(expr))					   // x ^ e
+		if (auto expo = eval_nocoef_term(expr, budget))			   // x ^ e
 			return Term { .coef = 1., .expo = *expo };
-		else if (const auto var = expr.get_if<parse::Variable>())  // x
+		else if (is_x(expr))  // x
 			return Term { .coef = 1., .expo = 1. };
 		else if (const auto num = expr.get_if<parse::Number>())
 			return Term { .coef = num->val, .expo = 0. };
@@ -289,34 +577,312 @@ namespace dcs213::p1::evaluate {
 		return std::nullopt;
 	}
 
-	inline static auto eval_termlist(const parse::Expr& expr) -> std::optional<TermList> {
+	/**
+	 * @brief Subtrees with at least this many nodes are worth forking onto the thread pool.
+	 *
+	 */
+	inline static constexpr std::size_t parallel_grain = 256;
+
+	/**
+	 * @brief The operands of a `SumExpr` or `ProductExpr`.
+	 *
+	 * @param expr
+	 * @return std::optional<std::span<const parse::Operand>>
+	 */
+	inline static auto nary_operands(const parse::Expr& expr)
+		-> std::optional<std::span<const parse::Operand>> {
+		if (const auto sum = expr.get_if<parse::SumExpr>())
+			return sum->operands;
+		else if (const auto prod = expr.get_if<parse::ProductExpr>())
+			return prod->operands;
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief Count the nodes of a subtree, giving up once `limit` is reached.
+	 *
+	 * @param expr
+	 * @param limit
+	 * @return std::size_t
+	 */
+	inline static auto subtree_size(const parse::Expr& expr, std::size_t limit) -> std::size_t {
+		std::size_t size = 1;
+
+		if (size >= limit)
+			return size;
+		else if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
+			size += subtree_size(*binop->lhs, limit - size);
+			if (size < limit)
+				size += subtree_size(*binop->rhs, limit - size);
+		} else if (const auto uop = expr.get_if<parse::UnaryOpExpr>())
+			size += subtree_size(*uop->operand, limit - size);
+		else if (const auto call = expr.get_if<parse::CallExpr>())
+			size += subtree_size(*call->arg, limit - size);
+		else if (const auto operands = nary_operands(expr))
+			for (const auto& operand : *operands) {
+				size += subtree_size(*operand.expr, limit - size);
+				if (size >= limit)
+					break;
+			}
+
+		return size;
+	}
+
+	inline static auto subtree_size(std::span<const parse::Operand> operands, std::size_t limit)
+		-> std::size_t {
+		std::size_t size = 0;
+		for (const auto& operand : operands) {
+			size += subtree_size(*operand.expr, limit - size);
+			if (size >= limit)
+				break;
+		}
+		return size;
+	}
+
+	/**
+	 * @brief Evaluate both operands of a binary expression with `f`.
+	 *
+	 * If both operands are big enough, they are evaluated in parallel on the work-stealing pool.
+	 * Otherwise they are evaluated in order, and `rhs` is skipped once `lhs` fails.
+	 *
+	 * @param binop
+	 * @param f evaluation pass returning an optional
+	 * @return std::pair of the results for `lhs` and `rhs`
+	 */
+	template<std::invocable<const parse::Expr&> F>
+	inline static auto eval_operands(const parse::BinOpExpr& binop, F&& f)
+		-> std::pair<std::invoke_result_t<F, const parse::Expr&>, std::invoke_result_t<F, const parse::Expr&>> {
+		const auto heavy = [](const parse::Expr& expr) {
+			return subtree_size(expr, parallel_grain) >= parallel_grain;
+		};
+
+		if (heavy(*binop.rhs) && heavy(*binop.lhs))
+			return sched::ThreadPool::global().join(
+				[&] { return f(*binop.lhs); },
+				[&] { return f(*binop.rhs); }
+			);
+
+		auto lhs = f(*binop.lhs);
+		if (!lhs)
+			return {};
+		return { std::move(lhs), f(*binop.rhs) };
+	}
+
+	template<typename R, typename F>
+	inline static auto eval_operand_range(
+		std::span<const parse::Operand> operands,
+		std::span<R>					results,
+		F&								f
+	) -> bool {
+		if (operands.size() == 1)
+			return (results.front() = f(*operands.front().expr)).has_value();
+
+		const auto m	 = operands.size() >> 1;
+		const auto heavy = [](std::span<const parse::Operand> operands) {
+			return subtree_size(operands, parallel_grain) >= parallel_grain;
+		};
+
+		if (heavy(operands.subspan(m)) && heavy(operands.first(m))) {
+			const auto [lhs, rhs] = sched::ThreadPool::global().join(
+				[&] { return eval_operand_range(operands.first(m), results.first(m), f); },
+				[&] { return eval_operand_range(operands.subspan(m), results.subspan(m), f); }
+			);
+			return lhs && rhs;
+		}
+
+		return eval_operand_range(operands.first(m), results.first(m), f)
+			&& eval_operand_range(operands.subspan(m), results.subspan(m), f);
+	}
+
+	/**
+	 * @brief Evaluate all operands of an n-ary expression with `f`.
+	 *
+	 * The operands are split in halves recursively, and halves that are both big enough are
+	 * evaluated in parallel. Evaluation stops early once an operand fails.
+	 *
+	 * @param operands
+	 * @param f evaluation pass returning an optional
+	 * @return the unwrapped results, or `std::nullopt` if any operand failed
+	 */
+	template<std::invocable<const parse::Expr&> F>
+	inline static auto eval_operands(std::span<const parse::Operand> operands, F&& f)
+		-> std::optional<std::vector<typename std::invoke_result_t<F, const parse::Expr&>::value_type>> {
+		using R = std::invoke_result_t<F, const parse::Expr&>;
+
+		std::vector<R> results(operands.size());
+
+		if (operands.empty() || !eval_operand_range(operands, std::span { results }, f))
+			return std::nullopt;
+
+		std::vector<typename R::value_type> values;
+		values.reserve(results.size());
+		for (auto& res : results) values.push_back(*std::move(res));
+		return values;	// nrvo
+	}
+
+	/**
+	 * @brief Charge an intermediate polynomial against the budget.
+	 *
+	 * @param terms
+	 * @param budget
+	 * @return the polynomial, or `std::nullopt` if it does not fit
+	 */
+	inline static auto charge(TermList&& terms, Budget& budget) -> std::optional<TermList> {
+		if (!budget.alloc(terms.size(), terms.size() * sizeof(Term)))
+			return std::nullopt;
+		return std::move(terms);
+	}
+
+	/**
+	 * @brief Multiply two polynomials within the budget.
+	 *
+	 * The `n * m` term products and an upper bound on the size of the result are charged up
+	 * front, so an oversized product is refused before any of its work or memory is spent.
+	 *
+	 * @param lhs
+	 * @param rhs
+	 * @param budget
+	 * @return std::optional<TermList>
+	 */
+	inline static auto multiply(const TermList& lhs, const TermList& rhs, Budget& budget)
+		-> std::optional<TermList> {
+		const auto bound = TermList::product_bound(lhs, rhs);
+		if (!budget.step(std::max<std::size_t>(lhs.size() * rhs.size(), 1))
+			|| !budget.alloc(bound, bound * sizeof(Term)))
+			return std::nullopt;
+		return lhs * rhs;
+	}
+
+	/**
+	 * @brief The same, for multivariate polynomials.
+	 *
+	 */
+	inline static auto charge(MPoly&& poly, Budget& budget) -> std::optional<MPoly> {
+		if (!budget.alloc(poly.size(), poly.size() * sizeof(MPoly::Term)))
+			return std::nullopt;
+		return std::move(poly);
+	}
+
+	/**
+	 * @brief The same, for multivariate polynomials, which also fails on exponent overflow.
+	 *
+	 */
+	inline static auto multiply(const MPoly& lhs, const MPoly& rhs, Budget& budget)
+		-> std::optional<MPoly> {
+		const auto bound = MPoly::product_bound(lhs, rhs);
+		if (!budget.step(std::max<std::size_t>(lhs.size() * rhs.size(), 1))
+			|| !budget.alloc(bound, bound * sizeof(MPoly::Term)))
+			return std::nullopt;
+		return MPoly::product(lhs, rhs);
+	}
+
+	/**
+	 * @brief Multiply polynomials by balanced reduction.
+	 *
+	 * Keeps the operands of every multiplication about the same size, and multiplies the halves
+	 * in parallel when both are big enough.
+	 *
+	 * @tparam P `TermList` or `MPoly`
+	 * @param lists
+	 * @param budget
+	 * @return std::optional<P>
+	 */
+	template<typename P>
+	inline static auto multiply_all(std::span<const P> lists, Budget& budget) -> std::optional<P> {
+		if (lists.size() == 1)
+			return lists.front();
+
+		const auto m	 = lists.size() >> 1;
+		const auto heavy = [](std::span<const P> lists) {
+			std::size_t terms = 0;
+			for (const auto& l : lists) terms += l.size();
+			return terms >= parallel_grain;
+		};
+
+		if (heavy(lists.subspan(m)) && heavy(lists.first(m))) {
+			const auto [lhs, rhs] = sched::ThreadPool::global().join(
+				[&] { return multiply_all(lists.first(m), budget); },
+				[&] { return multiply_all(lists.subspan(m), budget); }
+			);
+			if (lhs && rhs)
+				return multiply(*lhs, *rhs, budget);
+			return std::nullopt;
+		}
+
+		if (const auto lhs = multiply_all(lists.first(m), budget))
+			if (const auto rhs = multiply_all(lists.subspan(m), budget))
+				return multiply(*lhs, *rhs, budget);
+		return std::nullopt;
+	}
+
+	inline static auto eval_termlist_impl(const parse::Expr& expr, Budget& budget)
+		-> std::optional<TermList> {
 		// std::cout << std::format("parsing term list: {}\n", expr.to_string());
-		if (auto term = eval_term(expr))
+		if (!budget.step())
+			return std::nullopt;
+
+		const auto pass = [&](const parse::Expr& operand) { return eval_termlist(operand, budget); };
+
+		if (auto term = eval_term(expr, budget))
 			return TermList { *term };
-		else if (const auto binop = expr.get_if<parse::BinOpExpr>())
-			if (const auto lhs = eval_termlist(*binop->lhs))
-				if (const auto rhs = eval_termlist(*binop->rhs))
-					switch (binop->op) {
-						case lex::Operator::Plus: return *lhs + *rhs;
-						case lex::Operator::Minus: return *lhs - *rhs;
-						default: return std::nullopt;
-					}
+		else if (const auto sum = expr.get_if<parse::SumExpr>()) {
+			if (auto lists = eval_operands(sum->operands, pass)) {
+				for (std::size_t i = 0; i < lists->size(); ++i)
+					if (sum->operands[i].op == lex::Operator::Minus)
+						for (auto& term : (*lists)[i]) term.coef = -term.coef;
+				return charge(TermList::merge(*std::move(lists)), budget);
+			}
+		} else if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
+			if (binop->op != lex::Operator::Plus && binop->op != lex::Operator::Minus)
+				return std::nullopt;
+
+			if (const auto [lhs, rhs] = eval_operands(*binop, pass); lhs && rhs)
+				switch (binop->op) {
+					case lex::Operator::Plus: return charge(*lhs + *rhs, budget);
+					case lex::Operator::Minus: return charge(*lhs - *rhs, budget);
+					default: return std::nullopt;
+				}
+		}
 
 		return std::nullopt;
 	}
 
-	inline static auto eval_termlist_calc(const parse::Expr& expr) -> std::optional<TermList> {
+	inline static auto eval_termlist_calc_impl(const parse::Expr& expr, Budget& budget)
+		-> std::optional<TermList> {
+		DCS213_P1_TRACE_SCOPE(EvalTermList);
+
+		if (!budget.step())
+			return std::nullopt;
+
+		const auto pass = [&](const parse::Expr& operand) { return eval_termlist(operand, budget); };
+
+		if (expr.is<parse::SumExpr>())
+			return eval_termlist(expr, budget);
+
+		if (auto term = eval_term(expr, budget))  // x, x ^ e on their own
+			return TermList { *term };
+
+		if (const auto prod = expr.get_if<parse::ProductExpr>()) {
+			for (const auto& operand : prod->operands)
+				if (operand.op != lex::Operator::Multiply)
+					return std::nullopt;
+
+			if (const auto lists = eval_operands(prod->operands, pass))
+				return multiply_all<TermList>(*lists, budget);
+			return std::nullopt;
+		}
+
 		if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
-			if (const auto lhs = eval_termlist(*binop->lhs)) {
-				if (const auto rhs = eval_termlist(*binop->rhs)) {
+			if (const auto [lhs, rhs_terms] = eval_operands(*binop, pass); lhs) {
+				if (const auto& rhs = rhs_terms) {
 					switch (binop->op) {
-						case lex::Operator::Plus: return *lhs + *rhs;
-						case lex::Operator::Minus: return *lhs - *rhs;
-						case lex::Operator::Multiply: return *lhs * *rhs;
+						case lex::Operator::Plus: return charge(*lhs + *rhs, budget);
+						case lex::Operator::Minus: return charge(*lhs - *rhs, budget);
+						case lex::Operator::Multiply: return multiply(*lhs, *rhs, budget);
 						default: break;
 					}
 				}
-				if (const auto rhs = eval_con(*binop->rhs)) {
+				if (const auto rhs = eval_con(*binop->rhs, budget)) {
 					if (binop->op == lex::Operator::When)
 						return TermList {
 							Term { .coef = lhs->eval(*rhs), .expo = 0. }
@@ -326,7 +892,7 @@ namespace dcs213::p1::evaluate {
 		}
 
 		if (const auto uop = expr.get_if<parse::UnaryOpExpr>())
-			if (const auto oper = eval_termlist(*uop->operand))
+			if (const auto oper = eval_termlist(*uop->operand, budget))
 				switch (uop->op) {
 					case lex::Operator::Derivative:
 						if (auto d = oper->derivative())
@@ -346,21 +912,68 @@ namespace dcs213::p1::evaluate {
 		// handle(expr);
 	}
 
-	inline static auto eval_con(const parse::Expr& expr) -> std::optional<double> {
+	/**
+	 * @brief `lhs op rhs`, for the binary arithmetic operators.
+	 *
+	 * @param op
+	 * @param lhs
+	 * @param rhs
+	 * @return std::optional<double> nothing for other operators
+	 */
+	inline static auto arith(lex::Operator op, double lhs, double rhs) -> std::optional<double> {
+		switch (op) {
+			case lex::Operator::Plus: return lhs + rhs;
+			case lex::Operator::Minus: return lhs - rhs;
+			case lex::Operator::Multiply: return lhs * rhs;
+			case lex::Operator::Devide: return lhs / rhs;
+			case lex::Operator::Exponent: return std::pow(lhs, rhs);
+			default: return std::nullopt;
+		}
+	}
+
+	/**
+	 * @brief Fold the values of the operands of a `SumExpr` or `ProductExpr`.
+	 *
+	 * @param operands
+	 * @param vals
+	 * @return double
+	 */
+	inline static auto fold(std::span<const parse::Operand> operands, std::span<const double> vals)
+		-> double {
+		double res = operands.front().op == lex::Operator::Multiply ? 1. : 0.;
+		for (std::size_t i = 0; i < vals.size(); ++i) res = *arith(operands[i].op, res, vals[i]);
+		return res;
+	}
+
+	inline static auto eval_con_impl(const parse::Expr& expr, Budget& budget)
+		-> std::optional<double> {
 		// std::cout << std::format("parsing con: {}\n", expr.to_string());
+		DCS213_P1_TRACE_SCOPE(EvalCon);
+
+		if (!budget.step())
+			return std::nullopt;
+
+		const auto pass = [&](const parse::Expr& operand) { return eval_con(operand, budget); };
+
 		if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
-			if (const auto lhs = eval_con(*binop->lhs))
-				if (const auto rhs = eval_con(*binop->rhs))
-					switch (binop->op) {
-						case lex::Operator::Plus: return *lhs + *rhs;
-						case lex::Operator::Minus: return *lhs - *rhs;
-						case lex::Operator::Multiply: return *lhs * *rhs;
-						case lex::Operator::Devide: return *lhs / *rhs;
-						case lex::Operator::Exponent: return std::pow(*lhs, *rhs);
-						default: return std::nullopt;
-					}
+			if (binop->op == lex::Operator::When) {	 // lhs at a constant point
+				const auto at = eval_con(*binop->rhs, budget);
+				if (!at)
+					return std::nullopt;
+				if (const auto terms = eval_termlist_calc(*binop->lhs, budget))
+					return terms->eval(*at);
+				if (budget.exhausted())
+					return std::nullopt;
+				return eval_point(*binop->lhs, *at, budget);
+			}
+
+			if (const auto [lhs, rhs] = eval_operands(*binop, pass); lhs && rhs)
+				return arith(binop->op, *lhs, *rhs);
+		} else if (const auto operands = nary_operands(expr)) {
+			if (const auto vals = eval_operands(*operands, pass))
+				return fold(*operands, *vals);
 		} else if (const auto uop = expr.get_if<parse::UnaryOpExpr>()) {
-			if (const auto oper = eval_con(*uop->operand))
+			if (const auto oper = eval_con(*uop->operand, budget))
 				switch (uop->op) {
 					case lex::Operator::Plus: return *oper;
 					case lex::Operator::Minus: return -*oper;
@@ -368,18 +981,389 @@ namespace dcs213::p1::evaluate {
 					case lex::Operator::Ln: return std::log(*oper);
 					default: return std::nullopt;
 				}
+		} else if (const auto call = expr.get_if<parse::CallExpr>()) {
+			if (const auto arg = eval_con(*call->arg, budget))
+				return math::eval(call->fn, *arg);
 		} else if (const auto num = expr.get_if<parse::Number>())
 			return num->val;
 
 		return std::nullopt;
 	}
 
-	inline static auto eval(const parse::Expr& expr) -> std::optional<std::string> {
-		if (const auto res = eval_con(expr))
-			return std::format("{}", *res);
-		else if (const auto terms = eval_termlist_calc(expr))
-			return std::format("{}", terms->to_string());
+	/**
+	 * @brief Evaluate `expr` at the point `x`, node by node.
+	 *
+	 * For what does not reduce to a polynomial, e.g. built-in functions of `x`. Derivatives
+	 * still need a polynomial operand, and `lhs $ rhs` evaluates `lhs` at the value of `rhs`.
+	 *
+	 * @param expr
+	 * @param x
+	 * @param budget
+	 * @return std::optional<double>
+	 */
+	inline static auto eval_point_impl(const parse::Expr& expr, double x, Budget& budget)
+		-> std::optional<double> {
+		DCS213_P1_TRACE_SCOPE(EvalPoint);
+
+		if (!budget.step())
+			return std::nullopt;
+
+		const auto pass = [&](const parse::Expr& operand) { return eval_point(operand, x, budget); };
+
+		if (is_x(expr))
+			return x;
+		else if (const auto num = expr.get_if<parse::Number>())
+			return num->val;
+		else if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
+			if (binop->op == lex::Operator::When) {
+				if (const auto val = eval_con(expr, budget))  // the same as on its own
+					return val;
+				else if (budget.exhausted())
+					return std::nullopt;
+				if (const auto at = eval_point(*binop->rhs, x, budget))
+					return eval_point(*binop->lhs, *at, budget);
+			} else if (const auto [lhs, rhs] = eval_operands(*binop, pass); lhs && rhs)
+				return arith(binop->op, *lhs, *rhs);
+		} else if (const auto operands = nary_operands(expr)) {
+			if (const auto vals = eval_operands(*operands, pass))
+				return fold(*operands, *vals);
+		} else if (const auto uop = expr.get_if<parse::UnaryOpExpr>()) {
+			if (uop->op == lex::Operator::Derivative) {
+				if (const auto terms = eval_termlist_calc(*uop->operand, budget))
+					if (const auto d = terms->derivative())
+						return d->eval(x);
+			} else if (const auto oper = eval_point(*uop->operand, x, budget))
+				switch (uop->op) {
+					case lex::Operator::Plus: return *oper;
+					case lex::Operator::Minus: return -*oper;
+					case lex::Operator::Ln: return std::log(*oper);
+					default: return std::nullopt;
+				}
+		} else if (const auto call = expr.get_if<parse::CallExpr>()) {
+			if (const auto arg = eval_point(*call->arg, x, budget))
+				return math::eval(call->fn, *arg);
+		}
 
 		return std::nullopt;
 	}
+
+	/**
+	 * @brief Collect the names of the variables in `expr` into `names`.
+	 *
+	 */
+	inline static auto collect_variables(const parse::Expr& expr, std::vector<char>& names)
+		-> void {
+		if (const auto var = expr.get_if<parse::Variable>())
+			names.push_back(var->name);
+		else if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
+			collect_variables(*binop->lhs, names);
+			collect_variables(*binop->rhs, names);
+		} else if (const auto operands = nary_operands(expr)) {
+			for (const auto& operand : *operands) collect_variables(*operand.expr, names);
+		} else if (const auto uop = expr.get_if<parse::UnaryOpExpr>())
+			collect_variables(*uop->operand, names);
+		else if (const auto call = expr.get_if<parse::CallExpr>())
+			collect_variables(*call->arg, names);
+	}
+
+	/**
+	 * @brief The names of the variables in `expr`, sorted and distinct.
+	 *
+	 * @param expr
+	 * @return std::vector<char>
+	 */
+	inline static auto variables(const parse::Expr& expr) -> std::vector<char> {
+		std::vector<char> names;
+		collect_variables(expr, names);
+		std::ranges::sort(names);
+		names.erase(std::ranges::unique(names).begin(), names.end());
+		return names;  // nrvo
+	}
+
+	/**
+	 * @brief `base ^ n` by repeated squaring, within the budget.
+	 *
+	 */
+	inline static auto power(MPoly base, std::uint64_t n, Budget& budget) -> std::optional<MPoly> {
+		auto res = MPoly::constant(base.ring(), 1.);
+		for (; n > 0; n >>= 1) {
+			if (n & 1) {
+				if (auto prod = multiply(res, base, budget))
+					res = *std::move(prod);
+				else
+					return std::nullopt;
+			}
+			if (n > 1) {
+				if (auto square = multiply(base, base, budget))
+					base = *std::move(square);
+				else
+					return std::nullopt;
+			}
+		}
+		return res;	 // nrvo
+	}
+
+	/**
+	 * @brief `lhs op rhs` for multivariate polynomials.
+	 *
+	 * Division, exponentiation and `$` need a constant `rhs`, a non-negative integral one for
+	 * exponentiation. `$` substitutes for `x`.
+	 *
+	 */
+	inline static auto arith(lex::Operator op, const MPoly& lhs, const MPoly& rhs, Budget& budget)
+		-> std::optional<MPoly> {
+		const auto& ring = lhs.ring();
+		const auto	at	 = rhs.constant_value();
+
+		if (op == lex::Operator::When) {
+			const auto x = ring.index('x');
+			if (!at || !budget.step(lhs.size()))
+				return std::nullopt;
+			return charge(x ? lhs.substitute(*x, *at) : MPoly { lhs }, budget);
+		}
+
+		if (const auto con = lhs.constant_value(); con && at)
+			if (const auto val = arith(op, *con, *at))
+				return MPoly::constant(ring, *val);
+
+		switch (op) {
+			case lex::Operator::Plus: return charge(lhs + rhs, budget);
+			case lex::Operator::Minus: return charge(lhs - rhs, budget);
+			case lex::Operator::Multiply: return multiply(lhs, rhs, budget);
+			case lex::Operator::Devide:
+				if (at)
+					return charge(lhs.scaled(1. / *at), budget);
+				break;
+			case lex::Operator::Exponent:
+				if (at && *at >= 0. && *at == std::floor(*at)
+					&& *at <= static_cast<double>(ring.max_exponent()))
+					return power(lhs, static_cast<std::uint64_t>(*at), budget);
+				break;
+			default: break;
+		}
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief Evaluate `expr` into a polynomial over `ring`, which has all its variables.
+	 *
+	 * Derivatives and `$` act on `x`, and only constants may go through `ln` and built-in
+	 * functions.
+	 *
+	 * @param expr
+	 * @param ring
+	 * @param budget
+	 * @return std::optional<MPoly>
+	 */
+	inline static auto eval_mpoly_impl(const parse::Expr& expr, const Ring& ring, Budget& budget)
+		-> std::optional<MPoly> {
+		DCS213_P1_TRACE_SCOPE(EvalMPoly);
+
+		if (!budget.step())
+			return std::nullopt;
+
+		const auto pass = [&](const parse::Expr& operand) {
+			return eval_mpoly(operand, ring, budget);
+		};
+
+		if (const auto var = expr.get_if<parse::Variable>())
+			return MPoly::variable(ring, *ring.index(var->name));
+		else if (const auto num = expr.get_if<parse::Number>())
+			return MPoly::constant(ring, num->val);
+		else if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
+			if (const auto [lhs, rhs] = eval_operands(*binop, pass); lhs && rhs)
+				return arith(binop->op, *lhs, *rhs, budget);
+		} else if (const auto sum = expr.get_if<parse::SumExpr>()) {
+			if (auto polys = eval_operands(sum->operands, pass)) {
+				for (std::size_t i = 0; i < polys->size(); ++i)
+					if (sum->operands[i].op == lex::Operator::Minus)
+						(*polys)[i] = (*polys)[i].scaled(-1.);
+				return charge(MPoly::merge(ring, *polys), budget);
+			}
+		} else if (const auto prod = expr.get_if<parse::ProductExpr>()) {
+			if (auto polys = eval_operands(prod->operands, pass)) {
+				// Constants fold into one coefficient in order, like the ones of a `Term`.
+				double			   coef = 1.;
+				std::vector<MPoly> factors;
+				for (std::size_t i = 0; i < polys->size(); ++i)
+					if (const auto con = (*polys)[i].constant_value())
+						coef = *arith(prod->operands[i].op, coef, *con);
+					else if (prod->operands[i].op == lex::Operator::Multiply)
+						factors.push_back(std::move((*polys)[i]));
+					else
+						return std::nullopt;
+
+				if (factors.empty())
+					return MPoly::constant(ring, coef);
+				if (const auto res = multiply_all<MPoly>(factors, budget))
+					return res->scaled(coef);
+			}
+		} else if (const auto uop = expr.get_if<parse::UnaryOpExpr>()) {
+			if (const auto oper = eval_mpoly(*uop->operand, ring, budget)) {
+				const auto con = oper->constant_value();
+				switch (uop->op) {
+					case lex::Operator::Plus: return *oper;
+					case lex::Operator::Minus: return oper->scaled(-1.);
+					case lex::Operator::Derivative:
+						if (const auto x = ring.index('x'))
+							return oper->derivative(*x);
+						return MPoly { ring };
+					case lex::Operator::Ln:
+						if (con)
+							return MPoly::constant(ring, std::log(*con));
+						break;
+					default: break;
+				}
+			}
+		} else if (const auto call = expr.get_if<parse::CallExpr>()) {
+			if (const auto arg = eval_mpoly(*call->arg, ring, budget))
+				if (const auto con = arg->constant_value())
+					return MPoly::constant(ring, math::eval(call->fn, *con));
+		}
+
+		return std::nullopt;
+	}
+
+	inline static auto eval_con(const parse::Expr& expr, Budget& budget) -> std::optional<double> {
+		return observe(expr, budget, Budget::Observer::Pass::Constant, [&] {
+			return eval_con_impl(expr, budget);
+		});
+	}
+
+	inline static auto eval_term(const parse::Expr& expr, Budget& budget) -> std::optional<Term> {
+		return observe(expr, budget, Budget::Observer::Pass::Term, [&] {
+			return eval_term_impl(expr, budget);
+		});
+	}
+
+	inline static auto eval_termlist(const parse::Expr& expr, Budget& budget)
+		-> std::optional<TermList> {
+		return observe(expr, budget, Budget::Observer::Pass::TermList, [&] {
+			return eval_termlist_impl(expr, budget);
+		});
+	}
+
+	inline static auto eval_termlist_calc(const parse::Expr& expr, Budget& budget)
+		-> std::optional<TermList> {
+		return observe(expr, budget, Budget::Observer::Pass::TermList, [&] {
+			return eval_termlist_calc_impl(expr, budget);
+		});
+	}
+
+	inline static auto eval_point(const parse::Expr& expr, double x, Budget& budget)
+		-> std::optional<double> {
+		return observe(expr, budget, Budget::Observer::Pass::Point, [&] {
+			return eval_point_impl(expr, x, budget);
+		});
+	}
+
+	inline static auto eval_mpoly(const parse::Expr& expr, const Ring& ring, Budget& budget)
+		-> std::optional<MPoly> {
+		return observe(expr, budget, Budget::Observer::Pass::MPoly, [&] {
+			return eval_mpoly_impl(expr, ring, budget);
+		});
+	}
+
+	namespace Errors {
+		/**
+		 * @brief An error that the expression is not in a form the evaluator supports.
+		 *
+		 */
+		struct NotEvaluable {
+			[[nodiscard]] inline static auto to_string() -> std::string { return "Failed to eval!"; }
+		};
+
+		struct EvalError :
+			public std::variant<  //
+				NotEvaluable,	  //
+				BudgetExhausted	  //
+				> {
+			template<typename ErrorT>
+			[[nodiscard]] auto is() const -> bool {
+				return std::holds_alternative<ErrorT>(*this);
+			}
+
+			/**
+			 * @brief Forwarding `.to_string()`.
+			 *
+			 * @return std::string
+			 */
+			[[nodiscard]] auto to_string() const -> std::string {
+				return std::visit([](const auto& err) { return err.to_string(); }, *this);
+			}
+		};
+	}  // namespace Errors
+
+	using Errors::EvalError;
+
+	/**
+	 * @brief Evaluate an AST within a budget.
+	 *
+	 * @param expr
+	 * @param budget
+	 * @return tl::expected<std::string, EvalError>
+	 */
+	inline static auto eval(const parse::Expr& expr, Budget& budget)
+		-> tl::expected<std::string, EvalError> {
+		DCS213_P1_ALLOC_TAG(Evaluate);
+
+		if (const auto res = eval_con(expr, budget)) {
+			DCS213_P1_TRACE_SCOPE(Format);
+			DCS213_P1_ALLOC_TAG(Serialize);
+			return std::format("{}", *res);
+		} else if (budget.exhausted())
+			return tl::make_unexpected(EvalError { BudgetExhausted { budget.reason() } });
+
+		// Scripts in `x` alone try the univariate engine first, which also takes fractional and
+		// negative exponents. What it lacks, e.g. powers of sums, the multivariate one still
+		// does, so a script evaluates the same whatever its variable is called.
+		const auto names = variables(expr);
+		if (std::ranges::all_of(names, [](char name) { return name == 'x'; }))
+			if (const auto terms = eval_termlist_calc(expr, budget)) {
+				DCS213_P1_TRACE_SCOPE(Format);
+				DCS213_P1_ALLOC_TAG(Serialize);
+				return std::format("{}", terms->to_string());
+			}
+
+		const auto ring = budget.exhausted() ? std::nullopt : Ring::of(names);
+		if (const auto poly = ring ? eval_mpoly(expr, *ring, budget) : std::nullopt) {
+			DCS213_P1_TRACE_SCOPE(Format);
+			DCS213_P1_ALLOC_TAG(Serialize);
+			return poly->to_string();
+		}
+
+		if (budget.exhausted())
+			return tl::make_unexpected(EvalError { BudgetExhausted { budget.reason() } });
+		return tl::make_unexpected(EvalError { Errors::NotEvaluable {} });
+	}
+
+	inline static auto eval(const parse::Expr& expr) -> tl::expected<std::string, EvalError> {
+		Budget budget;
+		return eval(expr, budget);
+	}
+
+	/**
+	 * @brief Evaluate an AST into a polynomial of `x` within a budget.
+	 *
+	 * Constant expressions give constant polynomials.
+	 *
+	 * @param expr
+	 * @param budget
+	 * @return tl::expected<TermList, EvalError>
+	 */
+	inline static auto eval_polynomial(const parse::Expr& expr, Budget& budget)
+		-> tl::expected<TermList, EvalError> {
+		DCS213_P1_ALLOC_TAG(Evaluate);
+
+		if (const auto res = eval_con(expr, budget))
+			return TermList { Term { .coef = *res, .expo = 0. } };
+		else if (budget.exhausted())
+			return tl::make_unexpected(EvalError { BudgetExhausted { budget.reason() } });
+		else if (auto terms = eval_termlist_calc(expr, budget))
+			return *std::move(terms);
+		else if (budget.exhausted())
+			return tl::make_unexpected(EvalError { BudgetExhausted { budget.reason() } });
+
+		return tl::make_unexpected(EvalError { Errors::NotEvaluable {} });
+	}
 }  // namespace dcs213::p1::evaluate
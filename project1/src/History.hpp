@@ -0,0 +1,788 @@
+#pragma once
+
+#include "Pipeline.hpp"
+
+#if defined DCS213_P1_PLAT_WINDOWS
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/file.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Append-only binary log of evaluations.
+ *
+ * Layout, all integers in native byte order:
+ *
+ *   Header   64 bytes
+ *   Record*  `RecordHeader` + payload, padded to 8 bytes
+ *
+ * An entry record holds one evaluation: `EntryHeader`, the script and the result. After every
+ * `index_interval` entries comes an index record: `IndexHeader` and the offsets of those
+ * entries. Index records are chained backwards from `Header::last_index`, so finding the n-th
+ * entry walks index records, not entries. `Header::end` only moves past a record once it is
+ * complete, so a crashed writer leaves a valid log behind.
+ */
+namespace dcs213::p1::history {
+	inline static constexpr char		  magic[8]		 = { 'D', 'C', 'S', '2', '1', '3', 'H', 'L' };
+	inline static constexpr std::uint32_t version		 = 1;
+	inline static constexpr std::size_t	  index_interval = 1024;  // entries per index record
+
+	struct Header {
+		char		  magic[8];
+		std::uint32_t version;
+		std::uint32_t header_size;
+		std::uint64_t end;		   // of the last complete record
+		std::uint64_t count;	   // entries
+		std::uint64_t last_index;  // offset of the last index record, 0 if none
+		std::uint64_t reserved[3];
+	};
+	static_assert(sizeof(Header) == 64);
+
+	enum class Kind : std::uint8_t {
+		Entry = 1,
+		Index = 2,
+	};
+
+	/**
+	 * @brief `pipeline::Outcome` flags of an entry.
+	 *
+	 */
+	enum Flags : std::uint8_t {
+		Success	  = 1 << 0,
+		Cancelled = 1 << 1,
+		Transient = 1 << 2,
+	};
+
+	struct RecordHeader {
+		std::uint32_t size;	 // of the whole record, padding included
+		Kind		  kind;
+		std::uint8_t  flags;
+		std::uint16_t reserved;
+		std::uint64_t time;	 // ns since the Unix epoch
+	};
+	static_assert(sizeof(RecordHeader) == 16);
+
+	struct EntryHeader {
+		std::uint64_t duration;	 // ns
+		std::uint32_t script_size;
+		std::uint32_t result_size;
+	};
+	static_assert(sizeof(EntryHeader) == 16);
+
+	struct IndexHeader {
+		std::uint64_t previous;	 // offset of the previous index record, 0 if none
+		std::uint64_t first;	 // sequence number of the first entry listed
+		std::uint64_t count;	 // followed by that many entry offsets
+	};
+	static_assert(sizeof(IndexHeader) == 24);
+
+	inline static constexpr std::size_t index_size =	// of a whole index record
+		sizeof(RecordHeader) + sizeof(IndexHeader) + index_interval * sizeof(std::uint64_t);
+
+	/**
+	 * @brief One evaluation read back from a log, viewing into it.
+	 *
+	 */
+	struct Entry {
+		std::uint64_t			 seq;
+		std::chrono::nanoseconds time;	// since the Unix epoch
+		std::chrono::nanoseconds duration;
+		std::uint8_t			 flags;
+		std::string_view		 script;
+		std::string_view		 result;
+
+		[[nodiscard]] auto outcome() const -> pipeline::Outcome {
+			return {
+				.success   = (flags & Success) != 0,
+				.cancelled = (flags & Cancelled) != 0,
+				.transient = (flags & Transient) != 0,
+				.text	   = std::string(result),
+			};
+		}
+	};
+
+	namespace details {
+		[[nodiscard]] inline constexpr auto align8(std::size_t n) -> std::size_t {
+			return (n + 7) & ~std::size_t { 7 };
+		}
+
+		template<typename T>
+		[[nodiscard]] inline auto load(const std::byte* at) -> T {
+			T value;
+			std::memcpy(&value, at, sizeof(T));
+			return value;
+		}
+
+		template<typename T>
+		inline auto store(std::byte* at, const T& value) -> void {
+			std::memcpy(at, &value, sizeof(T));
+		}
+
+		/**
+		 * @brief A file mapped into memory, as a whole.
+		 *
+		 */
+		class Mapping {
+		public:
+			Mapping() = default;
+
+			Mapping(const Mapping&)			   = delete;
+			Mapping& operator=(const Mapping&) = delete;
+
+			Mapping(Mapping&& other) noexcept :
+#if defined DCS213_P1_PLAT_WINDOWS
+				_file(std::exchange(other._file, INVALID_HANDLE_VALUE)),
+#else
+				_fd(std::exchange(other._fd, -1)),
+#endif
+				_data(std::exchange(other._data, nullptr)),
+				_size(std::exchange(other._size, 0)),
+				_writable(other._writable) {
+			}
+
+			~Mapping() {
+				_unmap();
+#if defined DCS213_P1_PLAT_WINDOWS
+				if (_file != INVALID_HANDLE_VALUE)
+					::CloseHandle(_file);
+#else
+				if (_fd >= 0)
+					::close(_fd);
+#endif
+			}
+
+		public:
+			/**
+			 * @brief Map a file, creating it if `writable`.
+			 *
+			 * @param path
+			 * @param writable changes are written back to the file
+			 * @return the mapping, or `std::nullopt` if the file cannot be opened or mapped
+			 */
+			inline static auto open(const std::string& path, bool writable) -> std::optional<Mapping> {
+				Mapping mapping;
+				mapping._writable = writable;
+#if defined DCS213_P1_PLAT_WINDOWS
+				mapping._file = ::CreateFileA(
+					path.c_str(),
+					GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+					FILE_SHARE_READ | FILE_SHARE_WRITE,
+					nullptr,
+					writable ? OPEN_ALWAYS : OPEN_EXISTING,
+					FILE_ATTRIBUTE_NORMAL,
+					nullptr
+				);
+				LARGE_INTEGER size;
+				if (mapping._file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(mapping._file, &size))
+					return std::nullopt;
+				mapping._size = static_cast<std::size_t>(size.QuadPart);
+#else
+				mapping._fd =
+					::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+				struct stat st;
+				if (mapping._fd < 0 || ::fstat(mapping._fd, &st) != 0)
+					return std::nullopt;
+				mapping._size = static_cast<std::size_t>(st.st_size);
+#endif
+				if (!mapping._map())
+					return std::nullopt;
+				return mapping;
+			}
+
+			/**
+			 * @brief Resize the file and map it again, the data may move.
+			 *
+			 * Growing allocates the new blocks up front where the platform allows, so a full disk
+			 * fails here instead of faulting on a later write through the mapping.
+			 *
+			 * @param size
+			 * @return whether it succeeded, the old size is mapped again otherwise (if it can be)
+			 */
+			auto resize(std::size_t size) -> bool {
+				_unmap();
+#if defined DCS213_P1_PLAT_WINDOWS
+				LARGE_INTEGER end;
+				end.QuadPart = static_cast<LONGLONG>(size);
+				const auto resized =
+					::SetFilePointerEx(_file, end, nullptr, FILE_BEGIN) && ::SetEndOfFile(_file);
+#elif defined DCS213_P1_PLAT_LINUX
+				const auto resized = size > _size
+									   ? ::posix_fallocate(_fd, 0, static_cast<off_t>(size)) == 0
+									   : ::ftruncate(_fd, static_cast<off_t>(size)) == 0;
+#else
+				const auto resized = ::ftruncate(_fd, static_cast<off_t>(size)) == 0;
+#endif
+				if (!resized) {
+					_map();
+					return false;
+				}
+				_size = size;
+				return _map();
+			}
+
+			/**
+			 * @brief Take an exclusive lock on the file, without waiting for it.
+			 *
+			 * The lock is advisory and held until the mapping is destroyed.
+			 *
+			 * @return whether it was taken, i.e. no other mapping holds it
+			 */
+			auto lock() -> bool {
+#if defined DCS213_P1_PLAT_WINDOWS
+				// A byte far past any content, so that readers are not locked out.
+				OVERLAPPED at {};
+				at.Offset	  = MAXDWORD - 1;
+				at.OffsetHigh = MAXDWORD;
+				return ::LockFileEx(
+					_file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &at
+				);
+#else
+				return ::flock(_fd, LOCK_EX | LOCK_NB) == 0;
+#endif
+			}
+
+			[[nodiscard]] auto data() const -> std::byte* { return _data; }
+
+			[[nodiscard]] auto size() const -> std::size_t { return _size; }
+
+		private:
+			auto _map() -> bool {
+				if (_size == 0)
+					return true;
+#if defined DCS213_P1_PLAT_WINDOWS
+				const auto view = ::CreateFileMappingA(
+					_file, nullptr, _writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr
+				);
+				if (!view)
+					return false;
+				_data = static_cast<std::byte*>(
+					::MapViewOfFile(view, _writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0)
+				);
+				::CloseHandle(view);  // the mapped view keeps it alive
+				return _data != nullptr;
+#else
+				const auto addr = ::mmap(
+					nullptr,
+					_size,
+					PROT_READ | (_writable ? PROT_WRITE : 0),
+					_writable ? MAP_SHARED : MAP_PRIVATE,
+					_fd,
+					0
+				);
+				if (addr == MAP_FAILED)
+					return false;
+				_data = static_cast<std::byte*>(addr);
+				return true;
+#endif
+			}
+
+			auto _unmap() -> void {
+				if (!_data)
+					return;
+#if defined DCS213_P1_PLAT_WINDOWS
+				::UnmapViewOfFile(_data);
+#else
+				::munmap(_data, _size);
+#endif
+				_data = nullptr;
+			}
+
+		private:
+#if defined DCS213_P1_PLAT_WINDOWS
+			HANDLE _file = INVALID_HANDLE_VALUE;
+#else
+			int _fd = -1;
+#endif
+			std::byte*	_data	  = nullptr;
+			std::size_t _size	  = 0;
+			bool		_writable = false;
+		};
+	}  // namespace details
+
+	/**
+	 * @brief Read access to the bytes of a log.
+	 *
+	 * Entries are found by sequence number through the index records, or iterated in order.
+	 * Neither parses any text: scripts and results are views into the log.
+	 */
+	class LogView {
+	public:
+		class Iterator {
+		public:
+			using value_type	  = Entry;
+			using difference_type = std::ptrdiff_t;
+
+			Iterator() = default;
+
+			Iterator(const LogView* log, std::uint64_t offset, std::uint64_t seq) :
+				_log(log), _offset(offset), _seq(seq) {
+				_skip_indexes();
+			}
+
+			auto operator*() const -> Entry { return *_log->_entry(_offset, _seq); }
+
+			auto operator++() -> Iterator& {
+				_offset += _log->_record(_offset)->size;
+				++_seq;
+				_skip_indexes();
+				return *this;
+			}
+
+			auto operator++(int) -> Iterator {
+				auto it = *this;
+				++*this;
+				return it;
+			}
+
+			inline friend auto operator==(const Iterator& lhs, std::default_sentinel_t) -> bool {
+				return lhs._done();
+			}
+
+			/**
+			 * @brief Where the record of the current entry starts in the log.
+			 *
+			 */
+			[[nodiscard]] auto offset() const -> std::uint64_t { return _offset; }
+
+		private:
+			[[nodiscard]] auto _done() const -> bool { return _offset == _log->_end; }
+
+			auto _skip_indexes() -> void {
+				while (_offset != _log->_end) {
+					const auto record = _log->_record(_offset);
+					if (!record) {
+						_offset = _log->_end;  // corrupted, stop here
+						return;
+					}
+					if (record->kind == Kind::Entry) {
+						if (!_log->_entry(_offset, _seq))
+							_offset = _log->_end;
+						return;
+					}
+					_offset += record->size;
+				}
+			}
+
+		private:
+			const LogView* _log	   = nullptr;
+			std::uint64_t  _offset = 0;
+			std::uint64_t  _seq	   = 0;
+		};
+
+	public:
+		LogView() = default;
+
+		/**
+		 * @brief View a log, an invalid one views as empty.
+		 *
+		 * @param data the whole file, or its prefix up to at least `Header::end`
+		 */
+		explicit LogView(std::span<const std::byte> data) {
+			if (data.size() < sizeof(Header))
+				return;
+
+			const auto header = details::load<Header>(data.data());
+			if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version
+				|| header.header_size != sizeof(Header) || header.end < sizeof(Header)
+				|| header.end > data.size())
+				return;
+
+			_data  = data.first(header.end);
+			_end   = header.end;
+			_count = header.count;
+
+			// Index records only point backwards and there is one per `index_interval` entries,
+			// so a corrupt chain can neither loop nor run on.
+			_valid = true;
+			for (auto offset = header.last_index; offset != 0;) {
+				const auto record = _record(offset);
+				if (!record || record->kind != Kind::Index || record->size < index_size
+					|| _indexes.size() == _count / index_interval) {
+					_valid = false;
+					break;
+				}
+				_indexes.push_back(offset);
+
+				const auto* body	 = _data.data() + offset + sizeof(RecordHeader);
+				const auto	previous = details::load<IndexHeader>(body).previous;
+				if (previous >= offset) {
+					_valid = false;
+					break;
+				}
+				offset = previous;
+			}
+			std::ranges::reverse(_indexes);
+
+			_valid = _valid && _indexes.size() == _count / index_interval;
+			if (!_valid)
+				*this = LogView {};
+		}
+
+	public:
+		[[nodiscard]] auto valid() const -> bool { return _valid; }
+
+		/**
+		 * @brief Number of entries.
+		 *
+		 */
+		[[nodiscard]] auto size() const -> std::uint64_t { return _count; }
+
+		/**
+		 * @brief Look up an entry by sequence number.
+		 *
+		 * Constant time for entries covered by an index record, the last entries (fewer than
+		 * `index_interval`) are reached by skipping records.
+		 *
+		 * @param seq
+		 * @return the entry, or `std::nullopt` if out of range or corrupted
+		 */
+		[[nodiscard]] auto at(std::uint64_t seq) const -> std::optional<Entry> {
+			if (const auto offset = offset_of(seq))
+				return _entry(*offset, seq);
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief Where the record of an entry starts in the log.
+		 *
+		 * @see at
+		 */
+		[[nodiscard]] auto offset_of(std::uint64_t seq) const -> std::optional<std::uint64_t> {
+			if (seq >= _count)
+				return std::nullopt;
+
+			const auto block = seq / index_interval;
+			if (block < _indexes.size()) {
+				const auto slot = _data.data() + _indexes[block] + sizeof(RecordHeader)
+								+ sizeof(IndexHeader) + (seq % index_interval) * sizeof(std::uint64_t);
+				return details::load<std::uint64_t>(slot);
+			}
+
+			auto it = _indexes.empty() ? begin()
+									   : Iterator { this, _after(_indexes.back()), block * index_interval };
+			for (auto skip = seq - block * index_interval; skip > 0 && it != end(); --skip) ++it;
+			if (it == end())
+				return std::nullopt;
+			return it.offset();
+		}
+
+		[[nodiscard]] auto begin() const -> Iterator {
+			return { this, _valid ? sizeof(Header) : _end, 0 };
+		}
+
+		[[nodiscard]] auto end() const -> std::default_sentinel_t { return {}; }
+
+	private:
+		/**
+		 * @brief The header of the record at `offset`, if it is sound.
+		 *
+		 */
+		[[nodiscard]] auto _record(std::uint64_t offset) const -> std::optional<RecordHeader> {
+			if (offset < sizeof(Header) || offset % 8 != 0 || offset + sizeof(RecordHeader) > _end)
+				return std::nullopt;
+			const auto record = details::load<RecordHeader>(_data.data() + offset);
+			if (record.size < sizeof(RecordHeader) || record.size % 8 != 0 || record.size > _end - offset)
+				return std::nullopt;
+			return record;
+		}
+
+		[[nodiscard]] auto _after(std::uint64_t offset) const -> std::uint64_t {
+			return offset + _record(offset)->size;
+		}
+
+		[[nodiscard]] auto _entry(std::uint64_t offset, std::uint64_t seq) const -> std::optional<Entry> {
+			const auto record = _record(offset);
+			if (!record || record->kind != Kind::Entry
+				|| record->size < sizeof(RecordHeader) + sizeof(EntryHeader))
+				return std::nullopt;
+
+			const auto* body  = _data.data() + offset + sizeof(RecordHeader);
+			const auto	entry = details::load<EntryHeader>(body);
+			if (sizeof(RecordHeader) + sizeof(EntryHeader) + std::uint64_t { entry.script_size }
+					+ entry.result_size
+				> record->size)
+				return std::nullopt;
+
+			const auto* text = reinterpret_cast<const char*>(body + sizeof(EntryHeader));
+			return Entry {
+				.seq	  = seq,
+				.time	  = std::chrono::nanoseconds { record->time },
+				.duration = std::chrono::nanoseconds { entry.duration },
+				.flags	  = record->flags,
+				.script	  = { text, entry.script_size },
+				.result	  = { text + entry.script_size, entry.result_size },
+			};
+		}
+
+	private:
+		std::span<const std::byte> _data;
+		std::uint64_t			   _end	  = 0;
+		std::uint64_t			   _count = 0;
+		std::vector<std::uint64_t> _indexes;  // offsets of the index records, oldest first
+		bool					   _valid = false;
+	};
+
+	/**
+	 * @brief A log mapped read-only.
+	 *
+	 */
+	class Reader {
+	public:
+		inline static auto open(const std::string& path) -> std::optional<Reader> {
+			auto mapping = details::Mapping::open(path, false);
+			if (!mapping)
+				return std::nullopt;
+
+			Reader reader { *std::move(mapping) };
+			if (!reader._log.valid())
+				return std::nullopt;
+			return reader;
+		}
+
+		[[nodiscard]] auto log() const -> const LogView& { return _log; }
+
+	private:
+		explicit Reader(details::Mapping mapping) :
+			_mapping(std::move(mapping)),
+			_log(std::span<const std::byte> { _mapping.data(), _mapping.size() }) {}
+
+	private:
+		details::Mapping _mapping;
+		LogView			 _log;	// views into `_mapping`, which keeps its address when moved
+	};
+
+	/**
+	 * @brief Appends evaluations to a mapped log, from any thread.
+	 *
+	 * The file grows geometrically and is written through the mapping, so an append is a
+	 * couple of copies under a lock. It is truncated to its content when closed.
+	 */
+	class Writer {
+	public:
+		Writer(const Writer&)			 = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		~Writer() {
+			std::lock_guard lock { _mutex };
+			if (_header.end != 0)  // a log was opened or created
+				_mapping.resize(_header.end);
+		}
+
+	public:
+		/**
+		 * @brief Open a log for appending, creating it if needed.
+		 *
+		 * A log has one writer at a time: each keeps its own copy of the header, so a second
+		 * one would overwrite the records of the first.
+		 *
+		 * @param path
+		 * @return the writer, or `nullptr` if the file cannot be mapped, is not a log or already
+		 * has a writer
+		 */
+		inline static auto open(const std::string& path) -> std::unique_ptr<Writer> {
+			auto mapping = details::Mapping::open(path, true);
+			if (!mapping || !mapping->lock())
+				return nullptr;
+
+			std::unique_ptr<Writer> writer { new Writer(*std::move(mapping)) };
+			auto&					m = writer->_mapping;
+
+			if (m.size() == 0) {
+				auto& header = writer->_header;
+				std::memcpy(header.magic, magic, sizeof(magic));
+				header.version	   = version;
+				header.header_size = sizeof(Header);
+				header.end		   = sizeof(Header);
+				if (!m.resize(initial_capacity))
+					return nullptr;
+				details::store(m.data(), header);
+				return writer;
+			}
+
+			const LogView log { { m.data(), m.size() } };
+			if (!log.valid())
+				return nullptr;
+			writer->_header = details::load<Header>(m.data());
+
+			// Entries after the last index record still have to be indexed.
+			const auto tail = writer->_header.count / index_interval * index_interval;
+			for (auto seq = tail; seq < writer->_header.count; ++seq)
+				if (const auto offset = log.offset_of(seq))
+					writer->_pending.push_back(*offset);
+				else
+					return nullptr;
+			return writer;
+		}
+
+		/**
+		 * @brief Append an evaluation.
+		 *
+		 * @param script
+		 * @param outcome
+		 * @param duration how long the evaluation took
+		 * @return whether it was written
+		 */
+		auto append(
+			std::string_view		 script,
+			const pipeline::Outcome& outcome,
+			std::chrono::nanoseconds duration
+		) -> bool {
+			const auto size = details::align8(
+				sizeof(RecordHeader) + sizeof(EntryHeader) + script.size() + outcome.text.size()
+			);
+			if (script.size() > UINT32_MAX || outcome.text.size() > UINT32_MAX || size > UINT32_MAX)
+				return false;
+
+			const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()
+			);
+			const auto flags = static_cast<std::uint8_t>(
+				(outcome.success ? Success : 0) | (outcome.cancelled ? Cancelled : 0)
+				| (outcome.transient ? Transient : 0)
+			);
+
+			std::lock_guard lock { _mutex };
+
+			const auto needs_index = _pending.size() + 1 == index_interval;
+			if (!_reserve(size + (needs_index ? index_size : 0)))
+				return false;
+
+			auto* at = _mapping.data() + _header.end;
+			std::memset(at, 0, size);
+			details::store(
+				at,
+				RecordHeader {
+					.size	  = static_cast<std::uint32_t>(size),
+					.kind	  = Kind::Entry,
+					.flags	  = flags,
+					.reserved = 0,
+					.time	  = static_cast<std::uint64_t>(now.count()),
+				}
+			);
+			details::store(
+				at + sizeof(RecordHeader),
+				EntryHeader {
+					.duration	 = static_cast<std::uint64_t>(duration.count()),
+					.script_size = static_cast<std::uint32_t>(script.size()),
+					.result_size = static_cast<std::uint32_t>(outcome.text.size()),
+				}
+			);
+			auto* text = at + sizeof(RecordHeader) + sizeof(EntryHeader);
+			std::memcpy(text, script.data(), script.size());
+			std::memcpy(text + script.size(), outcome.text.data(), outcome.text.size());
+
+			_pending.push_back(_header.end);
+			_header.end += size;
+			++_header.count;
+
+			if (needs_index)
+				_write_index(now);
+
+			details::store(_mapping.data(), _header);  // commit
+			return true;
+		}
+
+		/**
+		 * @brief The scripts of the last `n` entries, oldest first.
+		 *
+		 * @param n
+		 * @return std::vector<std::string>
+		 */
+		[[nodiscard]] auto recent(std::size_t n) const -> std::vector<std::string> {
+			std::lock_guard lock { _mutex };
+
+			const LogView			 log { { _mapping.data(), _mapping.size() } };
+			std::vector<std::string> scripts;
+			for (auto seq = log.size() - std::min<std::uint64_t>(n, log.size()); seq < log.size(); ++seq)
+				if (const auto entry = log.at(seq))
+					scripts.emplace_back(entry->script);
+			return scripts;	 // nrvo
+		}
+
+		/**
+		 * @brief Number of entries.
+		 *
+		 */
+		[[nodiscard]] auto size() const -> std::uint64_t {
+			std::lock_guard lock { _mutex };
+			return _header.count;
+		}
+
+	private:
+		inline static constexpr std::size_t initial_capacity = 1 << 20;
+		inline static constexpr std::size_t max_growth		 = 64 << 20;
+
+		explicit Writer(details::Mapping mapping) : _mapping(std::move(mapping)) {}
+
+		/**
+		 * @brief Make room for `bytes` more, growing by the current size up to `max_growth`.
+		 *
+		 */
+		auto _reserve(std::size_t bytes) -> bool {
+			const auto need = _header.end + bytes;
+			if (need <= _mapping.size() && _mapping.data())
+				return true;
+			const auto growth = std::clamp(_mapping.size(), initial_capacity, max_growth);
+			return _mapping.resize(std::max<std::size_t>(need, _mapping.size() + growth));
+		}
+
+		auto _write_index(std::chrono::nanoseconds now) -> void {
+			auto* at = _mapping.data() + _header.end;
+			details::store(
+				at,
+				RecordHeader {
+					.size	  = static_cast<std::uint32_t>(index_size),
+					.kind	  = Kind::Index,
+					.flags	  = 0,
+					.reserved = 0,
+					.time	  = static_cast<std::uint64_t>(now.count()),
+				}
+			);
+			details::store(
+				at + sizeof(RecordHeader),
+				IndexHeader {
+					.previous = _header.last_index,
+					.first	  = _header.count - _pending.size(),
+					.count	  = _pending.size(),
+				}
+			);
+			std::memcpy(
+				at + sizeof(RecordHeader) + sizeof(IndexHeader),
+				_pending.data(),
+				_pending.size() * sizeof(std::uint64_t)
+			);
+
+			_header.last_index	= _header.end;
+			_header.end		   += index_size;
+			_pending.clear();
+		}
+
+	private:
+		mutable std::mutex		   _mutex;
+		details::Mapping		   _mapping;
+		Header					   _header {};
+		std::vector<std::uint64_t> _pending;  // offsets of the entries since the last index record
+	};
+}  // namespace dcs213::p1::history
@@ -1,10 +1,15 @@
 #pragma once
 
+#include "Alloc.hpp"
+#include "Dispatch.hpp"
+#include "Math.hpp"
 #include "String.hpp"
+#include "Trace.hpp"
 #include "Utils.hpp"
 
 #include <tl/expected.hpp>
 
+#include <cctype>
 #include <numbers>
 #include <optional>
 #include <cstdint>
@@ -82,14 +87,28 @@ namespace dcs213::p1::lex {
 		}
 	}
 
-	struct Variable {};
+	/**
+	 * @brief A variable, named by a single letter other than the constant `e`.
+	 *
+	 */
+	struct Variable {
+		char name = 'x';
+
+		inline friend constexpr auto operator==(Variable, Variable) -> bool = default;
+	};
+
+	/**
+	 * @brief A built-in function, e.g. `sin`, applied like the prefix operator `ln`.
+	 *
+	 */
+	using math::Function;
 
 	/**
 	 * @brief Token is an atomic element in parsing.
 	 *
 	 */
 	struct Token {
-		using Kind = std::variant<Number, Operator, Constant, Variable>;
+		using Kind = std::variant<Number, Operator, Constant, Variable, Function>;
 
 		Kind			   token;
 		bool			   conj = false;
@@ -120,7 +139,12 @@ namespace dcs213::p1::lex {
 								   case Constant::Pi: return std::format("CONSTANT(pi)");
 							   }
 						   },
-						   [&](const Variable& tok) { return std::format("VARIABLE(x)"); } },
+						   [&](const Variable& tok) {
+							   return std::format("VARIABLE({})", tok.name);
+						   },
+						   [&](const Function& tok) {
+							   return std::format("FUNCTION({})", math::to_string(tok));
+						   } },
 				token
 			);
 		}
@@ -138,7 +162,12 @@ namespace dcs213::p1::lex {
 						[&](const Constant& tok) {
 							return tok == *std::get_if<Constant>(&rhs.token);
 						},
-						[&](const Variable& tok) { return true; },
+						[&](const Variable& tok) {
+							return tok == *std::get_if<Variable>(&rhs.token);
+						},
+						[&](const Function& tok) {
+							return tok == *std::get_if<Function>(&rhs.token);
+						},
 					},
 					lhs.token
 				);
@@ -342,29 +371,34 @@ namespace dcs213::p1::lex {
 	 */
 	inline static auto lex_unsigned_number(std::string_view script)
 		-> tl::expected<std::tuple<double, std::string_view>, LexError> {
-		Cursor cursor  = script;
-		bool   dotted  = false;
-		double val	   = 0.;
-		int	   dec_exp = 0;	 // decimal exponent
-
-		if (const auto fst = cursor.first())
-			if (!is_number(fst))
-				return make_error(LexErrors::NotMatched {});
-
-		while (const auto c = cursor.first()) {
-			if (is_number(c))
-				if (!dotted)  // integer part
-					val = val * 10. + static_cast<double>(c - '0');
-				else		  // decimal part
-					val = val + std::pow(.1, ++dec_exp) * (c - '0');
-			else if (c == '.' && !dotted)
-				dotted = true;
-			else
-				break;
-			cursor.bump();
-		}
+		constexpr std::size_t exact_digits = 15;  // below 2^53, so exact in a double
+
+		const auto		  digits = dispatch::kernels().digits;
+		const char* const first	 = script.data();
+		const char* const last	 = script.data() + script.size();
 
-		return std::tuple { val, cursor.rest(0) };
+		const char* const int_end = digits(first, last);
+		if (int_end == first)
+			return make_error(LexErrors::NotMatched {});
+
+		double val = 0.;
+		if (static_cast<std::size_t>(int_end - first) <= exact_digits) {
+			std::uint64_t n = 0;
+			for (auto p = first; p != int_end; ++p)
+				n = n * 10 + static_cast<std::uint64_t>(*p - '0');
+			val = static_cast<double>(n);
+		} else
+			for (auto p = first; p != int_end; ++p) val = val * 10. + static_cast<double>(*p - '0');
+
+		if (int_end == last || *int_end != '.')
+			return std::tuple { val, script.substr(int_end - first) };
+
+		const char* const frac_end = digits(int_end + 1, last);
+		int				  dec_exp  = 0;	 // decimal exponent
+		for (auto p = int_end + 1; p != frac_end; ++p)
+			val = val + std::pow(.1, ++dec_exp) * (*p - '0');
+
+		return std::tuple { val, script.substr(frac_end - first) };
 	}
 
 	/**
@@ -433,6 +467,24 @@ namespace dcs213::p1::lex {
 		return make_error(LexErrors::NotMatched {});
 	}
 
+	/**
+	 * @brief Try lex the head of a script into a built-in function. Tried before constants, so
+	 * that `exp` is not read as `e`.
+	 *
+	 * @param script
+	 * @return LexResult
+	 */
+	inline static auto lex_function(std::string_view script) -> LexResult {
+		for (std::size_t i = 0; i < math::function_count; ++i) {
+			const auto fn	= static_cast<Function>(i);
+			const auto name = math::to_string(fn);
+			if (script.starts_with(name))
+				return LexSuccess::make(fn, script.substr(name.size()));
+		}
+
+		return make_error(LexErrors::NotMatched {});
+	}
+
 	/**
 	 * @brief Try lex the head of a script into a constant.
 	 *
@@ -451,22 +503,21 @@ namespace dcs213::p1::lex {
 	}
 
 	/**
-	 * @brief Try lex the head of a script into a varaible $x$.
+	 * @brief Try lex the head of a script into a variable, a single letter like $x$ or $y$.
 	 *
 	 * @param script
 	 * @return LexResult
 	 */
 	inline static auto lex_variable(std::string_view script) -> LexResult {
-		if (script.size() >= 1 && script.substr(0, 1) == "x") {
+		if (script.size() >= 1 && std::isalpha(static_cast<unsigned char>(script[0]))) {
 			return LexSuccess {
 				.tok =
 					Token {
-						   .token = Variable {},
+						   .token = Variable { script[0] },
 						   .conj  = is_space(script.substr(1)),
 						   },
 				.rest = trim_space(script.substr(1)),
 			};
-			return LexSuccess::make(Variable {}, script.substr(1));
 		}
 		return make_error(LexErrors::NotMatched {});
 	}
@@ -509,9 +560,13 @@ namespace dcs213::p1::lex {
 	 * @return tl::expected<TokenStream, LexError>
 	 */
 	inline static auto lex(std::string_view script) -> tl::expected<TokenStream, LexError> {
+		DCS213_P1_TRACE_SCOPE(Lex);
+		DCS213_P1_ALLOC_TAG(Lex);
+
 		static constexpr auto lex_handler = handle_lex {
 			&lex_operator,
 			&lex_number,
+			&lex_function,
 			&lex_constant,
 			&lex_variable,
 		};
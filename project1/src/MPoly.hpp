@@ -0,0 +1,513 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace dcs213::p1::evaluate {
+	/**
+	 * @brief The variables of multivariate polynomials, and how a monomial packs into 64 bits.
+	 *
+	 * Every variable gets a field of the key, the first one the most significant, so comparing
+	 * keys compares monomials lexicographically and multiplying monomials adds their keys. The
+	 * fields are 64, 32, 16 or 8 bits wide for up to 1, 2, 4 or 8 variables, and exponents keep
+	 * the top bit of theirs clear, so that adding two never carries into the next field.
+	 */
+	class Ring {
+	public:
+		inline static constexpr std::size_t max_variables = 8;
+
+		/**
+		 * @brief The ring over `names`, which are sorted and distinct.
+		 *
+		 * @param names
+		 * @return the ring, or `std::nullopt` if there are too many variables
+		 */
+		inline static auto of(std::span<const char> names) -> std::optional<Ring> {
+			if (names.size() > max_variables)
+				return std::nullopt;
+
+			Ring ring;
+			std::ranges::copy(names, ring._names.begin());
+			ring._count = names.size();
+			ring._bits	= 64 >> std::bit_width(std::max<std::size_t>(names.size(), 1) - 1);
+			return ring;
+		}
+
+	public:
+		[[nodiscard]] auto variables() const -> std::span<const char> {
+			return { _names.data(), _count };
+		}
+
+		[[nodiscard]] auto index(char name) const -> std::optional<std::size_t> {
+			for (std::size_t i = 0; i < _count; ++i)
+				if (_names[i] == name)
+					return i;
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief The largest exponent a variable can have.
+		 *
+		 */
+		[[nodiscard]] auto max_exponent() const -> std::uint64_t {
+			return (1ull << (_bits - 1)) - 1;
+		}
+
+		/**
+		 * @brief The key of `var ^ expo`, which is at most `max_exponent()`.
+		 *
+		 */
+		[[nodiscard]] auto key(std::size_t var, std::uint64_t expo) const -> std::uint64_t {
+			return expo << _shift(var);
+		}
+
+		[[nodiscard]] auto exponent(std::uint64_t key, std::size_t var) const -> std::uint64_t {
+			const auto mask = _bits == 64 ? ~0ull : (1ull << _bits) - 1;
+			return (key >> _shift(var)) & mask;
+		}
+
+		inline friend auto operator==(const Ring& lhs, const Ring& rhs) -> bool {
+			return std::ranges::equal(lhs.variables(), rhs.variables());
+		}
+
+	private:
+		Ring() = default;
+
+		[[nodiscard]] auto _shift(std::size_t var) const -> unsigned {
+			return 64 - _bits * static_cast<unsigned>(var + 1);
+		}
+
+	private:
+		std::array<char, max_variables> _names {};
+		std::size_t						_count = 0;
+		unsigned						_bits  = 64;  // per variable
+	};
+
+	/**
+	 * @brief Sparse multivariate polynomial, with non-negative integral exponents.
+	 *
+	 * Terms are kept sorted by their packed monomial keys, without zero coefficients. Both
+	 * operands of an operation are over the same ring.
+	 */
+	class MPoly {
+	public:
+		struct Term {
+			double		  coef = 1.;
+			std::uint64_t key  = 0;	 // packed exponents, see `Ring`
+		};
+
+	public:
+		explicit MPoly(Ring ring) : _ring(ring) {}
+
+		/**
+		 * @brief A polynomial of the given terms, in any order, like ones merged.
+		 *
+		 * @param ring
+		 * @param terms
+		 */
+		MPoly(Ring ring, std::vector<Term> terms) : _ring(ring), _terms(std::move(terms)) {
+			_normalize();
+		}
+
+		inline static auto constant(Ring ring, double coef) -> MPoly {
+			MPoly res { ring };
+			if (coef != 0.)
+				res._terms.push_back({ .coef = coef, .key = 0 });
+			return res;
+		}
+
+		/**
+		 * @brief `var ^ expo`.
+		 *
+		 * @return the monomial, or `std::nullopt` if the exponent does not fit
+		 */
+		inline static auto variable(Ring ring, std::size_t var, std::uint64_t expo = 1)
+			-> std::optional<MPoly> {
+			if (expo > ring.max_exponent())
+				return std::nullopt;
+			MPoly res { ring };
+			res._terms.push_back({ .coef = 1., .key = ring.key(var, expo) });
+			return res;
+		}
+
+	public:
+		[[nodiscard]] auto ring() const -> const Ring& { return _ring; }
+
+		[[nodiscard]] auto terms() const -> std::span<const Term> { return _terms; }
+
+		[[nodiscard]] auto size() const -> std::size_t { return _terms.size(); }
+
+		/**
+		 * @brief The value of a polynomial without variables.
+		 *
+		 * @return the constant, or `std::nullopt` if some term has a variable
+		 */
+		[[nodiscard]] auto constant_value() const -> std::optional<double> {
+			if (_terms.empty())
+				return 0.;
+			else if (_terms.size() == 1 && _terms[0].key == 0)
+				return _terms[0].coef;
+			return std::nullopt;
+		}
+
+		inline friend auto operator+(const MPoly& lhs, const MPoly& rhs) -> MPoly {
+			return _merge(lhs, rhs, 1.);
+		}
+
+		inline friend auto operator-(const MPoly& lhs, const MPoly& rhs) -> MPoly {
+			return _merge(lhs, rhs, -1.);
+		}
+
+		/**
+		 * @brief Add up many polynomials at once, by a k-way merge.
+		 *
+		 * @param ring
+		 * @param polys
+		 * @return MPoly
+		 */
+		[[nodiscard]] inline static auto merge(Ring ring, std::span<const MPoly> polys) -> MPoly {
+			struct Cursor {
+				std::uint64_t key;
+				std::size_t	  poly;
+				std::size_t	  index;
+			};
+
+			// Equal keys are summed in poly order, like folding `+` would.
+			const auto later = [](const Cursor& a, const Cursor& b) {
+				return std::tie(a.key, a.poly, a.index) > std::tie(b.key, b.poly, b.index);
+			};
+
+			std::vector<Cursor> heap;
+			std::size_t			total = 0;
+			heap.reserve(polys.size());
+			for (std::size_t i = 0; i < polys.size(); ++i)
+				if (!polys[i]._terms.empty()) {
+					heap.push_back({ polys[i]._terms[0].key, i, 0 });
+					total += polys[i].size();
+				}
+			std::ranges::make_heap(heap, later);
+
+			MPoly res { ring };
+			res._terms.reserve(total);
+
+			while (!heap.empty()) {
+				std::ranges::pop_heap(heap, later);
+				auto&		cur	  = heap.back();
+				const auto& terms = polys[cur.poly]._terms;
+				res._add(terms[cur.index].coef, cur.key);
+
+				if (++cur.index < terms.size()) {
+					cur.key = terms[cur.index].key;
+					std::ranges::push_heap(heap, later);
+				} else
+					heap.pop_back();
+			}
+
+			res._drop_zeros();
+			return res;
+		}
+
+		/**
+		 * @brief Multiply two polynomials.
+		 *
+		 * Products whose keys span a range comparable to the number of input terms, e.g. dense
+		 * univariate ones, are accumulated into a flat coefficient array indexed by key; the
+		 * others go through Johnson's heap-based sparse multiplication.
+		 *
+		 * @return the product, or `std::nullopt` if some exponent does not fit
+		 */
+		[[nodiscard]] inline static auto product(const MPoly& lhs, const MPoly& rhs)
+			-> std::optional<MPoly> {
+			assert(lhs._ring == rhs._ring);
+
+			if (lhs._terms.empty() || rhs._terms.empty())
+				return MPoly { lhs._ring };
+			if (_overflows(lhs, rhs))
+				return std::nullopt;
+
+			return _is_dense_product(lhs, rhs) ? _mul_dense(lhs, rhs) : _mul_heap(lhs, rhs);
+		}
+
+		/**
+		 * @brief An upper bound on the number of terms of the product, to charge up front.
+		 *
+		 * The product has at most one term per exponent vector in the box the exponents of both
+		 * sides span.
+		 */
+		[[nodiscard]] inline static auto product_bound(const MPoly& lhs, const MPoly& rhs)
+			-> std::size_t {
+			const auto products = lhs.size() * rhs.size();
+			if (products == 0)
+				return 0;
+
+			double box = 1.;
+			for (std::size_t var = 0; var < lhs._ring.variables().size(); ++var) {
+				const auto [lmin, lmax] = _range(lhs, var);
+				const auto [rmin, rmax] = _range(rhs, var);
+				box *= static_cast<double>((lmax - lmin) + (rmax - rmin)) + 1.;
+			}
+			return box < static_cast<double>(products) ? static_cast<std::size_t>(box) : products;
+		}
+
+		[[nodiscard]] auto scaled(double factor) const -> MPoly {
+			MPoly res = *this;
+			for (auto& term : res._terms) term.coef *= factor;
+			res._drop_zeros();
+			return res;
+		}
+
+		/**
+		 * @brief The partial derivative with respect to `var`.
+		 *
+		 * Lowering one field of every key that has it non-zero keeps the order.
+		 */
+		[[nodiscard]] auto derivative(std::size_t var) const -> MPoly {
+			const auto unit = _ring.key(var, 1);
+
+			MPoly res { _ring };
+			res._terms.reserve(size());
+			for (const auto [c, k] : _terms)
+				if (const auto e = _ring.exponent(k, var); e > 0)
+					res._terms.push_back({ .coef = c * static_cast<double>(e), .key = k - unit });
+			return res;
+		}
+
+		/**
+		 * @brief Substitute `value` for `var`, which stays in the ring with exponent zero.
+		 *
+		 * Without other variables, this is a plain sum like `TermList::eval`.
+		 */
+		[[nodiscard]] auto substitute(std::size_t var, double value) const -> MPoly {
+			if (_ring.variables().size() == 1) {
+				double res = 0.;
+				for (const auto [c, k] : _terms) res += c * std::pow(value, static_cast<double>(k));
+				return constant(_ring, res);
+			}
+
+			std::vector<Term> terms;
+			terms.reserve(size());
+			for (const auto [c, k] : _terms) {
+				const auto e = _ring.exponent(k, var);
+				terms.push_back({
+					.coef = c * std::pow(value, static_cast<double>(e)),
+					.key  = k - _ring.key(var, e),
+				});
+			}
+			return { _ring, std::move(terms) };
+		}
+
+		[[nodiscard]] auto to_string() const -> std::string {
+			if (_terms.empty())
+				return "0";
+
+			std::string s = _to_string(_terms[0]);
+			for (std::size_t i = 1; i < _terms.size(); ++i)
+				s += std::format("{}{}", _terms[i].coef > 0 ? "+" : "", _to_string(_terms[i]));
+			return s;  // nrvo
+		}
+
+	private:
+		inline static constexpr std::size_t dense_span_factor = 4;
+		inline static constexpr std::size_t dense_span_limit  = 1 << 20;
+
+		/**
+		 * @brief Add a term with a key no smaller than the last one.
+		 *
+		 */
+		auto _add(double coef, std::uint64_t key) -> void {
+			if (!_terms.empty() && _terms.back().key == key)
+				_terms.back().coef += coef;
+			else
+				_terms.push_back({ .coef = coef, .key = key });
+		}
+
+		auto _drop_zeros() -> void {
+			std::erase_if(_terms, [](const Term& term) { return term.coef == 0.; });
+		}
+
+		/**
+		 * @brief Sort the terms and merge equal keys, in place.
+		 *
+		 */
+		auto _normalize() -> void {
+			if (!std::ranges::is_sorted(_terms, {}, &Term::key))
+				std::ranges::sort(_terms, {}, &Term::key);
+
+			std::size_t n = 0;
+			for (std::size_t i = 0; i < _terms.size(); ++i)
+				if (n > 0 && _terms[n - 1].key == _terms[i].key)
+					_terms[n - 1].coef += _terms[i].coef;
+				else
+					_terms[n++] = _terms[i];
+			_terms.resize(n);
+			_drop_zeros();
+		}
+
+		[[nodiscard]] inline static auto _merge(const MPoly& lhs, const MPoly& rhs, double sign)
+			-> MPoly {
+			assert(lhs._ring == rhs._ring);
+
+			MPoly res { lhs._ring };
+			res._terms.reserve(lhs.size() + rhs.size());
+
+			std::size_t i = 0, j = 0;
+			while (i < lhs.size() || j < rhs.size())
+				if (j == rhs.size() || (i < lhs.size() && lhs._terms[i].key < rhs._terms[j].key))
+					res._add(lhs._terms[i].coef, lhs._terms[i].key), ++i;
+				else
+					res._add(sign * rhs._terms[j].coef, rhs._terms[j].key), ++j;
+
+			res._drop_zeros();
+			return res;
+		}
+
+		/**
+		 * @brief Whether some product of terms has an exponent out of range.
+		 *
+		 * Per variable, the largest exponents of both sides are what could overflow.
+		 */
+		[[nodiscard]] inline static auto _overflows(const MPoly& lhs, const MPoly& rhs) -> bool {
+			for (std::size_t var = 0; var < lhs._ring.variables().size(); ++var)
+				if (_range(lhs, var).second + _range(rhs, var).second > lhs._ring.max_exponent())
+					return true;
+			return false;
+		}
+
+		/**
+		 * @brief The smallest and largest exponent of `var` in a non-empty polynomial.
+		 *
+		 */
+		[[nodiscard]] inline static auto _range(const MPoly& poly, std::size_t var)
+			-> std::pair<std::uint64_t, std::uint64_t> {
+			auto range = std::pair<std::uint64_t, std::uint64_t> { ~0ull, 0 };
+			for (const auto& term : poly._terms) {
+				const auto e = poly._ring.exponent(term.key, var);
+				range		 = { std::min(range.first, e), std::max(range.second, e) };
+			}
+			return range;
+		}
+
+		[[nodiscard]] inline static auto _is_dense_product(const MPoly& lhs, const MPoly& rhs)
+			-> bool {
+			const auto l = lhs._terms.back().key - lhs._terms.front().key;
+			const auto r = rhs._terms.back().key - rhs._terms.front().key;
+
+			return l < dense_span_limit && r < dense_span_limit && l + r < dense_span_limit
+				&& l + r + 1 <= dense_span_factor * (lhs.size() + rhs.size());
+		}
+
+		/**
+		 * @brief Schoolbook multiplication into a flat coefficient array indexed by key.
+		 *
+		 */
+		[[nodiscard]] inline static auto _mul_dense(const MPoly& lhs, const MPoly& rhs) -> MPoly {
+			const auto base = lhs._terms.front().key + rhs._terms.front().key;
+			const auto span = static_cast<std::size_t>(
+				(lhs._terms.back().key - lhs._terms.front().key)
+				+ (rhs._terms.back().key - rhs._terms.front().key) + 1
+			);
+
+			std::vector<double> coefs(span, 0.);
+			for (const auto [c1, k1] : lhs._terms)
+				for (const auto [c2, k2] : rhs._terms) coefs[k1 + k2 - base] += c1 * c2;
+
+			MPoly res { lhs._ring };
+			res._terms.reserve(std::min(span, lhs.size() * rhs.size()));
+			for (std::size_t i = 0; i < span; ++i)
+				if (coefs[i] != 0.)
+					res._terms.push_back({ .coef = coefs[i], .key = base + i });
+			return res;
+		}
+
+		/**
+		 * @brief Johnson's heap-based sparse multiplication, merging equal keys on the fly.
+		 *
+		 * Equal keys are summed in the order of the schoolbook product, by `lhs` index, which is
+		 * descending along the shorter operand when it is `rhs` (`swapped`).
+		 */
+		[[nodiscard]] inline static auto _mul_heap(
+			const MPoly& lhs,
+			const MPoly& rhs,
+			bool		 swapped = false
+		) -> MPoly {
+			if (lhs.size() > rhs.size())
+				return _mul_heap(rhs, lhs, true);
+
+			struct Cursor {
+				std::uint64_t key;
+				std::size_t	  i;  // index into `lhs`
+				std::size_t	  j;  // index into `rhs`
+			};
+
+			const auto later = [swapped](const Cursor& a, const Cursor& b) {
+				if (a.key != b.key)
+					return a.key > b.key;
+				return swapped ? a.i < b.i : a.i > b.i;
+			};
+			const auto& l = lhs._terms;
+			const auto& r = rhs._terms;
+
+			std::vector<Cursor> heap;
+			heap.reserve(l.size());
+			for (std::size_t i = 0; i < l.size(); ++i)
+				heap.push_back({ l[i].key + r[0].key, i, 0 });
+			std::ranges::make_heap(heap, later);
+
+			MPoly res { lhs._ring };
+
+			while (!heap.empty()) {
+				std::ranges::pop_heap(heap, later);
+				auto& cur = heap.back();
+				res._add(l[cur.i].coef * r[cur.j].coef, cur.key);
+
+				if (++cur.j < r.size()) {
+					cur.key = l[cur.i].key + r[cur.j].key;
+					std::ranges::push_heap(heap, later);
+				} else
+					heap.pop_back();
+			}
+
+			res._drop_zeros();
+			return res;
+		}
+
+		[[nodiscard]] auto _to_string(const Term& term) const -> std::string {
+			std::string monomial;
+			for (std::size_t var = 0; var < _ring.variables().size(); ++var) {
+				const auto e = _ring.exponent(term.key, var);
+				if (e == 0)
+					continue;
+				if (!monomial.empty())
+					monomial += '*';
+				monomial += _ring.variables()[var];
+				if (e != 1)
+					std::format_to(std::back_inserter(monomial), "^{}", e);
+			}
+
+			if (monomial.empty())
+				return std::format("{}", term.coef);
+			else if (term.coef == 1.)
+				return monomial;
+			else if (term.coef == -1.)
+				return "-" + monomial;
+			else
+				return std::format("{}*{}", term.coef, monomial);
+		}
+
+	private:
+		Ring			  _ring;
+		std::vector<Term> _terms;  // by key
+	};
+}  // namespace dcs213::p1::evaluate
@@ -0,0 +1,785 @@
+#pragma once
+
+#include "Dispatch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+
+/**
+ * @brief Built-in elementary functions, one point at a time or in batches.
+ *
+ * Every function has a scalar implementation and, on x86, AVX2 and AVX-512 ones, chosen through
+ * `dispatch::kernels()` (`Kernel::Math`). All of them run the same operations in the same order,
+ * without fused multiply-adds, so a point gives bit for bit the same result whichever
+ * implementation and evaluation mode it goes through.
+ *
+ * Error bounds, against correctly rounded results:
+ * - `sqrt` and `abs` are exact.
+ * - `exp` is within 1 ulp, except for subnormal results, which are within 1 ulp of the smallest
+ *   normal.
+ * - `log` is within 1 ulp.
+ * - `sin` and `cos` are within 1 ulp, `tan` within 2.5 ulp, for |x| < 2^20. Larger arguments go
+ *   to libm, whose argument reduction is exact.
+ */
+namespace dcs213::p1::math {
+	enum class Function : std::uint8_t {
+		Sin,
+		Cos,
+		Tan,
+		Exp,
+		Log,   // natural, same as `ln`
+		Sqrt,
+		Abs,
+	};
+
+	inline static constexpr std::size_t function_count = 7;
+
+	inline static constexpr auto to_string(Function fn) -> std::string_view {
+		switch (fn) {
+			case Function::Sin: return "sin";
+			case Function::Cos: return "cos";
+			case Function::Tan: return "tan";
+			case Function::Exp: return "exp";
+			case Function::Log: return "log";
+			case Function::Sqrt: return "sqrt";
+			case Function::Abs: return "abs";
+		}
+		return "?";
+	}
+
+	/**
+	 * @brief The function spelled `name`, if any.
+	 *
+	 */
+	inline static constexpr auto parse_function(std::string_view name) -> std::optional<Function> {
+		for (std::size_t f = 0; f < function_count; ++f)
+			if (name == to_string(static_cast<Function>(f)))
+				return static_cast<Function>(f);
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief `ys[i] = f(xs[i])` for `i < n`. `xs` and `ys` may be the same array.
+	 *
+	 */
+	using BatchFn = void (*)(const double* xs, double* ys, std::size_t n);
+
+	namespace details {
+		inline static constexpr double shift = 0x1.8p52;  // x + shift - shift rounds x to integer
+		inline static constexpr double inf	 = std::numeric_limits<double>::infinity();
+		inline static constexpr double nan	 = std::numeric_limits<double>::quiet_NaN();
+
+		// exp: e^x = 2^k e^r, |r| <= ln(2) / 2, then fdlibm's rational approximation of e^r.
+		inline static constexpr double exp_lo = -746., exp_hi = 710.;  // 0 and inf beyond
+		inline static constexpr double log2e  = 1.44269504088896338700e+00;
+		inline static constexpr double ln2_hi = 6.93147180369123816490e-01;	 // 32 bits
+		inline static constexpr double ln2_lo = 1.90821492927058770002e-10;
+		inline static constexpr double exp_coefs[] {
+			1.66666666666666019037e-01,
+			-2.77777777770155933842e-03,
+			6.61375632143793436117e-05,
+			-1.65339022054652515390e-06,
+			4.13813679705723846039e-08,
+		};
+
+		// log: x = 2^k (1 + f), sqrt(2) / 2 <= 1 + f < sqrt(2), then fdlibm's log(1 + f).
+		inline static constexpr std::uint64_t log_offset = 0x3fe6a09e00000000ull;	// sqrt(2) / 2
+		inline static constexpr std::uint64_t mantissa	 = 0x000fffffffffffffull;
+		inline static constexpr double		  log_even[] {
+			   3.999999999940941908e-01,
+			   2.222219843214978396e-01,
+			   1.531383769920937332e-01,
+		};
+		inline static constexpr double log_odd[] {
+			6.666666666666735130e-01,
+			2.857142874366239149e-01,
+			1.818357216161805012e-01,
+			1.479819860511658591e-01,
+		};
+
+		// sin, cos, tan: x = q pi / 2 + r, |r| <= pi / 4, with r in two parts, then fdlibm's
+		// kernels. pi / 2 is split in three like fdlibm's third round: near a multiple of it, r
+		// loses up to 50 bits to cancellation, so two parts are not enough.
+		inline static constexpr double trig_limit  = 0x1p20;  // q * pio2_k stays exact below
+		inline static constexpr double two_over_pi = 6.36619772367581382433e-01;
+		inline static constexpr double pio2_1	   = 1.57079632673412561417e+00;  // 33 bits
+		inline static constexpr double pio2_2	   = 6.07710050630396597660e-11;  // 33 bits
+		inline static constexpr double pio2_3	   = 2.02226624871116645580e-21;  // 33 bits
+		inline static constexpr double pio2_3t	   = 8.47842766036889956997e-32;
+		inline static constexpr double sin_s1	   = -1.66666666666666324348e-01;
+		inline static constexpr double sin_coefs[] {
+			8.33333333332248946124e-03,
+			-1.98412698298579493134e-04,
+			2.75573137070700676789e-06,
+			-2.50507602534068634195e-08,
+			1.58969099521155010221e-10,
+		};
+		inline static constexpr double cos_coefs[] {
+			4.16666666666666019037e-02,
+			-1.38888888888741095749e-03,
+			2.48015872894767294178e-05,
+			-2.75573143513906633035e-07,
+			2.08757232129817482790e-09,
+			-1.13596475577881948265e-11,
+		};
+
+		// Scalar
+
+		DCS213_P1_NO_CONTRACT inline static auto bits(double x) -> std::uint64_t {
+			return std::bit_cast<std::uint64_t>(x);
+		}
+
+		DCS213_P1_NO_CONTRACT inline static auto from_bits(std::uint64_t x) -> double {
+			return std::bit_cast<double>(x);
+		}
+
+		template<std::size_t N>
+		DCS213_P1_NO_CONTRACT inline auto horner(double z, const double (&coefs)[N]) -> double {
+			double p = coefs[N - 1];
+			for (auto k = N - 1; k-- > 0;) p = coefs[k] + z * p;
+			return p;
+		}
+
+		/**
+		 * @brief The kernels of sin and cos on the reduced argument, and the quadrant.
+		 *
+		 */
+		struct Reduced {
+			double		  sin;
+			double		  cos;
+			std::uint64_t quadrant;	 // in the low two bits
+		};
+
+		DCS213_P1_NO_CONTRACT inline auto reduce_scalar(double x) -> Reduced {
+			const double qd = x * two_over_pi + shift;
+			const double q	= qd - shift;
+
+			// r = hi + lo, where `t`, `u` and `v3` are exact, and `w` picks up the roundings of
+			// `r1` and `r0`. `r1` may be smaller than `v3`, hence the full two-sum for `r0`.
+			const double t	= x - q * pio2_1;
+			const double u	= q * pio2_2;
+			const double r1 = t - u;
+			const double v3 = q * pio2_3;
+			const double r0 = r1 - v3;
+			const double b	= r0 - r1;
+			const double w	= q * pio2_3t - (((t - r1) - u) + ((r1 - (r0 - b)) - (v3 + b)));
+			const double hi = r0 - w;
+			const double lo = (r0 - hi) - w;
+
+			const double z	= hi * hi;
+			const double v	= z * hi;
+			const double hz = .5 * z;
+			const double c1 = 1. - hz;
+			return {
+				.sin	  = hi - ((z * (.5 * lo - v * horner(z, sin_coefs)) - lo) - v * sin_s1),
+				.cos	  = c1 + (((1. - c1) - hz) + (z * (z * horner(z, cos_coefs)) - hi * lo)),
+				.quadrant = bits(qd),
+			};
+		}
+
+		DCS213_P1_NO_CONTRACT inline auto sin_scalar(double x) -> double {
+			if (!(std::abs(x) < trig_limit))
+				return std::sin(x);
+			const auto [s, c, q] = reduce_scalar(x);
+			const auto y		 = (q & 1) != 0 ? c : s;
+			return (q & 2) != 0 ? -y : y;
+		}
+
+		DCS213_P1_NO_CONTRACT inline auto cos_scalar(double x) -> double {
+			if (!(std::abs(x) < trig_limit))
+				return std::cos(x);
+			const auto [s, c, q0] = reduce_scalar(x);
+			const auto q		  = q0 + 1;	 // cos(x) = sin(x + pi / 2)
+			const auto y		  = (q & 1) != 0 ? c : s;
+			return (q & 2) != 0 ? -y : y;
+		}
+
+		DCS213_P1_NO_CONTRACT inline auto tan_scalar(double x) -> double {
+			if (!(std::abs(x) < trig_limit))
+				return std::tan(x);
+			const auto [s, c, q] = reduce_scalar(x);
+			return (q & 1) != 0 ? -c / s : s / c;
+		}
+
+		DCS213_P1_NO_CONTRACT inline auto exp_scalar(double x) -> double {
+			const double xc = std::min(std::max(x, exp_lo), exp_hi);  // NaN stays NaN
+			const double k	= (xc * log2e + shift) - shift;
+			const double hi = xc - k * ln2_hi;	// exact
+			const double lo = k * ln2_lo;
+			const double r	= hi - lo;
+			const double t	= r * r;
+			const double c	= r - t * horner(t, exp_coefs);
+			const double p	= 1. - ((lo - (r * c) / (2. - c)) - hi);
+
+			// 2^k in two factors, so that subnormal and overflowing results come out right.
+			const double k1 = (k * .5 + shift) - shift;
+			const double s1 = from_bits(bits(k1 + (shift + 1023.)) << 52);
+			const double s2 = from_bits(bits((k - k1) + (shift + 1023.)) << 52);
+			return p * s1 * s2;
+		}
+
+		DCS213_P1_NO_CONTRACT inline auto log_scalar(double x) -> double {
+			const bool	 tiny = x < 0x1p-1022;	// scaled into normal numbers first
+			const double xs	  = tiny ? x * 0x1p54 : x;
+
+			const std::uint64_t ix = bits(xs) + (0x3ff0000000000000ull - log_offset);
+			const double e = from_bits((ix >> 52) | bits(shift)) - (shift + 1023.);
+			const double k = e - (tiny ? 54. : 0.);
+			const double f = from_bits((ix & mantissa) + log_offset) - 1.;
+
+			const double hfsq = .5 * f * f;
+			const double s	  = f / (2. + f);
+			const double z	  = s * s;
+			const double w	  = z * z;
+			const double r	  = z * horner(w, log_odd) + w * horner(w, log_even);
+			const double y	  = s * (hfsq + r) + k * ln2_lo - hfsq + f + k * ln2_hi;
+
+			return x > 0. ? (x == inf ? inf : y) : (x == 0. ? -inf : nan);
+		}
+
+		DCS213_P1_NO_CONTRACT inline auto sqrt_scalar(double x) -> double { return std::sqrt(x); }
+
+		DCS213_P1_NO_CONTRACT inline auto abs_scalar(double x) -> double { return std::abs(x); }
+
+		template<double (*F)(double)>
+		DCS213_P1_NO_CONTRACT
+		inline auto batch_scalar(const double* xs, double* ys, std::size_t n) -> void {
+			for (std::size_t i = 0; i < n; ++i) ys[i] = F(xs[i]);
+		}
+
+		inline static constexpr BatchFn scalar_table[function_count] {
+			&batch_scalar<&sin_scalar>,
+			&batch_scalar<&cos_scalar>,
+			&batch_scalar<&tan_scalar>,
+			&batch_scalar<&exp_scalar>,
+			&batch_scalar<&log_scalar>,
+			&batch_scalar<&sqrt_scalar>,
+			&batch_scalar<&abs_scalar>,
+		};
+
+#ifdef DCS213_P1_X86
+		// AVX2, 4 points at a time, the same operations as the scalar code.
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto set(double x) -> __m256d { return _mm256_set1_pd(x); }
+
+		template<std::size_t N>
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto horner(__m256d z, const double (&coefs)[N]) -> __m256d {
+			auto p = set(coefs[N - 1]);
+			for (auto k = N - 1; k-- > 0;) p = _mm256_add_pd(set(coefs[k]), _mm256_mul_pd(z, p));
+			return p;
+		}
+
+		struct Reduced256 {
+			__m256d sin;
+			__m256d cos;
+			__m256i quadrant;
+		};
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto reduce_avx2(__m256d x) -> Reduced256 {
+			const auto qd = _mm256_add_pd(_mm256_mul_pd(x, set(two_over_pi)), set(shift));
+			const auto q  = _mm256_sub_pd(qd, set(shift));
+
+			const auto t  = _mm256_sub_pd(x, _mm256_mul_pd(q, set(pio2_1)));
+			const auto u  = _mm256_mul_pd(q, set(pio2_2));
+			const auto r1 = _mm256_sub_pd(t, u);
+			const auto v3 = _mm256_mul_pd(q, set(pio2_3));
+			const auto r0 = _mm256_sub_pd(r1, v3);
+			const auto b  = _mm256_sub_pd(r0, r1);
+			const auto w  = _mm256_sub_pd(
+				 _mm256_mul_pd(q, set(pio2_3t)),
+				 _mm256_add_pd(
+					 _mm256_sub_pd(_mm256_sub_pd(t, r1), u),
+					 _mm256_sub_pd(
+						 _mm256_sub_pd(r1, _mm256_sub_pd(r0, b)),
+						 _mm256_add_pd(v3, b)
+					 )
+				 )
+			 );
+			const auto hi = _mm256_sub_pd(r0, w);
+			const auto lo = _mm256_sub_pd(_mm256_sub_pd(r0, hi), w);
+
+			const auto z   = _mm256_mul_pd(hi, hi);
+			const auto v   = _mm256_mul_pd(z, hi);
+			const auto hz  = _mm256_mul_pd(set(.5), z);
+			const auto c1  = _mm256_sub_pd(set(1.), hz);
+			const auto sin = _mm256_sub_pd(
+				hi,
+				_mm256_sub_pd(
+					_mm256_sub_pd(
+						_mm256_mul_pd(
+							z,
+							_mm256_sub_pd(
+								_mm256_mul_pd(set(.5), lo),
+								_mm256_mul_pd(v, horner(z, sin_coefs))
+							)
+						),
+						lo
+					),
+					_mm256_mul_pd(v, set(sin_s1))
+				)
+			);
+			const auto cos = _mm256_add_pd(
+				c1,
+				_mm256_add_pd(
+					_mm256_sub_pd(_mm256_sub_pd(set(1.), c1), hz),
+					_mm256_sub_pd(
+						_mm256_mul_pd(z, _mm256_mul_pd(z, horner(z, cos_coefs))),
+						_mm256_mul_pd(hi, lo)
+					)
+				)
+			);
+			return { sin, cos, _mm256_castpd_si256(qd) };
+		}
+
+		/**
+		 * @brief `s` or `c` by the low bit of the quadrant, negated by the next one.
+		 *
+		 */
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto quadrant_avx2(__m256d s, __m256d c, __m256i q) -> __m256d {
+			const auto one	= _mm256_set1_epi64x(1);
+			const auto low	= _mm256_and_si256(q, one);
+			const auto odd	= _mm256_castsi256_pd(_mm256_cmpeq_epi64(low, one));
+			const auto high = _mm256_slli_epi64(q, 62);
+			const auto sign = _mm256_and_si256(high, _mm256_castpd_si256(set(-0.)));
+			return _mm256_xor_pd(_mm256_blendv_pd(s, c, odd), _mm256_castsi256_pd(sign));
+		}
+
+		/**
+		 * @brief Recompute the points too large for the reduction with `f`.
+		 *
+		 */
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto fix_large_avx2(__m256d x, __m256d y, double (*f)(double)) -> __m256d {
+			const auto ax	 = _mm256_andnot_pd(set(-0.), x);
+			const auto large = _mm256_movemask_pd(_mm256_cmp_pd(ax, set(trig_limit), _CMP_NLT_UQ));
+			if (large == 0) [[likely]]
+				return y;
+
+			alignas(32) double xv[4], yv[4];
+			_mm256_store_pd(xv, x);
+			_mm256_store_pd(yv, y);
+			for (int l = 0; l < 4; ++l)
+				if ((large >> l) & 1)
+					yv[l] = f(xv[l]);
+			return _mm256_load_pd(yv);
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto sin_avx2(__m256d x) -> __m256d {
+			const auto [s, c, q] = reduce_avx2(x);
+			return fix_large_avx2(x, quadrant_avx2(s, c, q), &sin_scalar);
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto cos_avx2(__m256d x) -> __m256d {
+			const auto [s, c, q] = reduce_avx2(x);
+			const auto y		 = quadrant_avx2(s, c, _mm256_add_epi64(q, _mm256_set1_epi64x(1)));
+			return fix_large_avx2(x, y, &cos_scalar);
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto tan_avx2(__m256d x) -> __m256d {
+			const auto [s, c, q] = reduce_avx2(x);
+			const auto one		 = _mm256_set1_epi64x(1);
+			const auto odd = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(q, one), one));
+			const auto y   = _mm256_blendv_pd(
+				  _mm256_div_pd(s, c),
+				  _mm256_div_pd(_mm256_xor_pd(c, set(-0.)), s),
+				  odd
+			  );
+			return fix_large_avx2(x, y, &tan_scalar);
+		}
+
+		/**
+		 * @brief 2^k, for integral `k` within the exponent range.
+		 *
+		 */
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto scale_avx2(__m256d k) -> __m256d {
+			const auto biased = _mm256_castpd_si256(_mm256_add_pd(k, set(shift + 1023.)));
+			return _mm256_castsi256_pd(_mm256_slli_epi64(biased, 52));
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto exp_avx2(__m256d x) -> __m256d {
+			const auto xc = _mm256_min_pd(set(exp_hi), _mm256_max_pd(set(exp_lo), x));
+			const auto k  = _mm256_sub_pd(
+				 _mm256_add_pd(_mm256_mul_pd(xc, set(log2e)), set(shift)),
+				 set(shift)
+			 );
+			const auto hi = _mm256_sub_pd(xc, _mm256_mul_pd(k, set(ln2_hi)));
+			const auto lo = _mm256_mul_pd(k, set(ln2_lo));
+			const auto r  = _mm256_sub_pd(hi, lo);
+			const auto t  = _mm256_mul_pd(r, r);
+			const auto c  = _mm256_sub_pd(r, _mm256_mul_pd(t, horner(t, exp_coefs)));
+			const auto d  = _mm256_div_pd(_mm256_mul_pd(r, c), _mm256_sub_pd(set(2.), c));
+			const auto p  = _mm256_sub_pd(set(1.), _mm256_sub_pd(_mm256_sub_pd(lo, d), hi));
+
+			const auto half = _mm256_mul_pd(k, set(.5));
+			const auto k1	= _mm256_sub_pd(_mm256_add_pd(half, set(shift)), set(shift));
+			const auto k2	= _mm256_sub_pd(k, k1);
+			return _mm256_mul_pd(_mm256_mul_pd(p, scale_avx2(k1)), scale_avx2(k2));
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto log_avx2(__m256d x) -> __m256d {
+			const auto tiny = _mm256_cmp_pd(x, set(0x1p-1022), _CMP_LT_OQ);
+			const auto xs	= _mm256_blendv_pd(x, _mm256_mul_pd(x, set(0x1p54)), tiny);
+
+			const auto ix = _mm256_add_epi64(
+				_mm256_castpd_si256(xs),
+				_mm256_set1_epi64x(static_cast<long long>(0x3ff0000000000000ull - log_offset))
+			);
+			const auto biased	= _mm256_srli_epi64(ix, 52);
+			const auto exponent = _mm256_or_si256(biased, _mm256_castpd_si256(set(shift)));
+			const auto k		= _mm256_sub_pd(
+				   _mm256_sub_pd(_mm256_castsi256_pd(exponent), set(shift + 1023.)),
+				   _mm256_and_pd(tiny, set(54.))
+			   );
+			const auto f = _mm256_sub_pd(
+				_mm256_castsi256_pd(_mm256_add_epi64(
+					_mm256_and_si256(ix, _mm256_set1_epi64x(static_cast<long long>(mantissa))),
+					_mm256_set1_epi64x(static_cast<long long>(log_offset))
+				)),
+				set(1.)
+			);
+
+			const auto hfsq = _mm256_mul_pd(_mm256_mul_pd(set(.5), f), f);
+			const auto s	= _mm256_div_pd(f, _mm256_add_pd(set(2.), f));
+			const auto z	= _mm256_mul_pd(s, s);
+			const auto w	= _mm256_mul_pd(z, z);
+			const auto r	= _mm256_add_pd(
+				   _mm256_mul_pd(z, horner(w, log_odd)),
+				   _mm256_mul_pd(w, horner(w, log_even))
+			   );
+			auto y = _mm256_mul_pd(s, _mm256_add_pd(hfsq, r));
+			y	   = _mm256_add_pd(y, _mm256_mul_pd(k, set(ln2_lo)));
+			y	   = _mm256_sub_pd(y, hfsq);
+			y	   = _mm256_add_pd(y, f);
+			y	   = _mm256_add_pd(y, _mm256_mul_pd(k, set(ln2_hi)));
+
+			const auto positive = _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GT_OQ);
+			const auto infinite = _mm256_cmp_pd(x, set(inf), _CMP_EQ_OQ);
+			const auto zero		= _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ);
+			y					= _mm256_blendv_pd(y, set(inf), infinite);
+			return _mm256_blendv_pd(_mm256_blendv_pd(set(nan), set(-inf), zero), y, positive);
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto sqrt_avx2(__m256d x) -> __m256d {
+			return _mm256_sqrt_pd(x);
+		}
+
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT inline auto abs_avx2(__m256d x) -> __m256d {
+			return _mm256_andnot_pd(set(-0.), x);
+		}
+
+		template<__m256d (*F)(__m256d), double (*Scalar)(double)>
+		DCS213_P1_TARGET("avx2") DCS213_P1_NO_CONTRACT
+		inline auto batch_avx2(const double* xs, double* ys, std::size_t n)
+			-> void {
+			std::size_t i = 0;
+			for (; i + 4 <= n; i += 4) _mm256_storeu_pd(ys + i, F(_mm256_loadu_pd(xs + i)));
+			for (; i < n; ++i) ys[i] = Scalar(xs[i]);
+		}
+
+		inline static constexpr BatchFn avx2_table[function_count] {
+			&batch_avx2<&sin_avx2, &sin_scalar>,
+			&batch_avx2<&cos_avx2, &cos_scalar>,
+			&batch_avx2<&tan_avx2, &tan_scalar>,
+			&batch_avx2<&exp_avx2, &exp_scalar>,
+			&batch_avx2<&log_avx2, &log_scalar>,
+			&batch_avx2<&sqrt_avx2, &sqrt_scalar>,
+			&batch_avx2<&abs_avx2, &abs_scalar>,
+		};
+
+		// AVX-512, 8 points at a time, the same operations again.
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT inline auto set8(double x) -> __m512d {
+			return _mm512_set1_pd(x);
+		}
+
+		template<std::size_t N>
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto horner(__m512d z, const double (&coefs)[N]) -> __m512d {
+			auto p = set8(coefs[N - 1]);
+			for (auto k = N - 1; k-- > 0;) p = _mm512_add_pd(set8(coefs[k]), _mm512_mul_pd(z, p));
+			return p;
+		}
+
+		struct Reduced512 {
+			__m512d sin;
+			__m512d cos;
+			__m512i quadrant;
+		};
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto reduce_avx512(__m512d x) -> Reduced512 {
+			const auto qd = _mm512_add_pd(_mm512_mul_pd(x, set8(two_over_pi)), set8(shift));
+			const auto q  = _mm512_sub_pd(qd, set8(shift));
+
+			const auto t  = _mm512_sub_pd(x, _mm512_mul_pd(q, set8(pio2_1)));
+			const auto u  = _mm512_mul_pd(q, set8(pio2_2));
+			const auto r1 = _mm512_sub_pd(t, u);
+			const auto v3 = _mm512_mul_pd(q, set8(pio2_3));
+			const auto r0 = _mm512_sub_pd(r1, v3);
+			const auto b  = _mm512_sub_pd(r0, r1);
+			const auto w  = _mm512_sub_pd(
+				 _mm512_mul_pd(q, set8(pio2_3t)),
+				 _mm512_add_pd(
+					 _mm512_sub_pd(_mm512_sub_pd(t, r1), u),
+					 _mm512_sub_pd(
+						 _mm512_sub_pd(r1, _mm512_sub_pd(r0, b)),
+						 _mm512_add_pd(v3, b)
+					 )
+				 )
+			 );
+			const auto hi = _mm512_sub_pd(r0, w);
+			const auto lo = _mm512_sub_pd(_mm512_sub_pd(r0, hi), w);
+
+			const auto z   = _mm512_mul_pd(hi, hi);
+			const auto v   = _mm512_mul_pd(z, hi);
+			const auto hz  = _mm512_mul_pd(set8(.5), z);
+			const auto c1  = _mm512_sub_pd(set8(1.), hz);
+			const auto sin = _mm512_sub_pd(
+				hi,
+				_mm512_sub_pd(
+					_mm512_sub_pd(
+						_mm512_mul_pd(
+							z,
+							_mm512_sub_pd(
+								_mm512_mul_pd(set8(.5), lo),
+								_mm512_mul_pd(v, horner(z, sin_coefs))
+							)
+						),
+						lo
+					),
+					_mm512_mul_pd(v, set8(sin_s1))
+				)
+			);
+			const auto cos = _mm512_add_pd(
+				c1,
+				_mm512_add_pd(
+					_mm512_sub_pd(_mm512_sub_pd(set8(1.), c1), hz),
+					_mm512_sub_pd(
+						_mm512_mul_pd(z, _mm512_mul_pd(z, horner(z, cos_coefs))),
+						_mm512_mul_pd(hi, lo)
+					)
+				)
+			);
+			return { sin, cos, _mm512_castpd_si512(qd) };
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto quadrant_avx512(__m512d s, __m512d c, __m512i q) -> __m512d {
+			const auto odd	= _mm512_test_epi64_mask(q, _mm512_set1_epi64(1));
+			const auto high = _mm512_slli_epi64(q, 62);
+			const auto sign = _mm512_and_si512(high, _mm512_castpd_si512(set8(-0.)));
+			const auto y	= _mm512_castpd_si512(_mm512_mask_blend_pd(odd, s, c));
+			return _mm512_castsi512_pd(_mm512_xor_si512(y, sign));
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto fix_large_avx512(__m512d x, __m512d y, double (*f)(double)) -> __m512d {
+			const auto large = _mm512_cmp_pd_mask(_mm512_abs_pd(x), set8(trig_limit), _CMP_NLT_UQ);
+			if (large == 0) [[likely]]
+				return y;
+
+			alignas(64) double xv[8], yv[8];
+			_mm512_store_pd(xv, x);
+			_mm512_store_pd(yv, y);
+			for (int l = 0; l < 8; ++l)
+				if ((large >> l) & 1)
+					yv[l] = f(xv[l]);
+			return _mm512_load_pd(yv);
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto sin_avx512(__m512d x) -> __m512d {
+			const auto [s, c, q] = reduce_avx512(x);
+			return fix_large_avx512(x, quadrant_avx512(s, c, q), &sin_scalar);
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto cos_avx512(__m512d x) -> __m512d {
+			const auto [s, c, q] = reduce_avx512(x);
+			const auto y = quadrant_avx512(s, c, _mm512_add_epi64(q, _mm512_set1_epi64(1)));
+			return fix_large_avx512(x, y, &cos_scalar);
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto tan_avx512(__m512d x) -> __m512d {
+			const auto [s, c, q] = reduce_avx512(x);
+			const auto odd		 = _mm512_test_epi64_mask(q, _mm512_set1_epi64(1));
+			const auto neg_c	 = _mm512_castsi512_pd(
+				_mm512_xor_si512(_mm512_castpd_si512(c), _mm512_set1_epi64(1ll << 63))
+			);
+			const auto y = _mm512_mask_blend_pd(odd, _mm512_div_pd(s, c), _mm512_div_pd(neg_c, s));
+			return fix_large_avx512(x, y, &tan_scalar);
+		}
+
+		/**
+		 * @brief 2^k, for integral `k` within the exponent range.
+		 *
+		 */
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto scale_avx512(__m512d k) -> __m512d {
+			const auto biased = _mm512_castpd_si512(_mm512_add_pd(k, set8(shift + 1023.)));
+			return _mm512_castsi512_pd(_mm512_slli_epi64(biased, 52));
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto exp_avx512(__m512d x) -> __m512d {
+			const auto xc = _mm512_min_pd(set8(exp_hi), _mm512_max_pd(set8(exp_lo), x));
+			const auto k  = _mm512_sub_pd(
+				 _mm512_add_pd(_mm512_mul_pd(xc, set8(log2e)), set8(shift)),
+				 set8(shift)
+			 );
+			const auto hi = _mm512_sub_pd(xc, _mm512_mul_pd(k, set8(ln2_hi)));
+			const auto lo = _mm512_mul_pd(k, set8(ln2_lo));
+			const auto r  = _mm512_sub_pd(hi, lo);
+			const auto t  = _mm512_mul_pd(r, r);
+			const auto c  = _mm512_sub_pd(r, _mm512_mul_pd(t, horner(t, exp_coefs)));
+			const auto d  = _mm512_div_pd(_mm512_mul_pd(r, c), _mm512_sub_pd(set8(2.), c));
+			const auto p  = _mm512_sub_pd(set8(1.), _mm512_sub_pd(_mm512_sub_pd(lo, d), hi));
+
+			const auto half = _mm512_mul_pd(k, set8(.5));
+			const auto k1	= _mm512_sub_pd(_mm512_add_pd(half, set8(shift)), set8(shift));
+			const auto k2	= _mm512_sub_pd(k, k1);
+			return _mm512_mul_pd(_mm512_mul_pd(p, scale_avx512(k1)), scale_avx512(k2));
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto log_avx512(__m512d x) -> __m512d {
+			const auto tiny = _mm512_cmp_pd_mask(x, set8(0x1p-1022), _CMP_LT_OQ);
+			const auto xs	= _mm512_mask_mul_pd(x, tiny, x, set8(0x1p54));
+
+			const auto ix = _mm512_add_epi64(
+				_mm512_castpd_si512(xs),
+				_mm512_set1_epi64(static_cast<long long>(0x3ff0000000000000ull - log_offset))
+			);
+			const auto exponent =
+				_mm512_or_si512(_mm512_srli_epi64(ix, 52), _mm512_castpd_si512(set8(shift)));
+			const auto k = _mm512_sub_pd(
+				_mm512_sub_pd(_mm512_castsi512_pd(exponent), set8(shift + 1023.)),
+				_mm512_maskz_mov_pd(tiny, set8(54.))
+			);
+			const auto f = _mm512_sub_pd(
+				_mm512_castsi512_pd(_mm512_add_epi64(
+					_mm512_and_si512(ix, _mm512_set1_epi64(static_cast<long long>(mantissa))),
+					_mm512_set1_epi64(static_cast<long long>(log_offset))
+				)),
+				set8(1.)
+			);
+
+			const auto hfsq = _mm512_mul_pd(_mm512_mul_pd(set8(.5), f), f);
+			const auto s	= _mm512_div_pd(f, _mm512_add_pd(set8(2.), f));
+			const auto z	= _mm512_mul_pd(s, s);
+			const auto w	= _mm512_mul_pd(z, z);
+			const auto r	= _mm512_add_pd(
+				   _mm512_mul_pd(z, horner(w, log_odd)),
+				   _mm512_mul_pd(w, horner(w, log_even))
+			   );
+			auto y = _mm512_mul_pd(s, _mm512_add_pd(hfsq, r));
+			y	   = _mm512_add_pd(y, _mm512_mul_pd(k, set8(ln2_lo)));
+			y	   = _mm512_sub_pd(y, hfsq);
+			y	   = _mm512_add_pd(y, f);
+			y	   = _mm512_add_pd(y, _mm512_mul_pd(k, set8(ln2_hi)));
+
+			const auto positive = _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_GT_OQ);
+			const auto infinite = _mm512_cmp_pd_mask(x, set8(inf), _CMP_EQ_OQ);
+			const auto zero		= _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_EQ_OQ);
+			y					= _mm512_mask_blend_pd(infinite, y, set8(inf));
+			const auto other	= _mm512_mask_blend_pd(zero, set8(nan), set8(-inf));
+			return _mm512_mask_blend_pd(positive, other, y);
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto sqrt_avx512(__m512d x) -> __m512d {
+			return _mm512_sqrt_pd(x);
+		}
+
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto abs_avx512(__m512d x) -> __m512d {
+			return _mm512_abs_pd(x);
+		}
+
+		template<__m512d (*F)(__m512d), double (*Scalar)(double)>
+		DCS213_P1_TARGET("avx512f") DCS213_P1_NO_CONTRACT
+		inline auto batch_avx512(const double* xs, double* ys, std::size_t n) -> void {
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8) _mm512_storeu_pd(ys + i, F(_mm512_loadu_pd(xs + i)));
+			for (; i < n; ++i) ys[i] = Scalar(xs[i]);
+		}
+
+		inline static constexpr BatchFn avx512_table[function_count] {
+			&batch_avx512<&sin_avx512, &sin_scalar>,
+			&batch_avx512<&cos_avx512, &cos_scalar>,
+			&batch_avx512<&tan_avx512, &tan_scalar>,
+			&batch_avx512<&exp_avx512, &exp_scalar>,
+			&batch_avx512<&log_avx512, &log_scalar>,
+			&batch_avx512<&sqrt_avx512, &sqrt_scalar>,
+			&batch_avx512<&abs_avx512, &abs_scalar>,
+		};
+#endif
+
+		inline static auto table(dispatch::Level level) -> const BatchFn* {
+#ifdef DCS213_P1_X86
+			if (level >= dispatch::Level::AVX512)
+				return avx512_table;
+			if (level >= dispatch::Level::AVX2)
+				return avx2_table;
+#endif
+			return scalar_table;
+		}
+	}  // namespace details
+
+	/**
+	 * @brief `fn(x)`, at a single point.
+	 *
+	 * @param fn
+	 * @param x
+	 * @return double
+	 */
+	inline static auto eval(Function fn, double x) -> double {
+		switch (fn) {
+			case Function::Sin: return details::sin_scalar(x);
+			case Function::Cos: return details::cos_scalar(x);
+			case Function::Tan: return details::tan_scalar(x);
+			case Function::Exp: return details::exp_scalar(x);
+			case Function::Log: return details::log_scalar(x);
+			case Function::Sqrt: return details::sqrt_scalar(x);
+			case Function::Abs: return details::abs_scalar(x);
+		}
+		return details::nan;
+	}
+
+	/**
+	 * @brief The batch implementation of `fn` for this process.
+	 *
+	 * @param fn
+	 * @return BatchFn
+	 */
+	inline static auto batch(Function fn) -> BatchFn {
+		static const auto table = details::table(dispatch::kernels().level(dispatch::Kernel::Math));
+		return table[static_cast<std::size_t>(fn)];
+	}
+
+	/**
+	 * @brief `ys[i] = fn(xs[i])`, for the points of `xs`. `ys` has the same size, and may be
+	 * `xs` itself.
+	 *
+	 * @param fn
+	 * @param xs
+	 * @param ys
+	 */
+	inline static auto eval(Function fn, std::span<const double> xs, std::span<double> ys) -> void {
+		batch(fn)(xs.data(), ys.data(), xs.size());
+	}
+}  // namespace dcs213::p1::math
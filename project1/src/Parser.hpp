@@ -1,12 +1,18 @@
 #pragma once
 
+#include "Alloc.hpp"
 #include "BindPower.hpp"
+#include "Budget.hpp"
 #include "Lexer.hpp"
+#include "Trace.hpp"
 
 #include <tl/expected.hpp>
 
 #include <memory>
+#include <optional>
+#include <ranges>
 #include <variant>
+#include <vector>
 #include <exception>
 
 namespace dcs213::p1::parse {
@@ -53,6 +59,74 @@ namespace dcs213::p1::parse {
 		}
 	};
 
+	/**
+	 * @brief Represents a call of a built-in function.
+	 *
+	 * e.g.
+	 *    sin
+	 *    |
+	 *    x
+	 *
+	 */
+	struct CallExpr {
+		math::Function		  fn;
+		std::unique_ptr<Expr> arg;
+
+		[[nodiscard]] auto	  to_string() const -> std::string;
+
+		inline friend auto	  to_string(const CallExpr& expr) -> std::string {
+			   return expr.to_string();
+		}
+	};
+
+	/**
+	 * @brief An operand of an n-ary expression, along with the operator applied to it.
+	 *
+	 * The first operand of a chain always carries the identity operator (`+` or `*`).
+	 */
+	struct Operand {
+		lex::Operator		  op;
+		std::unique_ptr<Expr> expr;
+	};
+
+	/**
+	 * @brief Represents a flattened chain of `+` and `-`.
+	 *
+	 * e.g. `1 - 2 + 3`
+	 *       +
+	 *    /  |  \
+	 *  +1  -2  +3
+	 *
+	 */
+	struct SumExpr {
+		std::vector<Operand> operands;
+
+		[[nodiscard]] auto	 to_string() const -> std::string;
+
+		inline friend auto	 to_string(const SumExpr& expr) -> std::string {
+			  return expr.to_string();
+		}
+	};
+
+	/**
+	 * @brief Represents a flattened chain of `*` and `/`.
+	 *
+	 * e.g. `1 * 2 / 3`
+	 *       *
+	 *    /  |  \
+	 *  *1  *2  /3
+	 *
+	 */
+	struct ProductExpr {
+		std::vector<Operand> operands;
+
+		[[nodiscard]] auto	 to_string() const -> std::string;
+
+		inline friend auto	 to_string(const ProductExpr& expr) -> std::string {
+			  return expr.to_string();
+		}
+	};
+
 	/**
 	 * @brief Represents a known number literal atomic expression.
 	 *
@@ -72,21 +146,38 @@ namespace dcs213::p1::parse {
 	 *
 	 */
 	struct Variable {
+		char name = 'x';
+
 		inline static constexpr auto to_string(const Variable& expr) -> std::string {
-			// return std::format("{} {}", lex::to_string(expr.op),);
-			return "x";
+			return std::string(1, expr.name);
 		}
 
 		[[nodiscard]] constexpr auto to_string() const -> std::string { return to_string(*this); }
 	};
 
-	struct Expr : public std::variant<BinOpExpr, UnaryOpExpr, Number, Variable> {
+	struct Expr :
+		public std::variant<  //
+			BinOpExpr,		  //
+			UnaryOpExpr,	  //
+			CallExpr,		  //
+			SumExpr,		  //
+			ProductExpr,	  //
+			Number,			  //
+			Variable		  //
+			> {
 		inline friend auto to_string(const Expr& expr) -> std::string { return expr.to_string(); }
 
 		[[nodiscard]] auto to_string() const -> std::string {
 			return std::visit([](const auto& expr) { return expr.to_string(); }, *this);
 		}
 
+		/**
+		 * @brief The number of nodes of the tree rooted here, itself included.
+		 *
+		 * @return std::size_t
+		 */
+		[[nodiscard]] auto nodes() const -> std::size_t;
+
 		template<typename T>
 		auto get_if() -> T* {
 			return std::get_if<T>(this);
@@ -136,6 +227,18 @@ namespace dcs213::p1::parse {
 			}
 		};
 
+		/**
+		 * @brief An error that the argument of a built-in function is missed.
+		 *
+		 */
+		struct ArgumentMiss {
+			math::Function	   fn;
+
+			[[nodiscard]] auto to_string() const -> std::string {
+				return std::format("Loss argument for function `{}`!", math::to_string(fn));
+			}
+		};
+
 		/**
 		 * @brief An error that the right parenthesis corresponding to its left one is missed.
 		 *
@@ -146,6 +249,21 @@ namespace dcs213::p1::parse {
 			}
 		};
 
+		/**
+		 * @brief An error that tokens are left after a whole expression.
+		 *
+		 * e.g. `y` in `x y`, which is not read as a product.
+		 */
+		struct TrailingToken {
+			lex::Token		   token;
+
+			[[nodiscard]] auto to_string() const -> std::string {
+				return std::format(
+					"Unexpected token `{}` after the expression!", token.to_string()
+				);
+			}
+		};
+
 		inline static auto to_string(const auto& err) -> std::string {
 			return err.to_string();
 		}
@@ -155,7 +273,10 @@ namespace dcs213::p1::parse {
 				NotMatched,		   //
 				RhsMiss,		   //
 				UnaryOperandMiss,  //
-				RParenMiss		   //
+				ArgumentMiss,	   //
+				RParenMiss,		   //
+				TrailingToken,	   //
+				BudgetExhausted	   //
 				> {
 			template<typename ErrorT>
 			[[nodiscard]] auto is() const -> bool {
@@ -183,6 +304,105 @@ namespace dcs213::p1::parse {
 
 	class Parser {};
 
+	/**
+	 * @brief The identity operator of the associative chain `op` belongs to, if any.
+	 *
+	 * @param op
+	 * @return std::optional<lex::Operator> `+` for `+`/`-`, `*` for `*`/`/`
+	 */
+	inline static constexpr auto chain_of(lex::Operator op) -> std::optional<lex::Operator> {
+		switch (op) {
+			case lex::Operator::Plus:
+			case lex::Operator::Minus: return lex::Operator::Plus;
+			case lex::Operator::Multiply:
+			case lex::Operator::Devide: return lex::Operator::Multiply;
+			default: return std::nullopt;
+		}
+	}
+
+	/**
+	 * @brief Build an infix expression, flattening associative chains.
+	 *
+	 * Pratt parsing makes `a + b + c + ...` left-leaning, so it suffices to look at `lhs`: a
+	 * binary node of the same chain turns into an n-ary node of three operands, and an n-ary
+	 * node just grows by one. Lone binary operations stay `BinOpExpr`s.
+	 *
+	 * @param op
+	 * @param lhs
+	 * @param rhs
+	 * @return Expr
+	 */
+	inline static auto make_infix(lex::Operator op, Expr&& lhs, Expr&& rhs) -> Expr {
+		const auto chain = chain_of(op);
+
+		const auto grow	 = [&](std::vector<Operand>& operands) -> Expr {
+			 operands.push_back({ .op = op, .expr = std::make_unique<Expr>(std::move(rhs)) });
+			 return std::move(lhs);
+		};
+
+		const auto flatten = [&](BinOpExpr& binop) -> std::vector<Operand> {
+			std::vector<Operand> operands;
+			operands.push_back({ .op = *chain, .expr = std::move(binop.lhs) });
+			operands.push_back({ .op = binop.op, .expr = std::move(binop.rhs) });
+			operands.push_back({ .op = op, .expr = std::make_unique<Expr>(std::move(rhs)) });
+			return operands;
+		};
+
+		if (chain == lex::Operator::Plus) {
+			if (const auto sum = lhs.get_if<SumExpr>())
+				return grow(sum->operands);
+			if (const auto binop = lhs.get_if<BinOpExpr>(); binop && chain_of(binop->op) == chain)
+				return { SumExpr { flatten(*binop) } };
+		} else if (chain == lex::Operator::Multiply) {
+			if (const auto prod = lhs.get_if<ProductExpr>())
+				return grow(prod->operands);
+			if (const auto binop = lhs.get_if<BinOpExpr>(); binop && chain_of(binop->op) == chain)
+				return { ProductExpr { flatten(*binop) } };
+		}
+
+		return {
+			BinOpExpr {
+					   .op  = op,
+					   .lhs = std::make_unique<Expr>(std::move(lhs)),
+					   .rhs = std::make_unique<Expr>(std::move(rhs)),
+					   }
+		};
+	}
+
+	/**
+	 * @brief Parse a token stream into an AST, within a budget.
+	 *
+	 * Every parsed node charges a step, and nesting deeper than the depth limit fails instead of
+	 * overflowing the stack.
+	 *
+	 * @param ts token stream
+	 * @param budget
+	 * @param min_bp minimum binding power
+	 * @param depth current nesting depth
+	 * @return tl::expected<Expr, ParseError>
+	 */
+	inline static auto parse(
+		lex::TokenStream::View& ts,
+		Budget&					budget,
+		std::size_t				min_bp = 0,
+		std::size_t				depth  = 0
+	) -> tl::expected<Expr, ParseError>;
+
+	/**
+	 * @brief Complete the parse of a whole token stream, which must leave no token behind.
+	 *
+	 * @param ts what is left of the stream
+	 * @param ast
+	 * @return tl::expected<Expr, ParseError>
+	 */
+	inline static auto finish(lex::TokenStream::View& ts, tl::expected<Expr, ParseError>&& ast)
+		-> tl::expected<Expr, ParseError> {
+		if (ast)
+			if (const auto tok = ts.peek())
+				return make_error(Errors::TrailingToken { .token = *tok });
+		return std::move(ast);
+	}
+
 	/**
 	 * @brief Parse a token stream into an AST.
 	 *
@@ -191,7 +411,13 @@ namespace dcs213::p1::parse {
 	 * @return tl::expected<Expr, ParseError>
 	 */
 	inline static auto parse(lex::TokenStream::View& ts, std::size_t min_bp = 0)
-		-> tl::expected<Expr, ParseError>;
+		-> tl::expected<Expr, ParseError> {
+		DCS213_P1_TRACE_SCOPE(Parse);
+		DCS213_P1_ALLOC_TAG(Parse);
+
+		Budget budget;
+		return parse(ts, budget, min_bp);
+	}
 
 	/**
 	 * @brief Parse a token stream into an AST.
@@ -214,42 +440,83 @@ namespace dcs213::p1::parse {
 	 */
 	inline static auto parse(const lex::TokenStream& ts, std::size_t min_bp = 0)
 		-> tl::expected<Expr, ParseError> {
-		return parse(ts.view());
+		auto view = ts.view();
+		return finish(view, parse(view, min_bp));
+	}
+
+	/**
+	 * @brief Parse a token stream into an AST, within a budget.
+	 *
+	 * @param ts
+	 * @param budget
+	 * @return tl::expected<Expr, ParseError>
+	 */
+	inline static auto parse(const lex::TokenStream& ts, Budget& budget)
+		-> tl::expected<Expr, ParseError> {
+		DCS213_P1_TRACE_SCOPE(Parse);
+		DCS213_P1_ALLOC_TAG(Parse);
+
+		auto view = ts.view();
+		return finish(view, parse(view, budget));
 	}
 
 }  // namespace dcs213::p1::parse
 
 namespace dcs213::p1::parse {
-	inline static auto parse(lex::TokenStream::View& ts, std::size_t min_bp)
-		-> tl::expected<Expr, ParseError> {
+	inline static auto parse(
+		lex::TokenStream::View& ts,
+		Budget&					budget,
+		std::size_t				min_bp,
+		std::size_t				depth
+	) -> tl::expected<Expr, ParseError> {
+		if (!budget.depth(depth) || !budget.step())
+			return make_error(BudgetExhausted { budget.reason() });
+
 		if (const auto tok = ts.bump()) {
 			Expr lhs;
 
 			if (const auto op = tok->get_if<lex::Operator>()) {
 				if (*op == lex::Operator::LParen) {
-					if (auto prs = parse(ts, 0)) {
+					if (auto prs = parse(ts, budget, 0, depth + 1)) {
 						if (ts.expect({ lex::Operator::RParen }))
 							lhs = *std::move(prs);
 						else
 							return make_error(Errors::RParenMiss {});
-					}
+					} else
+						return prs;
 				} else if (const auto pbp = bindpower[*op].pbp; pbp > 0) {
-					if (auto&& rhs = parse(ts, pbp))
+					if (auto&& rhs = parse(ts, budget, pbp, depth + 1))
 						lhs = {
 							UnaryOpExpr {
 										 .op		 = *op,
 										 .operand = std::make_unique<Expr>(*std::move(rhs)),
 										 }
 						};
+					else if (rhs.error().is<BudgetExhausted>())
+						return rhs;
 					else
 						return make_error(Errors::UnaryOperandMiss { .op = *op });
 				}
+			} else if (const auto fn = tok->get_if<lex::Function>()) {
+				// Binds like `ln`: `sin x ^ 2` is `sin (x ^ 2)`, `sin x * 2` is `(sin x) * 2`.
+				const auto pbp = bindpower[lex::Operator::Ln].pbp;
+				if (auto&& arg = parse(ts, budget, pbp, depth + 1))
+					lhs = {
+						CallExpr {
+								  .fn  = *fn,
+								  .arg = std::make_unique<Expr>(*std::move(arg)),
+								  }
+					};
+				else if (arg.error().is<BudgetExhausted>())
+					return arg;
+				else
+					return make_error(Errors::ArgumentMiss { .fn = *fn });
 			} else if (const auto num = tok->get_if<lex::Number>()) {
 				lhs = { Number { num->value } };
 			} else if (const auto con = tok->get_if<lex::Constant>()) {
 				lhs = { Number { val(*con) } };
 			} else if (const auto var = tok->get_if<lex::Variable>()) {
-				lhs = { Variable {} };
+				lhs = { Variable { var->name } };
 			}
 
 			while (const auto tok = ts.peek()) {
@@ -276,15 +543,11 @@ namespace dcs213::p1::parse {
 						if (lbp < min_bp)
 							break;
 						ts.bump();
-						if (auto rhs = parse(ts, rbp)) {
-							lhs = {
-								BinOpExpr {
-										   .op	 = *op,
-										   .lhs = std::make_unique<Expr>(std::move(lhs)),
-										   .rhs = std::make_unique<Expr>(std::move(*rhs)),
-										   }
-							};
-						} else
+						if (auto rhs = parse(ts, budget, rbp, depth + 1)) {
+							lhs = make_infix(*op, std::move(lhs), std::move(*rhs));
+						} else if (rhs.error().is<BudgetExhausted>())
+							return rhs;
+						else
 							return make_error(Errors::RhsMiss {
 								.op	 = *op,
 								.lhs = std::make_unique<Expr>(std::move(lhs)),
@@ -309,10 +572,43 @@ namespace dcs213::p1::parse {
 		return std::format("({} {} {})", lhs->to_string(), lex::to_string(op), rhs->to_string());
 	}
 
+	inline auto SumExpr::to_string() const -> std::string {
+		std::string s = std::format("({}", operands.front().expr->to_string());
+		for (const auto& [op, expr] : operands | std::views::drop(1))
+			s += std::format(" {} {}", lex::to_string(op), expr->to_string());
+		return s + ")";
+	}
+
+	inline auto ProductExpr::to_string() const -> std::string {
+		std::string s = std::format("({}", operands.front().expr->to_string());
+		for (const auto& [op, expr] : operands | std::views::drop(1))
+			s += std::format(" {} {}", lex::to_string(op), expr->to_string());
+		return s + ")";
+	}
+
 	inline auto UnaryOpExpr::to_string() const -> std::string {
 		return std::format("({} {})", lex::to_string(op), operand->to_string());
 	}
 
+	inline auto CallExpr::to_string() const -> std::string {
+		return std::format("({} {})", math::to_string(fn), arg->to_string());
+	}
+
+	inline auto Expr::nodes() const -> std::size_t {
+		std::size_t nodes = 1;
+		if (const auto binop = get_if<BinOpExpr>())
+			nodes += binop->lhs->nodes() + binop->rhs->nodes();
+		else if (const auto uop = get_if<UnaryOpExpr>())
+			nodes += uop->operand->nodes();
+		else if (const auto call = get_if<CallExpr>())
+			nodes += call->arg->nodes();
+		else if (const auto sum = get_if<SumExpr>())
+			for (const auto& operand : sum->operands) nodes += operand.expr->nodes();
+		else if (const auto prod = get_if<ProductExpr>())
+			for (const auto& operand : prod->operands) nodes += operand.expr->nodes();
+		return nodes;
+	}
+
 	inline auto Errors::RhsMiss::to_string() const -> std::string {
 		return std::format(
 			"Loss Right operand for operator `{}`, while the left operand is {}!",
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "Budget.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Evaluator.hpp"
+#include "Pointwise.hpp"
+#include "Scheduler.hpp"
+#include "Utils.hpp"
+
+#include <tl/expected.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace dcs213::p1::pipeline {
+	/**
+	 * @brief Outcome of running a script through the whole pipeline.
+	 *
+	 */
+	struct Outcome {
+		bool		success	  = false;
+		bool		cancelled = false;
+		bool		transient = false;	// depends on the moment it ran, e.g. hit a deadline
+		std::string text;			// the result on success, the error message otherwise
+
+		inline static auto ok(std::string text) -> Outcome {
+			return { .success = true, .text = std::move(text) };
+		}
+
+		inline static auto fail(std::string text) -> Outcome {
+			return { .success = false, .text = std::move(text) };
+		}
+
+		inline static auto cancel() -> Outcome {
+			return { .success = false, .cancelled = true, .text = "Cancelled!" };
+		}
+
+		/**
+		 * @brief Failure for running out of budget.
+		 *
+		 * Only the deterministic limits (steps, depth, terms, bytes) give a reproducible outcome,
+		 * a deadline or a cancellation does not.
+		 */
+		inline static auto exhausted(const BudgetExhausted& err) -> Outcome {
+			switch (err.reason) {
+				case Budget::Exceeded::Cancelled: return cancel();
+				case Budget::Exceeded::Deadline:
+					return { .success = false, .transient = true, .text = err.to_string() };
+				default: return fail(err.to_string());
+			}
+		}
+
+		/**
+		 * @brief `{ "success": true, "result": ... }` or `{ "success": false, "cancelled": ...,
+		 * "error": ... }`.
+		 *
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object().field("success", success);
+			if (success)
+				writer.field("result", text);
+			else
+				writer.field("cancelled", cancelled).field("error", text);
+			writer.end_object();
+		}
+	};
+
+	/**
+	 * @brief Outcome of a batch of evaluations.
+	 *
+	 * Either one outcome per script, or the values of one polynomial at many points.
+	 */
+	struct Batch {
+		Outcome												   status = Outcome::ok({});  // of the batch as a whole
+		std::variant<std::vector<Outcome>, std::vector<double>> results;
+
+		/**
+		 * @brief `{ "success": true, "results": [...] }`, or `status` if the batch failed as a
+		 * whole.
+		 *
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			if (!status.success)
+				status.write_json(writer);
+			else
+				writer.begin_object().field("success", true).field("results", results).end_object();
+		}
+	};
+
+	/**
+	 * @brief Where the time of one run went, for callers that ask for it.
+	 *
+	 * Stages that did not run, e.g. because an earlier one failed or the outcome came from a
+	 * cache, are left at zero.
+	 */
+	struct Stages {
+		std::chrono::nanoseconds lex {};
+		std::chrono::nanoseconds parse {};
+		std::chrono::nanoseconds evaluate {};
+		std::size_t				 nodes	= 0;  // of the AST
+		std::size_t				 steps	= 0;  // of the budget, once done
+		bool					 cached = false;
+	};
+
+	/**
+	 * @brief Evaluate an already parsed script within a budget.
+	 *
+	 * @param ast
+	 * @param budget
+	 * @return Outcome
+	 */
+	inline static auto run(const parse::Expr& ast, Budget& budget) -> Outcome {
+		if (!budget.poll())
+			return Outcome::exhausted({ budget.reason() });
+
+		if (auto res = evaluate::eval(ast, budget))
+			return Outcome::ok(*std::move(res));
+		else if (const auto err = std::get_if<BudgetExhausted>(&res.error()))
+			return Outcome::exhausted(*err);
+		else
+			return Outcome::fail(res.error().to_string());
+	}
+
+	/**
+	 * @brief Parse and evaluate an already tokenized script within a budget.
+	 *
+	 * @param ts
+	 * @param budget shared by both stages, its stop token is polled throughout
+	 * @param stages if given, receives the time of parsing and evaluation
+	 * @return Outcome
+	 */
+	inline static auto run(const lex::TokenStream& ts, Budget& budget, Stages* stages = nullptr)
+		-> Outcome {
+		using Clock = std::chrono::steady_clock;
+
+		if (!budget.poll())
+			return Outcome::exhausted({ budget.reason() });
+
+		const auto start = stages ? Clock::now() : Clock::time_point {};
+		const auto ast	 = parse::parse(ts, budget);
+
+		if (!ast) {
+			if (stages) {
+				stages->parse = Clock::now() - start;
+				stages->steps = budget.steps();
+			}
+			if (const auto err = std::get_if<BudgetExhausted>(&ast.error()))
+				return Outcome::exhausted(*err);
+			return Outcome::fail(ast.error().to_string());
+		}
+
+		if (!stages)
+			return run(*ast, budget);
+
+		const auto parsed  = Clock::now();
+		auto	   outcome = run(*ast, budget);
+		stages->parse	   = parsed - start;
+		stages->evaluate   = Clock::now() - parsed;
+		stages->nodes	   = ast->nodes();
+		stages->steps	   = budget.steps();
+		return outcome;
+	}
+
+	/**
+	 * @brief Parse and evaluate an already tokenized script.
+	 *
+	 * @param ts
+	 * @param stop polled throughout
+	 * @return Outcome
+	 */
+	inline static auto run(const lex::TokenStream& ts, std::stop_token stop = {}) -> Outcome {
+		Budget budget { {}, std::move(stop) };
+		return run(ts, budget);
+	}
+
+	/**
+	 * @brief A script compiled for evaluation at many points: its polynomial of x, or its tape
+	 * when it does not reduce to one, e.g. with built-in functions of x.
+	 *
+	 */
+	using Compiled = std::variant<evaluate::TermList, pointwise::Tape>;
+
+	/**
+	 * @brief Operations per point of a compiled script, for budgeting.
+	 *
+	 */
+	inline static auto cost(const Compiled& compiled) -> std::size_t {
+		return std::visit(
+			overload {
+				[](const evaluate::TermList& terms) { return terms.size(); },
+				[](const pointwise::Tape& tape) { return tape.cost(); },
+			},
+			compiled
+		);
+	}
+
+	/**
+	 * @brief Parse an already tokenized script and compile it for evaluation at many points.
+	 *
+	 * @param ts
+	 * @param budget
+	 * @return the compiled script, or the failure to report
+	 */
+	inline static auto compile(const lex::TokenStream& ts, Budget& budget)
+		-> tl::expected<Compiled, Outcome> {
+		const auto ast = parse::parse(ts, budget);
+
+		if (!ast) {
+			if (const auto err = std::get_if<BudgetExhausted>(&ast.error()))
+				return tl::make_unexpected(Outcome::exhausted(*err));
+			return tl::make_unexpected(Outcome::fail(ast.error().to_string()));
+		}
+
+		auto terms = evaluate::eval_polynomial(*ast, budget);
+
+		if (terms)
+			return *std::move(terms);
+		else if (const auto err = std::get_if<BudgetExhausted>(&terms.error()))
+			return tl::make_unexpected(Outcome::exhausted(*err));
+		else if (auto tape = pointwise::Tape::compile(*ast, budget))
+			return *std::move(tape);
+		else if (budget.exhausted())
+			return tl::make_unexpected(Outcome::exhausted({ budget.reason() }));
+
+		return tl::make_unexpected(Outcome::fail(terms.error().to_string()));
+	}
+
+	/**
+	 * @brief Evaluate an already tokenized script at every point of `xs`, as if by `script $ x`.
+	 *
+	 * The script is parsed and compiled once, the points are then evaluated in parallel when
+	 * there are many of them.
+	 *
+	 * @param ts
+	 * @param xs
+	 * @param budget
+	 * @return Batch
+	 */
+	inline static auto run_at(const lex::TokenStream& ts, std::span<const double> xs, Budget& budget)
+		-> Batch {
+		constexpr std::size_t grain = 4096;  // points per task
+
+		const auto compiled = compile(ts, budget);
+
+		if (!compiled)
+			return { .status = compiled.error(), .results = {} };
+
+		if (!budget.step(xs.size() * cost(*compiled)) || !budget.poll())
+			return { .status = Outcome::exhausted({ budget.reason() }), .results = {} };
+
+		auto&				pool = sched::ThreadPool::global();
+		std::vector<double> values(xs.size());
+		if (const auto terms = std::get_if<evaluate::TermList>(&*compiled))
+			pool.parallel_for(0, xs.size(), grain, [&](std::size_t i) {
+				values[i] = terms->eval(xs[i]);
+			});
+		else
+			pool.parallel_for(0, (xs.size() + grain - 1) / grain, 1, [&](std::size_t chunk) {
+				const auto begin = chunk * grain;
+				const auto count = std::min(grain, xs.size() - begin);
+				std::get<pointwise::Tape>(*compiled).eval(
+					xs.subspan(begin, count),
+					std::span { values }.subspan(begin, count)
+				);
+			});
+
+		return { .results = std::move(values) };
+	}
+
+	/**
+	 * @brief Lex, parse and evaluate a script.
+	 *
+	 * @param script
+	 * @param stop polled throughout
+	 * @return Outcome
+	 */
+	inline static auto run(std::string_view script, std::stop_token stop = {}) -> Outcome {
+		const auto ts = lex::lex(script);
+
+		if (!ts)
+			return Outcome::fail(ts.error().to_string());
+
+		return run(*ts, std::move(stop));
+	}
+}  // namespace dcs213::p1::pipeline
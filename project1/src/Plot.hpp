@@ -0,0 +1,262 @@
+#pragma once
+
+#include "Budget.hpp"
+#include "Dispatch.hpp"
+#include "Evaluator.hpp"
+#include "Lexer.hpp"
+#include "Pipeline.hpp"
+#include "Pointwise.hpp"
+#include "Scheduler.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace dcs213::p1::plot {
+	/**
+	 * @brief A script compiled for evaluation at many points.
+	 *
+	 * Polynomials with non-negative integral exponents that are not too sparse become a dense
+	 * coefficient array evaluated by Horner's rule, the others keep their terms and go through
+	 * `std::pow`. Dense ones go through the `horner` kernel of `dispatch::kernels()`; sparse ones
+	 * are evaluated a block at a time with the loop over points innermost, so that it vectorizes.
+	 * Scripts that are not polynomials run on their `pointwise::Tape`.
+	 */
+	class Program {
+	public:
+		explicit Program(const evaluate::TermList& terms) {
+			double degree = 0.;
+			_dense		  = std::ranges::all_of(terms, [&](const evaluate::Term& term) {
+				 degree = std::max(degree, term.expo);
+				 return term.expo >= 0. && term.expo == std::floor(term.expo);
+			 }) && degree <= static_cast<double>(dense_span_factor * terms.size() + dense_span_slack);
+
+			if (_dense) {
+				_coefs.assign(static_cast<std::size_t>(degree) + 1, 0.);
+				for (const auto [c, e] : terms) _coefs[static_cast<std::size_t>(e)] += c;
+			} else
+				_terms = terms;
+		}
+
+		explicit Program(pointwise::Tape tape) : _dense(false), _tape(std::move(tape)) {}
+
+		explicit Program(const pipeline::Compiled& compiled) :
+			Program(std::visit([](const auto& c) { return Program { c }; }, compiled)) {}
+
+	public:
+		/**
+		 * @brief Operations per point, for budgeting.
+		 *
+		 * @return std::size_t
+		 */
+		[[nodiscard]] auto cost() const -> std::size_t {
+			if (_tape)
+				return _tape->cost();
+			return std::max<std::size_t>(_dense ? _coefs.size() : _terms.size(), 1);
+		}
+
+		/**
+		 * @brief Evaluate at every point of `xs` into `ys`, which has the same size.
+		 *
+		 * @param xs
+		 * @param ys
+		 */
+		auto eval(std::span<const double> xs, std::span<double> ys) const -> void {
+			if (_tape) {
+				_tape->eval(xs, ys);
+				return;
+			}
+
+			if (_dense) {
+				const auto horner = dispatch::kernels().horner;
+				horner(_coefs.data(), _coefs.size(), xs.data(), ys.data(), xs.size());
+				return;
+			}
+
+			for (std::size_t begin = 0; begin < xs.size(); begin += block) {
+				const auto	  n = std::min(block, xs.size() - begin);
+				const double* x = xs.data() + begin;
+				double*		  y = ys.data() + begin;
+
+				std::fill_n(y, n, 0.);
+				for (const auto [c, e] : _terms)
+					for (std::size_t i = 0; i < n; ++i) y[i] += c * std::pow(x[i], e);
+			}
+		}
+
+	private:
+		inline static constexpr std::size_t block			  = 256;  // points kept in L1 at once
+		inline static constexpr std::size_t dense_span_factor = 4;
+		inline static constexpr std::size_t dense_span_slack  = 64;
+
+		bool							_dense = true;
+		std::vector<double>				_coefs { 0. };	// by exponent
+		evaluate::TermList				_terms;
+		std::optional<pointwise::Tape>	_tape;	// if not a polynomial
+	};
+
+	/**
+	 * @brief Samples of a script over a range, sorted by x.
+	 *
+	 */
+	struct Samples {
+		pipeline::Outcome	status = pipeline::Outcome::ok({});
+		std::vector<double> xs;
+		std::vector<double> ys;
+
+		/**
+		 * @brief `{ "success": true, "count": n, "xs": ..., "ys": ... }`, or `status` on failure.
+		 *
+		 * `xs` and `ys` are base64 of the raw doubles, in native byte order, i.e. what a
+		 * `Float64Array` reads.
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			if (!status.success) {
+				status.write_json(writer);
+				return;
+			}
+
+			writer.begin_object()
+				.field("success", true)
+				.field("count", xs.size())
+				.field("xs", json::Base64 { std::as_bytes(std::span { xs }) })
+				.field("ys", json::Base64 { std::as_bytes(std::span { ys }) })
+				.end_object();
+		}
+	};
+
+	inline static constexpr std::size_t max_samples = 1 << 22;
+
+	/**
+	 * @brief Sample `program` at up to `n` points of `[xmin, xmax]`, denser where it bends.
+	 *
+	 * A quarter of the points go on an even grid. The rest are spread over its intervals in
+	 * proportion to the square root of the bend (second difference) around them, which is what
+	 * keeps the error of drawing straight segments between samples even. Intervals touching a
+	 * non-finite value count as maximally bent. Both passes run on the thread pool.
+	 *
+	 * @param program
+	 * @param xmin
+	 * @param xmax
+	 * @param n clamped to `[2, max_samples]`
+	 * @param budget charged for every evaluation
+	 * @return Samples
+	 */
+	inline static auto sample(
+		const Program& program,
+		double		   xmin,
+		double		   xmax,
+		std::size_t	   n,
+		Budget&		   budget
+	) -> Samples {
+		constexpr std::size_t grain = 1 << 14;	// points per task
+		constexpr std::size_t spans = 1 << 10;	// intervals per task
+
+		if (!std::isfinite(xmin) || !std::isfinite(xmax) || !(xmin < xmax))
+			return {
+				.status	= pipeline::Outcome::fail("Invalid sampling range!"),
+				.xs		= {},
+				.ys		= {},
+			};
+
+		n				= std::clamp<std::size_t>(n, 2, max_samples);
+		const auto base = std::max<std::size_t>(2, n / 4);
+
+		if (!budget.step((base + n) * program.cost()) || !budget.poll())
+			return {
+				.status	= pipeline::Outcome::exhausted({ budget.reason() }),
+				.xs		= {},
+				.ys		= {},
+			};
+
+		auto&	   pool		= sched::ThreadPool::global();
+		const auto eval_all = [&](std::span<const double> xs, std::span<double> ys) {
+			pool.parallel_for(0, (xs.size() + grain - 1) / grain, 1, [&](std::size_t chunk) {
+				const auto begin = chunk * grain;
+				const auto count = std::min(grain, xs.size() - begin);
+				program.eval(xs.subspan(begin, count), ys.subspan(begin, count));
+			});
+		};
+
+		// Even grid.
+		std::vector<double> grid(base), values(base);
+		const auto			step = (xmax - xmin) / static_cast<double>(base - 1);
+		for (std::size_t i = 0; i < base; ++i) grid[i] = xmin + step * static_cast<double>(i);
+		grid.back() = xmax;
+		eval_all(grid, values);
+
+		if (!budget.poll())
+			return {
+				.status	= pipeline::Outcome::exhausted({ budget.reason() }),
+				.xs		= {},
+				.ys		= {},
+			};
+
+		// Bend at each inner point, relative to the height of the curve.
+		double lo = INFINITY, hi = -INFINITY;
+		for (const auto y : values)
+			if (std::isfinite(y)) {
+				lo = std::min(lo, y);
+				hi = std::max(hi, y);
+			}
+		const auto height = hi > lo ? hi - lo : 1.;
+
+		std::vector<double> bend(base, 0.);
+		for (std::size_t i = 1; i + 1 < base; ++i) {
+			const auto d2 = values[i - 1] - 2. * values[i] + values[i + 1];
+			bend[i]		  = std::isfinite(d2) ? std::min(std::abs(d2) / height, 1.) : 1.;
+		}
+
+		std::vector<double> weight(base - 1);
+		double				total = 0.;
+		for (std::size_t j = 0; j + 1 < base; ++j) total += weight[j] = std::sqrt(bend[j] + bend[j + 1]);
+		if (total == 0.) {
+			std::ranges::fill(weight, 1.);
+			total = static_cast<double>(base - 1);
+		}
+
+		// Extra points per interval, and where each interval starts in the output.
+		const auto				 extra = static_cast<double>(n - base);
+		std::vector<std::size_t> offset(base);
+		for (std::size_t j = 0; j + 1 < base; ++j)
+			offset[j + 1] = offset[j] + 1 + static_cast<std::size_t>(extra * weight[j] / total);
+
+		Samples samples;
+		samples.xs.resize(offset.back() + 1);
+		samples.ys.resize(offset.back() + 1);
+		pool.parallel_for(0, base - 1, spans, [&](std::size_t j) {
+			const auto count = offset[j + 1] - offset[j];
+			const auto dx	 = (grid[j + 1] - grid[j]) / static_cast<double>(count);
+			for (std::size_t k = 0; k < count; ++k)
+				samples.xs[offset[j] + k] = grid[j] + dx * static_cast<double>(k);
+		});
+		samples.xs.back() = xmax;
+		eval_all(samples.xs, samples.ys);
+
+		return samples;	 // nrvo
+	}
+
+	/**
+	 * @brief Compile an already tokenized script and sample it.
+	 *
+	 * @see sample(const Program&, double, double, std::size_t, Budget&)
+	 */
+	inline static auto sample(
+		const lex::TokenStream& ts,
+		double					xmin,
+		double					xmax,
+		std::size_t				n,
+		Budget&					budget
+	) -> Samples {
+		const auto compiled = pipeline::compile(ts, budget);
+
+		if (!compiled)
+			return { .status = compiled.error(), .xs = {}, .ys = {} };
+
+		return sample(Program { *compiled }, xmin, xmax, n, budget);
+	}
+}  // namespace dcs213::p1::plot
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "Budget.hpp"
+#include "Evaluator.hpp"
+#include "Lexer.hpp"
+#include "Math.hpp"
+#include "Parser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Evaluation at many points of what does not reduce to a polynomial, e.g. `sin x + x`.
+ *
+ * The tree is flattened into postfix operations over a stack of blocks of points, and every
+ * operation runs over a whole block before the next one, so that built-in functions go through
+ * the batch kernels of `math`. The values are those of `evaluate::eval_point`, bit for bit.
+ */
+namespace dcs213::p1::pointwise {
+	class Tape {
+	public:
+		enum class Code : std::uint8_t {
+			Const,	// push `value`
+			Var,	// push the points, or the values in stack slot `slot`
+			Add,
+			Sub,
+			Mul,
+			Div,
+			Pow,
+			Neg,
+			Ln,
+			Call,  // `fn` of the top
+			Poly,  // polynomial `poly` at the top
+			Nip,   // drop the value under the top, for `lhs $ rhs`
+		};
+
+		struct Op {
+			Code		   code;
+			double		   value = 0.;
+			std::size_t	   slot	 = points;
+			math::Function fn	 = {};
+			std::size_t	   poly	 = 0;
+		};
+
+		inline static constexpr auto points = static_cast<std::size_t>(-1);  // as a `slot`
+
+	public:
+		/**
+		 * @brief Compile an AST within a budget, charging a step per node.
+		 *
+		 * Constant subtrees of `$` are evaluated here, derivatives are reduced to polynomials.
+		 *
+		 * @param expr
+		 * @param budget
+		 * @return the tape, or `std::nullopt` if some node cannot be evaluated pointwise
+		 */
+		inline static auto compile(const parse::Expr& expr, Budget& budget) -> std::optional<Tape> {
+			Tape tape;
+			if (!tape._emit(expr, points, budget))
+				return std::nullopt;
+			return tape;  // nrvo
+		}
+
+	public:
+		/**
+		 * @brief Operations per point, for budgeting.
+		 *
+		 * @return std::size_t
+		 */
+		[[nodiscard]] auto cost() const -> std::size_t {
+			std::size_t cost = _ops.size();
+			for (const auto& terms : _polys) cost += terms.size();
+			return cost;
+		}
+
+		/**
+		 * @brief Evaluate at every point of `xs` into `ys`, which has the same size.
+		 *
+		 * @param xs
+		 * @param ys
+		 */
+		auto eval(std::span<const double> xs, std::span<double> ys) const -> void {
+			std::vector<double> stack(_depth * block);
+
+			for (std::size_t begin = 0; begin < xs.size(); begin += block) {
+				const auto n = std::min(block, xs.size() - begin);
+				_run(xs.data() + begin, n, stack.data());
+				std::copy_n(stack.data(), n, ys.data() + begin);
+			}
+		}
+
+	private:
+		inline static constexpr std::size_t block = 256;  // points kept in L1 at once
+
+		Tape() = default;
+
+		auto _push(Op op) -> void {
+			_ops.push_back(op);
+			_depth = std::max(_depth, ++_top);
+		}
+
+		auto _pop(Code code) -> void {
+			_ops.push_back({ .code = code });
+			--_top;
+		}
+
+		/**
+		 * @brief Emit the operations of `expr`, leaving its value on top of the stack.
+		 *
+		 * @param expr
+		 * @param var where the values of `x` are: `points`, or a stack slot
+		 * @param budget
+		 * @return whether it could be compiled
+		 */
+		auto _emit(const parse::Expr& expr, std::size_t var, Budget& budget) -> bool {
+			if (!budget.step())
+				return false;
+
+			if (evaluate::is_x(expr))
+				_push({ .code = Code::Var, .slot = var });
+			else if (const auto num = expr.get_if<parse::Number>())
+				_push({ .code = Code::Const, .value = num->val });
+			else if (const auto binop = expr.get_if<parse::BinOpExpr>()) {
+				if (binop->op == lex::Operator::When) {
+					if (const auto val = evaluate::eval_con(expr, budget)) {
+						_push({ .code = Code::Const, .value = *val });
+						return true;
+					} else if (budget.exhausted() || !_emit(*binop->rhs, var, budget))
+						return false;
+					// `lhs` reads its `x` from where `rhs` was left.
+					if (!_emit(*binop->lhs, _top - 1, budget))
+						return false;
+					_pop(Code::Nip);
+					return true;
+				}
+
+				const auto code = _code(binop->op);
+				if (!code || !_emit(*binop->lhs, var, budget) || !_emit(*binop->rhs, var, budget))
+					return false;
+				_pop(*code);
+			} else if (const auto operands = evaluate::nary_operands(expr)) {
+				const auto identity = operands->front().op == lex::Operator::Multiply ? 1. : 0.;
+				_push({ .code = Code::Const, .value = identity });
+				for (const auto& [op, operand] : *operands) {
+					if (!_emit(*operand, var, budget))
+						return false;
+					_pop(*_code(op));
+				}
+			} else if (const auto uop = expr.get_if<parse::UnaryOpExpr>()) {
+				if (uop->op == lex::Operator::Derivative) {
+					const auto terms = evaluate::eval_termlist_calc(*uop->operand, budget);
+					const auto d	 = terms ? terms->derivative() : std::nullopt;
+					if (!d)
+						return false;
+					_push({ .code = Code::Var, .slot = var });
+					_ops.push_back({ .code = Code::Poly, .poly = _polys.size() });
+					_polys.push_back(*std::move(d));
+					return true;
+				}
+
+				if (!_emit(*uop->operand, var, budget))
+					return false;
+				switch (uop->op) {
+					case lex::Operator::Plus: break;
+					case lex::Operator::Minus: _ops.push_back({ .code = Code::Neg }); break;
+					case lex::Operator::Ln: _ops.push_back({ .code = Code::Ln }); break;
+					default: return false;
+				}
+			} else if (const auto call = expr.get_if<parse::CallExpr>()) {
+				if (!_emit(*call->arg, var, budget))
+					return false;
+				_ops.push_back({ .code = Code::Call, .fn = call->fn });
+			} else
+				return false;
+
+			return true;
+		}
+
+		inline static auto _code(lex::Operator op) -> std::optional<Code> {
+			switch (op) {
+				case lex::Operator::Plus: return Code::Add;
+				case lex::Operator::Minus: return Code::Sub;
+				case lex::Operator::Multiply: return Code::Mul;
+				case lex::Operator::Devide: return Code::Div;
+				case lex::Operator::Exponent: return Code::Pow;
+				default: return std::nullopt;
+			}
+		}
+
+		/**
+		 * @brief Run the tape over one block of `n` points, the result ends up in slot 0.
+		 *
+		 */
+		auto _run(const double* xs, std::size_t n, double* stack) const -> void {
+			std::size_t used = 0;  // slots
+			for (const auto& op : _ops) {
+				const auto slot = [&](std::size_t k) { return stack + k * block; };
+				const auto binary = [&](auto f) {
+					double* const lhs = slot(used - 2);
+					double* const rhs = slot(used - 1);
+					for (std::size_t i = 0; i < n; ++i) lhs[i] = f(lhs[i], rhs[i]);
+					--used;
+				};
+				double* const top = used > 0 ? slot(used - 1) : nullptr;
+
+				switch (op.code) {
+					case Code::Const: std::fill_n(slot(used++), n, op.value); break;
+					case Code::Var:
+						std::copy_n(op.slot == points ? xs : slot(op.slot), n, slot(used++));
+						break;
+					case Code::Add: binary([](double a, double b) { return a + b; }); break;
+					case Code::Sub: binary([](double a, double b) { return a - b; }); break;
+					case Code::Mul: binary([](double a, double b) { return a * b; }); break;
+					case Code::Div: binary([](double a, double b) { return a / b; }); break;
+					case Code::Pow:
+						binary([](double a, double b) { return std::pow(a, b); });
+						break;
+					case Code::Neg:
+						for (std::size_t i = 0; i < n; ++i) top[i] = -top[i];
+						break;
+					case Code::Ln:
+						for (std::size_t i = 0; i < n; ++i) top[i] = std::log(top[i]);
+						break;
+					case Code::Call: math::batch(op.fn)(top, top, n); break;
+					case Code::Poly:
+						for (std::size_t i = 0; i < n; ++i) top[i] = _polys[op.poly].eval(top[i]);
+						break;
+					case Code::Nip: binary([](double, double b) { return b; }); break;
+				}
+			}
+		}
+
+	private:
+		std::vector<Op>					_ops;
+		std::vector<evaluate::TermList> _polys;	  // of `Code::Poly`
+		std::size_t						_depth = 0;	 // slots the stack needs
+		std::size_t						_top   = 0;	 // slots in use while compiling
+	};
+}  // namespace dcs213::p1::pointwise
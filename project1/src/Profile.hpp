@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dcs213::p1::profile {
+	/**
+	 * @brief Timeline of the startup phases of the process.
+	 *
+	 * Phases are recorded by `mark`, each one spanning from the previous mark (or from the
+	 * creation of the timeline) to now. Recording is a no-op unless enabled, by `enable()` or
+	 * by setting the `DCS213_P1_PROFILE_STARTUP` environment variable.
+	 */
+	class Startup {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct Phase {
+			std::string		name;
+			Clock::duration duration;  // since the previous mark
+			Clock::duration at;		   // since the creation of the timeline
+		};
+
+	public:
+		/**
+		 * @brief The process-wide timeline, created on first use, ideally first thing in `main`.
+		 *
+		 * @return Startup&
+		 */
+		inline static auto global() -> Startup& {
+			static Startup startup;
+			return startup;
+		}
+
+		auto enable() -> void {
+			std::lock_guard lock { _mutex };
+			_enabled = true;
+		}
+
+		[[nodiscard]] auto enabled() const -> bool {
+			std::lock_guard lock { _mutex };
+			return _enabled;
+		}
+
+		/**
+		 * @brief End the current phase as `name`.
+		 *
+		 * @param name
+		 */
+		auto mark(std::string_view name) -> void {
+			const auto now = Clock::now();
+
+			std::lock_guard lock { _mutex };
+			if (!_enabled)
+				return;
+			_phases.push_back({
+				.name	  = std::string(name),
+				.duration = now - _last,
+				.at		  = now - _origin,
+			});
+			_last = now;
+		}
+
+		/**
+		 * @brief Print the phases recorded so far, once.
+		 *
+		 * @param out
+		 */
+		auto report(std::FILE* out = stderr) -> void {
+			std::lock_guard lock { _mutex };
+			if (!_enabled || _reported)
+				return;
+			_reported = true;
+
+			const auto ms = [](Clock::duration d) {
+				return std::chrono::duration<double, std::milli>(d).count();
+			};
+
+			std::string text = "startup phases:\n";
+			for (const auto& phase : _phases)
+				text += std::format(
+					"  {:<24} {:>9.3f} ms   (at {:>9.3f} ms)\n",
+					phase.name,
+					ms(phase.duration),
+					ms(phase.at)
+				);
+			std::fputs(text.c_str(), out);
+		}
+
+	private:
+		Startup() : _origin(Clock::now()), _last(_origin) {
+			if (const auto env = std::getenv("DCS213_P1_PROFILE_STARTUP"); env && *env && *env != '0')
+				_enabled = true;
+		}
+
+	private:
+		mutable std::mutex _mutex;
+		bool			   _enabled	 = false;
+		bool			   _reported = false;
+		Clock::time_point  _origin;
+		Clock::time_point  _last;
+		std::vector<Phase> _phases;
+	};
+}  // namespace dcs213::p1::profile
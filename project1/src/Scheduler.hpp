@@ -0,0 +1,448 @@
+#pragma once
+
+#include "Alloc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dcs213::p1::sched {
+	/**
+	 * @brief A unit of work that can sit in a queue of the pool.
+	 *
+	 * The forking side owns the job (usually on its stack) and keeps it alive until `done` is
+	 * set, so queues only ever hold borrowed pointers. Allocations of the job are attributed to
+	 * the tag of the forking side, wherever it runs.
+	 */
+	class Job {
+	public:
+		virtual ~Job() = default;
+
+		virtual auto run() -> void {
+			execute_tagged();
+			done.store(true, std::memory_order_release);
+		}
+
+	public:
+		std::atomic<bool> done = false;
+
+	protected:
+		auto execute_tagged() -> void {
+#ifdef DCS213_P1_COUNT_ALLOCS
+			const alloc::Tagged tagged { _tag };
+#endif
+			execute();
+		}
+
+	private:
+		virtual auto execute() -> void = 0;
+
+	private:
+#ifdef DCS213_P1_COUNT_ALLOCS
+		alloc::Tag _tag = alloc::current();
+#endif
+	};
+
+	/**
+	 * @brief A work-stealing thread pool for fork-join parallelism.
+	 *
+	 * Every worker owns a deque: it pushes and pops forked jobs at the back (LIFO, cache
+	 * friendly), while idle workers steal from the front (FIFO, i.e. the biggest pieces).
+	 * Threads outside of the pool fork into a shared injector queue instead.
+	 *
+	 * A joining thread never blocks while its job is queued: it takes the job back and runs it
+	 * inline, or, if the job was stolen, keeps executing other forked jobs until it is done
+	 * (threads outside of the pool help too). Nested `join`s inside jobs are therefore deadlock
+	 * free. Spawned jobs have a queue of their own that only idle workers take from, since they
+	 * may block on work that is lower on the stack of a helping thread.
+	 */
+	class ThreadPool {
+	public:
+		explicit ThreadPool(std::size_t threads = default_concurrency()) {
+			_queues.reserve(threads);
+			for (std::size_t i = 0; i < threads; ++i) _queues.push_back(std::make_unique<Queue>());
+
+			_threads.reserve(threads);
+			for (std::size_t i = 0; i < threads; ++i)
+				_threads.emplace_back([this, i] { _work(i); });
+		}
+
+		ThreadPool(const ThreadPool&)			 = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool() {
+			{
+				std::lock_guard lock { _sleep_mutex };
+				_stop = true;
+			}
+			_sleep_cv.notify_all();
+			for (auto& t : _threads) t.join();
+		}
+
+	public:
+		/**
+		 * @brief The process-wide pool, created on first use.
+		 *
+		 * @return ThreadPool&
+		 */
+		inline static auto global() -> ThreadPool& {
+			static ThreadPool pool { [] {
+				std::lock_guard lock { _global_mutex };
+				_global_created = true;
+				return _global_threads.value_or(default_concurrency());
+			}() };
+			return pool;
+		}
+
+		/**
+		 * @brief Set the number of workers of the global pool, e.g. from a `--jobs` option.
+		 *
+		 * With no workers, joins run both halves inline and spawned jobs run right away.
+		 *
+		 * @param threads
+		 * @return false if the global pool is already in use, and keeps its size
+		 */
+		inline static auto configure_global(std::size_t threads) -> bool {
+			std::lock_guard lock { _global_mutex };
+			if (_global_created)
+				return false;
+			_global_threads = threads;
+			return true;
+		}
+
+		/**
+		 * @brief Workers besides the calling thread, which takes part in every `join`.
+		 *
+		 * @return std::size_t
+		 */
+		inline static auto default_concurrency() -> std::size_t {
+			const auto hc = std::thread::hardware_concurrency();
+			return hc > 1 ? hc - 1 : 1;
+		}
+
+		[[nodiscard]] auto concurrency() const -> std::size_t { return _threads.size() + 1; }
+
+		/**
+		 * @brief Whether the calling thread is helping out while it waits in a `join`.
+		 *
+		 * Whatever such a thread blocks on may be waiting, lower on its own stack, for the very
+		 * job it helps with, so it must not block on other threads' work.
+		 *
+		 * @return bool
+		 */
+		[[nodiscard]] inline static auto helping() -> bool { return _waits > 0; }
+
+		/**
+		 * @brief Run `f` and `g` potentially in parallel and wait for both.
+		 *
+		 * `g` is offered to the other workers while the calling thread runs `f`. If `f` throws,
+		 * `g` is taken back unstarted or waited for before the exception propagates, since it
+		 * lives on this stack frame.
+		 *
+		 * @return std::pair<std::invoke_result_t<F>, std::invoke_result_t<G>>
+		 */
+		template<std::invocable F, std::invocable G>
+		auto join(F&& f, G&& g) -> std::pair<std::invoke_result_t<F>, std::invoke_result_t<G>> {
+			if (_threads.empty()) {
+				auto lhs = std::invoke(std::forward<F>(f));
+				return { std::move(lhs), std::invoke(std::forward<G>(g)) };
+			}
+
+			ForkedJob<G> forked { std::forward<G>(g) };
+
+			_push(&forked);
+			std::optional<std::invoke_result_t<F>> lhs;
+			std::exception_ptr					   error;
+			try {
+				lhs.emplace(std::invoke(std::forward<F>(f)));
+			} catch (...) { error = std::current_exception(); }
+
+			if (!forked.done.load(std::memory_order_acquire)) {
+				if (_take_back(&forked)) {
+					if (!error)
+						forked.run();
+				} else
+					_wait(forked);
+			}
+
+			if (error)
+				std::rethrow_exception(error);
+			return { *std::move(lhs), std::move(forked).result() };
+		}
+
+		/**
+		 * @brief Call `f(i)` for every `i` in `[begin, end)`, potentially in parallel.
+		 *
+		 * The range is split in halves recursively with `join` until pieces have at most `grain`
+		 * indices, which are then run in order.
+		 *
+		 * @param begin
+		 * @param end
+		 * @param grain
+		 * @param f
+		 */
+		template<std::invocable<std::size_t> F>
+		auto parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F&& f) -> void {
+			if (end - begin <= std::max<std::size_t>(grain, 1)) {
+				for (auto i = begin; i < end; ++i) std::invoke(f, i);
+				return;
+			}
+
+			const auto mid = begin + ((end - begin) >> 1);
+			join(
+				[&] { return parallel_for(begin, mid, grain, f), true; },
+				[&] { return parallel_for(mid, end, grain, f), true; }
+			);
+		}
+
+		/**
+		 * @brief Run `f` on the pool without waiting for it.
+		 *
+		 * Spawned jobs go to a queue of their own, so they start in FIFO order even when spawned
+		 * from inside the pool, and only on workers that are otherwise idle.
+		 *
+		 * @param f
+		 */
+		template<std::invocable F>
+		auto spawn(F&& f) -> void {
+			if (_threads.empty())
+				return (new SpawnedJob<std::decay_t<F>> { std::forward<F>(f) })->run();
+			_enqueue(_spawned, new SpawnedJob<std::decay_t<F>> { std::forward<F>(f) });
+		}
+
+	private:
+		struct Queue {
+			std::mutex		 mutex;
+			std::deque<Job*> jobs;
+		};
+
+		template<typename G>
+		class ForkedJob final : public Job {
+		public:
+			using R = std::invoke_result_t<G>;
+
+			explicit ForkedJob(G&& g) : _g(std::forward<G>(g)) {}
+
+			auto result() && -> R {
+				if (_error)
+					std::rethrow_exception(_error);
+				return *std::move(_result);
+			}
+
+		private:
+			auto execute() -> void override {
+				try {
+					_result.emplace(std::invoke(std::forward<G>(_g)));
+				} catch (...) { _error = std::current_exception(); }
+			}
+
+		private:
+			G				   _g;
+			std::optional<R>   _result;
+			std::exception_ptr _error;
+		};
+
+		template<typename F>
+		class SpawnedJob final : public Job {
+		public:
+			explicit SpawnedJob(F&& f) : _f(std::move(f)) {}
+
+			explicit SpawnedJob(const F& f) : _f(f) {}
+
+			auto run() -> void override {
+				const std::unique_ptr<SpawnedJob> self { this };
+				execute_tagged();
+			}
+
+		private:
+			/**
+			 * @brief Nobody waits for a spawned job, so an exception escaping `f` would have
+			 * nowhere to go but `std::terminate`; `f` is expected to report its own errors.
+			 */
+			auto execute() -> void override {
+				try {
+					std::invoke(_f);
+				} catch (...) {}
+			}
+
+		private:
+			F _f;
+		};
+
+		inline static constexpr std::size_t spin_limit = 64;  // yields in `_wait` before parking
+
+		inline static std::mutex				 _global_mutex;
+		inline static std::optional<std::size_t> _global_threads;  // workers of `global()`
+		inline static bool						 _global_created = false;
+
+		inline static thread_local ThreadPool* _owner = nullptr;
+		inline static thread_local std::size_t _index = 0;
+		inline static thread_local std::size_t _waits = 0;	// nested `_wait`s, of any pool
+
+		[[nodiscard]] auto _local() -> Queue* {
+			return _owner == this ? _queues[_index].get() : nullptr;
+		}
+
+		auto _push(Job* job) -> void {
+			auto* local = _local();
+			_enqueue(local ? *local : _injector, job);
+		}
+
+		auto _enqueue(Queue& queue, Job* job) -> void {
+			{
+				std::lock_guard lock { queue.mutex };
+				queue.jobs.push_back(job);
+			}
+
+			_queued.fetch_add(1);
+			if (_sleepers.load() > 0) {
+				{ std::lock_guard lock { _sleep_mutex }; }
+				_sleep_cv.notify_one();
+			}
+		}
+
+		/**
+		 * @brief Remove a job that has not been started yet from the queue it was pushed to.
+		 *
+		 * @return whether the job was still there
+		 */
+		auto _take_back(Job* job) -> bool {
+			auto& queue = _local() ? *_local() : _injector;
+
+			std::lock_guard lock { queue.mutex };
+			if (const auto it = std::ranges::find(queue.jobs, job); it != queue.jobs.end()) {
+				queue.jobs.erase(it);
+				_queued.fetch_sub(1);
+				return true;
+			}
+			return false;
+		}
+
+		auto _pop_from(Queue& queue, bool back) -> Job* {
+			std::lock_guard lock { queue.mutex };
+			if (queue.jobs.empty())
+				return nullptr;
+
+			Job* job;
+			if (back) {
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			} else {
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+			}
+			_queued.fetch_sub(1);
+			return job;
+		}
+
+		auto _find(std::size_t self) -> Job* {
+			if (auto* local = _local())
+				if (auto* job = _pop_from(*local, true))
+					return job;
+
+			if (auto* job = _pop_from(_injector, false))
+				return job;
+
+			for (std::size_t i = 1; i <= _queues.size(); ++i)
+				if (auto* job = _pop_from(*_queues[(self + i) % _queues.size()], false))
+					return job;
+
+			return nullptr;
+		}
+
+		/**
+		 * @brief Wait for a stolen job, helping with other forked jobs meanwhile.
+		 *
+		 * With nothing to help with, spins for a while, then parks until some forked job
+		 * finishes. The job lives on our stack, so the thief must not touch it after setting
+		 * `done`: parking waits on the pool's `_completions` instead of the flag, so no notify
+		 * races the destruction.
+		 */
+		auto _wait(Job& job) -> void {
+			++_waits;
+			for (std::size_t spins = 0; !job.done.load(std::memory_order_acquire);)
+				if (auto* other = _find(_index)) {
+					other->run();
+					_finished();
+					spins = 0;
+				} else if (++spins < spin_limit)
+					std::this_thread::yield();
+				else
+					_park(job);
+			--_waits;
+		}
+
+		/**
+		 * @brief Block until some forked job finishes, unless `job` already has.
+		 *
+		 * The thread running `job` keeps making progress without us: what it forks it can run
+		 * itself, so parking without watching the queues cannot deadlock.
+		 */
+		auto _park(const Job& job) -> void {
+			_parked.fetch_add(1);
+			const auto seen = _completions.load();
+			if (!job.done.load(std::memory_order_acquire))
+				_completions.wait(seen);
+			_parked.fetch_sub(1);
+		}
+
+		/**
+		 * @brief Wake the parked waiters after running a forked job, which they may wait for.
+		 *
+		 */
+		auto _finished() -> void {
+			_completions.fetch_add(1);
+			if (_parked.load() > 0)
+				_completions.notify_all();
+		}
+
+		auto _work(std::size_t index) -> void {
+			_owner = this;
+			_index = index;
+
+			while (true) {
+				if (auto* job = _find(index)) {
+					job->run();
+					_finished();
+					continue;
+				}
+				if (auto* job = _pop_from(_spawned, false)) {
+					job->run();
+					continue;
+				}
+
+				std::unique_lock lock { _sleep_mutex };
+				_sleepers.fetch_add(1);
+				_sleep_cv.wait(lock, [this] { return _stop || _queued.load() > 0; });
+				_sleepers.fetch_sub(1);
+				if (_stop)
+					return;
+			}
+		}
+
+	private:
+		std::vector<std::unique_ptr<Queue>> _queues;
+		Queue								_injector;
+		Queue								_spawned;
+		std::vector<std::thread>			_threads;
+
+		std::atomic<std::size_t>			_queued		 = 0;
+		std::atomic<std::size_t>			_sleepers	 = 0;
+		std::atomic<std::size_t>			_parked		 = 0;  // threads in `_park`
+		std::atomic<std::size_t>			_completions = 0;  // forked jobs run by workers
+		std::mutex							_sleep_mutex;
+		std::condition_variable				_sleep_cv;
+		bool								_stop = false;
+	};
+}  // namespace dcs213::p1::sched
@@ -0,0 +1,375 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+/**
+ * @brief Log of the evaluations that took longer than a threshold, one JSON object per line.
+ *
+ * Evaluating threads only hand entries over through a bounded lock-free queue; a background
+ * thread formats and writes them, and rotates the file once it grows too large. When the queue
+ * is full, entries are dropped and counted rather than waited for.
+ */
+namespace dcs213::p1::slowlog {
+	struct Config {
+		std::string				 path;	// no log if empty
+		std::chrono::nanoseconds threshold = std::chrono::milliseconds { 100 };
+		std::uint64_t			 max_bytes = 16 << 20;	// per file, then it is rotated
+		std::size_t				 max_files = 4;			// rotated files kept, `path.1` the newest
+		std::size_t				 capacity  = 1024;		// entries queued for the writer
+	};
+
+	/**
+	 * @brief One slow evaluation.
+	 *
+	 */
+	struct Entry {
+		std::string				 script;
+		std::int64_t			 time = 0;	// unix time in milliseconds, at the end
+		std::chrono::nanoseconds total {};
+		pipeline::Stages		 stages;
+		bool					 success	  = false;
+		bool					 cancelled	  = false;
+		std::size_t				 result_bytes = 0;	// of the result, or of the error message
+		std::string				 error;
+
+		/**
+		 * @brief An entry for an evaluation that just finished.
+		 *
+		 * @param script
+		 * @param outcome
+		 * @param stages
+		 * @param total
+		 * @return Entry
+		 */
+		inline static auto of(
+			std::string_view		 script,
+			const pipeline::Outcome& outcome,
+			const pipeline::Stages&	 stages,
+			std::chrono::nanoseconds total
+		) -> Entry {
+			const auto now = std::chrono::system_clock::now().time_since_epoch();
+			return {
+				.script		  = std::string(script),
+				.time		  = std::chrono::duration_cast<std::chrono::milliseconds>(now).count(),
+				.total		  = total,
+				.stages		  = stages,
+				.success	  = outcome.success,
+				.cancelled	  = outcome.cancelled,
+				.result_bytes = outcome.text.size(),
+				.error		  = outcome.success ? std::string {} : outcome.text,
+			};
+		}
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("time", time)
+				.field("script", script)
+				.field("success", success)
+				.field("cancelled", cancelled)
+				.field("cached", stages.cached)
+				.key("ns")
+				.begin_object()
+				.field("total", total.count())
+				.field("lex", stages.lex.count())
+				.field("parse", stages.parse.count())
+				.field("evaluate", stages.evaluate.count())
+				.end_object()
+				.field("nodes", stages.nodes)
+				.field("steps", stages.steps)
+				.field("result_bytes", result_bytes);
+			if (!success)
+				writer.field("error", error);
+			writer.end_object();
+		}
+	};
+
+	struct Stats {
+		std::uint64_t logged	= 0;  // entries written
+		std::uint64_t dropped	= 0;  // entries lost to a full queue
+		std::uint64_t failed	= 0;  // entries lost to a failed write
+		std::uint64_t rotations = 0;
+
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object()
+				.field("logged", logged)
+				.field("dropped", dropped)
+				.field("failed", failed)
+				.field("rotations", rotations)
+				.end_object();
+		}
+	};
+
+	namespace details {
+		/**
+		 * @brief Bounded multi-producer, single-consumer queue, lock-free on both ends.
+		 *
+		 * Every cell carries a sequence number that tells whose turn it is: `pos` for the
+		 * producer claiming position `pos`, `pos + 1` for the consumer.
+		 */
+		template<typename T>
+		class Queue {
+		public:
+			explicit Queue(std::size_t capacity) :
+				_capacity(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+				_cells(std::make_unique<Cell[]>(_capacity)) {
+				for (std::size_t i = 0; i < _capacity; ++i)
+					_cells[i].seq.store(i, std::memory_order_relaxed);
+			}
+
+		public:
+			/**
+			 * @brief Enqueue a value, from any thread.
+			 *
+			 * @param value moved from only on success
+			 * @return whether there was room
+			 */
+			auto try_push(T& value) -> bool {
+				auto pos = _tail.load(std::memory_order_relaxed);
+				for (;;) {
+					auto&	   cell = _cells[pos & (_capacity - 1)];
+					const auto seq	= cell.seq.load(std::memory_order_acquire);
+					const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+
+					if (diff == 0) {
+						if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+							cell.value = std::move(value);
+							cell.seq.store(pos + 1, std::memory_order_release);
+							return true;
+						}
+					} else if (diff < 0)
+						return false;  // a lap behind: full
+					else
+						pos = _tail.load(std::memory_order_relaxed);
+				}
+			}
+
+			/**
+			 * @brief Dequeue a value, from the consumer thread only.
+			 *
+			 * @return std::optional<T> nothing if empty
+			 */
+			auto try_pop() -> std::optional<T> {
+				auto& cell = _cells[_head & (_capacity - 1)];
+				if (cell.seq.load(std::memory_order_acquire) != _head + 1)
+					return std::nullopt;
+
+				std::optional<T> value { std::move(cell.value) };
+				cell.seq.store(_head + _capacity, std::memory_order_release);
+				++_head;
+				return value;
+			}
+
+		private:
+			struct Cell {
+				std::atomic<std::size_t> seq;
+				T						 value;
+			};
+
+			std::size_t							 _capacity;
+			std::unique_ptr<Cell[]>				 _cells;
+			alignas(64) std::atomic<std::size_t> _tail = 0;	 // producers
+			alignas(64) std::size_t				 _head = 0;	 // the consumer
+		};
+	}  // namespace details
+
+	class Log {
+	public:
+		Log(const Log&)			   = delete;
+		Log& operator=(const Log&) = delete;
+
+		/**
+		 * @brief Write out what is still queued, then close the file.
+		 *
+		 */
+		~Log() {
+			_thread.request_stop();
+			_wake();
+			_thread.join();
+			if (_file)
+				std::fclose(_file);
+		}
+
+	public:
+		/**
+		 * @brief Open a log for appending, creating it if needed, and start its writer.
+		 *
+		 * @param config
+		 * @return the log, or `nullptr` if the file cannot be opened
+		 */
+		inline static auto open(Config config) -> std::unique_ptr<Log> {
+			auto* file = std::fopen(config.path.c_str(), "ab");
+			if (!file)
+				return nullptr;
+
+			std::unique_ptr<Log> log { new Log(std::move(config), file) };
+			log->_thread = std::jthread { [log = log.get()](std::stop_token stop) {
+				log->_run(std::move(stop));
+			} };
+			return log;
+		}
+
+	public:
+		/**
+		 * @brief Whether an evaluation that took `elapsed` belongs in the log.
+		 *
+		 */
+		[[nodiscard]] auto slow(std::chrono::nanoseconds elapsed) const -> bool {
+			return elapsed >= _config.threshold;
+		}
+
+		/**
+		 * @brief Queue an entry for the writer, without blocking.
+		 *
+		 * @param entry
+		 * @return whether it was queued, it is dropped otherwise
+		 */
+		auto record(Entry entry) -> bool {
+			if (!_queue.try_push(entry)) {
+				_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			_wake();
+			return true;
+		}
+
+		[[nodiscard]] auto stats() const -> Stats {
+			return {
+				.logged	   = _logged.load(std::memory_order_relaxed),
+				.dropped   = _dropped.load(std::memory_order_relaxed),
+				.failed	   = _failed.load(std::memory_order_relaxed),
+				.rotations = _rotations.load(std::memory_order_relaxed),
+			};
+		}
+
+		[[nodiscard]] auto config() const -> const Config& { return _config; }
+
+	private:
+		Log(Config config, std::FILE* file) :
+			_config(std::move(config)), _file(file), _queue(_config.capacity) {
+			std::error_code ec;
+			_bytes = std::filesystem::file_size(_config.path, ec);
+			if (ec)
+				_bytes = 0;
+		}
+
+		auto _wake() -> void {
+			_pending.fetch_add(1, std::memory_order_release);
+			_pending.notify_one();
+		}
+
+		/**
+		 * @brief The writer thread: drain the queue, flush, sleep until something is queued.
+		 *
+		 */
+		auto _run(std::stop_token stop) -> void {
+			for (;;) {
+				const auto seen = _pending.load(std::memory_order_acquire);
+				while (auto entry = _queue.try_pop()) _write(*entry);
+				if (_file)
+					std::fflush(_file);
+
+				if (stop.stop_requested())
+					return;
+				_pending.wait(seen, std::memory_order_acquire);
+			}
+		}
+
+		auto _write(const Entry& entry) -> void {
+			json::Writer writer;
+			writer.value(entry);
+			const auto& line = writer.str();
+
+			if (!_file)
+				_reopen();
+			if (_bytes > 0 && _bytes + line.size() + 1 > _config.max_bytes)
+				_rotate();
+
+			if (!_file || std::fwrite(line.data(), 1, line.size(), _file) != line.size()
+				|| std::fputc('\n', _file) == EOF) {
+				_failed.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			_bytes += line.size() + 1;
+			_logged.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Shift `path.k` to `path.k+1`, dropping the oldest, and start over at `path`.
+		 *
+		 * If the file cannot be reopened, entries are counted as failed, and every one of them
+		 * tries to open it again first (see `_reopen`).
+		 */
+		auto _rotate() -> void {
+			namespace fs = std::filesystem;
+
+			if (_file)
+				std::fclose(_file);
+
+			const auto rotated = [&](std::size_t k) {
+				return std::format("{}.{}", _config.path, k);
+			};
+
+			std::error_code ec;
+			if (_config.max_files == 0)
+				fs::remove(_config.path, ec);
+			else {
+				fs::remove(rotated(_config.max_files), ec);
+				for (auto k = _config.max_files - 1; k > 0; --k)
+					fs::rename(rotated(k), rotated(k + 1), ec);
+				fs::rename(_config.path, rotated(1), ec);
+			}
+
+			_file  = std::fopen(_config.path.c_str(), "wb");
+			_bytes = 0;
+			_rotations.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Try to open `path` for appending again, after it could not be.
+		 *
+		 */
+		auto _reopen() -> void {
+			_file = std::fopen(_config.path.c_str(), "ab");
+			if (!_file)
+				return;
+
+			std::error_code ec;
+			_bytes = std::filesystem::file_size(_config.path, ec);
+			if (ec)
+				_bytes = 0;
+		}
+
+	private:
+		Config					   _config;
+		std::FILE*				   _file;
+		std::uint64_t			   _bytes = 0;	// of the current file
+		details::Queue<Entry>	   _queue;
+
+		std::atomic<std::uint64_t> _pending	  = 0;	// bumped on every push, the writer waits on it
+		std::atomic<std::uint64_t> _logged	  = 0;
+		std::atomic<std::uint64_t> _dropped	  = 0;
+		std::atomic<std::uint64_t> _failed	  = 0;
+		std::atomic<std::uint64_t> _rotations = 0;
+
+		std::jthread			   _thread;	 // last, so it stops before the rest goes away
+	};
+}  // namespace dcs213::p1::slowlog
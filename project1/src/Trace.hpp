@@ -0,0 +1,389 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Trace the enclosing scope as `DCS213_P1_TRACE_SCOPE(Lex)`, by the enumerator of
+ * `trace::Stage`, or as `DCS213_P1_TRACE_SCOPE(Bind, name)`, `name` being a string that
+ * outlives the trace.
+ *
+ * Compiled out unless `DCS213_P1_TRACE` is defined (`xmake f --p1_trace=y`). The arguments are
+ * still evaluated then, so keep them trivial.
+ */
+#ifdef DCS213_P1_TRACE
+#	define DCS213_P1_TRACE_CONCAT_IMPL(a, b) a##b
+#	define DCS213_P1_TRACE_CONCAT(a, b)	  DCS213_P1_TRACE_CONCAT_IMPL(a, b)
+#	define DCS213_P1_TRACE_SCOPE(...)                                                             \
+		const ::dcs213::p1::trace::Scope DCS213_P1_TRACE_CONCAT(_trace_scope_, __LINE__) {         \
+			::dcs213::p1::trace::Stage::__VA_ARGS__                                                \
+		}
+#else
+#	define DCS213_P1_TRACE_SCOPE(...) \
+		::dcs213::p1::trace::discard(::dcs213::p1::trace::Stage::__VA_ARGS__)
+#endif
+
+namespace dcs213::p1::trace {
+	inline static constexpr bool enabled =
+#ifdef DCS213_P1_TRACE
+		true;
+#else
+		false;
+#endif
+
+	enum class Stage : std::uint8_t {
+		Lex,
+		Parse,
+		EvalCon,
+		EvalTermList,
+		EvalPoint,
+		EvalMPoly,
+		Format,		// the result of an evaluation to text
+		Serialize,	// the result of a binding to JSON
+		Bind,		// a whole binding call
+	};
+
+	inline static constexpr std::size_t stage_count = 9;
+
+	inline static constexpr auto to_string(Stage stage) -> std::string_view {
+		switch (stage) {
+			case Stage::Lex: return "lex";
+			case Stage::Parse: return "parse";
+			case Stage::EvalCon: return "eval_con";
+			case Stage::EvalTermList: return "eval_termlist_calc";
+			case Stage::EvalPoint: return "eval_point";
+			case Stage::EvalMPoly: return "eval_mpoly";
+			case Stage::Format: return "format";
+			case Stage::Serialize: return "serialize";
+			case Stage::Bind: return "bind";
+		}
+		return "?";
+	}
+
+	/**
+	 * @brief What `DCS213_P1_TRACE_SCOPE` expands to when tracing is compiled out.
+	 *
+	 */
+	template<typename... Args>
+	inline static constexpr auto discard(const Args&... /* args */) -> void {}
+
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief A complete event: a scope that ran from `begin` for `duration` ns.
+	 *
+	 */
+	struct Event {
+		const char*	  name;	 // may be null, the stage names it then
+		std::uint64_t begin;	 // ns since the origin of the tracer
+		std::uint64_t duration;	 // ns
+		Stage		  stage;
+	};
+
+	/**
+	 * @brief The events of one thread, the latest `capacity` of them.
+	 *
+	 * Only the owning thread pushes, without locking: it fills the slot, then publishes it by
+	 * bumping `head`. Readers copy the slots below `head`, then drop those the writer may have
+	 * overwritten meanwhile.
+	 */
+	class Ring {
+	public:
+		inline static constexpr std::size_t capacity = 1 << 16;
+
+		explicit Ring(std::uint32_t tid) : _tid(tid), _events(capacity) {}
+
+	public:
+		[[nodiscard]] auto tid() const -> std::uint32_t { return _tid; }
+
+		auto push(const Event& event) -> void {
+			const auto head			 = _head.load(std::memory_order_relaxed);
+			_events[head % capacity] = event;
+			_head.store(head + 1, std::memory_order_release);
+		}
+
+		/**
+		 * @brief Append the events still in the ring to `out`, oldest first.
+		 *
+		 * @param out
+		 */
+		auto snapshot(std::vector<Event>& out) const -> void {
+			const auto head	 = _head.load(std::memory_order_acquire);
+			const auto first = std::max(head > capacity ? head - capacity : 0, _floor.load());
+			const auto size	 = out.size();
+			for (auto i = first; i < head; ++i) out.push_back(_events[i % capacity]);
+
+			// Slots below `now - capacity` may have been overwritten while copying, the one at
+			// `now` may be being written.
+			const auto now	= _head.load(std::memory_order_acquire) + 1;
+			const auto torn = std::min(now - std::min(now, capacity + first), head - first);
+			out.erase(out.begin() + size, out.begin() + size + torn);
+		}
+
+		/**
+		 * @brief Forget the events so far. Safe while the owner pushes.
+		 *
+		 */
+		auto clear() -> void { _floor.store(_head.load(std::memory_order_acquire)); }
+
+	private:
+		std::uint32_t			   _tid;
+		std::atomic<std::uint64_t> _head  = 0;
+		std::atomic<std::uint64_t> _floor = 0;	// events below are cleared
+		std::vector<Event>		   _events;
+	};
+
+	/**
+	 * @brief Latencies of one stage, in power-of-two buckets of ns.
+	 *
+	 * Bucket `k` counts latencies in `[2^(k-1), 2^k)`, bucket 0 those of 0 ns.
+	 */
+	class Histogram {
+	public:
+		inline static constexpr std::size_t buckets = 48;
+
+		auto record(std::uint64_t ns) -> void {
+			const auto bucket = std::min<std::size_t>(std::bit_width(ns), buckets - 1);
+			_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+			_count.fetch_add(1, std::memory_order_relaxed);
+			_total.fetch_add(ns, std::memory_order_relaxed);
+
+			auto max = _max.load(std::memory_order_relaxed);
+			while (ns > max && !_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+		}
+
+		auto clear() -> void {
+			for (auto& count : _counts) count.store(0, std::memory_order_relaxed);
+			_count.store(0, std::memory_order_relaxed);
+			_total.store(0, std::memory_order_relaxed);
+			_max.store(0, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief `{ "count", "total_ns", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns",
+		 * "buckets": [[upper bound in ns, count], ...] }`, omitting empty buckets.
+		 *
+		 * Percentiles are the upper bounds of the buckets they fall into.
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			std::array<std::uint64_t, buckets> counts;
+			for (std::size_t k = 0; k < buckets; ++k)
+				counts[k] = _counts[k].load(std::memory_order_relaxed);
+			const auto count = _count.load(std::memory_order_relaxed);
+			const auto total = _total.load(std::memory_order_relaxed);
+
+			const auto upper	  = [](std::size_t k) { return std::uint64_t { 1 } << k; };
+			const auto percentile = [&](double q) -> std::uint64_t {
+				const auto	  rank = static_cast<std::uint64_t>(q * static_cast<double>(count));
+				std::uint64_t seen = 0;
+				for (std::size_t k = 0; k < buckets; ++k)
+					if ((seen += counts[k]) > rank)
+						return upper(k);
+				return upper(buckets - 1);
+			};
+
+			writer.begin_object()
+				.field("count", count)
+				.field("total_ns", total)
+				.field("mean_ns", count ? static_cast<double>(total) / count : 0.)
+				.field("p50_ns", count ? percentile(.5) : 0)
+				.field("p90_ns", count ? percentile(.9) : 0)
+				.field("p99_ns", count ? percentile(.99) : 0)
+				.field("max_ns", _max.load(std::memory_order_relaxed))
+				.key("buckets")
+				.begin_array();
+			for (std::size_t k = 0; k < buckets; ++k)
+				if (counts[k] > 0)
+					writer.begin_array().value(upper(k)).value(counts[k]).end_array();
+			writer.end_array().end_object();
+		}
+
+	private:
+		std::array<std::atomic<std::uint64_t>, buckets> _counts {};
+		std::atomic<std::uint64_t>						_count = 0;
+		std::atomic<std::uint64_t>						_total = 0;
+		std::atomic<std::uint64_t>						_max   = 0;
+	};
+
+	/**
+	 * @brief The process-wide tracer: the rings of every thread that traced, and the
+	 * histograms of every stage.
+	 *
+	 * Histograms count the outermost scope of a stage on a thread only, so that a recursive
+	 * stage such as `eval_con` is measured once per evaluation.
+	 */
+	class Tracer {
+	public:
+		inline static auto global() -> Tracer& {
+			static Tracer tracer;
+			return tracer;
+		}
+
+	public:
+		[[nodiscard]] auto now() const -> std::uint64_t {
+			return static_cast<std::uint64_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _origin).count()
+			);
+		}
+
+		/**
+		 * @brief The ring of the calling thread, registered on first use.
+		 *
+		 * @return Ring&
+		 */
+		auto ring() -> Ring& {
+			thread_local Ring* ring = nullptr;
+			if (!ring) {
+				std::lock_guard lock { _mutex };
+				ring = _rings.emplace_back(std::make_unique<Ring>(_rings.size() + 1)).get();
+			}
+			return *ring;
+		}
+
+		[[nodiscard]] auto histogram(Stage stage) -> Histogram& {
+			return _histograms[static_cast<std::size_t>(stage)];
+		}
+
+		/**
+		 * @brief A copy of `name` that lives as long as the process, for `Event::name`.
+		 *
+		 * @param name
+		 * @return const char*
+		 */
+		auto intern(std::string_view name) -> const char* {
+			std::lock_guard lock { _mutex };
+			for (const auto& known : _names)
+				if (known == name)
+					return known.c_str();
+			return _names.emplace_back(name).c_str();
+		}
+
+		auto clear() -> void {
+			std::lock_guard lock { _mutex };
+			for (const auto& ring : _rings) ring->clear();
+			for (auto& histogram : _histograms) histogram.clear();
+		}
+
+		/**
+		 * @brief The events in Chrome's trace-event format, for `chrome://tracing` or Perfetto.
+		 *
+		 * @param writer
+		 */
+		auto write_chrome(json::Writer& writer) const -> void {
+			std::lock_guard lock { _mutex };
+
+			std::vector<Event> events;
+			writer.begin_object().key("traceEvents").begin_array();
+			for (const auto& ring : _rings) {
+				events.clear();
+				ring->snapshot(events);
+				for (const auto& event : events)
+					writer.begin_object()
+						.field("name", event.name ? event.name : to_string(event.stage))
+						.field("cat", to_string(event.stage))
+						.field("ph", "X")
+						.field("ts", static_cast<double>(event.begin) / 1e3)
+						.field("dur", static_cast<double>(event.duration) / 1e3)
+						.field("pid", 1)
+						.field("tid", ring->tid())
+						.end_object();
+			}
+			writer.end_array().field("displayTimeUnit", "ns").end_object();
+		}
+
+		/**
+		 * @brief Write the Chrome trace to a file.
+		 *
+		 * @param path
+		 * @return whether it was written
+		 */
+		auto dump(const std::string& path) const -> bool {
+			json::Writer writer;
+			write_chrome(writer);
+
+			auto* out = std::fopen(path.c_str(), "wb");
+			if (!out)
+				return false;
+			const auto& text = writer.str();
+			const auto	ok	 = std::fwrite(text.data(), 1, text.size(), out) == text.size();
+			return std::fclose(out) == 0 && ok;
+		}
+
+		/**
+		 * @brief `{ "enabled": ..., "stages": { "lex": histogram, ... } }`.
+		 *
+		 * @see Histogram::write_json
+		 */
+		auto write_json(json::Writer& writer) const -> void {
+			writer.begin_object().field("enabled", enabled).key("stages").begin_object();
+			for (std::size_t s = 0; s < stage_count; ++s)
+				writer.field(to_string(static_cast<Stage>(s)), _histograms[s]);
+			writer.end_object().end_object();
+		}
+
+	private:
+		Tracer() : _origin(Clock::now()) {}
+
+	private:
+		mutable std::mutex				   _mutex;
+		Clock::time_point				   _origin;
+		std::vector<std::unique_ptr<Ring>> _rings;	// never removed, threads may exit
+		std::deque<std::string>			   _names;
+		std::array<Histogram, stage_count> _histograms;
+	};
+
+	/**
+	 * @brief Traces its lifetime. Use through `DCS213_P1_TRACE_SCOPE`.
+	 *
+	 */
+	class Scope {
+	public:
+		explicit Scope(Stage stage, const char* name = nullptr) :
+			_stage(stage), _name(name), _outermost(_depth(stage)++ == 0),
+			_begin(Tracer::global().now()) {}
+
+		Scope(const Scope&)			   = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope() {
+			auto&	   tracer	= Tracer::global();
+			const auto duration = tracer.now() - _begin;
+
+			tracer.ring().push({
+				.name	  = _name,
+				.begin	  = _begin,
+				.duration = duration,
+				.stage	  = _stage,
+			});
+			if (_outermost)
+				tracer.histogram(_stage).record(duration);
+			--_depth(_stage);
+		}
+
+	private:
+		inline static auto _depth(Stage stage) -> std::uint32_t& {
+			thread_local std::array<std::uint32_t, stage_count> depths {};
+			return depths[static_cast<std::size_t>(stage)];
+		}
+
+	private:
+		Stage		  _stage;
+		const char*	  _name;
+		bool		  _outermost;
+		std::uint64_t _begin;
+	};
+}  // namespace dcs213::p1::trace
@@ -1,7 +1,26 @@
 #pragma once
 
+#include "Dispatch.hpp"
+
 #include <simdjson.h>
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <variant>
+#include <vector>
 
 namespace dcs213::p1 {
 	namespace details {
@@ -107,33 +126,547 @@ namespace dcs213::p1 {
 }  // namespace dcs213::p1
 
 namespace dcs213::p1::json {
-	inline static simdjson::ondemand::parser parser {};
+	/**
+	 * @brief Exclusive use of a parser (and its input buffer) from the calling thread's pool.
+	 *
+	 * Every decode takes its own lease, so bindings running concurrently on different threads
+	 * never share a parser, and a binding decoding JSON while its own arguments are still alive
+	 * on the same thread gets a second one. Returned leases are recycled, so after warm-up
+	 * decoding does not allocate.
+	 *
+	 * Strings decoded as `std::string_view` point into the parser, keep the lease alive as long
+	 * as they are used.
+	 */
+	class ParserLease {
+	public:
+		struct Slot {
+			simdjson::ondemand::parser parser;
+			std::string				   buffer;
+		};
+
+	public:
+		ParserLease() {
+			auto& pool = _pool();
+			if (pool.empty())
+				_slot = std::make_unique<Slot>();
+			else {
+				_slot = std::move(pool.back());
+				pool.pop_back();
+			}
+		}
+
+		ParserLease(const ParserLease&)			   = delete;
+		ParserLease& operator=(const ParserLease&) = delete;
+
+		~ParserLease() {
+			if (_slot)
+				_pool().push_back(std::move(_slot));
+		}
+
+	public:
+		/**
+		 * @brief Start iterating `json`, copied into the lease's padded buffer.
+		 *
+		 * @param json
+		 * @return simdjson::simdjson_result<simdjson::ondemand::document>
+		 */
+		auto iterate(std::string_view json)
+			-> simdjson::simdjson_result<simdjson::ondemand::document> {
+			auto& buffer = _slot->buffer;
+			buffer.reserve(json.size() + simdjson::SIMDJSON_PADDING);
+			buffer.assign(json);
+			return _slot->parser.iterate(
+				simdjson::padded_string_view { buffer.data(), buffer.size(), buffer.capacity() }
+			);
+		}
+
+	private:
+		inline static auto _pool() -> std::vector<std::unique_ptr<Slot>>& {
+			thread_local std::vector<std::unique_ptr<Slot>> pool;
+			return pool;
+		}
+
+	private:
+		std::unique_ptr<Slot> _slot;
+	};
 
 	namespace details {
-		template<size_t I, typename... Args>
-		auto init_args(std::tuple<Args...>& args, simdjson::padded_string&& json) -> void {
-			if constexpr (I < sizeof...(Args)) {
-				auto doc		  = parser.iterate(json);
-				std::get<I>(args) = doc.at(I).get<get_type_n_t<I, Args...>>().take_value();
-				init_args<I + 1>(args, std::move(json));
+		template<typename T>
+		struct is_optional : std::false_type {};
+
+		template<typename T>
+		struct is_optional<std::optional<T>> : std::true_type {};
+
+		template<typename T>
+		struct is_vector : std::false_type {};
+
+		template<typename T>
+		struct is_vector<std::vector<T>> : std::true_type {};
+
+		template<typename T>
+		struct is_variant : std::false_type {};
+
+		template<typename... Ts>
+		struct is_variant<std::variant<Ts...>> : std::true_type {};
+
+		/**
+		 * @brief Whether a JSON value of `type` may decode into `T`, used to pick the alternative
+		 * of a `std::variant`.
+		 *
+		 */
+		template<typename T>
+		inline constexpr auto accepts(simdjson::ondemand::json_type type) -> bool {
+			using simdjson::ondemand::json_type;
+
+			if constexpr (is_optional<T>::value)
+				return type == json_type::null || accepts<typename T::value_type>(type);
+			else if constexpr (is_vector<T>::value)
+				return type == json_type::array;
+			else if constexpr (std::same_as<T, bool>)
+				return type == json_type::boolean;
+			else if constexpr (std::is_arithmetic_v<T>)
+				return type == json_type::number;
+			else if constexpr (std::same_as<T, std::string> || std::same_as<T, std::string_view>)
+				return type == json_type::string;
+			else
+				return true;
+		}
+
+		template<typename T>
+		auto decode(simdjson::ondemand::value value, T& out) -> simdjson::error_code;
+		inline auto decode(simdjson::ondemand::value value, std::string& out)
+			-> simdjson::error_code;
+		template<typename T>
+		auto decode(simdjson::ondemand::value value, std::optional<T>& out) -> simdjson::error_code;
+		template<typename T>
+		auto decode(simdjson::ondemand::value value, std::vector<T>& out) -> simdjson::error_code;
+		template<typename... Ts>
+		auto decode(simdjson::ondemand::value value, std::variant<Ts...>& out)
+			-> simdjson::error_code;
+
+		template<typename T>
+		auto decode(simdjson::ondemand::value value, T& out) -> simdjson::error_code {
+			return value.get<T>().get(out);
+		}
+
+		inline auto decode(simdjson::ondemand::value value, std::string& out)
+			-> simdjson::error_code {
+			std::string_view view;
+			if (const auto err = value.get_string().get(view))
+				return err;
+			out.assign(view);
+			return simdjson::SUCCESS;
+		}
+
+		/**
+		 * @brief `null` decodes to `std::nullopt`.
+		 *
+		 */
+		template<typename T>
+		auto decode(simdjson::ondemand::value value, std::optional<T>& out)
+			-> simdjson::error_code {
+			bool is_null = false;
+			if (const auto err = value.is_null().get(is_null))
+				return err;
+			if (is_null) {
+				out.reset();
+				return simdjson::SUCCESS;
 			}
+
+			T inner;
+			if (const auto err = decode(value, inner))
+				return err;
+			out = std::move(inner);
+			return simdjson::SUCCESS;
 		}
 
-		template<typename... Args>
-		auto init_args(std::tuple<Args...>& args, simdjson::padded_string&& json) -> void {
-			init_args<0>(args, std::move(json));
+		template<typename T>
+		auto decode(simdjson::ondemand::value value, std::vector<T>& out)
+			-> simdjson::error_code {
+			simdjson::ondemand::array arr;
+			if (const auto err = value.get_array().get(arr))
+				return err;
+
+			out.clear();
+			for (auto elem : arr) {
+				simdjson::ondemand::value item;
+				if (const auto err = elem.get(item))
+					return err;
+				if (const auto err = decode(item, out.emplace_back()))
+					return err;
+			}
+			return simdjson::SUCCESS;
 		}
 
-		template<typename... Args>
-		auto init_args(std::tuple<Args...>& args, const std::string& json) -> void {
-			init_args<0>(args, json);
+		/**
+		 * @brief Decode into the first alternative that `accepts` the type of the value.
+		 *
+		 */
+		template<typename... Ts>
+		auto decode(simdjson::ondemand::value value, std::variant<Ts...>& out)
+			-> simdjson::error_code {
+			simdjson::ondemand::json_type type;
+			if (const auto err = value.type().get(type))
+				return err;
+
+			auto	   status  = simdjson::INCORRECT_TYPE;
+			const auto attempt = [&]<typename T>(std::type_identity<T>) {
+				if (status != simdjson::INCORRECT_TYPE || !accepts<T>(type))
+					return;
+				T alt;
+				if ((status = decode(value, alt)) == simdjson::SUCCESS)
+					out = std::move(alt);
+			};
+
+			(attempt(std::type_identity<Ts> {}), ...);
+
+			return status;
 		}
 
-		template<>
-		auto init_args(std::tuple<>& args, const std::string& json) -> void {
-			// No-op for empty tuple
+		template<typename... Args, std::size_t... I>
+		auto init_args(
+			std::tuple<Args...>&		args,
+			simdjson::ondemand::array&& arr,
+			std::index_sequence<I...>
+		) -> simdjson::error_code {
+			auto it		= arr.begin();
+			auto end	= arr.end();
+			auto status = simdjson::SUCCESS;
+
+			const auto next = [&]<typename T>(T& arg) {
+				if (status != simdjson::SUCCESS)
+					return;
+				if (it == end) {
+					if constexpr (!is_optional<T>::value)
+						status = simdjson::INDEX_OUT_OF_BOUNDS;
+				} else if ((status = decode(*it, arg)) == simdjson::SUCCESS)
+					++it;
+			};
+
+			(next(std::get<I>(args)), ...);
+
+			return status;
 		}
 	}  // namespace details
 
-	using details::init_args;
-}  // namespace dcs213::p1::json
\ No newline at end of file
+	/**
+	 * @brief Decode a JSON argument array into `args`, in a single pass over the array.
+	 *
+	 * Besides scalars and strings, arguments may be `std::vector`s (JSON arrays), `std::variant`s
+	 * and `std::optional`s, which also may be left out at the end of the array.
+	 *
+	 * @tparam Args
+	 * @param args
+	 * @param json e.g. `[1, "x"]`
+	 * @param lease the parser to decode with, must outlive decoded `std::string_view`s
+	 * @return simdjson::error_code
+	 */
+	template<typename... Args>
+	auto init_args(std::tuple<Args...>& args, std::string_view json, ParserLease& lease)
+		-> simdjson::error_code {
+		if constexpr (sizeof...(Args) == 0)
+			return simdjson::SUCCESS;
+		else {
+			auto					  doc = lease.iterate(json);
+			simdjson::ondemand::array arr;
+			if (const auto err = doc.get_array().get(arr))
+				return err;
+			return details::init_args(args, std::move(arr), std::index_sequence_for<Args...>());
+		}
+	}
+
+	/**
+	 * @brief Already serialized JSON, written out verbatim.
+	 *
+	 */
+	struct Raw {
+		std::string_view json;
+	};
+
+	/**
+	 * @brief Binary data, written out as a base64 string.
+	 *
+	 */
+	struct Base64 {
+		std::span<const std::byte> bytes;
+	};
+
+	class Writer;
+
+	/**
+	 * @brief Types that serialize themselves through a `write_json(json::Writer&) const` member.
+	 *
+	 */
+	template<typename T>
+	concept Serializable = requires(const T& value, Writer& writer) { value.write_json(writer); };
+
+	namespace details {
+		template<typename T>
+		concept tuple_like = requires { std::tuple_size<T>::value; } && !std::ranges::range<T>;
+
+		inline static constexpr char hex_digits[] = "0123456789abcdef";
+
+		/**
+		 * @brief Append the escape sequence of a character that must not appear raw in a string.
+		 *
+		 * @param c `"`, `\` or a control character
+		 * @param out
+		 */
+		inline auto escape_char(char c, std::string& out) -> void {
+			switch (c) {
+				case '"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\b': out += "\\b"; break;
+				case '\f': out += "\\f"; break;
+				case '\n': out += "\\n"; break;
+				case '\r': out += "\\r"; break;
+				case '\t': out += "\\t"; break;
+				default: {
+					const auto u = static_cast<unsigned char>(c);
+					const char seq[] { '\\', 'u', '0', '0', hex_digits[u >> 4], hex_digits[u & 0xf] };
+					out.append(seq, sizeof(seq));
+				}
+			}
+		}
+	}  // namespace details
+
+	/**
+	 * @brief Append `str` to `out` as the body of a JSON string (without the quotes).
+	 *
+	 * Runs without anything to escape are copied in bulk; the `escape` kernel of
+	 * `dispatch::kernels()` finds where they end, up to 64 bytes at a time. Other bytes, including
+	 * UTF-8 sequences, are passed through as is.
+	 *
+	 * @param str
+	 * @param out
+	 */
+	inline auto escape(std::string_view str, std::string& out) -> void {
+		const auto		  scan = dispatch::kernels().escape;
+		const char*		  run  = str.data();  // start of the pending unescaped run
+		const char* const last = str.data() + str.size();
+
+		for (;;) {
+			const char* const stop = scan(run, last);
+			out.append(run, stop);
+			if (stop == last)
+				return;
+			details::escape_char(*stop, out);
+			run = stop + 1;
+		}
+	}
+
+	/**
+	 * @brief Append `bytes` to `out` in standard, padded base64.
+	 *
+	 * @param bytes
+	 * @param out
+	 */
+	inline auto base64(std::span<const std::byte> bytes, std::string& out) -> void {
+		constexpr char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+		const auto start = out.size();
+		out.resize(start + (bytes.size() + 2) / 3 * 4);
+		char* dst = out.data() + start;
+
+		const auto byte = [&](std::size_t i) { return static_cast<std::uint32_t>(bytes[i]); };
+
+		std::size_t i = 0;
+		for (; i + 3 <= bytes.size(); i += 3) {
+			const auto triple = byte(i) << 16 | byte(i + 1) << 8 | byte(i + 2);
+			*dst++			  = digits[triple >> 18 & 0x3f];
+			*dst++			  = digits[triple >> 12 & 0x3f];
+			*dst++			  = digits[triple >> 6 & 0x3f];
+			*dst++			  = digits[triple & 0x3f];
+		}
+
+		if (const auto rest = bytes.size() - i; rest > 0) {
+			const auto triple = byte(i) << 16 | (rest > 1 ? byte(i + 1) << 8 : 0);
+			*dst++			  = digits[triple >> 18 & 0x3f];
+			*dst++			  = digits[triple >> 12 & 0x3f];
+			*dst++			  = rest > 1 ? digits[triple >> 6 & 0x3f] : '=';
+			*dst++			  = '=';
+		}
+	}
+
+	/**
+	 * @brief A streaming JSON writer appending into a buffer from the calling thread's pool.
+	 *
+	 * Values are written straight into the buffer, with no intermediate strings; commas are
+	 * inserted automatically. Like `ParserLease`, buffers are recycled, so after warm-up writing
+	 * does not allocate.
+	 *
+	 * `value` serializes generically: `Serializable` types, `Raw`, `Base64`, `bool`, numbers
+	 * (non-finite ones as `null`), strings, `std::optional` (`null` if empty), `std::variant`,
+	 * tuples and ranges (as arrays).
+	 */
+	class Writer {
+	public:
+		Writer() {
+			auto& pool = _pool();
+			if (pool.empty())
+				_buffer = std::make_unique<std::string>();
+			else {
+				_buffer = std::move(pool.back());
+				pool.pop_back();
+			}
+		}
+
+		Writer(const Writer&)			 = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		~Writer() {
+			if (_buffer) {
+				_buffer->clear();
+				_pool().push_back(std::move(_buffer));
+			}
+		}
+
+	public:
+		/**
+		 * @brief The JSON written so far.
+		 *
+		 * @return const std::string&
+		 */
+		[[nodiscard]] auto str() const -> const std::string& { return *_buffer; }
+
+		auto begin_object() -> Writer& {
+			_separate();
+			*_buffer	+= '{';
+			_need_comma	 = false;
+			return *this;
+		}
+
+		auto end_object() -> Writer& {
+			*_buffer	+= '}';
+			_need_comma	 = true;
+			return *this;
+		}
+
+		auto begin_array() -> Writer& {
+			_separate();
+			*_buffer	+= '[';
+			_need_comma	 = false;
+			return *this;
+		}
+
+		auto end_array() -> Writer& {
+			*_buffer	+= ']';
+			_need_comma	 = true;
+			return *this;
+		}
+
+		/**
+		 * @brief Write an object key, the next value belongs to it.
+		 *
+		 * @param name
+		 * @return Writer&
+		 */
+		auto key(std::string_view name) -> Writer& {
+			_string(name);
+			*_buffer	+= ':';
+			_need_comma	 = false;
+			return *this;
+		}
+
+		/**
+		 * @brief Write a key and its value.
+		 *
+		 */
+		template<typename T>
+		auto field(std::string_view name, const T& val) -> Writer& {
+			return key(name).value(val);
+		}
+
+		auto null() -> Writer& {
+			_separate();
+			*_buffer	+= "null";
+			_need_comma	 = true;
+			return *this;
+		}
+
+		template<typename T>
+		auto value(const T& val) -> Writer& {
+			using U = std::remove_cvref_t<T>;
+
+			if constexpr (Serializable<U>)
+				val.write_json(*this);
+			else if constexpr (std::same_as<U, Raw>) {
+				_separate();
+				*_buffer	+= val.json;
+				_need_comma	 = true;
+			} else if constexpr (std::same_as<U, Base64>) {
+				_separate();
+				*_buffer += '"';
+				base64(val.bytes, *_buffer);
+				*_buffer	+= '"';
+				_need_comma	 = true;
+			} else if constexpr (std::same_as<U, std::nullptr_t> || std::same_as<U, std::nullopt_t>)
+				null();
+			else if constexpr (std::same_as<U, bool>) {
+				_separate();
+				*_buffer	+= val ? "true" : "false";
+				_need_comma	 = true;
+			} else if constexpr (std::is_arithmetic_v<U>)
+				_number(val);
+			else if constexpr (std::convertible_to<const U&, std::string_view>)
+				_string(val);
+			else if constexpr (details::is_optional<U>::value) {
+				if (val)
+					value(*val);
+				else
+					null();
+			} else if constexpr (details::is_variant<U>::value)
+				std::visit([this](const auto& alt) { value(alt); }, val);
+			else if constexpr (details::tuple_like<U>) {
+				begin_array();
+				std::apply([this](const auto&... elems) { (value(elems), ...); }, val);
+				end_array();
+			} else if constexpr (std::ranges::input_range<const U>) {
+				begin_array();
+				for (const auto& elem : val) value(elem);
+				end_array();
+			} else
+				static_assert(false, "Type is not serializable to JSON");
+
+			return *this;
+		}
+
+	private:
+		inline static auto _pool() -> std::vector<std::unique_ptr<std::string>>& {
+			thread_local std::vector<std::unique_ptr<std::string>> pool;
+			return pool;
+		}
+
+		auto _separate() -> void {
+			if (_need_comma)
+				*_buffer += ',';
+		}
+
+		auto _string(std::string_view str) -> void {
+			_separate();
+			*_buffer += '"';
+			escape(str, *_buffer);
+			*_buffer	+= '"';
+			_need_comma	 = true;
+		}
+
+		template<typename T>
+		auto _number(T num) -> void {
+			if constexpr (std::is_floating_point_v<T>)
+				if (!std::isfinite(num)) {
+					null();
+					return;
+				}
+
+			_separate();
+			char buf[32];
+			const auto [end, _] = std::to_chars(buf, buf + sizeof(buf), num);
+			_buffer->append(buf, end);
+			_need_comma = true;
+		}
+
+	private:
+		std::unique_ptr<std::string> _buffer;
+		bool						 _need_comma = false;
+	};
+}  // namespace dcs213::p1::json
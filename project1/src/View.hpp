@@ -1,8 +1,19 @@
 #pragma once
 
+#include "Alloc.hpp"
+#include "Analyze.hpp"
+#include "Budget.hpp"
 #include "Lexer.hpp"
 #include "Parser.hpp"
 #include "Evaluator.hpp"
+#include "Pipeline.hpp"
+#include "Cache.hpp"
+#include "History.hpp"
+#include "Plot.hpp"
+#include "Profile.hpp"
+#include "Scheduler.hpp"
+#include "SlowLog.hpp"
+#include "Trace.hpp"
 #include "Utils.hpp"
 
 #if defined DCS213_P1_PLAT_WINDOWS
@@ -17,8 +28,17 @@
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <stop_token>
 #include <thread>
+#include <variant>
+#include <vector>
 #include <iostream>
 #include <format>
 
@@ -26,11 +46,31 @@ namespace dcs213::p1 {
 	class MainView : public webview::webview {
 	public:
 		struct Spec {
-			bool		debug  = false;
-			int			width  = 400;
-			int			height = 600;
-			std::string title  = "Calculator";
+			bool		debug	= false;
+			int			width	= 400;
+			int			height	= 600;
+			std::string title	= "Calculator";
 			std::string ui;
+			std::string ui_url	= {};  // if set, navigated to instead of loading `ui` inline
+			std::string history = {};  // log of `evalExpr` calls, none if empty
+
+			slowlog::Config slow_log = {};  // of `evalExpr` calls, none if `path` is empty
+
+			cache::Config cache = {};
+			Budget::Limits limits = {
+				.steps	 = 50'000'000,
+				.depth	 = 1'000,
+				.terms	 = 1 << 20,
+				.bytes	 = 256 << 20,
+				.timeout = std::chrono::seconds { 10 },
+			};	// per `evalExpr` call
+			Budget::Limits preview_limits = {
+				.steps	 = 200'000,
+				.depth	 = 200,
+				.terms	 = 1 << 12,
+				.bytes	 = 1 << 20,
+				.timeout = std::chrono::milliseconds { 50 },
+			};	// per `previewExpr` call, runs on every (debounced) edit
 		};
 
 	private:
@@ -53,10 +93,29 @@ namespace dcs213::p1 {
 		};
 
 	public:
+		/**
+		 * @brief Create the webview, bind the native functions and load the UI.
+		 *
+		 * The webview owns its native window, so GLFW is not initialized here, and evaluation
+		 * subsystems (thread pool, JSON parsers) start on first use. The UI is loaded after all
+		 * bindings exist, and calls `uiReady` once it is interactive. Each step is a phase of
+		 * `profile::Startup::global()`.
+		 *
+		 * @param spec
+		 */
 		MainView(const Spec& spec);
 
 		MainView() : MainView(Spec {}) {}
 
+		/**
+		 * @brief Wait for in-flight `bind_async` calls, they still refer to the webview.
+		 *
+		 */
+		~MainView() {
+			std::unique_lock lock { _tasks_mutex };
+			_tasks_cv.wait(lock, [this] { return _tasks == 0; });
+		}
+
 	public:
 		auto launch() -> void;
 
@@ -64,7 +123,7 @@ namespace dcs213::p1 {
 		 * @brief Bind a function to the webview.
 		 *
 		 * unlike `webview::webview::bind`, this function does the json arg parsing automatically
-		 * for you.
+		 * for you, and serializes the result with `json::Writer`.
 		 *
 		 * @see webview::webview::bind
 		 *
@@ -80,32 +139,236 @@ namespace dcs213::p1 {
 		) noexcept(std::is_nothrow_invocable_v<decltype(f), Args...>) -> webview::noresult {
 			return this->webview::webview::bind(
 				name,
-				[&](const std::string& id, const std::string& req, void* /* arg */) -> void {
+				[this,
+				 f	   = std::forward<decltype(f)>(f),
+				 label = trace::Tracer::global().intern(name)](
+					const std::string& id,
+					const std::string& req,
+					void* /* arg */
+				) -> void {
+					DCS213_P1_TRACE_SCOPE(Bind, label);
+
 					// Parse `req` to args and send to `f`.
 					using R = std::invoke_result_t<decltype(f), Args...>;
+					json::ParserLease	lease;
+					json::Writer		writer;
 					std::tuple<Args...> args;
-					json::init_args(args, req);
+					if (const auto err = json::init_args(args, req, lease)) {
+						resolve(id, 1, writer.value(simdjson::error_message(err)).str());
+						return;
+					}
 
 					if constexpr (std::is_void_v<R>) {
 						std::apply(f, args);
 						resolve(id, 0, "");
 					} else {
-						auto result = std::apply(f, args);
-						// TODO: General `result -> json string` abstraction.
-						// TODO: Fix string -> json string conversion, e.g. `\` -> `\\` in strings.
-						// resolve(id, 0, std::to_string(result));
-						// resolve(id, 0, std::format("\"{}\"", result));
-						// std::cerr << result << '\n';
-						// resolve(id, 0, result);
-						resolve(id, 0, result);
+						const auto& result = std::apply(f, args);
+						{
+							DCS213_P1_TRACE_SCOPE(Serialize);
+							DCS213_P1_ALLOC_TAG(Serialize);
+							writer.value(result);
+						}
+						resolve(id, 0, writer.str());
 					}
 				},
 				nullptr
 			);
 		}
 
+		/**
+		 * @brief Bind a function to the webview that runs on the thread pool.
+		 *
+		 * Like `bind_fn`, but the webview callback returns right away, and `f` is invoked on
+		 * `sched::ThreadPool::global()` with a `std::stop_token` in front of the decoded
+		 * arguments. The result is handed back through `resolve`, which marshals it onto the UI
+		 * thread.
+		 *
+		 * Unless `supersede` is off, a newer call of the same binding supersedes the older ones:
+		 * their stop tokens are triggered, and if they still finish, they resolve with
+		 * `cancelled` instead.
+		 *
+		 * @tparam Args
+		 * @param name
+		 * @param f
+		 * @param cancelled result for superseded calls
+		 * @param supersede
+		 * @return webview::noresult
+		 */
+		template<typename... Args>
+		auto bind_async(
+			const std::string&												  name,
+			std::invocable<std::stop_token, Args...> auto&&					  f,
+			std::invoke_result_t<decltype(f), std::stop_token, Args...> cancelled,
+			bool															  supersede = true
+		) -> webview::noresult {
+			using F = std::decay_t<decltype(f)>;
+			using R = std::invoke_result_t<F&, std::stop_token, Args...>;
+
+			return this->webview::webview::bind(
+				name,
+				[this,
+				 f		   = std::make_shared<F>(std::forward<decltype(f)>(f)),
+				 cancelled = std::make_shared<const R>(std::move(cancelled)),
+				 latest	   = std::make_shared<std::stop_source>(),
+				 label	   = trace::Tracer::global().intern(name),
+				 supersede](
+					const std::string& id,
+					const std::string& req,
+					void* /* arg */
+				) -> void {
+					// Webview callbacks all come from the UI thread, no locking needed here.
+					std::stop_token stop;
+					if (supersede) {
+						latest->request_stop();
+						*latest = std::stop_source {};
+						stop	= latest->get_token();
+					}
+
+					_task_started();
+					sched::ThreadPool::global().spawn([this, f, cancelled, label, id, req, stop] {
+						DCS213_P1_TRACE_SCOPE(Bind, label);
+
+						// Finishes the task however the call ends, or `~MainView` waits forever.
+						struct Finish {
+							MainView* view;
+
+							~Finish() { view->_task_finished(); }
+						} finish { this };
+
+						try {
+							json::ParserLease	lease;
+							json::Writer		writer;
+							std::tuple<Args...> args;
+							if (const auto err = json::init_args(args, req, lease))
+								resolve(id, 1, writer.value(simdjson::error_message(err)).str());
+							else if (stop.stop_requested())
+								resolve(id, 0, writer.value(*cancelled).str());
+							else {
+								const auto result = std::apply(
+									*f,
+									std::tuple_cat(
+										std::tuple<std::stop_token> { stop },
+										std::move(args)
+									)
+								);
+								{
+									DCS213_P1_TRACE_SCOPE(Serialize);
+									DCS213_P1_ALLOC_TAG(Serialize);
+									writer.value(stop.stop_requested() ? *cancelled : result);
+								}
+								resolve(id, 0, writer.str());
+							}
+						} catch (const std::exception& e) {
+							resolve(id, 1, json::Writer {}.value(e.what()).str());
+						} catch (...) {
+							resolve(id, 1, json::Writer {}.value("Unknown error!").str());
+						}
+					});
+				},
+				nullptr
+			);
+		}
+
 	private:
-		GLFWwindow* _window;
+		/**
+		 * @brief Lex, parse and evaluate a script from the UI, through the cache.
+		 *
+		 * @param script
+		 * @param stop
+		 * @param stages if given, receives the time of every stage
+		 * @return pipeline::Outcome
+		 */
+		auto _eval(
+			std::string_view  script,
+			std::stop_token	  stop,
+			pipeline::Stages* stages = nullptr
+		) -> pipeline::Outcome {
+			Budget budget { _limits, std::move(stop) };
+			return _eval(script, budget, false, stages);
+		}
+
+		/**
+		 * @brief Lex, parse and evaluate a script from the UI, through the cache, within `budget`.
+		 *
+		 * @param script
+		 * @param budget
+		 * @param shared whether other scripts charge `budget` too; running out of it then says
+		 * nothing about this script, so such an outcome is not cached
+		 * @param stages if given, receives the time of every stage
+		 * @return pipeline::Outcome
+		 */
+		auto _eval(
+			std::string_view  script,
+			Budget&			  budget,
+			bool			  shared,
+			pipeline::Stages* stages = nullptr
+		) -> pipeline::Outcome {
+			const auto start = stages ? std::chrono::steady_clock::now()
+									  : std::chrono::steady_clock::time_point {};
+			const auto ts	 = lex::lex(script);
+			if (stages)
+				stages->lex = std::chrono::steady_clock::now() - start;
+
+			if (!ts)
+				return pipeline::Outcome::fail(ts.error().to_string());
+
+			if (stages)
+				stages->cached = true;	// until computed
+			return _cache.get_or_compute(*ts, [&] {
+				if (stages)
+					stages->cached = false;
+				auto outcome	  = pipeline::run(*ts, budget, stages);
+				outcome.transient = outcome.transient || (shared && budget.exhausted());
+				return outcome;
+			});
+		}
+
+		/**
+		 * @brief Speculatively evaluate a script that is still being typed.
+		 *
+		 * Served from the cache when possible, otherwise evaluated under the tight preview
+		 * limits. The outcome is never cached: running out of the preview budget says nothing
+		 * about whether `evalExpr` would succeed.
+		 *
+		 * @param script
+		 * @param stop
+		 * @return pipeline::Outcome
+		 */
+		auto _preview(std::string_view script, std::stop_token stop) -> pipeline::Outcome {
+			const auto ts = lex::lex(script);
+
+			if (!ts)
+				return pipeline::Outcome::fail(ts.error().to_string());
+			if (auto cached = _cache.find(*ts))
+				return *std::move(cached);
+
+			Budget budget { _preview_limits, std::move(stop) };
+			return pipeline::run(*ts, budget);
+		}
+
+		auto _task_started() -> void {
+			std::lock_guard lock { _tasks_mutex };
+			++_tasks;
+		}
+
+		auto _task_finished() -> void {
+			std::lock_guard lock { _tasks_mutex };
+			if (--_tasks == 0)
+				_tasks_cv.notify_all();
+		}
+
+	private:
+		GLFWwindow*				_window;
+		cache::ResultCache		_cache;
+		Budget::Limits			_limits;
+		Budget::Limits			_preview_limits;
+
+		std::unique_ptr<history::Writer> _history;	 // may be null
+		std::unique_ptr<slowlog::Log>	 _slow_log;	 // may be null
+
+		std::mutex				_tasks_mutex;
+		std::condition_variable _tasks_cv;
+		std::size_t				_tasks = 0;	 // `bind_async` calls in flight
 	};
 
 	inline static constexpr auto ui = R"html(<!DOCTYPE html>
@@ -211,6 +474,15 @@ namespace dcs213::p1 {
           outline: none;
         }
       }
+      .calculator-display-preview {
+        font-size: 16px;
+        font-family: "HarmonyOS Sans SC";
+        min-height: 1.25em;
+        opacity: 0.6;
+        overflow: hidden;
+        white-space: nowrap;
+        text-overflow: ellipsis;
+      }
 
       .calculator-button-box {
         display: grid;
@@ -276,6 +548,53 @@ namespace dcs213::p1 {
         }
       }
 
+      .plot-panel {
+        display: none;
+        position: relative;
+        width: 100%;
+        min-height: 0;
+        flex-grow: 1;
+        margin-top: 20px;
+        border-radius: 20px;
+        overflow: hidden;
+        background-color: var(--pad-color);
+        color: var(--text-color);
+        font-family: "HarmonyOS Sans SC";
+      }
+      .calculator-box.plotting {
+        .calculator-button-box {
+          display: none;
+        }
+        .plot-panel {
+          display: block;
+        }
+      }
+      .plot-canvas {
+        display: block;
+        width: 100%;
+        height: 100%;
+        cursor: grab;
+        touch-action: none;
+      }
+      .plot-close {
+        position: absolute;
+        top: 8px;
+        right: 12px;
+        border: none;
+        background: none;
+        color: var(--text-color);
+        font-size: 20px;
+        cursor: pointer;
+      }
+      .plot-status {
+        position: absolute;
+        left: 12px;
+        bottom: 8px;
+        font-size: 12px;
+        opacity: 0.6;
+        pointer-events: none;
+      }
+
       .calculator-button-number-padding-text {
         color: var(--text-color);
         justify-self: center;
@@ -285,7 +604,7 @@ namespace dcs213::p1 {
     </style>
   </head>
   <body>
-    <div class="calculator-box">
+    <div class="calculator-box" id="calculatorBox">
       <div class="calculator-display">
         <div class="calculator-display-text">
           <input
@@ -295,6 +614,7 @@ namespace dcs213::p1 {
             id="displayInput"
           />
         </div>
+        <div class="calculator-display-preview" id="displayPreview"></div>
       </div>
       <div class="calculator-button-box">
         <button class="calculator-button-number" id="dayNightSwitcher">
@@ -430,6 +750,11 @@ namespace dcs213::p1 {
           </div>
         </button>
       </div>
+      <div class="plot-panel" id="plotPanel">
+        <canvas class="plot-canvas" id="plotCanvas"></canvas>
+        <button class="plot-close" id="plotClose">&#x2715;</button>
+        <div class="plot-status" id="plotStatus"></div>
+      </div>
     </div>
     <script type="module">
       const getElements = (ids) =>
@@ -439,6 +764,11 @@ namespace dcs213::p1 {
         );
       const ui = getElements([
         "displayInput",
+        "displayPreview",
+        "calculatorBox",
+        "plotCanvas",
+        "plotClose",
+        "plotStatus",
         "dayNightSwitcher",
         "dayNightSwitcherText",
         "allClear",
@@ -533,6 +863,58 @@ namespace dcs213::p1 {
         constantE: "e",
       };
 
+      // Live preview: once typing pauses, evaluate the input speculatively. Native code cancels
+      // the previous preview whenever a new one starts, `previewSeq` drops answers to stale ones.
+      const previewDelay = 150;
+      let previewTimer = undefined;
+      let previewSeq = 0;
+
+      const clearPreview = () => {
+        clearTimeout(previewTimer);
+        ++previewSeq;
+        ui.displayPreview.textContent = "";
+      };
+
+      const schedulePreview = () => {
+        clearTimeout(previewTimer);
+        const seq = ++previewSeq;
+        previewTimer = setTimeout(async () => {
+          const script = ui.displayInput.value;
+          if (script.trim() === "") {
+            ui.displayPreview.textContent = "";
+            return;
+          }
+          const res = await window.previewExpr(script);
+          if (seq !== previewSeq || res.cancelled) return;
+          ui.displayPreview.textContent =
+            res.success && res.result !== script ? "= " + res.result : "";
+        }, previewDelay);
+      };
+
+      // History: ArrowUp and ArrowDown recall evaluated expressions, those of past sessions
+      // included, which the native side keeps in its history log.
+      const recall = { list: [], pos: 0 };
+      window.recentExprs(100).then((list) => {
+        recall.list = list.concat(recall.list);
+        recall.pos = recall.list.length;
+      });
+
+      const remember = (script) => {
+        if (script.trim() !== "" && recall.list[recall.list.length - 1] !== script)
+          recall.list.push(script);
+        recall.pos = recall.list.length;
+      };
+
+      const evaluate = async () => {
+        clearPreview();
+        const script = ui.displayInput.value;
+        remember(script);
+        const res = await window.evalExpr(script);
+        if (res.cancelled) return;
+        if (res.success) ui.displayInput.value = res.result;
+        else ui.displayInput.value = res.error;
+      };
+
       for (const [k, v] of Object.entries(buttonMap)) {
         ui[k].addEventListener("click", async () => {
           const display = ui.displayInput;
@@ -541,34 +923,265 @@ namespace dcs213::p1 {
           display.selectionStart = newLength;
           display.selectionEnd = newLength;
           display.focus();
+          schedulePreview();
         });
       }
 
       ui.backSpace.addEventListener("click", async () => {
         ui.displayInput.value = ui.displayInput.value.slice(0, -1);
+        schedulePreview();
+      });
+
+      ui.displayInput.addEventListener("input", schedulePreview);
+
+      ui.displayInput.addEventListener("keydown", (event) => {
+        if (event.key !== "ArrowUp" && event.key !== "ArrowDown") return;
+        if (recall.list.length === 0) return;
+        event.preventDefault();
+        recall.pos =
+          event.key === "ArrowUp"
+            ? Math.max(0, recall.pos - 1)
+            : Math.min(recall.list.length, recall.pos + 1);
+        ui.displayInput.value = recall.list[recall.pos] ?? "";
+        schedulePreview();
+      });
+
+      // Plot: Shift+Enter plots the input. Samples arrive as base64 Float64 arrays and are drawn
+      // as one min/max span per pixel column, so redrawing stays cheap with a million of them.
+      // Once panning or zooming settles, the visible range is sampled again.
+      const plotSamples = 1 << 20;
+      const plotResampleDelay = 200;
+      const plot = {
+        script: "",
+        xs: new Float64Array(0),
+        ys: new Float64Array(0),
+        view: { x0: -10, x1: 10, y0: -10, y1: 10 },
+        seq: 0,
+        timer: undefined,
+        frame: 0,
+        drag: undefined,
+      };
+
+      const decodeFloat64 = (base64) => {
+        const bin = atob(base64);
+        const bytes = new Uint8Array(bin.length);
+        for (let i = 0; i < bin.length; ++i) bytes[i] = bin.charCodeAt(i);
+        return new Float64Array(bytes.buffer);
+      };
+
+      const lowerBound = (xs, x) => {
+        let lo = 0;
+        let hi = xs.length;
+        while (lo < hi) {
+          const mid = (lo + hi) >>> 1;
+          if (xs[mid] < x) lo = mid + 1;
+          else hi = mid;
+        }
+        return lo;
+      };
+
+      // Fit the vertical range to the bulk of the samples, ignoring poles.
+      const fitPlot = () => {
+        const stride = Math.max(1, Math.floor(plot.ys.length / 4096));
+        const finite = [];
+        for (let i = 0; i < plot.ys.length; i += stride)
+          if (Number.isFinite(plot.ys[i])) finite.push(plot.ys[i]);
+        if (finite.length === 0) return;
+        finite.sort((a, b) => a - b);
+        let lo = finite[Math.floor((finite.length - 1) * 0.02)];
+        let hi = finite[Math.ceil((finite.length - 1) * 0.98)];
+        if (hi - lo < 1e-9) {
+          lo -= 1;
+          hi += 1;
+        }
+        const pad = (hi - lo) * 0.1;
+        plot.view.y0 = lo - pad;
+        plot.view.y1 = hi + pad;
+      };
+
+      const drawPlot = () => {
+        plot.frame = 0;
+        const canvas = ui.plotCanvas;
+        const dpr = window.devicePixelRatio || 1;
+        const width = Math.max(1, Math.round(canvas.clientWidth * dpr));
+        const height = Math.max(1, Math.round(canvas.clientHeight * dpr));
+        if (canvas.width !== width) canvas.width = width;
+        if (canvas.height !== height) canvas.height = height;
+
+        const ctx = canvas.getContext("2d");
+        const { x0, x1, y0, y1 } = plot.view;
+        const sx = width / (x1 - x0);
+        const sy = height / (y1 - y0);
+        const px = (x) => (x - x0) * sx;
+        const py = (y) => Math.min(Math.max(height - (y - y0) * sy, -height), 2 * height);
+
+        ctx.clearRect(0, 0, width, height);
+        ctx.strokeStyle = getComputedStyle(document.documentElement).getPropertyValue(
+          "--text-color"
+        );
+        ctx.lineWidth = dpr;
+
+        ctx.globalAlpha = 0.3;
+        ctx.beginPath();
+        ctx.moveTo(0, py(0));
+        ctx.lineTo(width, py(0));
+        ctx.moveTo(px(0), 0);
+        ctx.lineTo(px(0), height);
+        ctx.stroke();
+
+        ctx.globalAlpha = 1;
+        ctx.beginPath();
+        const { xs, ys } = plot;
+        const begin = Math.max(0, lowerBound(xs, x0) - 1);
+        const end = Math.min(xs.length, lowerBound(xs, x1) + 1);
+        let open = false;
+        let column = NaN;
+        let first = 0;
+        let last = 0;
+        let min = 0;
+        let max = 0;
+        const flush = () => {
+          if (Number.isNaN(column)) return;
+          if (open) ctx.lineTo(column, first);
+          else ctx.moveTo(column, first);
+          ctx.lineTo(column, min);
+          ctx.lineTo(column, max);
+          ctx.lineTo(column, last);
+          open = true;
+        };
+        for (let i = begin; i < end; ++i) {
+          if (!Number.isFinite(ys[i])) {
+            flush();
+            column = NaN;
+            open = false;
+            continue;
+          }
+          const c = Math.floor(px(xs[i]));
+          const y = py(ys[i]);
+          if (c !== column) {
+            flush();
+            column = c;
+            first = min = max = y;
+          }
+          min = Math.min(min, y);
+          max = Math.max(max, y);
+          last = y;
+        }
+        flush();
+        ctx.stroke();
+      };
+
+      const requestDraw = () => {
+        if (!plot.frame) plot.frame = requestAnimationFrame(drawPlot);
+      };
+
+      const fetchSamples = async (fit) => {
+        clearTimeout(plot.timer);
+        const seq = ++plot.seq;
+        const { x0, x1 } = plot.view;
+        const res = await window.sampleExpr(plot.script, x0, x1, plotSamples);
+        if (seq !== plot.seq || res.cancelled) return;
+        if (res.success) {
+          plot.xs = decodeFloat64(res.xs);
+          plot.ys = decodeFloat64(res.ys);
+          if (fit) fitPlot();
+          ui.plotStatus.textContent = `${plot.script}  (${res.count} samples)`;
+        } else {
+          plot.xs = new Float64Array(0);
+          plot.ys = new Float64Array(0);
+          ui.plotStatus.textContent = res.error;
+        }
+        requestDraw();
+      };
+
+      const viewChanged = () => {
+        requestDraw();
+        clearTimeout(plot.timer);
+        plot.timer = setTimeout(() => fetchSamples(false), plotResampleDelay);
+      };
+
+      const openPlot = (script) => {
+        clearPreview();
+        plot.script = script;
+        plot.view = { x0: -10, x1: 10, y0: -10, y1: 10 };
+        ui.plotStatus.textContent = "";
+        ui.calculatorBox.classList.add("plotting");
+        fetchSamples(true);
+      };
+
+      const closePlot = () => {
+        clearTimeout(plot.timer);
+        ++plot.seq;
+        plot.xs = new Float64Array(0);
+        plot.ys = new Float64Array(0);
+        ui.calculatorBox.classList.remove("plotting");
+      };
+
+      ui.plotClose.addEventListener("click", closePlot);
+
+      ui.plotCanvas.addEventListener("pointerdown", (event) => {
+        ui.plotCanvas.setPointerCapture(event.pointerId);
+        plot.drag = { x: event.clientX, y: event.clientY };
+      });
+
+      ui.plotCanvas.addEventListener("pointermove", (event) => {
+        if (!plot.drag) return;
+        const { view } = plot;
+        const dx = ((event.clientX - plot.drag.x) / ui.plotCanvas.clientWidth) * (view.x1 - view.x0);
+        const dy = ((event.clientY - plot.drag.y) / ui.plotCanvas.clientHeight) * (view.y1 - view.y0);
+        view.x0 -= dx;
+        view.x1 -= dx;
+        view.y0 += dy;
+        view.y1 += dy;
+        plot.drag = { x: event.clientX, y: event.clientY };
+        viewChanged();
+      });
+
+      ui.plotCanvas.addEventListener("pointerup", () => {
+        plot.drag = undefined;
+      });
+
+      ui.plotCanvas.addEventListener(
+        "wheel",
+        (event) => {
+          event.preventDefault();
+          const { view } = plot;
+          const rect = ui.plotCanvas.getBoundingClientRect();
+          const x = view.x0 + ((event.clientX - rect.left) / rect.width) * (view.x1 - view.x0);
+          const y = view.y1 - ((event.clientY - rect.top) / rect.height) * (view.y1 - view.y0);
+          const scale = Math.exp(event.deltaY * 0.001);
+          view.x0 = x + (view.x0 - x) * scale;
+          view.x1 = x + (view.x1 - x) * scale;
+          view.y0 = y + (view.y0 - y) * scale;
+          view.y1 = y + (view.y1 - y) * scale;
+          viewChanged();
+        },
+        { passive: false }
+      );
+
+      window.addEventListener("resize", () => {
+        if (ui.calculatorBox.classList.contains("plotting")) requestDraw();
       });
 
       ui.displayInput.addEventListener("keyup", async (event) => {
         if (event.key === "Enter") {
           event.preventDefault();
-          const res = await window.evalExpr(event.target.value);
-          if (res.success) ui.displayInput.value = res.result;
-          else ui.displayInput.value = res.error;
-        }
+          if (event.shiftKey) openPlot(ui.displayInput.value);
+          else await evaluate();
+        } else if (event.key === "Escape") closePlot();
       });
 
       ui.allClear.addEventListener("click", async () => {
         ui.displayInput.value = "";
+        clearPreview();
         displayInput.selectionStart = 0;
         displayInput.selectionEnd = 0;
         displayInput.focus();
       });
 
-      ui.opEqual.addEventListener("click", async () => {
-        const res = await window.evalExpr(ui.displayInput.value);
-        if (res.success) ui.displayInput.value = res.result;
-        else ui.displayInput.value = res.error;
-      });
+      ui.opEqual.addEventListener("click", evaluate);
+
+      window.uiReady();
     </script>
   </body>
 </html>
@@ -578,6 +1191,7 @@ namespace dcs213::p1 {
 namespace dcs213::p1 {
 	inline auto MainView::_window_from(const Spec& spec) -> void* {
 		GlfwManager::init();
+		profile::Startup::global().mark("glfw init");
 
 		// glfwWindowHint(GLFW_DECORATED, GLFW_FALSE);
 		// glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
@@ -602,39 +1216,172 @@ namespace dcs213::p1 {
 #endif
 	}
 
-	inline MainView::MainView(const Spec& spec) : webview::webview(spec.debug, nullptr) {
-		bind_fn("terminate", [this]() {
-			std::cerr << std::format("Received terminate request!");
-			this->terminate();
-		});
+	inline MainView::MainView(const Spec& spec) :
+		webview::webview(spec.debug, nullptr), _cache(spec.cache), _limits(spec.limits),
+		_preview_limits(spec.preview_limits) {
+		auto& startup = profile::Startup::global();
+		startup.mark("webview create");
 
 		set_title(spec.title);
 		set_size(spec.width, spec.height, WEBVIEW_HINT_NONE);
-		set_html(spec.ui);
-		bind_fn<std::string_view>("evalExpr", [](std::string_view s) -> std::string {
-			const auto ts = lex::lex(s);
+		startup.mark("window setup");
 
-			if (!ts)
-				return std::format(
-					R"({{ "success": false, "error": "{}" }})",
-					ts.error().to_string()
+		if (!spec.history.empty()) {
+			_history = history::Writer::open(spec.history);
+			if (!_history)
+				std::cerr << std::format(
+					"Cannot open history log `{}`, or it is in use!\n", spec.history
 				);
+		}
+		if (!spec.slow_log.path.empty()) {
+			_slow_log = slowlog::Log::open(spec.slow_log);
+			if (!_slow_log)
+				std::cerr << std::format("Cannot open slow log `{}`!\n", spec.slow_log.path);
+		}
+		startup.mark("history open");
+
+		bind_fn("terminate", [this]() {
+			std::cerr << std::format("Received terminate request!");
+			this->terminate();
+		});
+		bind_fn("uiReady", []() {
+			auto& startup = profile::Startup::global();
+			startup.mark("ui ready");
+			startup.report();
+		});
+		bind_async<std::string_view>(
+			"evalExpr",
+			[this](std::stop_token stop, std::string_view s) -> pipeline::Outcome {
+				pipeline::Stages stages;
+				const auto		 start	 = std::chrono::steady_clock::now();
+				auto			 outcome = _eval(s, std::move(stop), _slow_log ? &stages : nullptr);
+				const auto		 elapsed = std::chrono::steady_clock::now() - start;
+				if (_history)
+					_history->append(s, outcome, elapsed);
+				if (_slow_log && _slow_log->slow(elapsed))
+					_slow_log->record(slowlog::Entry::of(s, outcome, stages, elapsed));
+				return outcome;
+			},
+			pipeline::Outcome::cancel()
+		);
+		// Each edit of the input supersedes the preview of the previous one, so at most one
+		// preview runs to completion at a time, and each is capped by `preview_limits`.
+		bind_async<std::string_view>(
+			"previewExpr",
+			[this](std::stop_token stop, std::string_view s) -> pipeline::Outcome {
+				return _preview(s, std::move(stop));
+			},
+			pipeline::Outcome::cancel()
+		);
+		// `evalBatch(["1+1", "x*x"])` evaluates every script, `evalBatch("x^2", [1, 2])` one
+		// script at every x. Batches serve several features at once, so they do not supersede
+		// each other.
+		bind_async<
+			std::variant<std::vector<std::string_view>, std::string_view>,
+			std::optional<std::vector<double>>>(
+			"evalBatch",
+			[this](
+				std::stop_token												  stop,
+				const std::variant<std::vector<std::string_view>, std::string_view>& scripts,
+				const std::optional<std::vector<double>>&					  xs
+			) -> pipeline::Batch {
+				constexpr std::size_t grain = 8;  // scripts per task
 
-			const auto ast = parse::parse(*ts);
+				if (const auto script = std::get_if<std::string_view>(&scripts)) {
+					if (!xs)
+						return {
+							.status	 = pipeline::Outcome::fail("Missing x values!"),
+							.results = {},
+						};
 
-			if (!ast)
-				return std::format(
-					R"({{ "success": false, "error": "{}" }})",
-					ast.error().to_string()
-				);
+					const auto ts = lex::lex(*script);
+					if (!ts)
+						return {
+							.status	 = pipeline::Outcome::fail(ts.error().to_string()),
+							.results = {},
+						};
 
-			const auto res = evaluate::eval(*ast);
+					Budget budget { _limits, std::move(stop) };
+					return pipeline::run_at(*ts, *xs, budget);
+				}
 
-			if (!res)
-				return R"({{ "success": false, "error": "Failed to eval!" }})";
+				// One budget for the whole batch, like the points of a script above, so that a
+				// long list cannot multiply the per-request limits.
+				const auto&					   list = std::get<std::vector<std::string_view>>(scripts);
+				std::vector<pipeline::Outcome> results(list.size());
+				Budget						   budget { _limits, std::move(stop) };
+				sched::ThreadPool::global().parallel_for(0, list.size(), grain, [&](std::size_t i) {
+					results[i] = _eval(list[i], budget, true);
+				});
+				return { .results = std::move(results) };
+			},
+			{ .status = pipeline::Outcome::cancel(), .results = {} },
+			false
+		);
+		// `analyzeExpr("(x+1)^3")` evaluates a script like `evalExpr`, but past the cache and
+		// the history, and also returns the cost of every node of its tree.
+		bind_async<std::string_view>(
+			"analyzeExpr",
+			[this](std::stop_token stop, std::string_view script) -> analyze::Report {
+				const auto ts = lex::lex(script);
+				if (!ts)
+					return {
+						.outcome = pipeline::Outcome::fail(ts.error().to_string()),
+						.tree	 = {},
+					};
 
-			return std::format(R"({{ "success": true, "result": "{}" }})", *res);
+				Budget budget { _limits, std::move(stop) };
+				return analyze::analyze(*ts, budget);
+			},
+			{ .outcome = pipeline::Outcome::cancel(), .tree = {} }
+		);
+		// `sampleExpr("x^3-x", -2, 2, 1 << 20)` samples a script for plotting. Panning and zooming
+		// resamples, so the newest request supersedes the others.
+		bind_async<std::string_view, double, double, std::uint64_t>(
+			"sampleExpr",
+			[this](
+				std::stop_token	 stop,
+				std::string_view script,
+				double			 xmin,
+				double			 xmax,
+				std::uint64_t	 n
+			) -> plot::Samples {
+				const auto ts = lex::lex(script);
+				if (!ts)
+					return {
+						.status	= pipeline::Outcome::fail(ts.error().to_string()),
+						.xs		= {},
+						.ys		= {},
+					};
+
+				Budget budget { _limits, std::move(stop) };
+				return plot::sample(*ts, xmin, xmax, n, budget);
+			},
+			{ .status = pipeline::Outcome::cancel(), .xs = {}, .ys = {} }
+		);
+		bind_fn<std::uint64_t>("recentExprs", [this](std::uint64_t n) -> std::vector<std::string> {
+			return _history ? _history->recent(n) : std::vector<std::string> {};
+		});
+		bind_fn("cacheStats", [this]() -> cache::Stats { return _cache.stats(); });
+		bind_fn("slowLogStats", [this]() -> std::optional<slowlog::Stats> {
+			return _slow_log ? std::optional { _slow_log->stats() } : std::nullopt;
+		});
+		// Allocations per stage, all zero unless built with `DCS213_P1_COUNT_ALLOCS`.
+		bind_fn("allocStats", []() -> alloc::Snapshot {
+			return alloc::Registry::global().snapshot();
 		});
+		// Per-stage latency histograms, all empty unless built with `DCS213_P1_TRACE`.
+		bind_fn("traceStats", []() -> const trace::Tracer& { return trace::Tracer::global(); });
+		bind_fn<std::string_view>("traceDump", [](std::string_view path) -> bool {
+			return trace::Tracer::global().dump(std::string(path));
+		});
+		startup.mark("bind");
+
+		if (spec.ui_url.empty())
+			set_html(spec.ui);
+		else
+			navigate(spec.ui_url);
+		startup.mark("html load");
 	}
 
 	inline auto MainView::launch() -> void {
@@ -1,23 +1,131 @@
+#include "Alloc.hpp"
+#include "Profile.hpp"
 #include "View.hpp"
 
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+DCS213_P1_ALLOC_COUNTING();
+
 using namespace dcs213::p1;
 
+/**
+ * @brief The history log in the per-user data directory of the platform, created if needed.
+ *
+ * @return the path, or an empty string if there is no such directory
+ */
+static auto default_history() -> std::string {
+	namespace fs = std::filesystem;
+
+	fs::path dir;
+#if defined DCS213_P1_PLAT_WINDOWS
+	if (const auto appdata = std::getenv("APPDATA"))
+		dir = appdata;
+#elif defined DCS213_P1_PLAT_MACOS
+	if (const auto home = std::getenv("HOME"))
+		dir = fs::path(home) / "Library" / "Application Support";
+#else
+	if (const auto data = std::getenv("XDG_DATA_HOME"); data && *data)
+		dir = data;
+	else if (const auto home = std::getenv("HOME"))
+		dir = fs::path(home) / ".local" / "share";
+#endif
+	if (dir.empty())
+		return {};
+
+	dir /= "dcs213.project1";
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	return ec ? std::string {} : (dir / "history.log").string();
+}
+
+/**
+ * @brief Command line options.
+ *
+ * `--profile-startup` (or `DCS213_P1_PROFILE_STARTUP=1`) reports the startup phases to stderr
+ * once the UI is interactive. `--ui <file>` (or `DCS213_P1_UI=<file>`) loads the UI from a file,
+ * e.g. the `index.html` that `dcs213.project1.ui` places next to the executable, instead of the
+ * copy built into the binary. `--history <file>` (or `DCS213_P1_HISTORY=<file>`) logs evaluations
+ * to another file than the default one, `--no-history` (or `DCS213_P1_HISTORY=`) not at all.
+ * `--slow-log <file>` (or `DCS213_P1_SLOW_LOG=<file>`) logs the evaluations that take longer than
+ * `--slow-ms <n>` milliseconds (or `DCS213_P1_SLOW_MS=<n>`, 100 by default) to a rotating file.
+ */
+static auto apply_args(int argc, char** argv, MainView::Spec& spec) -> void {
+	const auto use_ui = [&](std::string_view file) {
+		std::error_code ec;
+		const auto		path = std::filesystem::absolute(file, ec);
+		if (ec || !std::filesystem::exists(path, ec))
+			return;
+
+		const auto generic = path.generic_string();	 // `/home/...` or `C:/...`
+		spec.ui_url		   = (generic.starts_with('/') ? "file://" : "file:///") + generic;
+	};
+
+	if (const auto env = std::getenv("DCS213_P1_UI"))
+		use_ui(env);
+
+	std::optional<std::string> history;
+	if (const auto env = std::getenv("DCS213_P1_HISTORY"))
+		history = env;
+
+	const auto use_slow_ms = [&](std::string_view ms) {
+		std::uint64_t n;
+		if (const auto [end, ec] = std::from_chars(ms.data(), ms.data() + ms.size(), n);
+			ec == std::errc {} && end == ms.data() + ms.size())
+			spec.slow_log.threshold = std::chrono::milliseconds { n };
+	};
+
+	if (const auto env = std::getenv("DCS213_P1_SLOW_LOG"))
+		spec.slow_log.path = env;
+	if (const auto env = std::getenv("DCS213_P1_SLOW_MS"))
+		use_slow_ms(env);
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "--profile-startup")
+			profile::Startup::global().enable();
+		else if (arg == "--ui" && i + 1 < argc)
+			use_ui(argv[++i]);
+		else if (arg == "--history" && i + 1 < argc)
+			history = argv[++i];
+		else if (arg == "--no-history")
+			history = "";
+		else if (arg == "--slow-log" && i + 1 < argc)
+			spec.slow_log.path = argv[++i];
+		else if (arg == "--slow-ms" && i + 1 < argc)
+			use_slow_ms(argv[++i]);
+	}
+
+	spec.history = history ? *std::move(history) : default_history();
+}
+
 //
 #if defined DCS213_P1_PLAT_WINDOWS
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd) {
+	const auto argc = __argc;
+	const auto argv = __argv;
 #else
 int main(int argc, char** argv) {
 #endif
-	MainView view {
-		{
-			.debug	= false,
-			.width	= 400,
-			.height = 560,
-			.title	= "DCS213 P1 YatCalculator",
-			.ui		= ui,
-		 }
+	profile::Startup::global();	 // the origin of the startup timeline
+
+	MainView::Spec spec {
+		.debug	= false,
+		.width	= 400,
+		.height = 560,
+		.title	= "DCS213 P1 YatCalculator",
+		.ui		= ui,
 	};
+	apply_args(argc, argv, spec);
+
+	MainView view { spec };
 	view.run();
 
 	return 0;
-}
\ No newline at end of file
+}
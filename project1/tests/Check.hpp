@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+
+/**
+ * @brief Just enough of a test harness: checks report where they fail and the test carries on.
+ *
+ */
+namespace dcs213::p1::test {
+	inline std::size_t failures = 0;
+
+	inline static auto check(bool ok, const char* expr, const char* file, int line) -> bool {
+		if (!ok) {
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+			++failures;
+		}
+		return ok;
+	}
+
+	/**
+	 * @brief The exit code of a test binary.
+	 *
+	 */
+	inline static auto report(const char* name) -> int {
+		if (failures == 0) {
+			std::printf("%s: ok\n", name);
+			return 0;
+		}
+		std::printf("%s: %zu check(s) failed\n", name, failures);
+		return 1;
+	}
+}  // namespace dcs213::p1::test
+
+#define DCS213_P1_CHECK(...) \
+	::dcs213::p1::test::check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
@@ -0,0 +1,172 @@
+#include "Check.hpp"
+#include "History.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace dcs213::p1;
+namespace fs = std::filesystem;
+
+namespace {
+	auto temp(const char* name) -> std::string {
+		const auto path = fs::temp_directory_path() / name;
+		fs::remove(path);
+		return path.string();
+	}
+
+	auto outcome(std::uint64_t i) -> pipeline::Outcome {
+		return { .success = i % 3 != 0, .text = "r" + std::to_string(i) };
+	}
+
+	auto append(history::Writer& writer, std::uint64_t from, std::uint64_t to) -> bool {
+		for (auto i = from; i < to; ++i)
+			if (!writer.append(std::to_string(i), outcome(i), std::chrono::nanoseconds { i }))
+				return false;
+		return true;
+	}
+
+	/**
+	 * @brief Whether the log at `path` holds exactly the entries `[0, n)` written by `append`.
+	 *
+	 */
+	auto holds(const std::string& path, std::uint64_t n) -> bool {
+		const auto reader = history::Reader::open(path);
+		if (!reader || reader->log().size() != n)
+			return false;
+		for (std::uint64_t i = 0; i < n; ++i) {
+			const auto entry = reader->log().at(i);
+			if (!entry || entry->seq != i || entry->script != std::to_string(i)
+				|| entry->result != "r" + std::to_string(i)
+				|| entry->duration != std::chrono::nanoseconds { i }
+				|| entry->outcome().success != (i % 3 != 0))
+				return false;
+		}
+		return !reader->log().at(n);
+	}
+
+	template<typename T>
+	auto patch(const std::string& path, std::uint64_t offset, const T& value) -> void {
+		std::fstream file { path, std::ios::in | std::ios::out | std::ios::binary };
+		file.seekp(static_cast<std::streamoff>(offset));
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	auto header(const std::string& path) -> history::Header {
+		history::Header header {};
+		std::ifstream	file { path, std::ios::binary };
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		return header;
+	}
+
+	/**
+	 * @brief Entries survive closing and reopening, across index records.
+	 *
+	 */
+	auto reopen() -> void {
+		const auto path = temp("dcs213.test.history.reopen");
+		const auto n	= 3 * history::index_interval + 5;
+
+		DCS213_P1_CHECK(append(*history::Writer::open(path), 0, history::index_interval - 1));
+		DCS213_P1_CHECK(holds(path, history::index_interval - 1));
+
+		// The reopened writer must index the entries the first one left pending.
+		auto writer = history::Writer::open(path);
+		DCS213_P1_CHECK(writer && writer->size() == history::index_interval - 1);
+		DCS213_P1_CHECK(writer && append(*writer, history::index_interval - 1, n));
+		writer.reset();
+		DCS213_P1_CHECK(holds(path, n));
+		DCS213_P1_CHECK(fs::file_size(path) == header(path).end);
+		fs::remove(path);
+	}
+
+	/**
+	 * @brief A copy taken while the writer is open is what a crash leaves behind.
+	 *
+	 */
+	auto recovery() -> void {
+		const auto path = temp("dcs213.test.history.recovery");
+		const auto copy = temp("dcs213.test.history.recovery.copy");
+
+		auto writer = history::Writer::open(path);
+		DCS213_P1_CHECK(writer && append(*writer, 0, history::index_interval + 10));
+		fs::copy_file(path, copy);
+		writer.reset();
+
+		// The file still has its spare capacity, and a torn record past `end`.
+		DCS213_P1_CHECK(fs::file_size(copy) > header(copy).end);
+		const history::RecordHeader torn {
+			.size = 4096, .kind = history::Kind::Entry, .flags = 0, .reserved = 0, .time = 0
+		};
+		patch(copy, header(copy).end, torn);
+		DCS213_P1_CHECK(holds(copy, history::index_interval + 10));
+
+		writer = history::Writer::open(copy);
+		DCS213_P1_CHECK(writer && append(*writer, history::index_interval + 10, 2100));
+		writer.reset();
+		DCS213_P1_CHECK(holds(copy, 2100));
+		fs::remove(path);
+		fs::remove(copy);
+	}
+
+	auto corruption() -> void {
+		const auto path = temp("dcs213.test.history.corruption");
+		const auto good = temp("dcs213.test.history.corruption.good");
+		DCS213_P1_CHECK(append(*history::Writer::open(good), 0, 2 * history::index_interval + 1));
+
+		const auto damaged = [&](auto&& damage) {
+			fs::remove(path);
+			fs::copy_file(good, path);
+			damage(header(path));
+			const auto rejected = !history::Reader::open(path) && !history::Writer::open(path);
+			return rejected && fs::file_size(path) == fs::file_size(good);
+		};
+		DCS213_P1_CHECK(damaged([&](const history::Header&) { patch(path, 0, 'X'); }));
+		DCS213_P1_CHECK(damaged([&](const history::Header& h) {
+			patch(path, offsetof(history::Header, end), h.end + 1);
+		}));
+		DCS213_P1_CHECK(damaged([&](const history::Header& h) {
+			patch(path, offsetof(history::Header, count), h.count + history::index_interval);
+		}));
+		DCS213_P1_CHECK(damaged([&](const history::Header& h) {
+			patch(path, offsetof(history::Header, last_index), h.last_index + 8);
+		}));
+		DCS213_P1_CHECK(damaged([&](const history::Header& h) {	 // an index pointing at itself
+			patch(path, h.last_index + sizeof(history::RecordHeader), h.last_index);
+		}));
+
+		// A file that is not a log is neither read nor truncated.
+		fs::remove(path);
+		std::ofstream { path } << std::string(100, '.');
+		DCS213_P1_CHECK(!history::Reader::open(path) && !history::Writer::open(path));
+		DCS213_P1_CHECK(fs::file_size(path) == 100);
+		fs::remove(path);
+		fs::remove(good);
+	}
+
+	auto one_writer() -> void {
+		const auto path = temp("dcs213.test.history.writer");
+		{
+			auto first = history::Writer::open(path);
+			DCS213_P1_CHECK(first != nullptr);
+			DCS213_P1_CHECK(!history::Writer::open(path));
+			DCS213_P1_CHECK(first && append(*first, 0, 10));
+		}
+		auto again = history::Writer::open(path);
+		DCS213_P1_CHECK(again && again->size() == 10);
+		again.reset();
+		DCS213_P1_CHECK(holds(path, 10));
+		fs::remove(path);
+	}
+}  // namespace
+
+auto main() -> int {
+	reopen();
+	recovery();
+	corruption();
+	one_writer();
+	return test::report("history");
+}
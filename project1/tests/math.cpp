@@ -0,0 +1,99 @@
+#include "Check.hpp"
+#include "Math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace dcs213::p1;
+
+namespace {
+	/**
+	 * @brief The error of `y` in ulps of the result, against a `long double` reference.
+	 *
+	 * glibc's `long double` functions are off by about a `long double` ulp, 2^-11 of a double
+	 * one, which is plenty here.
+	 */
+	auto ulps(double y, long double ref) -> double {
+		int exponent = 0;
+		std::frexp(static_cast<double>(ref), &exponent);
+		const auto ulp = std::ldexp(1., std::max(exponent, -1021) - 53);
+		return static_cast<double>(std::fabs(static_cast<long double>(y) - ref)) / ulp;
+	}
+
+	/**
+	 * @brief The points of the trig regression: random ones, and the doubles next to every
+	 * multiple of pi / 2 below `trig_limit`, where the argument reduction cancels most.
+	 *
+	 */
+	auto trig_points() -> std::vector<double> {
+		// Had 1.063 ulp with pi / 2 in two parts.
+		std::vector<double> xs { 826882.89438810153, 413441.44719405076 };
+
+		const long double pio2 = 1.570796326794896619231321691639751442L;
+		for (long k = 1; k * pio2 < math::details::trig_limit; ++k) {
+			const auto x = static_cast<double>(k * pio2);
+			if (x < math::details::trig_limit)
+				xs.insert(xs.end(), { std::nextafter(x, 0.), x, -x });
+		}
+
+		std::mt19937_64 rng { 4 };
+		for (int i = 0; i < 200'000; ++i) {
+			const auto mantissa = std::uniform_real_distribution { .5, 1. }(rng);
+			xs.push_back(std::ldexp(mantissa, static_cast<int>(rng() % 21) - 1));
+		}
+		return xs;
+	}
+
+	/**
+	 * @brief Every implementation this CPU has is within the documented bound, and gives the
+	 * scalar one's results bit for bit.
+	 *
+	 */
+	auto trig() -> void {
+		struct Case {
+			math::Function fn;
+			long double (*ref)(long double);
+			double bound;
+		};
+		const Case cases[] {
+			{ math::Function::Sin, &sinl, 1. },
+			{ math::Function::Cos, &cosl, 1. },
+			{ math::Function::Tan, &tanl, 2.5 },
+		};
+		const dispatch::Level levels[] {
+			dispatch::Level::Scalar,
+			dispatch::Level::AVX2,
+			dispatch::Level::AVX512,
+		};
+
+		const auto xs = trig_points();
+		for (const auto& [fn, ref, bound] : cases) {
+			const auto f = static_cast<std::size_t>(fn);
+
+			std::vector<double> scalar(xs.size());
+			math::details::table(dispatch::Level::Scalar)[f](xs.data(), scalar.data(), xs.size());
+
+			double worst = 0.;
+			for (std::size_t i = 0; i < xs.size(); ++i)
+				worst = std::max(worst, ulps(scalar[i], ref(xs[i])));
+			std::printf("%s: %.3f ulp\n", math::to_string(fn).data(), worst);
+			DCS213_P1_CHECK(worst < bound);
+
+			for (const auto level : levels) {
+				if (level > dispatch::detect())
+					continue;
+				std::vector<double> ys(xs.size());
+				math::details::table(level)[f](xs.data(), ys.data(), xs.size());
+				DCS213_P1_CHECK(ys == scalar);
+			}
+		}
+	}
+}  // namespace
+
+auto main() -> int {
+	trig();
+	return test::report("math");
+}
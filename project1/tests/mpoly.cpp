@@ -0,0 +1,153 @@
+#include "Check.hpp"
+#include "Evaluator.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace dcs213::p1;
+using evaluate::MPoly;
+using evaluate::Ring;
+
+namespace {
+	using Coefs = std::map<std::uint64_t, double>;	// key (or exponent) to coefficient
+
+	auto close(const Coefs& lhs, const Coefs& rhs) -> bool {
+		if (lhs.size() != rhs.size())
+			return false;
+		for (auto l = lhs.begin(), r = rhs.begin(); l != lhs.end(); ++l, ++r)
+			if (l->first != r->first
+				|| std::abs(l->second - r->second) > 1e-9 * std::max(1., std::abs(r->second)))
+				return false;
+		return true;
+	}
+
+	auto coefs(const MPoly& poly) -> Coefs {
+		Coefs res;
+		for (const auto& term : poly.terms()) res[term.key] = term.coef;
+		return res;
+	}
+
+	auto coefs(const evaluate::TermList& terms) -> Coefs {
+		Coefs res;
+		for (const auto& term : terms)
+			if (term.coef != 0.)
+				res[static_cast<std::uint64_t>(term.expo)] += term.coef;
+		return res;
+	}
+
+	/**
+	 * @brief The product by the schoolbook method, the reference for both fast paths.
+	 *
+	 */
+	auto schoolbook(const MPoly& lhs, const MPoly& rhs) -> Coefs {
+		Coefs res;
+		for (const auto& l : lhs.terms())
+			for (const auto& r : rhs.terms()) res[l.key + r.key] += l.coef * r.coef;
+		std::erase_if(res, [](const auto& kv) { return kv.second == 0.; });
+		return res;
+	}
+
+	/**
+	 * @brief A random polynomial of `n` terms with exponents in `[0, max_exponent]`.
+	 *
+	 */
+	auto random(const Ring& ring, std::size_t n, std::uint64_t max_exponent, std::mt19937_64& rng)
+		-> MPoly {
+		std::vector<MPoly::Term> terms;
+		for (std::size_t i = 0; i < n; ++i) {
+			std::uint64_t key = 0;
+			for (std::size_t var = 0; var < ring.variables().size(); ++var)
+				key += ring.key(var, rng() % (max_exponent + 1));
+			terms.push_back({ .coef = static_cast<double>(rng() % 19) - 9., .key = key });
+		}
+		return MPoly { ring, std::move(terms) };
+	}
+
+	auto key_packing() -> void {
+		const char names[] = { 'x', 'y', 'z' };
+		const auto ring	   = *Ring::of(names);
+		const auto top	   = ring.max_exponent();
+		DCS213_P1_CHECK(top == (1u << 15) - 1);
+
+		std::mt19937_64 rng { 1 };
+		for (int i = 0; i < 1000; ++i) {
+			const std::uint64_t e[] = { rng() % (top + 1), rng() % (top + 1), rng() % (top + 1) };
+			const auto			key = ring.key(0, e[0]) + ring.key(1, e[1]) + ring.key(2, e[2]);
+			for (std::size_t var = 0; var < 3; ++var)
+				DCS213_P1_CHECK(ring.exponent(key, var) == e[var]);
+		}
+
+		DCS213_P1_CHECK(!Ring::of(std::string_view { "abcdefghijklmnopq" }));
+		DCS213_P1_CHECK(MPoly::variable(ring, 1, top).has_value());
+		DCS213_P1_CHECK(!MPoly::variable(ring, 1, top + 1));
+	}
+
+	auto overflow() -> void {
+		const char names[] = { 'x', 'y' };
+		const auto ring	   = *Ring::of(names);
+		const auto top	   = *MPoly::variable(ring, 0, ring.max_exponent());
+
+		// A carry out of one field would silently change another variable's exponent.
+		DCS213_P1_CHECK(!MPoly::product(top, *MPoly::variable(ring, 0)));
+		DCS213_P1_CHECK(MPoly::product(top, *MPoly::variable(ring, 1)).has_value());
+		DCS213_P1_CHECK(!MPoly::product(top + MPoly::constant(ring, 1.), top));
+
+		Budget budget;
+		DCS213_P1_CHECK(!evaluate::power(*MPoly::variable(ring, 1, 2), ring.max_exponent(), budget));
+	}
+
+	auto products() -> void {
+		std::mt19937_64 rng { 2 };
+
+		// Small exponent boxes take the dense path, large ones the heap.
+		for (const auto vars : { 1, 2, 3 })
+			for (const std::uint64_t max_exponent : { 4, 40, 100'000 })
+				for (const auto n : { 1, 7, 60 }) {
+					const char names[] = { 'x', 'y', 'z' };
+					const auto ring	   = *Ring::of(std::span { names }.first(vars));
+					const auto top	   = std::min(max_exponent, ring.max_exponent() / 2);
+					const auto lhs	   = random(ring, n, top, rng);
+					const auto rhs	   = random(ring, n + 3, top, rng);
+					const auto prod	   = MPoly::product(lhs, rhs);
+					const auto swapped = MPoly::product(rhs, lhs);
+					DCS213_P1_CHECK(prod && close(coefs(*prod), schoolbook(lhs, rhs)));
+					DCS213_P1_CHECK(prod && swapped && close(coefs(*prod), coefs(*swapped)));
+				}
+	}
+
+	/**
+	 * @brief Univariate products agree between `TermList` and `MPoly`, dense or sparse.
+	 *
+	 */
+	auto against_termlist() -> void {
+		std::mt19937_64 rng { 3 };
+		const char		names[] = { 'x' };
+		const auto		ring	= *Ring::of(names);
+
+		for (const std::uint64_t max_exponent : { 8, 200, 1'000'000 })
+			for (const auto n : { 3, 50, 400 }) {
+				const auto lhs = random(ring, n, max_exponent, rng);
+				const auto rhs = random(ring, n / 2 + 1, max_exponent, rng);
+
+				const auto to_terms = [](const MPoly& poly) {
+					evaluate::TermList terms;
+					for (const auto& term : poly.terms())
+						terms.push_back({ .coef = term.coef, .expo = static_cast<double>(term.key) });
+					return terms;
+				};
+				const auto prod = MPoly::product(lhs, rhs);
+				DCS213_P1_CHECK(prod && close(coefs(*prod), coefs(to_terms(lhs) * to_terms(rhs))));
+			}
+	}
+}  // namespace
+
+auto main() -> int {
+	key_packing();
+	overflow();
+	products();
+	against_termlist();
+	return test::report("mpoly");
+}
@@ -0,0 +1,155 @@
+#include "Check.hpp"
+#include "SlowLog.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace dcs213::p1;
+namespace fs = std::filesystem;
+
+namespace {
+	inline constexpr std::uint64_t producers = 4;
+
+	/**
+	 * @brief Producers retry on a full queue, so every item arrives once and in its
+	 * producer's order.
+	 *
+	 */
+	auto queue() -> void {
+		constexpr std::uint64_t per_producer = 200'000;
+
+		slowlog::details::Queue<std::uint64_t> queue { 64 };
+		std::vector<std::jthread>			   threads;
+		for (std::uint64_t p = 0; p < producers; ++p)
+			threads.emplace_back([&queue, p] {
+				for (std::uint64_t i = 0; i < per_producer; ++i) {
+					auto item = p << 32 | i;
+					while (!queue.try_push(item)) std::this_thread::yield();
+				}
+			});
+
+		std::vector<std::uint64_t> next(producers, 0);
+		bool					   ordered = true;
+		for (std::uint64_t seen = 0; seen < producers * per_producer;)
+			if (const auto item = queue.try_pop()) {
+				const auto p = *item >> 32;
+				ordered		 = ordered && p < producers && (*item & 0xffff'ffff) == next[p];
+				if (p < producers)
+					++next[p];
+				++seen;
+			} else
+				std::this_thread::yield();
+		threads.clear();
+
+		DCS213_P1_CHECK(ordered);
+		DCS213_P1_CHECK(next == std::vector<std::uint64_t>(producers, per_producer));
+		DCS213_P1_CHECK(!queue.try_pop());
+	}
+
+	auto entry(std::string script) -> slowlog::Entry {
+		slowlog::Entry entry;
+		entry.script = std::move(script);
+		return entry;
+	}
+
+	/**
+	 * @brief The stats once the writer has drained `total` entries on its own, or given up.
+	 *
+	 */
+	auto drained(const slowlog::Log& log, std::uint64_t total) -> slowlog::Stats {
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds { 30 };
+		auto	   stats	= log.stats();
+		while (stats.logged + stats.dropped + stats.failed < total
+			   && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::sleep_for(std::chrono::milliseconds { 1 });
+			stats = log.stats();
+		}
+		return stats;
+	}
+
+	auto lines(const fs::path& path) -> std::uint64_t {
+		std::ifstream file { path };
+		std::uint64_t n = 0;
+		for (std::string line; std::getline(file, line);) n += !line.empty();
+		return n;
+	}
+
+	/**
+	 * @brief Concurrent `record` calls: every entry is either written or counted as dropped.
+	 *
+	 */
+	auto log() -> void {
+		constexpr std::uint64_t per_producer = 5'000;
+
+		const auto path = fs::temp_directory_path() / "dcs213.test.slowlog";
+		fs::remove(path);
+		for (int k = 1; k <= 2; ++k) fs::remove(path.string() + "." + std::to_string(k));
+
+		auto log = slowlog::Log::open({ .path = path.string(), .max_files = 2, .capacity = 32 });
+		DCS213_P1_CHECK(log != nullptr);
+		if (!log)
+			return;
+
+		std::vector<std::jthread> threads;
+		for (std::uint64_t p = 0; p < producers; ++p)
+			threads.emplace_back([&log, p] {
+				for (std::uint64_t i = 0; i < per_producer; ++i)
+					log->record(entry(std::to_string(p) + "x^" + std::to_string(i)));
+			});
+		threads.clear();
+		const auto stats = drained(*log, producers * per_producer);
+		log.reset();
+
+		DCS213_P1_CHECK(stats.failed == 0);
+		DCS213_P1_CHECK(stats.rotations == 0);
+		DCS213_P1_CHECK(stats.logged + stats.dropped == producers * per_producer);
+		DCS213_P1_CHECK(stats.logged > 0);
+		DCS213_P1_CHECK(lines(path) == stats.logged);
+		fs::remove(path);
+	}
+
+	/**
+	 * @brief A full file is rotated, and only `max_files` old ones are kept.
+	 *
+	 */
+	auto rotation() -> void {
+		const auto path	   = fs::temp_directory_path() / "dcs213.test.slowlog.rotation";
+		const auto rotated = [&](int k) {
+			return fs::path { path.string() + "." + std::to_string(k) };
+		};
+		fs::remove(path);
+		for (int k = 1; k <= 3; ++k) fs::remove(rotated(k));
+
+		auto log = slowlog::Log::open({ .path = path.string(), .max_bytes = 1024, .max_files = 2 });
+		DCS213_P1_CHECK(log != nullptr);
+		if (!log)
+			return;
+		for (int i = 0; i < 100; ++i)
+			while (!log->record(entry("x^" + std::to_string(i)))) std::this_thread::yield();
+		const auto stats = drained(*log, 100);
+		log.reset();
+
+		DCS213_P1_CHECK(stats.logged == 100 && stats.rotations > 0);
+
+		DCS213_P1_CHECK(fs::exists(path) && fs::exists(rotated(1)) && fs::exists(rotated(2)));
+		DCS213_P1_CHECK(!fs::exists(rotated(3)));
+		for (int k = 0; k <= 2; ++k) {
+			const auto file = k == 0 ? path : rotated(k);
+			DCS213_P1_CHECK(fs::file_size(file) <= 1024);
+			fs::remove(file);
+		}
+	}
+}  // namespace
+
+auto main() -> int {
+	queue();
+	log();
+	rotation();
+	return test::report("slowlog");
+}
@@ -0,0 +1,26 @@
+-- One binary per test file, run by `xmake test`.
+for _, file in ipairs(os.files(path.join(os.scriptdir(), "*.cpp"))) do
+    target("dcs213.project1.test." .. path.basename(file))
+        set_kind("binary")
+        set_default(false)
+        set_group("tests")
+        set_languages("cxx20")
+
+        add_packages("simdjson")
+        add_packages("tl_expected")
+        add_packages("magic_enum")
+
+        add_files(file)
+        add_includedirs("$(scriptdir)/../src")
+        add_tests("default")
+
+        if is_plat("windows") then
+            add_defines("DCS213_P1_PLAT_WINDOWS")
+        elseif is_plat("macos") then
+            add_defines("DCS213_P1_PLAT_MACOS")
+        elseif is_plat("linux") then
+            add_defines("DCS213_P1_PLAT_LINUX")
+            add_syslinks("pthread")
+        end
+    target_end()
+end
@@ -4,7 +4,27 @@ add_requires("simdjson")
 add_requires("tl_expected")
 add_requires("magic_enum")
 
+option("p1_trace")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Compile in the hot-path tracing of project1 (DCS213_P1_TRACE)")
+    add_defines("DCS213_P1_TRACE")
+option_end()
+
+option("p1_alloc_stats")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Count the allocations of project1 per pipeline stage (DCS213_P1_COUNT_ALLOCS)")
+    add_defines("DCS213_P1_COUNT_ALLOCS")
+option_end()
+
 includes("ui")
+includes("headless")
+includes("bench")
+includes("corpus")
+includes("replay")
+includes("server")
+includes("tests")
 
 target("dcs213.project1")
     set_languages("cxx20")
@@ -15,6 +35,7 @@ target("dcs213.project1")
     add_packages("tl_expected", {public = true})
     add_packages("magic_enum", {public = true})
     add_deps("dcs213.project1.ui")
+    add_options("p1_trace", "p1_alloc_stats")
     
     add_headerfiles("src/**.hpp")
     add_files("src/**.cpp")